@@ -0,0 +1,251 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ *  Micro-benchmarks for the logging hot paths.
+ *
+ *  Messages which pass level check go to an appender which formats them
+ *  with a PatternLayout and discards the result, so that benchmarks
+ *  measure the cost of the logging machinery and not of the I/O.
+ */
+
+// System headers
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Third-party headers
+#include "benchmark/benchmark.h"
+#include "log4cxx/appenderskeleton.h"
+#include "log4cxx/logger.h"
+#include "log4cxx/patternlayout.h"
+
+// Local headers
+#include "lsst/log/Log.h"
+
+namespace {
+
+// Appender which formats events and throws them away
+class NullAppender : public log4cxx::AppenderSkeleton {
+public:
+    DECLARE_LOG4CXX_OBJECT(NullAppender)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(NullAppender)
+            LOG4CXX_CAST_ENTRY_CHAIN(AppenderSkeleton)
+    END_LOG4CXX_CAST_MAP()
+
+    void append(const log4cxx::spi::LoggingEventPtr& event, log4cxx::helpers::Pool& pool) override {
+        log4cxx::LogString output;
+        getLayout()->format(output, event, pool);
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    void close() override {}
+
+    bool requiresLayout() const override { return true; }
+};
+
+}
+
+IMPLEMENT_LOG4CXX_OBJECT(NullAppender)
+
+namespace {
+
+// Configure root logger at given level with a single NullAppender
+void configure(char const* level) {
+    lsst::log::Log::configure_prop(std::string("log4j.rootLogger=") + level + "\n");
+    auto appender = std::make_shared<NullAppender>();
+    appender->setLayout(std::make_shared<log4cxx::PatternLayout>(LOG4CXX_STR("%d %-5p %c (%F:%L) - %m%n")));
+    log4cxx::Logger::getRootLogger()->addAppender(appender);
+}
+
+// Fixture which configures logging once for all threads
+class Logging : public benchmark::Fixture {
+public:
+    void SetUp(benchmark::State& state) override {
+        if (state.thread_index() == 0) {
+            configure("INFO");
+        }
+    }
+};
+
+// Disabled messages
+
+BENCHMARK_F(Logging, DisabledLog)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOG("bench.logger", LOG_LVL_DEBUG, "message %d", 42);
+    }
+}
+
+BENCHMARK_F(Logging, DisabledLogl)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOGL_DEBUG("bench.logger", "message %d", 42);
+    }
+}
+
+BENCHMARK_F(Logging, DisabledLogls)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOGLS_DEBUG("bench.logger", "message " << 42);
+    }
+}
+
+BENCHMARK_F(Logging, DisabledLoglf)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOGLF_DEBUG("bench.logger", "message {}", 42);
+    }
+}
+
+BENCHMARK_F(Logging, DisabledLoggerObject)(benchmark::State& state) {
+    lsst::log::Log const logger = lsst::log::Log::getLogger("bench.logger");
+    for (auto _ : state) {
+        LOGL_DEBUG(logger, "message %d", 42);
+    }
+}
+
+BENCHMARK_F(Logging, DisabledCheck)(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(LOG_CHECK_LVL("bench.logger", LOG_LVL_DEBUG));
+    }
+}
+
+// Enabled messages, different formatting paths
+
+BENCHMARK_F(Logging, EnabledLogVarargs)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOGL_INFO("bench.logger", "message %d %s %.3f", 42, "string", 3.14);
+    }
+}
+
+BENCHMARK_F(Logging, EnabledLogStream)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOGLS_INFO("bench.logger", "message " << 42 << " " << "string" << " " << 3.14);
+    }
+}
+
+BENCHMARK_F(Logging, EnabledLogFormat)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOGLF_INFO("bench.logger", "message {} {} {:.3f}", 42, "string", 3.14);
+    }
+}
+
+BENCHMARK_F(Logging, EnabledLogWithMDC)(benchmark::State& state) {
+    LOG_MDC("LABEL", "some label");
+    for (auto _ : state) {
+        LOGL_INFO("bench.logger", "message %d", 42);
+    }
+    LOG_MDC_REMOVE("LABEL");
+}
+
+// MDC
+
+BENCHMARK_F(Logging, MDCScope)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOG_MDC_SCOPE("BENCH_SCOPE", "value");
+    }
+}
+
+BENCHMARK_F(Logging, MDCPutRemove)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOG_MDC("BENCH_PUT", "value");
+        LOG_MDC_REMOVE("BENCH_PUT");
+    }
+}
+
+// Logger lookups
+
+BENCHMARK_F(Logging, GetLogger)(benchmark::State& state) {
+    std::string const name = "bench.lookup.logger";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lsst::log::Log::getLogger(name));
+    }
+}
+
+BENCHMARK_F(Logging, GetChild)(benchmark::State& state) {
+    lsst::log::Log const parent = lsst::log::Log::getLogger("bench.lookup");
+    std::string const suffix = "child";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(parent.getChild(suffix));
+    }
+}
+
+// Configuration
+
+// XML configuration translated into properties, argument enables cache
+void ConfigureXml(benchmark::State& state) {
+    std::string const filename = std::string(P_tmpdir) + "/benchLog.xml";
+    std::ofstream(filename) << R"(<?xml version="1.0" encoding="UTF-8" ?>
+<log4j:configuration xmlns:log4j="http://jakarta.apache.org/log4j/">
+  <appender name="CA" class="org.apache.log4j.ConsoleAppender">
+    <param name="Target" value="System.err"/>
+    <layout class="org.apache.log4j.PatternLayout">
+      <param name="ConversionPattern" value="%d %-5p %c - %m%n"/>
+    </layout>
+  </appender>
+  <root>
+    <priority value="info"/>
+    <appender-ref ref="CA"/>
+  </root>
+  <logger name="bench.config" additivity="false">
+    <level value="debug"/>
+    <appender-ref ref="CA"/>
+  </logger>
+</log4j:configuration>
+)";
+    lsst::log::Log::setConfigCacheEnabled(state.range(0) != 0);
+    for (auto _ : state) {
+        lsst::log::Log::configure(filename);
+    }
+    lsst::log::Log::setConfigCacheEnabled(false);
+    std::remove(filename.c_str());
+}
+BENCHMARK(ConfigureXml)->Arg(0)->Arg(1);
+
+// Contention between threads
+
+BENCHMARK_DEFINE_F(Logging, ThreadsDisabled)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOGL_DEBUG("bench.threads", "message %d", 42);
+    }
+}
+BENCHMARK_REGISTER_F(Logging, ThreadsDisabled)->ThreadRange(1, 64)->UseRealTime();
+
+BENCHMARK_DEFINE_F(Logging, ThreadsEnabled)(benchmark::State& state) {
+    for (auto _ : state) {
+        LOGL_INFO("bench.threads", "message %d", 42);
+    }
+}
+BENCHMARK_REGISTER_F(Logging, ThreadsEnabled)->ThreadRange(1, 64)->UseRealTime();
+
+BENCHMARK_DEFINE_F(Logging, ThreadsGetLogger)(benchmark::State& state) {
+    std::string const name = "bench.threads." + std::to_string(state.thread_index() % 4);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lsst::log::Log::getLogger(name));
+    }
+}
+BENCHMARK_REGISTER_F(Logging, ThreadsGetLogger)->ThreadRange(1, 64)->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
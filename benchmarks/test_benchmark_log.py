@@ -0,0 +1,144 @@
+# This file is part of log.
+#
+# Developed for the LSST Data Management System.
+# This product includes software developed by the LSST Project
+# (https://www.lsst.org).
+# See the COPYRIGHT file at the top-level directory of this distribution
+# for details of code ownership.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+"""Benchmarks for Python logging paths, run with ``pytest benchmarks``.
+
+Requires ``pytest-benchmark``, all benchmarks are skipped without it.
+"""
+
+import logging
+import os
+
+import pytest
+
+import lsst.log as log
+
+pytest.importorskip("pytest_benchmark")
+
+# Output of lsst.log goes to /dev/null, formatting is still done
+DEVNULL_CONFIG = f"""
+log4j.rootLogger=INFO, FA
+log4j.appender.FA=FileAppender
+log4j.appender.FA.File={os.devnull}
+log4j.appender.FA.layout=PatternLayout
+log4j.appender.FA.layout.ConversionPattern=%d %-5p %c (%F:%L) - %m%n
+"""
+
+PYLOG_CONFIG = """
+log4j.rootLogger=INFO, PyLog
+log4j.appender.PyLog=PyLogAppender
+"""
+
+
+class _NullHandler(logging.Handler):
+    """Handler which formats records and discards them."""
+
+    def emit(self, record):
+        self.format(record)
+
+
+@pytest.fixture
+def devnull():
+    log.configure_prop(DEVNULL_CONFIG)
+    yield
+    log.configure()
+
+
+@pytest.fixture
+def pylog():
+    """Forward lsst.log to Python logging with a discarding handler."""
+    log.configure_prop(PYLOG_CONFIG)
+    logger = logging.getLogger("bench.pylog")
+    handler = _NullHandler()
+    logger.addHandler(handler)
+    logger.setLevel(logging.INFO)
+    logger.propagate = False
+    yield
+    logger.removeHandler(handler)
+    log.configure()
+
+
+@pytest.fixture
+def loghandler():
+    """Forward Python logging to lsst.log through LogHandler."""
+    log.configure_prop(DEVNULL_CONFIG)
+    logger = logging.getLogger("bench.handler")
+    handler = log.LogHandler()
+    logger.addHandler(handler)
+    logger.setLevel(logging.DEBUG)
+    logger.propagate = False
+    yield logger
+    logger.removeHandler(handler)
+    log.configure()
+
+
+def test_disabled(benchmark, devnull):
+    logger = log.getLogger("bench.logger")
+    benchmark(logger.debug, "message %d", 42)
+
+
+def test_enabled(benchmark, devnull):
+    logger = log.getLogger("bench.logger")
+    benchmark(logger.info, "message %d", 42)
+
+
+def test_enabled_format(benchmark, devnull):
+    # str.format style, as used by log.log(..., key=value)
+    logger = log.getLogger("bench.logger")
+    benchmark(logger._log, log.INFO, True, "message {value}", value=42)
+
+
+def test_module_log(benchmark, devnull):
+    # goes through Log._log with a logger lookup for every call
+    benchmark(log.log, "bench.logger", log.INFO, "message %d", 42)
+
+
+def test_get_logger(benchmark, devnull):
+    benchmark(log.getLogger, "bench.lookup.logger")
+
+
+def test_mdc(benchmark, devnull):
+    def mdc():
+        log.MDC("LABEL", "value")
+        log.MDCRemove("LABEL")
+    benchmark(mdc)
+
+
+def test_pylogappender(benchmark, pylog):
+    logger = log.getLogger("bench.pylog")
+    benchmark(logger.info, "message %d", 42)
+
+
+def test_pylogappender_disabled_in_python(benchmark, pylog):
+    # enabled in lsst.log but rejected by Python logger level
+    logger = log.getLogger("bench.pylog")
+    logging.getLogger("bench.pylog").setLevel(logging.WARNING)
+    benchmark(logger.info, "message %d", 42)
+
+
+def test_loghandler(benchmark, loghandler):
+    benchmark(loghandler.info, "message %d", 42)
+
+
+def test_loghandler_disabled(benchmark, loghandler):
+    # enabled in Python logging but rejected by lsst.log level
+    benchmark(loghandler.debug, "message %d", 42)
@@ -0,0 +1,199 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_FORMATRECORD_H
+#define LSST_LOG_FORMATRECORD_H
+
+// System headers
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace lsst {
+namespace log {
+namespace detail {
+
+/**
+ *  Return number of argument placeholders in a format string.
+ *
+ *  Used by LOGF* macros to check at compile time that number of arguments
+ *  matches the format string. Escaped braces ("{{" and "}}") do not count.
+ */
+constexpr std::size_t formatArgCount(char const* fmt) {
+    std::size_t count = 0;
+    for (; *fmt != '\0'; ++fmt) {
+        if (fmt[0] == '{') {
+            if (fmt[1] == '{') {
+                ++fmt;
+                continue;
+            }
+            ++count;
+            while (*fmt != '\0' && *fmt != '}') {
+                ++fmt;
+            }
+            if (*fmt == '\0') {
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+/// Never defined, only used in unevaluated context to count arguments.
+template <typename... Args>
+std::integral_constant<std::size_t, sizeof...(Args)> formatArgs(int, Args const&...);
+
+/**
+ *  Captured message format and arguments.
+ *
+ *  Format string uses `{}` placeholders which are replaced by the arguments
+ *  in order; placeholder may contain printf-like specification after colon,
+ *  e.g. `{:.3f}` or `{:08x}` (without length modifiers, these are deduced
+ *  from argument type). Literal braces are written as `{{` and `}}`.
+ *
+ *  Constructor stores format pointer (which has to be a string with static
+ *  storage duration, e.g. a literal) and copies each argument into a compact
+ *  type-tagged binary buffer, string arguments are copied, arguments of
+ *  other types are converted to string using stream insertion operator.
+ *  Actual formatting happens in render(), records can also be kept or
+ *  serialized unrendered through format()/data()/size().
+ */
+class FormatRecord {
+public:
+
+    /// Type tags of the encoded arguments.
+    enum class ArgType : std::uint8_t { Bool, Char, Int, UInt, Double, Pointer, String };
+
+    template <typename... Args>
+    explicit FormatRecord(char const* fmt, Args const&... args) : _fmt(fmt) {
+        (_add(args), ...);
+    }
+
+    ~FormatRecord() {
+        if (_data != _inline) {
+            delete [] _data;
+        }
+    }
+
+    // no copy, records are short-lived
+    FormatRecord(FormatRecord const&) = delete;
+    FormatRecord& operator=(FormatRecord const&) = delete;
+
+    /// Return format string.
+    char const* format() const { return _fmt; }
+
+    /// Return pointer to the encoded arguments.
+    char const* data() const { return _data; }
+
+    /// Return size of the encoded arguments in bytes.
+    std::size_t size() const { return _size; }
+
+    /// Format the message and append it to a string.
+    void render(std::string& out) const { render(out, _fmt, _data, _size); }
+
+    /**
+     *  Format a message from a format string and encoded arguments.
+     *
+     *  Missing arguments are rendered as their placeholder text, extra
+     *  arguments are ignored.
+     */
+    static void render(std::string& out, char const* fmt, char const* data, std::size_t size);
+
+private:
+
+    template <typename T>
+    void _add(T const& arg) {
+        if constexpr (std::is_same_v<T, bool>) {
+            _addScalar(ArgType::Bool, arg);
+        } else if constexpr (std::is_same_v<T, char>) {
+            _addScalar(ArgType::Char, arg);
+        } else if constexpr (std::is_enum_v<T>) {
+            _add(static_cast<std::underlying_type_t<T>>(arg));
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            _addScalar(ArgType::Int, static_cast<std::int64_t>(arg));
+        } else if constexpr (std::is_integral_v<T>) {
+            _addScalar(ArgType::UInt, static_cast<std::uint64_t>(arg));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            _addScalar(ArgType::Double, static_cast<double>(arg));
+        } else if constexpr (std::is_convertible_v<T const&, std::string_view>) {
+            if constexpr (std::is_pointer_v<T>) {
+                if (arg == nullptr) {
+                    _addString("(null)");
+                    return;
+                }
+            }
+            _addString(std::string_view(arg));
+        } else if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>) {
+            _addScalar(ArgType::Pointer, static_cast<void const*>(arg));
+        } else {
+            std::ostringstream str;
+            str << arg;
+            _addString(str.str());
+        }
+    }
+
+    template <typename T>
+    void _addScalar(ArgType type, T value) {
+        char* ptr = _reserve(1 + sizeof(T));
+        *ptr = static_cast<char>(type);
+        std::memcpy(ptr + 1, &value, sizeof(T));
+    }
+
+    void _addString(std::string_view str) {
+        auto const size = static_cast<std::uint32_t>(str.size());
+        char* ptr = _reserve(1 + sizeof(size) + size);
+        *ptr = static_cast<char>(ArgType::String);
+        std::memcpy(ptr + 1, &size, sizeof(size));
+        std::memcpy(ptr + 1 + sizeof(size), str.data(), size);
+    }
+
+    // Return pointer to the space for `size` new bytes
+    char* _reserve(std::size_t size) {
+        if (_size + size > _capacity) {
+            _grow(_size + size);
+        }
+        char* ptr = _data + _size;
+        _size += size;
+        return ptr;
+    }
+
+    void _grow(std::size_t size);
+
+    static constexpr std::size_t INLINE_SIZE = 192;
+
+    char const* _fmt;
+    char* _data = _inline;
+    std::size_t _size = 0;
+    std::size_t _capacity = INLINE_SIZE;
+    char _inline[INLINE_SIZE];
+};
+
+}}} // namespace lsst::log::detail
+
+#endif // LSST_LOG_FORMATRECORD_H
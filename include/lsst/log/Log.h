@@ -34,15 +34,43 @@
 
 
 // System headers
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <optional>
 #include <sstream>
 #include <stdarg.h>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 // Third-party headers
 #include <log4cxx/logger.h>
 #include <boost/format.hpp>
 
+// Local headers
+#include "lsst/log/FormatRecord.h"
+#include "lsst/log/TraceContext.h"
+
+/**
+  * @def LSST_LOG_MIN_LEVEL
+  * Compile-time minimum logging level.
+  *
+  * Logging macros with a fixed level below this value expand to an empty
+  * statement, their arguments are not evaluated and no logger lookup is
+  * done, e.g. compiling with `-DLSST_LOG_MIN_LEVEL=LOG_LVL_INFO` removes
+  * all TRACE and DEBUG messages. Macros with a level argument and
+  * LOG_CHECK_* macros also return false for levels below this value. By
+  * default all levels are enabled.
+  */
+#ifndef LSST_LOG_MIN_LEVEL
+#define LSST_LOG_MIN_LEVEL INT_MIN
+#endif
+
 /**
   * @def LOG_CONFIG(filename)
   * Configures log4cxx and initializes logging module.
@@ -108,8 +136,11 @@
   * @def LOG_MDC_SCOPE(key, value)
   * Places a KEY/VALUE pair in the Mapped Diagnostic Context (MDC) for the
   * current thread, and restores previous KEY/VALUE on exit from a scope.
+  * Key given as a string literal is interned once per call site (see
+  * lsst::log::MDCKey), so setting and restoring the value is cheap. Keys
+  * which are not literals are set in LOG4CXX MDC directly.
   *
-  * @param key    Unique key.
+  * @param key    Unique key, string or MDCKey instance.
   * @param value  String value.
   */
 // These two macros generate unique variable name using __COUNTER__ built-in
@@ -117,7 +148,11 @@
 // of the macro name in concatenation.
 #define LOG_CONCAT_IMPL(a, b) a ## b
 #define LOG_CONCAT_IMPL2(a, b) LOG_CONCAT_IMPL(a, b)
-#define LOG_MDC_SCOPE(key, value) lsst::log::LogMDCScope LOG_CONCAT_IMPL2(_log_mdc_scope_, __COUNTER__)(key, value);
+#define LOG_MDC_SCOPE(key, value) LOG_MDC_SCOPE_IMPL_(key, value, __COUNTER__)
+#define LOG_MDC_SCOPE_IMPL_(key, value, id) \
+    static lsst::log::detail::MDCKeySite LOG_CONCAT_IMPL2(_log_mdc_site_, id); \
+    lsst::log::LogMDCScope LOG_CONCAT_IMPL2(_log_mdc_scope_, id)( \
+        LOG_CONCAT_IMPL2(_log_mdc_site_, id).get(key), value);
 
 /**
   * @def LOG_MDC_INIT(function)
@@ -183,7 +218,7 @@
   * @param level   Logging threshold to check.
   */
 #define LOG_CHECK_LVL(logger, level) \
-    lsst::log::Log::getLogger(logger).isEnabledFor(level)
+    ((level) >= LSST_LOG_MIN_LEVEL && lsst::log::Log::getLogger(logger).isEnabledFor(level))
 
 /**
   * @def LOG_CHECK_TRACE()
@@ -192,7 +227,8 @@
   * @return Bool indicating whether or not logger is enabled.
   */
 #define LOG_CHECK_TRACE() \
-    LOG4CXX_UNLIKELY(lsst::log::Log::getDefaultLogger().isTraceEnabled())
+    (LOG_LVL_TRACE >= LSST_LOG_MIN_LEVEL && \
+     LOG4CXX_UNLIKELY(lsst::log::Log::getDefaultLogger().isTraceEnabled()))
 
 /**
   * @def LOG_CHECK_DEBUG()
@@ -201,7 +237,8 @@
   * @return Bool indicating whether or not logger is enabled.
   */
 #define LOG_CHECK_DEBUG() \
-    LOG4CXX_UNLIKELY(lsst::log::Log::getDefaultLogger().isDebugEnabled())
+    (LOG_LVL_DEBUG >= LSST_LOG_MIN_LEVEL && \
+     LOG4CXX_UNLIKELY(lsst::log::Log::getDefaultLogger().isDebugEnabled()))
 
 /**
   * @def LOG_CHECK_INFO()
@@ -210,7 +247,7 @@
   * @return Bool indicating whether or not logger is enabled.
   */
 #define LOG_CHECK_INFO() \
-        lsst::log::Log::getDefaultLogger().isInfoEnabled()
+    (LOG_LVL_INFO >= LSST_LOG_MIN_LEVEL && lsst::log::Log::getDefaultLogger().isInfoEnabled())
 
 /**
   * @def LOG_CHECK_WARN()
@@ -219,7 +256,7 @@
   * @return Bool indicating whether or not logger is enabled.
   */
 #define LOG_CHECK_WARN() \
-        lsst::log::Log::getDefaultLogger().isWarnEnabled()
+    (LOG_LVL_WARN >= LSST_LOG_MIN_LEVEL && lsst::log::Log::getDefaultLogger().isWarnEnabled())
 
 /**
   * @def LOG_CHECK_ERROR()
@@ -228,7 +265,7 @@
   * @return Bool indicating whether or not logger is enabled.
   */
 #define LOG_CHECK_ERROR() \
-        lsst::log::Log::getDefaultLogger().isErrorEnabled()
+    (LOG_LVL_ERROR >= LSST_LOG_MIN_LEVEL && lsst::log::Log::getDefaultLogger().isErrorEnabled())
 
 /**
   * @def LOG_CHECK_FATAL()
@@ -237,7 +274,7 @@
   * @return Bool indicating whether or not logger is enabled.
   */
 #define LOG_CHECK_FATAL() \
-        lsst::log::Log::getDefaultLogger().isFatalEnabled()
+    (LOG_LVL_FATAL >= LSST_LOG_MIN_LEVEL && lsst::log::Log::getDefaultLogger().isFatalEnabled())
 
 /**
   * @def LOG(logger, level, message...)
@@ -250,9 +287,12 @@
   */
 #define LOG(logger, level, message...) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isEnabledFor(level)) { \
-            log.log(log4cxx::Level::toLevel(level), LOG4CXX_LOCATION, message); } \
+        if ((level) >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isEnabledFor(level)) { \
+                log.log(log4cxx::Level::toLevel(level), LOG4CXX_LOCATION, message); } \
+        } \
     } while (false)
 
 /**
@@ -265,9 +305,12 @@
   */
 #define LOG_TRACE(message...) \
     do { \
-        lsst::log::Log log; \
-        if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
-            log.log(log4cxx::Level::getTrace(), LOG4CXX_LOCATION, message); } \
+        if constexpr (LOG_LVL_TRACE >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
+                log.log(log4cxx::Level::getTrace(), LOG4CXX_LOCATION, message); } \
+        } \
     } while (false)
 
 /**
@@ -280,9 +323,12 @@
   */
 #define LOG_DEBUG(message...) \
     do { \
-        lsst::log::Log log; \
-        if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
-            log.log(log4cxx::Level::getDebug(), LOG4CXX_LOCATION, message); } \
+        if constexpr (LOG_LVL_DEBUG >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
+                log.log(log4cxx::Level::getDebug(), LOG4CXX_LOCATION, message); } \
+        } \
     } while (false)
 
 /**
@@ -295,9 +341,12 @@
   */
 #define LOG_INFO(message...) \
     do { \
-        lsst::log::Log log; \
-        if (log.isInfoEnabled()) { \
-            log.log(log4cxx::Level::getInfo(), LOG4CXX_LOCATION, message); } \
+        if constexpr (LOG_LVL_INFO >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isInfoEnabled()) { \
+                log.log(log4cxx::Level::getInfo(), LOG4CXX_LOCATION, message); } \
+        } \
     } while (false)
 
 /**
@@ -310,9 +359,12 @@
   */
 #define LOG_WARN(message...) \
     do { \
-        lsst::log::Log log; \
-        if (log.isWarnEnabled()) { \
-            log.log(log4cxx::Level::getWarn(), LOG4CXX_LOCATION, message); } \
+        if constexpr (LOG_LVL_WARN >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isWarnEnabled()) { \
+                log.log(log4cxx::Level::getWarn(), LOG4CXX_LOCATION, message); } \
+        } \
     } while (false)
 
 /**
@@ -325,9 +377,12 @@
   */
 #define LOG_ERROR(message...) \
     do { \
-        lsst::log::Log log; \
-        if (log.isErrorEnabled()) { \
-            log.log(log4cxx::Level::getError(), LOG4CXX_LOCATION, message); } \
+        if constexpr (LOG_LVL_ERROR >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isErrorEnabled()) { \
+                log.log(log4cxx::Level::getError(), LOG4CXX_LOCATION, message); } \
+        } \
     } while (false)
 
 /**
@@ -340,9 +395,12 @@
   */
 #define LOG_FATAL(message...) \
     do { \
-        lsst::log::Log log; \
-        if (log.isFatalEnabled()) { \
-            log.log(log4cxx::Level::getFatal(), LOG4CXX_LOCATION, message); } \
+        if constexpr (LOG_LVL_FATAL >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isFatalEnabled()) { \
+                log.log(log4cxx::Level::getFatal(), LOG4CXX_LOCATION, message); } \
+        } \
     } while (false)
 
 
@@ -368,9 +426,12 @@
   */
 #define LOGS(logger, level, message) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isEnabledFor(level)) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::toLevel(level), message); \
+        if ((level) >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isEnabledFor(level)) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::toLevel(level), message); \
+            } \
         } \
     } while (false)
 
@@ -387,9 +448,12 @@
   */
 #define LOGS_TRACE(message) \
     do { \
-        lsst::log::Log log; \
-        if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getTrace(), message); \
+        if constexpr (LOG_LVL_TRACE >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getTrace(), message); \
+            } \
         } \
     } while (false)
 
@@ -406,9 +470,12 @@
   */
 #define LOGS_DEBUG(message) \
     do { \
-        lsst::log::Log log; \
-        if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getDebug(), message); \
+        if constexpr (LOG_LVL_DEBUG >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getDebug(), message); \
+            } \
         } \
     } while (false)
 
@@ -425,9 +492,12 @@
   */
 #define LOGS_INFO(message) \
     do { \
-        lsst::log::Log log; \
-        if (log.isInfoEnabled()) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getInfo(), message); \
+        if constexpr (LOG_LVL_INFO >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isInfoEnabled()) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getInfo(), message); \
+            } \
         } \
     } while (false)
 
@@ -444,9 +514,12 @@
   */
 #define LOGS_WARN(message) \
     do { \
-        lsst::log::Log log; \
-        if (log.isWarnEnabled()) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getWarn(), message); \
+        if constexpr (LOG_LVL_WARN >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isWarnEnabled()) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getWarn(), message); \
+            } \
         } \
     } while (false)
 
@@ -463,9 +536,12 @@
   */
 #define LOGS_ERROR(message) \
     do { \
-        lsst::log::Log log; \
-        if (log.isErrorEnabled()) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getError(), message); \
+        if constexpr (LOG_LVL_ERROR >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isErrorEnabled()) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getError(), message); \
+            } \
         } \
     } while (false)
 
@@ -482,9 +558,12 @@
   */
 #define LOGS_FATAL(message) \
     do { \
-        lsst::log::Log log; \
-        if (log.isFatalEnabled()) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getFatal(), message); \
+        if constexpr (LOG_LVL_FATAL >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isFatalEnabled()) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getFatal(), message); \
+            } \
         } \
     } while (false)
 
@@ -498,9 +577,12 @@
   */
 #define LOGL_TRACE(logger, message...) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
-            log.log(log4cxx::Level::getTrace(), LOG4CXX_LOCATION, message);\
+        if constexpr (LOG_LVL_TRACE >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
+                log.log(log4cxx::Level::getTrace(), LOG4CXX_LOCATION, message);\
+            } \
         } \
     } while (false)
 
@@ -514,9 +596,12 @@
   */
 #define LOGL_DEBUG(logger, message...) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
-            log.log(log4cxx::Level::getDebug(), LOG4CXX_LOCATION, message); \
+        if constexpr (LOG_LVL_DEBUG >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
+                log.log(log4cxx::Level::getDebug(), LOG4CXX_LOCATION, message); \
+            } \
         } \
     } while (false)
 
@@ -530,9 +615,12 @@
   */
 #define LOGL_INFO(logger, message...) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isInfoEnabled()) { \
-            log.log(log4cxx::Level::getInfo(), LOG4CXX_LOCATION, message); \
+        if constexpr (LOG_LVL_INFO >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isInfoEnabled()) { \
+                log.log(log4cxx::Level::getInfo(), LOG4CXX_LOCATION, message); \
+            } \
         } \
     } while (false)
 
@@ -546,9 +634,12 @@
   */
 #define LOGL_WARN(logger, message...) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isWarnEnabled()) { \
-            log.log(log4cxx::Level::getWarn(), LOG4CXX_LOCATION, message); \
+        if constexpr (LOG_LVL_WARN >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isWarnEnabled()) { \
+                log.log(log4cxx::Level::getWarn(), LOG4CXX_LOCATION, message); \
+            } \
         } \
     } while (false)
 
@@ -562,9 +653,12 @@
   */
 #define LOGL_ERROR(logger, message...) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isErrorEnabled()) { \
-            log.log(log4cxx::Level::getError(), LOG4CXX_LOCATION, message); \
+        if constexpr (LOG_LVL_ERROR >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isErrorEnabled()) { \
+                log.log(log4cxx::Level::getError(), LOG4CXX_LOCATION, message); \
+            } \
         } \
     } while (false)
 
@@ -578,9 +672,12 @@
   */
 #define LOGL_FATAL(logger, message...) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isFatalEnabled()) { \
-            log.log(log4cxx::Level::getFatal(), LOG4CXX_LOCATION, message); \
+        if constexpr (LOG_LVL_FATAL >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isFatalEnabled()) { \
+                log.log(log4cxx::Level::getFatal(), LOG4CXX_LOCATION, message); \
+            } \
         } \
     } while (false)
 
@@ -598,9 +695,12 @@
   */
 #define LOGLS_TRACE(logger, message) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getTrace(), message); \
+        if constexpr (LOG_LVL_TRACE >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getTrace(), message); \
+            } \
         } \
     } while (false)
 
@@ -618,9 +718,12 @@
   */
 #define LOGLS_DEBUG(logger, message) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getDebug(), message); \
+        if constexpr (LOG_LVL_DEBUG >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getDebug(), message); \
+            } \
         } \
     } while (false)
 
@@ -638,9 +741,12 @@
   */
 #define LOGLS_INFO(logger, message) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isInfoEnabled()) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getInfo(), message); \
+        if constexpr (LOG_LVL_INFO >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isInfoEnabled()) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getInfo(), message); \
+            } \
         } \
     } while (false)
 
@@ -658,9 +764,12 @@
   */
 #define LOGLS_WARN(logger, message) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isWarnEnabled()) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getWarn(), message); \
+        if constexpr (LOG_LVL_WARN >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isWarnEnabled()) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getWarn(), message); \
+            } \
         } \
     } while (false)
 
@@ -678,9 +787,12 @@
   */
 #define LOGLS_ERROR(logger, message) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isErrorEnabled()) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getError(), message); \
+        if constexpr (LOG_LVL_ERROR >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isErrorEnabled()) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getError(), message); \
+            } \
         } \
     } while (false)
 
@@ -698,165 +810,1432 @@
   */
 #define LOGLS_FATAL(logger, message) \
     do { \
-        lsst::log::Log log(lsst::log::Log::getLogger(logger)); \
-        if (log.isFatalEnabled()) { \
-            LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getFatal(), message); \
+        if constexpr (LOG_LVL_FATAL >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isFatalEnabled()) { \
+                LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::getFatal(), message); \
+            } \
         } \
     } while (false)
 
-#define LOG_LVL_TRACE static_cast<int>(log4cxx::Level::TRACE_INT)
-#define LOG_LVL_DEBUG static_cast<int>(log4cxx::Level::DEBUG_INT)
-#define LOG_LVL_INFO static_cast<int>(log4cxx::Level::INFO_INT)
-#define LOG_LVL_WARN static_cast<int>(log4cxx::Level::WARN_INT)
-#define LOG_LVL_ERROR static_cast<int>(log4cxx::Level::ERROR_INT)
-#define LOG_LVL_FATAL static_cast<int>(log4cxx::Level::FATAL_INT)
+// small internal utility macro, not for regular clients
+#define LOG_MESSAGE_VIA_RECORD_(logger, level, fmt, args...) \
+    static_assert(lsst::log::detail::formatArgCount("" fmt "") == \
+                  decltype(lsst::log::detail::formatArgs(0, ##args))::value, \
+                  "number of {} placeholders in format does not match number of arguments"); \
+    logger.logRecord(level, LOG4CXX_LOCATION, lsst::log::detail::FormatRecord("" fmt "", ##args))
 
-#define LOG_LOGGER lsst::log::Log
+/**
+  * @def LOGF(logger, level, fmt, args...)
+  * Log a message using a type-safe `{}`-style interface.
+  *
+  * Arguments are captured into a compact record which is only rendered
+  * if the message passes level check, e.g.
+  * `LOGF("logger", LOG_LVL_DEBUG, "coordinates: x={} y={:.3f}", x, y);`.
+  * Number of placeholders is checked at compile time.
+  *
+  * @param logger  Either a logger name or a Log object.
+  * @param level   Logging level associated with message.
+  * @param fmt     Format string literal with `{}` placeholders.
+  * @param args    Zero, one, or more comma-separated arguments.
+  */
+#define LOGF(logger, level, fmt, args...) \
+    do { \
+        if ((level) >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isEnabledFor(level)) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::toLevel(level), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-namespace lsst {
-namespace log {
+/**
+  * @def LOGF_TRACE(fmt, args...)
+  * Log a trace-level message to the default logger using a type-safe
+  * `{}`-style interface.
+  *
+  * @param fmt   Format string literal with `{}` placeholders.
+  * @param args  Zero, one, or more comma-separated arguments.
+  */
+#define LOGF_TRACE(fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_TRACE >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getTrace(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-/** This static class includes a variety of methods for interacting with the
-  * the logging module. These methods are not meant for direct use. Rather,
-  * they are used by the LOG* macros and the SWIG interface declared in
-  * logInterface.h.
+/**
+  * @def LOGF_DEBUG(fmt, args...)
+  * Log a debug-level message to the default logger using a type-safe
+  * `{}`-style interface.
+  *
+  * @param fmt   Format string literal with `{}` placeholders.
+  * @param args  Zero, one, or more comma-separated arguments.
   */
-class Log {
-public:
+#define LOGF_DEBUG(fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_DEBUG >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getDebug(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    /***
-     *  Default constructor creates an instance of root logger.
-     */
-    Log() : _logger(_defaultLogger()) { }
+/**
+  * @def LOGF_INFO(fmt, args...)
+  * Log a info-level message to the default logger using a type-safe
+  * `{}`-style interface.
+  *
+  * @param fmt   Format string literal with `{}` placeholders.
+  * @param args  Zero, one, or more comma-separated arguments.
+  */
+#define LOGF_INFO(fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_INFO >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isInfoEnabled()) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getInfo(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    /**
-     *  Check whether the logger is enabled for the DEBUG Level
-     */
-    bool isDebugEnabled() const { return _logger->isDebugEnabled(); }
-    /**
-     *  Check whether the logger is enabled for the ERROR Level
-     */
-    bool isErrorEnabled() const { return _logger->isErrorEnabled(); }
-    /**
-     *  Check whether the logger is enabled for the FATAL Level
-     */
-    bool isFatalEnabled() const { return _logger->isFatalEnabled(); }
-    /**
-     *  Check whether the logger is enabled for the INFO Level
-     */
-    bool isInfoEnabled() const { return _logger->isInfoEnabled(); }
-    /**
-     *  Check whether the logger is enabled for the TRACE Level
-     */
-    bool isTraceEnabled() const { return _logger->isTraceEnabled(); }
-    /**
-     *  Check whether the logger is enabled for the WARN Level
-     */
-    bool isWarnEnabled() const { return _logger->isWarnEnabled(); }
+/**
+  * @def LOGF_WARN(fmt, args...)
+  * Log a warn-level message to the default logger using a type-safe
+  * `{}`-style interface.
+  *
+  * @param fmt   Format string literal with `{}` placeholders.
+  * @param args  Zero, one, or more comma-separated arguments.
+  */
+#define LOGF_WARN(fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_WARN >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isWarnEnabled()) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getWarn(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    std::string getName() const;
-    void setLevel(int level);
-    int getLevel() const;
-    int getEffectiveLevel() const;
-    bool isEnabledFor(int level) const;
+/**
+  * @def LOGF_ERROR(fmt, args...)
+  * Log a error-level message to the default logger using a type-safe
+  * `{}`-style interface.
+  *
+  * @param fmt   Format string literal with `{}` placeholders.
+  * @param args  Zero, one, or more comma-separated arguments.
+  */
+#define LOGF_ERROR(fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_ERROR >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isErrorEnabled()) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getError(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    Log getChild(std::string const& suffix) const;
+/**
+  * @def LOGF_FATAL(fmt, args...)
+  * Log a fatal-level message to the default logger using a type-safe
+  * `{}`-style interface.
+  *
+  * @param fmt   Format string literal with `{}` placeholders.
+  * @param args  Zero, one, or more comma-separated arguments.
+  */
+#define LOGF_FATAL(fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_FATAL >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(); \
+            if (log.isFatalEnabled()) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getFatal(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    /// Return default logger instance, same as default constructor.
-    static Log getDefaultLogger() { return Log(); }
+/**
+  * @def LOGLF_TRACE(logger, fmt, args...)
+  * Log a trace-level message using a type-safe `{}`-style interface.
+  *
+  * @param logger  Either a logger name or a Log object.
+  * @param fmt     Format string literal with `{}` placeholders.
+  * @param args    Zero, one, or more comma-separated arguments.
+  */
+#define LOGLF_TRACE(logger, fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_TRACE >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (LOG4CXX_UNLIKELY(log.isTraceEnabled())) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getTrace(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    static void configure();
-    static void configure(std::string const& filename);
-    static void configure_prop(std::string const& properties);
+/**
+  * @def LOGLF_DEBUG(logger, fmt, args...)
+  * Log a debug-level message using a type-safe `{}`-style interface.
+  *
+  * @param logger  Either a logger name or a Log object.
+  * @param fmt     Format string literal with `{}` placeholders.
+  * @param args    Zero, one, or more comma-separated arguments.
+  */
+#define LOGLF_DEBUG(logger, fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_DEBUG >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (LOG4CXX_UNLIKELY(log.isDebugEnabled())) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getDebug(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    static Log getLogger(Log const& logger) { return logger; }
-    static Log getLogger(std::string const& loggername);
+/**
+  * @def LOGLF_INFO(logger, fmt, args...)
+  * Log a info-level message using a type-safe `{}`-style interface.
+  *
+  * @param logger  Either a logger name or a Log object.
+  * @param fmt     Format string literal with `{}` placeholders.
+  * @param args    Zero, one, or more comma-separated arguments.
+  */
+#define LOGLF_INFO(logger, fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_INFO >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isInfoEnabled()) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getInfo(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    static std::string MDC(std::string const& key, std::string const& value);
-    static void MDCRemove(std::string const& key);
-    static int MDCRegisterInit(std::function<void()> function);
+/**
+  * @def LOGLF_WARN(logger, fmt, args...)
+  * Log a warn-level message using a type-safe `{}`-style interface.
+  *
+  * @param logger  Either a logger name or a Log object.
+  * @param fmt     Format string literal with `{}` placeholders.
+  * @param args    Zero, one, or more comma-separated arguments.
+  */
+#define LOGLF_WARN(logger, fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_WARN >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isWarnEnabled()) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getWarn(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    void log(log4cxx::LevelPtr level,
-             log4cxx::spi::LocationInfo const& location,
-             char const* fmt, ...);
-    void logMsg(log4cxx::LevelPtr level,
-                log4cxx::spi::LocationInfo const& location,
-                std::string const& msg);
+/**
+  * @def LOGLF_ERROR(logger, fmt, args...)
+  * Log a error-level message using a type-safe `{}`-style interface.
+  *
+  * @param logger  Either a logger name or a Log object.
+  * @param fmt     Format string literal with `{}` placeholders.
+  * @param args    Zero, one, or more comma-separated arguments.
+  */
+#define LOGLF_ERROR(logger, fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_ERROR >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isErrorEnabled()) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getError(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-private:
+/**
+  * @def LOGLF_FATAL(logger, fmt, args...)
+  * Log a fatal-level message using a type-safe `{}`-style interface.
+  *
+  * @param logger  Either a logger name or a Log object.
+  * @param fmt     Format string literal with `{}` placeholders.
+  * @param args    Zero, one, or more comma-separated arguments.
+  */
+#define LOGLF_FATAL(logger, fmt, args...) \
+    do { \
+        if constexpr (LOG_LVL_FATAL >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isFatalEnabled()) { \
+                LOG_MESSAGE_VIA_RECORD_(log, log4cxx::Level::getFatal(), fmt, ##args); \
+            } \
+        } \
+    } while (false)
 
-    /**
-     *  Returns default LOG4CXX logger, which is the same as root logger.
-     *
-     *  This method is needed to ensure proper LOG4CXX initialization before
-     *  any code uses any logger instance.
-     */
-    static log4cxx::LoggerPtr const& _defaultLogger();
+// small internal utility macro, not for regular clients
+#define LOG_SAMPLED_(logger, level, sample, emit) \
+    do { \
+        if ((level) >= LSST_LOG_MIN_LEVEL) { \
+            static lsst::log::detail::LogCallSite _log_site_; \
+            static lsst::log::detail::LogSampler _log_sampler_; \
+            lsst::log::Log const& log = _log_site_.get(logger); \
+            if (log.isEnabledFor(level)) { \
+                if (_log_sampler_.sample) { \
+                    _log_sampler_.passed(); \
+                    emit; \
+                } else { \
+                    _log_sampler_.suppress(log, level, LOG4CXX_LOCATION); \
+                } \
+            } \
+        } \
+    } while (false)
 
-    /**
-     *  Construct a Log using a LOG4CXX logger.
-     *
-     *  The default constructor is called to ensure the default logger is
-     *  initialized and LOG4CXX is configured.
-     */
-    Log(log4cxx::LoggerPtr const& logger) : Log() { _logger = logger; }
+/**
+  * @def LOG_EVERY_N(logger, level, n, message...)
+  * Log every n-th message from this call site using a varargs/printf style
+  * interface.
+  *
+  * Only messages which pass level check are counted, first message is
+  * always logged. Messages which are not logged are counted and reported
+  * periodically, see lsst::log::detail::LogSampler.
+  *
+  * @param logger   Either a logger name or a Log object.
+  * @param level    Logging level associated with message.
+  * @param n        Sampling period.
+  * @param message  An sprintf-compatible format string followed by zero,
+  *                    one, or more comma-separated arguments.
+  */
+#define LOG_EVERY_N(logger, level, n, message...) \
+    LOG_SAMPLED_(logger, level, everyN(n), \
+                 log.log(log4cxx::Level::toLevel(level), LOG4CXX_LOCATION, message))
 
-    log4cxx::LoggerPtr _logger;
-};
+/**
+  * @def LOG_FIRST_N(logger, level, n, message...)
+  * Log only first n messages from this call site using a varargs/printf
+  * style interface.
+  *
+  * @param logger   Either a logger name or a Log object.
+  * @param level    Logging level associated with message.
+  * @param n        Number of messages to log.
+  * @param message  An sprintf-compatible format string followed by zero,
+  *                    one, or more comma-separated arguments.
+  */
+#define LOG_FIRST_N(logger, level, n, message...) \
+    LOG_SAMPLED_(logger, level, firstN(n), \
+                 log.log(log4cxx::Level::toLevel(level), LOG4CXX_LOCATION, message))
 
-class LogMDCScope {
-public:
+/**
+  * @def LOG_ONCE(logger, level, message...)
+  * Log only first message from this call site using a varargs/printf
+  * style interface.
+  *
+  * @param logger   Either a logger name or a Log object.
+  * @param level    Logging level associated with message.
+  * @param message  An sprintf-compatible format string followed by zero,
+  *                    one, or more comma-separated arguments.
+  */
+#define LOG_ONCE(logger, level, message...) LOG_FIRST_N(logger, level, 1, message)
 
-    /**
-     * Constructor adds KEY/VALUE pair to current thread MDC.
-     * Key should not be empty (not checked).
-     */
-    LogMDCScope(std::string const& key, std::string const& value)
-      : _key(key)
-    {
-        _oldValue = Log::MDC(key, value);
-    }
+/**
+  * @def LOG_RATE_LIMIT(logger, level, perSecond, message...)
+  * Log messages from this call site at a limited rate using a
+  * varargs/printf style interface.
+  *
+  * Rate is limited by a token bucket which holds up to one second worth
+  * of messages, so short bursts are logged completely.
+  *
+  * @param logger     Either a logger name or a Log object.
+  * @param level      Logging level associated with message.
+  * @param perSecond  Maximum average number of messages per second.
+  * @param message    An sprintf-compatible format string followed by zero,
+  *                      one, or more comma-separated arguments.
+  */
+#define LOG_RATE_LIMIT(logger, level, perSecond, message...) \
+    LOG_SAMPLED_(logger, level, rateLimit(perSecond), \
+                 log.log(log4cxx::Level::toLevel(level), LOG4CXX_LOCATION, message))
 
-    // no copy allowed
-    LogMDCScope(LogMDCScope const&) = delete;
-    LogMDCScope& operator=(LogMDCScope const&) = delete;
+/**
+  * @def LOGS_EVERY_N(logger, level, n, message)
+  * Log every n-th message from this call site using an iostream-based
+  * interface.
+  *
+  * @param logger   Either a logger name or a Log object.
+  * @param level    Logging level associated with message.
+  * @param n        Sampling period.
+  * @param message  Message to be logged.
+  */
+#define LOGS_EVERY_N(logger, level, n, message) \
+    LOG_SAMPLED_(logger, level, everyN(n), \
+                 LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::toLevel(level), message))
 
-    LogMDCScope(LogMDCScope&& other) {
-        _key = other._key;
-        _oldValue = other._oldValue;
-        other._key.clear();
-    }
+/**
+  * @def LOGS_FIRST_N(logger, level, n, message)
+  * Log only first n messages from this call site using an iostream-based
+  * interface.
+  *
+  * @param logger   Either a logger name or a Log object.
+  * @param level    Logging level associated with message.
+  * @param n        Number of messages to log.
+  * @param message  Message to be logged.
+  */
+#define LOGS_FIRST_N(logger, level, n, message) \
+    LOG_SAMPLED_(logger, level, firstN(n), \
+                 LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::toLevel(level), message))
 
-    LogMDCScope& operator=(LogMDCScope&& other) {
-        if (not _key.empty()) {
-            if (_oldValue.empty()) {
-                Log::MDCRemove(_key);
-            } else {
-                Log::MDC(_key, _oldValue);
-            }
-        }
-        _key = other._key;
-        _oldValue = other._oldValue;
-        other._key.clear();
-        return *this;
-    }
+/**
+  * @def LOGS_ONCE(logger, level, message)
+  * Log only first message from this call site using an iostream-based
+  * interface.
+  *
+  * @param logger   Either a logger name or a Log object.
+  * @param level    Logging level associated with message.
+  * @param message  Message to be logged.
+  */
+#define LOGS_ONCE(logger, level, message) LOGS_FIRST_N(logger, level, 1, message)
 
-    /**
-     * Destructor restores old key value in MDC.
-     */
-    ~LogMDCScope() {
-        if (not _key.empty()) {
-            if (_oldValue.empty()) {
-                Log::MDCRemove(_key);
-            } else {
-                Log::MDC(_key, _oldValue);
-            }
-        }
-    }
+/**
+  * @def LOGS_RATE_LIMIT(logger, level, perSecond, message)
+  * Log messages from this call site at a limited rate using an
+  * iostream-based interface.
+  *
+  * @param logger     Either a logger name or a Log object.
+  * @param level      Logging level associated with message.
+  * @param perSecond  Maximum average number of messages per second.
+  * @param message    Message to be logged.
+  */
+#define LOGS_RATE_LIMIT(logger, level, perSecond, message) \
+    LOG_SAMPLED_(logger, level, rateLimit(perSecond), \
+                 LOG_MESSAGE_VIA_STREAM_(log, log4cxx::Level::toLevel(level), message))
 
-private:
-    std::string _key;
-    std::string _oldValue;
+/**
+  * @def LOGL_TRACE_EVERY_N(logger, n, message...)
+  * Log every n-th trace-level message from this call site, see LOG_EVERY_N.
+  */
+#define LOGL_TRACE_EVERY_N(logger, n, message...) LOG_EVERY_N(logger, LOG_LVL_TRACE, n, message)
+
+/**
+  * @def LOGL_TRACE_FIRST_N(logger, n, message...)
+  * Log first n trace-level messages from this call site, see LOG_FIRST_N.
+  */
+#define LOGL_TRACE_FIRST_N(logger, n, message...) LOG_FIRST_N(logger, LOG_LVL_TRACE, n, message)
+
+/**
+  * @def LOGL_TRACE_ONCE(logger, message...)
+  * Log first trace-level message from this call site, see LOG_ONCE.
+  */
+#define LOGL_TRACE_ONCE(logger, message...) LOG_FIRST_N(logger, LOG_LVL_TRACE, 1, message)
+
+/**
+  * @def LOGL_TRACE_RATE_LIMIT(logger, perSecond, message...)
+  * Log trace-level messages from this call site at a limited rate, see
+  * LOG_RATE_LIMIT.
+  */
+#define LOGL_TRACE_RATE_LIMIT(logger, perSecond, message...) \
+    LOG_RATE_LIMIT(logger, LOG_LVL_TRACE, perSecond, message)
+
+/**
+  * @def LOGLS_TRACE_EVERY_N(logger, n, message)
+  * Log every n-th trace-level message from this call site, see LOGS_EVERY_N.
+  */
+#define LOGLS_TRACE_EVERY_N(logger, n, message) LOGS_EVERY_N(logger, LOG_LVL_TRACE, n, message)
+
+/**
+  * @def LOGLS_TRACE_FIRST_N(logger, n, message)
+  * Log first n trace-level messages from this call site, see LOGS_FIRST_N.
+  */
+#define LOGLS_TRACE_FIRST_N(logger, n, message) LOGS_FIRST_N(logger, LOG_LVL_TRACE, n, message)
+
+/**
+  * @def LOGLS_TRACE_ONCE(logger, message)
+  * Log first trace-level message from this call site, see LOGS_ONCE.
+  */
+#define LOGLS_TRACE_ONCE(logger, message) LOGS_FIRST_N(logger, LOG_LVL_TRACE, 1, message)
+
+/**
+  * @def LOGLS_TRACE_RATE_LIMIT(logger, perSecond, message)
+  * Log trace-level messages from this call site at a limited rate, see
+  * LOGS_RATE_LIMIT.
+  */
+#define LOGLS_TRACE_RATE_LIMIT(logger, perSecond, message) \
+    LOGS_RATE_LIMIT(logger, LOG_LVL_TRACE, perSecond, message)
+
+/**
+  * @def LOGL_DEBUG_EVERY_N(logger, n, message...)
+  * Log every n-th debug-level message from this call site, see LOG_EVERY_N.
+  */
+#define LOGL_DEBUG_EVERY_N(logger, n, message...) LOG_EVERY_N(logger, LOG_LVL_DEBUG, n, message)
+
+/**
+  * @def LOGL_DEBUG_FIRST_N(logger, n, message...)
+  * Log first n debug-level messages from this call site, see LOG_FIRST_N.
+  */
+#define LOGL_DEBUG_FIRST_N(logger, n, message...) LOG_FIRST_N(logger, LOG_LVL_DEBUG, n, message)
+
+/**
+  * @def LOGL_DEBUG_ONCE(logger, message...)
+  * Log first debug-level message from this call site, see LOG_ONCE.
+  */
+#define LOGL_DEBUG_ONCE(logger, message...) LOG_FIRST_N(logger, LOG_LVL_DEBUG, 1, message)
+
+/**
+  * @def LOGL_DEBUG_RATE_LIMIT(logger, perSecond, message...)
+  * Log debug-level messages from this call site at a limited rate, see
+  * LOG_RATE_LIMIT.
+  */
+#define LOGL_DEBUG_RATE_LIMIT(logger, perSecond, message...) \
+    LOG_RATE_LIMIT(logger, LOG_LVL_DEBUG, perSecond, message)
+
+/**
+  * @def LOGLS_DEBUG_EVERY_N(logger, n, message)
+  * Log every n-th debug-level message from this call site, see LOGS_EVERY_N.
+  */
+#define LOGLS_DEBUG_EVERY_N(logger, n, message) LOGS_EVERY_N(logger, LOG_LVL_DEBUG, n, message)
+
+/**
+  * @def LOGLS_DEBUG_FIRST_N(logger, n, message)
+  * Log first n debug-level messages from this call site, see LOGS_FIRST_N.
+  */
+#define LOGLS_DEBUG_FIRST_N(logger, n, message) LOGS_FIRST_N(logger, LOG_LVL_DEBUG, n, message)
+
+/**
+  * @def LOGLS_DEBUG_ONCE(logger, message)
+  * Log first debug-level message from this call site, see LOGS_ONCE.
+  */
+#define LOGLS_DEBUG_ONCE(logger, message) LOGS_FIRST_N(logger, LOG_LVL_DEBUG, 1, message)
+
+/**
+  * @def LOGLS_DEBUG_RATE_LIMIT(logger, perSecond, message)
+  * Log debug-level messages from this call site at a limited rate, see
+  * LOGS_RATE_LIMIT.
+  */
+#define LOGLS_DEBUG_RATE_LIMIT(logger, perSecond, message) \
+    LOGS_RATE_LIMIT(logger, LOG_LVL_DEBUG, perSecond, message)
+
+/**
+  * @def LOGL_INFO_EVERY_N(logger, n, message...)
+  * Log every n-th info-level message from this call site, see LOG_EVERY_N.
+  */
+#define LOGL_INFO_EVERY_N(logger, n, message...) LOG_EVERY_N(logger, LOG_LVL_INFO, n, message)
+
+/**
+  * @def LOGL_INFO_FIRST_N(logger, n, message...)
+  * Log first n info-level messages from this call site, see LOG_FIRST_N.
+  */
+#define LOGL_INFO_FIRST_N(logger, n, message...) LOG_FIRST_N(logger, LOG_LVL_INFO, n, message)
+
+/**
+  * @def LOGL_INFO_ONCE(logger, message...)
+  * Log first info-level message from this call site, see LOG_ONCE.
+  */
+#define LOGL_INFO_ONCE(logger, message...) LOG_FIRST_N(logger, LOG_LVL_INFO, 1, message)
+
+/**
+  * @def LOGL_INFO_RATE_LIMIT(logger, perSecond, message...)
+  * Log info-level messages from this call site at a limited rate, see
+  * LOG_RATE_LIMIT.
+  */
+#define LOGL_INFO_RATE_LIMIT(logger, perSecond, message...) \
+    LOG_RATE_LIMIT(logger, LOG_LVL_INFO, perSecond, message)
+
+/**
+  * @def LOGLS_INFO_EVERY_N(logger, n, message)
+  * Log every n-th info-level message from this call site, see LOGS_EVERY_N.
+  */
+#define LOGLS_INFO_EVERY_N(logger, n, message) LOGS_EVERY_N(logger, LOG_LVL_INFO, n, message)
+
+/**
+  * @def LOGLS_INFO_FIRST_N(logger, n, message)
+  * Log first n info-level messages from this call site, see LOGS_FIRST_N.
+  */
+#define LOGLS_INFO_FIRST_N(logger, n, message) LOGS_FIRST_N(logger, LOG_LVL_INFO, n, message)
+
+/**
+  * @def LOGLS_INFO_ONCE(logger, message)
+  * Log first info-level message from this call site, see LOGS_ONCE.
+  */
+#define LOGLS_INFO_ONCE(logger, message) LOGS_FIRST_N(logger, LOG_LVL_INFO, 1, message)
+
+/**
+  * @def LOGLS_INFO_RATE_LIMIT(logger, perSecond, message)
+  * Log info-level messages from this call site at a limited rate, see
+  * LOGS_RATE_LIMIT.
+  */
+#define LOGLS_INFO_RATE_LIMIT(logger, perSecond, message) \
+    LOGS_RATE_LIMIT(logger, LOG_LVL_INFO, perSecond, message)
+
+/**
+  * @def LOGL_WARN_EVERY_N(logger, n, message...)
+  * Log every n-th warn-level message from this call site, see LOG_EVERY_N.
+  */
+#define LOGL_WARN_EVERY_N(logger, n, message...) LOG_EVERY_N(logger, LOG_LVL_WARN, n, message)
+
+/**
+  * @def LOGL_WARN_FIRST_N(logger, n, message...)
+  * Log first n warn-level messages from this call site, see LOG_FIRST_N.
+  */
+#define LOGL_WARN_FIRST_N(logger, n, message...) LOG_FIRST_N(logger, LOG_LVL_WARN, n, message)
+
+/**
+  * @def LOGL_WARN_ONCE(logger, message...)
+  * Log first warn-level message from this call site, see LOG_ONCE.
+  */
+#define LOGL_WARN_ONCE(logger, message...) LOG_FIRST_N(logger, LOG_LVL_WARN, 1, message)
+
+/**
+  * @def LOGL_WARN_RATE_LIMIT(logger, perSecond, message...)
+  * Log warn-level messages from this call site at a limited rate, see
+  * LOG_RATE_LIMIT.
+  */
+#define LOGL_WARN_RATE_LIMIT(logger, perSecond, message...) \
+    LOG_RATE_LIMIT(logger, LOG_LVL_WARN, perSecond, message)
+
+/**
+  * @def LOGLS_WARN_EVERY_N(logger, n, message)
+  * Log every n-th warn-level message from this call site, see LOGS_EVERY_N.
+  */
+#define LOGLS_WARN_EVERY_N(logger, n, message) LOGS_EVERY_N(logger, LOG_LVL_WARN, n, message)
+
+/**
+  * @def LOGLS_WARN_FIRST_N(logger, n, message)
+  * Log first n warn-level messages from this call site, see LOGS_FIRST_N.
+  */
+#define LOGLS_WARN_FIRST_N(logger, n, message) LOGS_FIRST_N(logger, LOG_LVL_WARN, n, message)
+
+/**
+  * @def LOGLS_WARN_ONCE(logger, message)
+  * Log first warn-level message from this call site, see LOGS_ONCE.
+  */
+#define LOGLS_WARN_ONCE(logger, message) LOGS_FIRST_N(logger, LOG_LVL_WARN, 1, message)
+
+/**
+  * @def LOGLS_WARN_RATE_LIMIT(logger, perSecond, message)
+  * Log warn-level messages from this call site at a limited rate, see
+  * LOGS_RATE_LIMIT.
+  */
+#define LOGLS_WARN_RATE_LIMIT(logger, perSecond, message) \
+    LOGS_RATE_LIMIT(logger, LOG_LVL_WARN, perSecond, message)
+
+/**
+  * @def LOGL_ERROR_EVERY_N(logger, n, message...)
+  * Log every n-th error-level message from this call site, see LOG_EVERY_N.
+  */
+#define LOGL_ERROR_EVERY_N(logger, n, message...) LOG_EVERY_N(logger, LOG_LVL_ERROR, n, message)
+
+/**
+  * @def LOGL_ERROR_FIRST_N(logger, n, message...)
+  * Log first n error-level messages from this call site, see LOG_FIRST_N.
+  */
+#define LOGL_ERROR_FIRST_N(logger, n, message...) LOG_FIRST_N(logger, LOG_LVL_ERROR, n, message)
+
+/**
+  * @def LOGL_ERROR_ONCE(logger, message...)
+  * Log first error-level message from this call site, see LOG_ONCE.
+  */
+#define LOGL_ERROR_ONCE(logger, message...) LOG_FIRST_N(logger, LOG_LVL_ERROR, 1, message)
+
+/**
+  * @def LOGL_ERROR_RATE_LIMIT(logger, perSecond, message...)
+  * Log error-level messages from this call site at a limited rate, see
+  * LOG_RATE_LIMIT.
+  */
+#define LOGL_ERROR_RATE_LIMIT(logger, perSecond, message...) \
+    LOG_RATE_LIMIT(logger, LOG_LVL_ERROR, perSecond, message)
+
+/**
+  * @def LOGLS_ERROR_EVERY_N(logger, n, message)
+  * Log every n-th error-level message from this call site, see LOGS_EVERY_N.
+  */
+#define LOGLS_ERROR_EVERY_N(logger, n, message) LOGS_EVERY_N(logger, LOG_LVL_ERROR, n, message)
+
+/**
+  * @def LOGLS_ERROR_FIRST_N(logger, n, message)
+  * Log first n error-level messages from this call site, see LOGS_FIRST_N.
+  */
+#define LOGLS_ERROR_FIRST_N(logger, n, message) LOGS_FIRST_N(logger, LOG_LVL_ERROR, n, message)
+
+/**
+  * @def LOGLS_ERROR_ONCE(logger, message)
+  * Log first error-level message from this call site, see LOGS_ONCE.
+  */
+#define LOGLS_ERROR_ONCE(logger, message) LOGS_FIRST_N(logger, LOG_LVL_ERROR, 1, message)
+
+/**
+  * @def LOGLS_ERROR_RATE_LIMIT(logger, perSecond, message)
+  * Log error-level messages from this call site at a limited rate, see
+  * LOGS_RATE_LIMIT.
+  */
+#define LOGLS_ERROR_RATE_LIMIT(logger, perSecond, message) \
+    LOGS_RATE_LIMIT(logger, LOG_LVL_ERROR, perSecond, message)
+
+/**
+  * @def LOGL_FATAL_EVERY_N(logger, n, message...)
+  * Log every n-th fatal-level message from this call site, see LOG_EVERY_N.
+  */
+#define LOGL_FATAL_EVERY_N(logger, n, message...) LOG_EVERY_N(logger, LOG_LVL_FATAL, n, message)
+
+/**
+  * @def LOGL_FATAL_FIRST_N(logger, n, message...)
+  * Log first n fatal-level messages from this call site, see LOG_FIRST_N.
+  */
+#define LOGL_FATAL_FIRST_N(logger, n, message...) LOG_FIRST_N(logger, LOG_LVL_FATAL, n, message)
+
+/**
+  * @def LOGL_FATAL_ONCE(logger, message...)
+  * Log first fatal-level message from this call site, see LOG_ONCE.
+  */
+#define LOGL_FATAL_ONCE(logger, message...) LOG_FIRST_N(logger, LOG_LVL_FATAL, 1, message)
+
+/**
+  * @def LOGL_FATAL_RATE_LIMIT(logger, perSecond, message...)
+  * Log fatal-level messages from this call site at a limited rate, see
+  * LOG_RATE_LIMIT.
+  */
+#define LOGL_FATAL_RATE_LIMIT(logger, perSecond, message...) \
+    LOG_RATE_LIMIT(logger, LOG_LVL_FATAL, perSecond, message)
+
+/**
+  * @def LOGLS_FATAL_EVERY_N(logger, n, message)
+  * Log every n-th fatal-level message from this call site, see LOGS_EVERY_N.
+  */
+#define LOGLS_FATAL_EVERY_N(logger, n, message) LOGS_EVERY_N(logger, LOG_LVL_FATAL, n, message)
+
+/**
+  * @def LOGLS_FATAL_FIRST_N(logger, n, message)
+  * Log first n fatal-level messages from this call site, see LOGS_FIRST_N.
+  */
+#define LOGLS_FATAL_FIRST_N(logger, n, message) LOGS_FIRST_N(logger, LOG_LVL_FATAL, n, message)
+
+/**
+  * @def LOGLS_FATAL_ONCE(logger, message)
+  * Log first fatal-level message from this call site, see LOGS_ONCE.
+  */
+#define LOGLS_FATAL_ONCE(logger, message) LOGS_FIRST_N(logger, LOG_LVL_FATAL, 1, message)
+
+/**
+  * @def LOGLS_FATAL_RATE_LIMIT(logger, perSecond, message)
+  * Log fatal-level messages from this call site at a limited rate, see
+  * LOGS_RATE_LIMIT.
+  */
+#define LOGLS_FATAL_RATE_LIMIT(logger, perSecond, message) \
+    LOGS_RATE_LIMIT(logger, LOG_LVL_FATAL, perSecond, message)
+
+#define LOG_LVL_TRACE static_cast<int>(log4cxx::Level::TRACE_INT)
+#define LOG_LVL_DEBUG static_cast<int>(log4cxx::Level::DEBUG_INT)
+#define LOG_LVL_INFO static_cast<int>(log4cxx::Level::INFO_INT)
+#define LOG_LVL_WARN static_cast<int>(log4cxx::Level::WARN_INT)
+#define LOG_LVL_ERROR static_cast<int>(log4cxx::Level::ERROR_INT)
+#define LOG_LVL_FATAL static_cast<int>(log4cxx::Level::FATAL_INT)
+
+#define LOG_LOGGER lsst::log::Log
+
+/**
+ * @def LSST_LOG_PRINTF_FORMAT(fmt, args)
+ * Enables compiler checks of printf-style format strings, `fmt` and
+ * `args` are positions of the format and of the first argument (0 for
+ * va_list), counting implicit `this` of member functions.
+ */
+#if defined(__GNUC__)
+#define LSST_LOG_PRINTF_FORMAT(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define LSST_LOG_PRINTF_FORMAT(fmt, args)
+#endif
+
+namespace lsst {
+namespace log {
+
+namespace detail {
+class LogCallSite;
+class MDCKeySite;
+}
+
+/**
+ *  Handle for an interned MDC key.
+ *
+ *  Interning a key registers it once for the whole process, MDC values for
+ *  interned keys are kept in a per-thread flat array indexed by the key
+ *  handle so that setting and restoring them does not need any map lookups
+ *  or heap allocation for short values. Values are transferred to LOG4CXX
+ *  MDC only when a message is logged, so they are visible to `%X{KEY}` in
+ *  pattern layouts as usual. Interned keys are never released.
+ */
+class MDCKey {
+public:
+
+    /// Intern the key, returns the same handle for the same name.
+    explicit MDCKey(std::string const& name);
+
+    /// Return key name.
+    std::string const& name() const;
+
+    /// Return key index.
+    unsigned index() const { return _index; }
+
+private:
+
+    friend class detail::MDCKeySite;
+
+    struct IndexTag {};
+    MDCKey(unsigned index, IndexTag) : _index(index) {}
+
+    unsigned _index;
+};
+
+namespace detail {
+
+/**
+ *  Storage for MDC values with inline buffer for short values. Default
+ *  constructed value is not present (key is not in MDC), which is
+ *  different from present empty value.
+ */
+class MDCValue {
+public:
+
+    void assign(std::string_view value) {
+        _present = true;
+        _size = value.size();
+        if (_size <= INLINE_SIZE) {
+            std::memcpy(_inline, value.data(), _size);
+        } else {
+            _long.assign(value.data(), value.size());
+        }
+    }
+
+    void reset() {
+        _present = false;
+        _size = 0;
+    }
+
+    std::string_view view() const {
+        return _size <= INLINE_SIZE ? std::string_view(_inline, _size) : std::string_view(_long);
+    }
+
+    bool present() const { return _present; }
+
+    void swap(MDCValue& other) noexcept {
+        std::swap(_present, other._present);
+        std::swap(_size, other._size);
+        std::swap(_inline, other._inline);
+        _long.swap(other._long);
+    }
+
+private:
+    static constexpr std::size_t INLINE_SIZE = 40;
+    bool _present = false;
+    std::size_t _size = 0;
+    char _inline[INLINE_SIZE];
+    std::string _long;
+};
+
+/**
+ *  Exchange value of the interned key in current thread MDC with a given
+ *  value. Value which is not present means that key is not in MDC.
+ */
+void mdcSwap(MDCKey key, MDCValue& value);
+
+/**
+ *  Exchange value of the key in current thread MDC with a given value
+ *  without interning the key, LOG4CXX MDC is used directly unless the key
+ *  is already interned.
+ */
+void mdcSwap(std::string const& key, MDCValue& value);
+
+/**
+ *  Set function which is called after every Log::configure() and
+ *  Log::reconfigure() call, without holding configuration lock. Empty
+ *  function removes the hook. Used by Python notebook capture to replace
+ *  console appenders created by new configuration.
+ */
+void setConfigureHook(std::function<void()> hook);
+
+} // namespace detail
+
+/**
+ *  Message statistics for one logger and level, see Log::getStatistics().
+ */
+struct LogMessageStatistics {
+    std::string logger;        ///< Logger name, empty for root logger.
+    int level;                 ///< Message level.
+    std::uint64_t count;       ///< Number of messages.
+    std::uint64_t nanoseconds; ///< Total time spent in appenders.
+};
+
+/**
+ *  Aggregated message statistics, see Log::getStatistics().
+ */
+struct LogStatistics {
+    /// Statistics for each logger and level which had messages, ordered.
+    std::vector<LogMessageStatistics> messages;
+
+    /**
+     *  Number of messages by time spent in appenders, element `i` counts
+     *  times in range `[2^i, 2^(i+1))` nanoseconds (first one also counts
+     *  shorter times, last non-zero element can include longer times).
+     */
+    std::vector<std::uint64_t> latencyHistogram;
+};
+
+/**
+ *  Logger name pattern and level, see Log::setLevels().
+ */
+struct LogLevelRule {
+    std::string pattern;  ///< Logger name or glob pattern, empty for root logger.
+    int level;            ///< Level, negative value means no level (inherit from parent).
+};
+
+/** This static class includes a variety of methods for interacting with the
+  * the logging module. These methods are not meant for direct use. Rather,
+  * they are used by the LOG* macros and the SWIG interface declared in
+  * logInterface.h.
+  */
+class Log {
+public:
+
+    /***
+     *  Default constructor creates an instance of root logger.
+     */
+    Log() : _logger(_defaultLogger()) { }
+
+    // copying does not need synchronization but atomic members need help
+    Log(Log const& other)
+        : _logger(other._logger), _levelCache(other._levelCache.load(std::memory_order_relaxed)),
+          _appendThreshold(other._appendThreshold.load(std::memory_order_relaxed)),
+          _deferCache(other._deferCache.load(std::memory_order_relaxed)) {}
+    Log& operator=(Log const& other) {
+        _logger = other._logger;
+        _levelCache.store(other._levelCache.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        _appendThreshold.store(other._appendThreshold.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        _deferCache.store(other._deferCache.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    /**
+     *  Check whether the logger is enabled for the DEBUG Level
+     */
+    bool isDebugEnabled() const { return isEnabledFor(log4cxx::Level::DEBUG_INT); }
+    /**
+     *  Check whether the logger is enabled for the ERROR Level
+     */
+    bool isErrorEnabled() const { return isEnabledFor(log4cxx::Level::ERROR_INT); }
+    /**
+     *  Check whether the logger is enabled for the FATAL Level
+     */
+    bool isFatalEnabled() const { return isEnabledFor(log4cxx::Level::FATAL_INT); }
+    /**
+     *  Check whether the logger is enabled for the INFO Level
+     */
+    bool isInfoEnabled() const { return isEnabledFor(log4cxx::Level::INFO_INT); }
+    /**
+     *  Check whether the logger is enabled for the TRACE Level
+     */
+    bool isTraceEnabled() const { return isEnabledFor(log4cxx::Level::TRACE_INT); }
+    /**
+     *  Check whether the logger is enabled for the WARN Level
+     */
+    bool isWarnEnabled() const { return isEnabledFor(log4cxx::Level::WARN_INT); }
+
+    /**
+     *  Return whether the logging threshold of the logger is less than or
+     *  equal to LEVEL.
+     *
+     *  Effective threshold is cached in this instance and is re-evaluated
+     *  after any call to setLevel() or configure*() methods. Levels changed
+     *  directly through LOG4CXX API are not noticed until then.
+     *
+     *  @param level   Logging threshold to check.
+     *  @return Bool indicating whether or not logger is enabled.
+     */
+    bool isEnabledFor(int level) const { return level >= _threshold(); }
+
+    std::string getName() const;
+    void setLevel(int level);
+    static std::vector<LogLevelRule> setLevels(std::vector<LogLevelRule> const& rules);
+    int getLevel() const;
+    int getEffectiveLevel() const;
+
+    Log getChild(std::string_view suffix) const;
+
+    /// Return default logger instance, same as default constructor.
+    static Log getDefaultLogger() { return Log(); }
+
+    static void configure();
+    static void configure(std::string const& filename);
+    static void configure_prop(std::string const& properties);
+    static void reconfigure(std::string const& filename);
+    static void reconfigure_prop(std::string const& properties);
+    static void watchConfig(std::string const& filename = std::string(), double interval = 1.0);
+    static void unwatchConfig();
+
+    static Log getLogger(Log const& logger) { return logger; }
+    static Log getLogger(std::string const& loggername);
+
+    static std::string MDC(std::string const& key, std::string const& value);
+    static void MDC(MDCKey key, std::string_view value);
+    static void MDCRemove(std::string const& key);
+    static void MDCRemove(MDCKey key);
+    static int MDCRegisterInit(std::function<void()> function);
+
+    /**
+     *  Enable or disable collection of message statistics.
+     *
+     *  When enabled, every message which passes level check is counted per
+     *  logger and level, and time spent in appenders is measured. Counters
+     *  are kept per thread and aggregated by getStatistics(). When disabled
+     *  the only cost is a check of a single flag per message.
+     */
+    static void setStatisticsEnabled(bool enabled);
+    static bool isStatisticsEnabled();
+
+    /// Return statistics collected so far by all threads.
+    static LogStatistics getStatistics();
+
+    /// Reset all collected statistics.
+    static void resetStatistics();
+
+    /**
+     *  Enable flight recorder.
+     *
+     *  When enabled, messages at `level` or above which are below threshold
+     *  of their logger are not discarded but are kept in a fixed-size
+     *  per-thread ring in memory. Cost of a recorded message depends on
+     *  the macro: LOGF* messages only copy their arguments and are
+     *  formatted when dumped, LOG/LOGL* messages are formatted with
+     *  vsnprintf directly into the ring slot (truncated to its size), and
+     *  LOGS* messages build the whole stream before they are recorded.
+     *  Messages at `dumpLevel` or higher (WARN by
+     *  default) write all recorded messages to `filename` (appending to it,
+     *  standard error is used if name is empty) before they are logged.
+     *  Level checks on loggers return true for recorded levels.
+     *
+     *  @param filename  Dump file name.
+     *  @param level     Lowest level of recorded messages.
+     *  @param dumpLevel Level of messages which trigger dump.
+     *  @param capacity  Number of messages kept per thread, only applies to
+     *                   threads which record their first message after
+     *                   this call.
+     */
+    static void enableFlightRecorder(std::string const& filename, int level = log4cxx::Level::TRACE_INT,
+                                     int dumpLevel = log4cxx::Level::WARN_INT, std::size_t capacity = 1024);
+
+    /// Stop recording messages, already recorded messages can still be dumped.
+    static void disableFlightRecorder();
+
+    /// Return true if flight recorder is enabled.
+    static bool isFlightRecorderEnabled();
+
+    /**
+     *  Write recorded messages which have not been dumped yet, messages
+     *  from all threads are ordered by time.
+     *
+     *  @return Number of messages written.
+     */
+    static std::size_t dumpFlightRecorder();
+
+    /**
+     *  Install handler which dumps recorded messages when signal is
+     *  received. For SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT default
+     *  action (process termination) follows the dump.
+     */
+    static void dumpFlightRecorderOnSignal(int signum);
+
+    /**
+     *  Enable or disable configuration cache.
+     *
+     *  When enabled, properties parsed from a configuration file (or
+     *  translated from XML file) are saved in a compact binary form to a
+     *  per-user cache directory, `$XDG_CACHE_HOME/lsst_log` or
+     *  `~/.cache/lsst_log`, and are loaded from there by all later
+     *  configure() and reconfigure() calls, until modification time, size
+     *  or inode of the configuration file change. Default is taken from
+     *  LSST_LOG_CONFIG_CACHE environment variable (enabled if it is set to
+     *  non-empty value other than "0").
+     */
+    static void setConfigCacheEnabled(bool enabled);
+    static bool isConfigCacheEnabled();
+
+    /**
+     *  Enable or disable lazy construction of appenders.
+     *
+     *  When enabled, appenders defined in configuration properties are
+     *  made when the first message reaches them, appenders which never
+     *  receive a message do not open files or start threads. Applies to
+     *  configurations made after this call, XML configurations are only
+     *  affected if they can be translated into properties. Default is
+     *  taken from LSST_LOG_LAZY_APPENDERS environment variable (enabled if
+     *  it is set to non-empty value other than "0").
+     */
+    static void setLazyAppendersEnabled(bool enabled);
+    static bool isLazyAppendersEnabled();
+
+    void log(log4cxx::LevelPtr level,
+             log4cxx::spi::LocationInfo const& location,
+             char const* fmt, ...) const LSST_LOG_PRINTF_FORMAT(4, 5);
+    void vlog(log4cxx::LevelPtr level,
+              log4cxx::spi::LocationInfo const& location,
+              char const* fmt, va_list args) const LSST_LOG_PRINTF_FORMAT(4, 0);
+    void logMsg(log4cxx::LevelPtr level,
+                log4cxx::spi::LocationInfo const& location,
+                std::string_view msg) const;
+    void logRecord(log4cxx::LevelPtr level,
+                   log4cxx::spi::LocationInfo const& location,
+                   detail::FormatRecord const& record) const;
+
+private:
+
+    friend class detail::LogCallSite;
+
+    /**
+     *  Configuration generation number, incremented every time when logging
+     *  is re-configured. Used to invalidate cached Log instances.
+     */
+    static std::atomic<unsigned> _configGeneration;
+
+    /**
+     *  Level generation number, incremented every time when logging is
+     *  re-configured or any logger level changes. Used to invalidate cached
+     *  thresholds.
+     */
+    static std::atomic<unsigned> _levelGeneration;
+
+    /**
+     *  Returns default LOG4CXX logger, which is the same as root logger.
+     *
+     *  This method is needed to ensure proper LOG4CXX initialization before
+     *  any code uses any logger instance.
+     */
+    static log4cxx::LoggerPtr const& _defaultLogger();
+
+    /**
+     *  Construct a Log using a LOG4CXX logger.
+     *
+     *  The default constructor is called to ensure the default logger is
+     *  initialized and LOG4CXX is configured.
+     */
+    Log(log4cxx::LoggerPtr const& logger) : Log() { _logger = logger; }
+
+    /**
+     *  Return effective threshold, cached value is used if it was
+     *  calculated for current level generation.
+     */
+    int _threshold() const {
+        std::uint64_t const cache = _levelCache.load(std::memory_order_relaxed);
+        if (LOG4CXX_UNLIKELY(static_cast<unsigned>(cache >> 32) !=
+                             _levelGeneration.load(std::memory_order_acquire))) {
+            return _updateThreshold();
+        }
+        return static_cast<std::int32_t>(static_cast<std::uint32_t>(cache));
+    }
+
+    // Calculate effective threshold and store it in cache.
+    int _updateThreshold() const;
+
+    // Returns true if message is below append threshold and has to be kept
+    // in flight recorder instead of passing it to appenders, dumps recorder
+    // for messages at dump level.
+    bool _toFlightRecorder(log4cxx::LevelPtr const& level) const;
+
+    // Returns true if all appenders of this logger can render LOGF*
+    // messages themselves, cached for current level generation.
+    bool _deferRendering() const;
+
+    // Pass message to appenders, if record is not null then message is
+    // ignored and event with deferred rendering of the record is made.
+    void _append(log4cxx::LevelPtr const& level, log4cxx::spi::LocationInfo const& location,
+                 log4cxx::LogString const& msg, detail::FormatRecord const* record = nullptr) const;
+
+    log4cxx::LoggerPtr _logger;
+
+    // Level generation number in upper 32 bits and threshold in lower 32 bits,
+    // packed together so that they are always updated consistently.
+    mutable std::atomic<std::uint64_t> _levelCache{0};
+
+    // Threshold for passing messages to appenders, same as cached threshold
+    // unless flight recorder lowers the latter.
+    mutable std::atomic<int> _appendThreshold{log4cxx::Level::ALL_INT};
+
+    // Level generation number in upper 32 bits, result of _deferRendering()
+    // plus one in lower bits (zero means not calculated).
+    mutable std::atomic<std::uint64_t> _deferCache{0};
+};
+
+namespace detail {
+
+/**
+ *  Cache of a Log instance for a single call site of LOG* macros.
+ *
+ *  Each logging macro defines a function-local static instance of this class.
+ *  When a logger is given by a string literal it is looked up only on first
+ *  use and after each re-configuration, the common path is then just a
+ *  comparison of the generation numbers. Loggers given by a Log instance or
+ *  by a name which is not a literal are looked up every time.
+ */
+class LogCallSite {
+public:
+
+    constexpr LogCallSite() = default;
+
+    // no copy allowed
+    LogCallSite(LogCallSite const&) = delete;
+    LogCallSite& operator=(LogCallSite const&) = delete;
+
+    /// Return default logger.
+    Log const& get() { return _get(nullptr); }
+
+    /// Return logger for a name given by string literal, cached.
+    template <std::size_t N>
+    Log const& get(char const (&loggername)[N]) { return _get(loggername); }
+
+    /// Contents of non-const character arrays can change, not cached.
+    template <std::size_t N>
+    Log get(char (&loggername)[N]) const { return Log::getLogger(loggername); }
+
+    /// Return logger for a name, not cached.
+    Log get(std::string const& loggername) const { return Log::getLogger(loggername); }
+
+    /**
+     *  Return logger for a name, cached. Caller has to pass the same name
+     *  to every call on this instance and keep it alive, this is used by
+     *  caches which keep one instance per logger name.
+     */
+    Log const& getNamed(char const* loggername) { return _get(loggername); }
+
+    /// Return logger itself.
+    Log const& get(Log const& logger) const { return logger; }
+
+private:
+
+    Log const& _get(char const* loggername) {
+        if (LOG4CXX_UNLIKELY(_generation.load(std::memory_order_acquire) !=
+                             Log::_configGeneration.load(std::memory_order_relaxed))) {
+            _resolve(loggername);
+        }
+        return *_log.load(std::memory_order_relaxed);
+    }
+
+    // Find Log instance for a given name (nullptr for default logger),
+    // update cached pointer and generation number.
+    void _resolve(char const* loggername);
+
+    std::atomic<unsigned> _generation{0};
+    std::atomic<Log const*> _log{nullptr};
+};
+
+/**
+ *  Cache of an interned MDC key for a single call site of LOG_MDC_SCOPE.
+ *
+ *  Keys given as string literals are interned on first use, other names
+ *  are passed through and set in LOG4CXX MDC directly, so that keys made
+ *  at run time do not accumulate in the registry of interned keys.
+ */
+class MDCKeySite {
+public:
+
+    constexpr MDCKeySite() = default;
+
+    // no copy allowed
+    MDCKeySite(MDCKeySite const&) = delete;
+    MDCKeySite& operator=(MDCKeySite const&) = delete;
+
+    template <std::size_t N>
+    MDCKey get(char const (&name)[N]) {
+        unsigned index = _index.load(std::memory_order_acquire);
+        if (LOG4CXX_UNLIKELY(index == NO_INDEX)) {
+            index = MDCKey(name).index();
+            _index.store(index, std::memory_order_release);
+        }
+        return MDCKey(index, MDCKey::IndexTag());
+    }
+
+    // mutable arrays can change their contents, do not intern them
+    template <std::size_t N>
+    std::string get(char (&name)[N]) { return name; }
+
+    std::string const& get(std::string const& name) { return name; }
+
+    MDCKey get(MDCKey key) { return key; }
+
+private:
+    static constexpr unsigned NO_INDEX = ~0U;
+    std::atomic<unsigned> _index{NO_INDEX};
+};
+
+/**
+ *  State of a single call site of sampling and rate-limiting macros.
+ *
+ *  Checks only use atomic counters of the call site and never block.
+ *  Messages which are not logged are counted, counts are reported as
+ *  a separate message at the level and location of the call site, at most
+ *  once per report interval (10 seconds by default) when some message is
+ *  suppressed or logged at a call site which has suppressed messages, or
+ *  when reportSuppressed() is called. Remaining counts are also reported
+ *  before configuration is reset by Log::configure() and at exit.
+ */
+class LogSampler {
+public:
+
+    constexpr LogSampler() = default;
+
+    // no copy allowed
+    LogSampler(LogSampler const&) = delete;
+    LogSampler& operator=(LogSampler const&) = delete;
+
+    /// Return true for the first call and then for every n-th call.
+    bool everyN(std::uint64_t n) {
+        return _count.fetch_add(1, std::memory_order_relaxed) % (n > 0 ? n : 1) == 0;
+    }
+
+    /// Return true for the first n calls.
+    bool firstN(std::uint64_t n) {
+        // do not touch the counter after the limit is reached
+        return _count.load(std::memory_order_relaxed) < n and
+               _count.fetch_add(1, std::memory_order_relaxed) < n;
+    }
+
+    /**
+     *  Return true if the call fits into a token bucket which is refilled
+     *  at `perSecond` tokens per second and holds at most `perSecond`
+     *  tokens (but at least one).
+     */
+    bool rateLimit(double perSecond);
+
+    /**
+     *  Count suppressed message and report suppressed messages from all
+     *  call sites if report interval has passed since the last report.
+     */
+    void suppress(Log const& log, int level, log4cxx::spi::LocationInfo const& location);
+
+    /**
+     *  Called for messages which are logged, reports suppressed messages
+     *  from all call sites if this site has suppressed some and report
+     *  interval has passed since the last report.
+     */
+    void passed() {
+        if (_suppressed.load(std::memory_order_relaxed) != 0) {
+            _reportIfDue();
+        }
+    }
+
+    /// Report and reset counts of suppressed messages for all call sites.
+    static void reportSuppressed();
+
+    /// Set minimum interval between reports, zero or negative disables them.
+    static void setReportInterval(double seconds);
+
+private:
+    // Report suppressed messages if report interval has passed
+    static void _reportIfDue();
+
+    std::atomic<std::uint64_t> _count{0};
+    std::atomic<std::int64_t> _bucketTime{0};  // nanoseconds, when the bucket will be full
+    std::atomic<std::uint64_t> _suppressed{0};
+    std::atomic<bool> _registered{false};
+};
+
+} // namespace detail
+
+class LogMDCScope {
+public:
+
+    /**
+     * Constructor adds KEY/VALUE pair to current thread MDC.
+     * Key should not be empty (not checked). Key is not interned, value is
+     * set in LOG4CXX MDC directly unless the key is already interned.
+     */
+    LogMDCScope(std::string const& key, std::string_view value)
+      : _name(key), _active(true)
+    {
+        _oldValue.assign(value);
+        detail::mdcSwap(_name, _oldValue);
+    }
+
+    /**
+     * Constructor adds KEY/VALUE pair to current thread MDC using interned
+     * key, this does not allocate memory unless value is long.
+     */
+    LogMDCScope(MDCKey key, std::string_view value)
+      : _key(key), _active(true)
+    {
+        _oldValue.assign(value);
+        detail::mdcSwap(*_key, _oldValue);
+    }
+
+    // no copy allowed
+    LogMDCScope(LogMDCScope const&) = delete;
+    LogMDCScope& operator=(LogMDCScope const&) = delete;
+
+    LogMDCScope(LogMDCScope&& other)
+      : _key(other._key), _name(std::move(other._name)), _active(other._active)
+    {
+        _oldValue.swap(other._oldValue);
+        other._active = false;
+    }
+
+    LogMDCScope& operator=(LogMDCScope&& other) {
+        _restore();
+        _key = other._key;
+        _name = std::move(other._name);
+        _oldValue.swap(other._oldValue);
+        _active = other._active;
+        other._active = false;
+        return *this;
+    }
+
+    /**
+     * Destructor restores old key value in MDC.
+     */
+    ~LogMDCScope() {
+        _restore();
+    }
+
+private:
+
+    void _restore() {
+        if (_active) {
+            if (_key) {
+                detail::mdcSwap(*_key, _oldValue);
+            } else {
+                detail::mdcSwap(_name, _oldValue);
+            }
+            _active = false;
+        }
+    }
+
+    std::optional<MDCKey> _key;  // empty for keys which are not interned
+    std::string _name;  // key name if it is not interned
+    detail::MDCValue _oldValue;
+    bool _active = false;
+};
+
+/**
+ *  Scoped change of logger levels.
+ *
+ *  Constructor applies rules using Log::setLevels(), destructor restores
+ *  previous levels of all loggers that were changed.
+ */
+class LogLevelScope {
+public:
+
+    explicit LogLevelScope(std::vector<LogLevelRule> const& rules)
+      : _saved(Log::setLevels(rules))
+    {}
+
+    // no copy allowed
+    LogLevelScope(LogLevelScope const&) = delete;
+    LogLevelScope& operator=(LogLevelScope const&) = delete;
+
+    ~LogLevelScope() {
+        Log::setLevels(_saved);
+    }
+
+private:
+
+    std::vector<LogLevelRule> _saved;
 };
 
 /**
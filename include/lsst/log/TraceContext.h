@@ -0,0 +1,166 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_TRACECONTEXT_H
+#define LSST_LOG_TRACECONTEXT_H
+
+// System headers
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Third-party headers
+#include <log4cxx/spi/loggingevent.h>
+
+namespace lsst {
+namespace log {
+
+/**
+ *  Distributed trace context: 128-bit trace ID and 64-bit span ID, same as
+ *  in W3C Trace Context and OpenTelemetry.
+ *
+ *  Each thread has a current context (invalid by default) which is set with
+ *  LogTraceScope. Messages logged through lsst::log carry a copy of the
+ *  current context as three integers, it is converted to hex only by the
+ *  layouts which output it (\c %traceid and \c %spanid conversions of
+ *  lsst.log.ExtendedPatternLayout, lsst.log.JsonLinesLayout,
+ *  lsst.log.BinaryFileAppender) and is passed to Python records as
+ *  `trace_id` and `span_id` integer attributes. Unlike MDC, setting the
+ *  context is three stores to thread-local memory.
+ *
+ *  Context is per thread, use withTraceContext() to carry it to tasks
+ *  executed by thread pools.
+ */
+struct TraceContext {
+
+    std::uint64_t traceIdHigh = 0;  ///< Upper 64 bits of trace ID.
+    std::uint64_t traceIdLow = 0;  ///< Lower 64 bits of trace ID.
+    std::uint64_t spanId = 0;  ///< Span ID.
+
+    /// Return true if trace ID and span ID are not zero.
+    bool valid() const { return (traceIdHigh != 0 || traceIdLow != 0) && spanId != 0; }
+
+    /// Return context of the current thread.
+    static TraceContext current();
+
+    /// Replace context of the current thread, returns previous context.
+    static TraceContext exchange(TraceContext const& context);
+
+    /**
+     *  Parse W3C \c traceparent header value, e.g.
+     *  "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01".
+     *  Returns invalid context if value cannot be parsed.
+     */
+    static TraceContext fromTraceparent(std::string_view header);
+
+    /// Return trace ID as 32 lower-case hex digits.
+    std::string traceIdHex() const;
+
+    /// Return span ID as 16 lower-case hex digits.
+    std::string spanIdHex() const;
+
+    /**
+     *  Write trace ID as 32 lower-case hex digits (without terminating
+     *  zero), returns pointer past the last digit.
+     */
+    char* formatTraceId(char* out) const;
+
+    /**
+     *  Write span ID as 16 lower-case hex digits (without terminating
+     *  zero), returns pointer past the last digit.
+     */
+    char* formatSpanId(char* out) const;
+
+    bool operator==(TraceContext const& other) const {
+        return traceIdHigh == other.traceIdHigh && traceIdLow == other.traceIdLow && spanId == other.spanId;
+    }
+    bool operator!=(TraceContext const& other) const { return !(*this == other); }
+};
+
+namespace detail {
+
+/// Trace context of the current thread.
+inline thread_local TraceContext currentTraceContext;
+
+/**
+ *  Return trace context of the thread which logged the event, invalid
+ *  context if there was none or event was not made by lsst::log.
+ */
+TraceContext eventTraceContext(log4cxx::spi::LoggingEvent const& event);
+
+} // namespace detail
+
+inline TraceContext TraceContext::current() {
+    return detail::currentTraceContext;
+}
+
+inline TraceContext TraceContext::exchange(TraceContext const& context) {
+    TraceContext const old = detail::currentTraceContext;
+    detail::currentTraceContext = context;
+    return old;
+}
+
+/**
+ *  Scoped change of the current thread trace context, destructor restores
+ *  previous context.
+ */
+class LogTraceScope {
+public:
+
+    explicit LogTraceScope(TraceContext const& context)
+      : _old(TraceContext::exchange(context))
+    {}
+
+    // no copy allowed
+    LogTraceScope(LogTraceScope const&) = delete;
+    LogTraceScope& operator=(LogTraceScope const&) = delete;
+
+    ~LogTraceScope() {
+        TraceContext::exchange(_old);
+    }
+
+private:
+    TraceContext _old;
+};
+
+/**
+ *  Wrap a callable so that it runs with the trace context of the thread
+ *  which wrapped it, e.g. when submitting a task to a thread pool:
+ *  \code
+ *  pool.submit(lsst::log::withTraceContext([=]() { process(item); }));
+ *  \endcode
+ */
+template <typename Func>
+auto withTraceContext(Func&& func) {
+    return [context = TraceContext::current(), func = std::forward<Func>(func)](auto&&... args) mutable
+            -> decltype(auto) {
+        LogTraceScope scope(context);
+        return func(std::forward<decltype(args)>(args)...);
+    };
+}
+
+}} // namespace lsst::log
+
+#endif // LSST_LOG_TRACECONTEXT_H
@@ -0,0 +1,478 @@
+# This file is part of log.
+#
+# Developed for the LSST Data Management System.
+# This product includes software developed by the LSST Project
+# (https://www.lsst.org).
+# See the COPYRIGHT file at the top-level directory of this distribution
+# for details of code ownership.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Decoder for files written by ``lsst.log.BinaryFileAppender``.
+
+Can be used as a command line tool::
+
+    python -m lsst.log.binlog [--json | --pattern PATTERN] FILE [FILE ...]
+"""
+
+__all__ = ["BinaryLogRecord", "readBinaryLog", "renderFormat", "formatRecord", "recordToJson", "main"]
+
+import argparse
+import dataclasses
+import datetime
+import decimal
+import json
+import math
+import re
+import struct
+import sys
+from typing import Dict, Iterator, Optional
+
+_MAGIC = b"LSSTBLOG"
+_VERSION = 1
+_HEADER_SIZE = 16
+_BYTE_ORDER_MARK = 0x01020304
+
+_RECORD_STRING = 1
+_RECORD_EVENT = 2
+_RECORD_TRACE = 3
+_RECORD_FORMAT = 4
+
+# argument type tags of FormatRecord
+_ARG_BOOL = 0
+_ARG_CHAR = 1
+_ARG_INT = 2
+_ARG_UINT = 3
+_ARG_DOUBLE = 4
+_ARG_POINTER = 5
+_ARG_STRING = 6
+
+# longest printf specification accepted inside braces
+_MAX_SPEC_LEN = 24
+
+_LEVEL_NAMES = {5000: "TRACE", 10000: "DEBUG", 20000: "INFO", 30000: "WARN", 40000: "ERROR",
+                50000: "FATAL"}
+
+DEFAULT_PATTERN = "%c %p: %m%n"
+
+
+@dataclasses.dataclass
+class BinaryLogRecord:
+    """Single logging event read from a binary log file."""
+
+    timestamp: int
+    """Time of the event in microseconds since epoch."""
+
+    level: int
+    """Numeric level, same as `lsst.log` levels."""
+
+    logger: str
+    filename: str
+    funcName: str
+    lineno: int
+    lwp: int
+    mdc: Dict[str, str]
+    message: str
+
+    traceId: int = 0
+    """128-bit trace ID, 0 if event was logged without trace context."""
+
+    spanId: int = 0
+    """64-bit span ID, 0 if event was logged without trace context."""
+
+    @property
+    def levelName(self) -> str:
+        """Name of the level (`str`)."""
+        return _LEVEL_NAMES.get(self.level, f"Level {self.level}")
+
+    @property
+    def datetime(self) -> datetime.datetime:
+        """Time of the event as timezone-aware `datetime.datetime`."""
+        return datetime.datetime.fromtimestamp(self.timestamp / 1e6, datetime.timezone.utc)
+
+
+def _printfFormat(spec: str, convs: str, defConv: str) -> Optional[str]:
+    """Build printf format from placeholder specification, same as C++
+    FormatRecord does, return `None` if specification is not usable.
+    """
+    if len(spec) > _MAX_SPEC_LEN:
+        return None
+    conv = defConv
+    if spec and spec[-1] in "diouxXeEfFgGaAcspb":
+        if spec[-1] in convs:
+            conv = spec[-1]
+        spec = spec[:-1]
+    if spec.strip("-+ #0123456789."):
+        return None
+    return "%" + spec + conv
+
+
+def _printf(pfmt: str, value) -> str:
+    """Apply printf format to a single value, emulating C where Python
+    differs.
+    """
+    conv = pfmt[-1]
+    if conv == "u":
+        pfmt = pfmt[:-1] + "d"
+    elif conv in "aA":
+        # no hexadecimal float in Python, precision and width are ignored
+        text = float.hex(value)
+        return text.upper() if conv == "A" else text
+    elif conv == "o":
+        # C prefixes alternate form of octal numbers with single zero
+        return (pfmt % value).replace("0o", "0", 1)
+    return pfmt % value
+
+
+def _shortestDouble(value: float) -> str:
+    """Render double in the same way as C++ ``std::to_chars`` without
+    format, i.e. shortest representation which round-trips.
+    """
+    if math.isnan(value):
+        return "-nan" if math.copysign(1.0, value) < 0 else "nan"
+    if math.isinf(value):
+        return "-inf" if value < 0 else "inf"
+    sign = "-" if math.copysign(1.0, value) < 0 else ""
+    if value == 0:
+        return sign + "0"
+    # repr() gives shortest digits which round-trip
+    _, digits, exponent = decimal.Decimal(repr(abs(value))).as_tuple()
+    digits = "".join(str(digit) for digit in digits)
+    stripped = digits.rstrip("0")
+    exponent += len(digits) - len(stripped)
+    digits = stripped
+    ndigits = len(digits)
+    if exponent >= 0:
+        fixed = digits + "0" * exponent
+    elif -exponent < ndigits:
+        fixed = digits[:ndigits + exponent] + "." + digits[ndigits + exponent:]
+    else:
+        fixed = "0." + "0" * (-exponent - ndigits) + digits
+    sci_exp = ndigits - 1 + exponent
+    scientific = digits[0] + ("." + digits[1:] if ndigits > 1 else "") + f"e{sci_exp:+03d}"
+    return sign + (fixed if len(fixed) <= len(scientific) else scientific)
+
+
+def renderFormat(fmt: str, args: bytes, order: str = "=") -> str:
+    """Render message of a ``LOGF*`` macro from its format string and
+    encoded arguments, same as C++ ``FormatRecord`` does.
+
+    Parameters
+    ----------
+    fmt : `str`
+        Format string with ``{}`` placeholders.
+    args : `bytes`
+        Encoded arguments.
+    order : `str`, optional
+        Byte order of the arguments as `struct` prefix character.
+
+    Returns
+    -------
+    message : `str`
+        Rendered message, printf conversions which have no Python
+        equivalent (``%a``) are approximated.
+    """
+    scalars = {
+        _ARG_BOOL: struct.Struct(order + "?"),
+        _ARG_CHAR: struct.Struct(order + "b"),
+        _ARG_INT: struct.Struct(order + "q"),
+        _ARG_UINT: struct.Struct(order + "Q"),
+        _ARG_DOUBLE: struct.Struct(order + "d"),
+        _ARG_POINTER: struct.Struct(order + "Q"),
+    }
+    u32 = struct.Struct(order + "I")
+
+    def render_arg(pos, spec):
+        # return rendered argument and position of the next one
+        atype = args[pos]
+        pos += 1
+        if atype == _ARG_STRING:
+            (size,) = u32.unpack_from(args, pos)
+            pos += u32.size
+            value = args[pos:pos + size].decode("utf-8", errors="replace")
+            pfmt = _printfFormat(spec, "s", "s") if spec else None
+            return (_printf(pfmt, value) if pfmt else value), pos + size
+        scalar = scalars.get(atype)
+        if scalar is None:
+            raise ValueError("unknown argument type")
+        (value,) = scalar.unpack_from(args, pos)
+        pos += scalar.size
+        if atype == _ARG_BOOL:
+            return ("true" if value else "false"), pos
+        if atype == _ARG_POINTER:
+            return (f"0x{value:x}" if value else "(nil)"), pos
+        convs, defConv = {
+            _ARG_CHAR: ("cdiouxX", "c"),
+            _ARG_INT: ("dioxX", "d"),
+            _ARG_UINT: ("uoxX", "u"),
+            _ARG_DOUBLE: ("eEfFgGaA", "g"),
+        }[atype]
+        pfmt = _printfFormat(spec, convs, defConv) if spec else None
+        if pfmt:
+            return _printf(pfmt, value), pos
+        if atype == _ARG_CHAR:
+            return bytes([value & 0xff]).decode("utf-8", errors="replace"), pos
+        if atype == _ARG_DOUBLE:
+            return _shortestDouble(value), pos
+        return str(value), pos
+
+    out = []
+    # position of the next argument, None after corrupted argument
+    arg = 0
+    ptr = 0
+    while ptr < len(fmt):
+        brace = min((pos for pos in (fmt.find("{", ptr), fmt.find("}", ptr)) if pos >= 0),
+                    default=len(fmt))
+        out.append(fmt[ptr:brace])
+        ptr = brace
+        if ptr == len(fmt):
+            break
+        if fmt[ptr:ptr + 1] == fmt[ptr + 1:ptr + 2]:
+            # escaped brace
+            out.append(fmt[ptr])
+            ptr += 2
+            continue
+        if fmt[ptr] == "}":
+            # unbalanced closing brace, copy as is
+            out.append("}")
+            ptr += 1
+            continue
+        close = fmt.find("}", ptr)
+        if close < 0:
+            out.append(fmt[ptr:])
+            break
+        if arg is not None and arg < len(args):
+            spec = fmt[ptr + 1:close]
+            if spec.startswith(":"):
+                spec = spec[1:]
+            try:
+                text, arg = render_arg(arg, spec)
+                out.append(text)
+            except (ValueError, struct.error):
+                # corrupted data, stop rendering arguments
+                arg = None
+        else:
+            out.append(fmt[ptr:close + 1])
+        ptr = close + 1
+    return "".join(out)
+
+
+def readBinaryLog(path: str) -> Iterator[BinaryLogRecord]:
+    """Read events from a binary log file.
+
+    Parameters
+    ----------
+    path : `str`
+        Name of the file written by ``BinaryFileAppender``.
+
+    Yields
+    ------
+    record : `BinaryLogRecord`
+        Logging events in the order they were written.
+
+    Raises
+    ------
+    ValueError
+        Raised if file is not a binary log file or it is corrupted.
+    """
+    with open(path, "rb") as file:
+        data = file.read()
+
+    if len(data) < _HEADER_SIZE or data[:8] != _MAGIC:
+        raise ValueError(f"{path}: not a binary log file")
+    for order in "<>":
+        version, mark = struct.unpack_from(order + "II", data, 8)
+        if mark == _BYTE_ORDER_MARK:
+            break
+    else:
+        raise ValueError(f"{path}: unexpected byte order mark")
+    if version != _VERSION:
+        raise ValueError(f"{path}: unsupported format version {version}")
+
+    u32 = struct.Struct(order + "I")
+    record_header = struct.Struct(order + "IB")
+    event_header = struct.Struct(order + "qiIIIiIH")
+    trace_record = struct.Struct(order + "QQQ")
+
+    def read_bytes(offset):
+        (size,) = u32.unpack_from(data, offset)
+        offset += u32.size
+        return data[offset:offset + size].decode("utf-8", errors="replace"), offset + size
+
+    strings: Dict[int, str] = {}
+    # trace context and format apply to the event record which follows them
+    trace = (0, 0)
+    fmt = None
+    offset = _HEADER_SIZE
+    while offset + record_header.size <= len(data):
+        size, rtype = record_header.unpack_from(data, offset)
+        if size == 0:
+            # unused tail of a file which was not closed
+            break
+        if size < record_header.size or offset + size > len(data):
+            raise ValueError(f"{path}: corrupted record at offset {offset}")
+        pos = offset + record_header.size
+        if rtype == _RECORD_TRACE:
+            high, low, span = trace_record.unpack_from(data, pos)
+            trace = ((high << 64) | low, span)
+        elif rtype == _RECORD_FORMAT:
+            (format_id,) = u32.unpack_from(data, pos)
+            fmt = (strings.get(format_id, ""), data[pos + u32.size:offset + size])
+        elif rtype == _RECORD_STRING:
+            (string_id,) = u32.unpack_from(data, pos)
+            strings[string_id], _ = read_bytes(pos + u32.size)
+        elif rtype == _RECORD_EVENT:
+            (timestamp, level, logger_id, file_id, func_id, lineno, lwp,
+             mdc_count) = event_header.unpack_from(data, pos)
+            pos += event_header.size
+            mdc = {}
+            for _ in range(mdc_count):
+                (key_id,) = u32.unpack_from(data, pos)
+                mdc[strings.get(key_id, "")], pos = read_bytes(pos + u32.size)
+            message, _ = read_bytes(pos)
+            if fmt is not None:
+                message += renderFormat(fmt[0], fmt[1], order)
+            traceId, spanId = trace
+            trace = (0, 0)
+            fmt = None
+            yield BinaryLogRecord(timestamp=timestamp, level=level, logger=strings.get(logger_id, ""),
+                                  filename=strings.get(file_id, ""), funcName=strings.get(func_id, ""),
+                                  lineno=lineno, lwp=lwp, mdc=mdc, message=message,
+                                  traceId=traceId, spanId=spanId)
+        # unknown record types are skipped
+        offset += size
+
+
+# %[-][width][.precision]conversion[{option}]
+_PATTERN_RE = re.compile(r"%(-?)(\d*)(?:\.(\d+))?([a-zA-Z%])(?:\{([^}]*)\})?")
+
+
+def _formatDate(record: BinaryLogRecord, option: Optional[str]) -> str:
+    # Only ISO8601 layout is supported, in local time like log4cxx
+    local = datetime.datetime.fromtimestamp(record.timestamp / 1e6)
+    return local.strftime("%Y-%m-%d %H:%M:%S") + f",{local.microsecond // 1000:03d}"
+
+
+def _formatMDC(record: BinaryLogRecord, option: Optional[str]) -> str:
+    if option:
+        return record.mdc.get(option, "")
+    return "{" + "".join(f"{{{key},{record.mdc[key]}}}" for key in sorted(record.mdc)) + "}"
+
+
+_CONVERTERS = {
+    "c": lambda record, option: record.logger,
+    "p": lambda record, option: record.levelName,
+    "m": lambda record, option: record.message,
+    "n": lambda record, option: "\n",
+    "d": _formatDate,
+    "F": lambda record, option: record.filename,
+    "L": lambda record, option: str(record.lineno),
+    "M": lambda record, option: record.funcName,
+    "l": lambda record, option: f"{record.filename}({record.lineno})",
+    "t": lambda record, option: str(record.lwp),
+    "X": _formatMDC,
+    "%": lambda record, option: "%",
+}
+
+
+def formatRecord(record: BinaryLogRecord, pattern: str = DEFAULT_PATTERN) -> str:
+    """Format a record using log4cxx ``PatternLayout`` conversion pattern.
+
+    Parameters
+    ----------
+    record : `BinaryLogRecord`
+        Record to format.
+    pattern : `str`, optional
+        Conversion pattern, supported conversions are ``%c``, ``%d``,
+        ``%F``, ``%l``, ``%L``, ``%m``, ``%M``, ``%n``, ``%p``, ``%t`` (LWP
+        ID), ``%X`` and ``%X{key}``, with optional alignment, minimum width
+        and maximum width (which keeps the end of the string).
+
+    Returns
+    -------
+    text : `str`
+        Formatted record.
+    """
+    def replace(match):
+        left, width, precision, conversion, option = match.groups()
+        converter = _CONVERTERS.get(conversion)
+        if converter is None:
+            return match.group(0)
+        value = converter(record, option)
+        if precision:
+            value = value[-int(precision):]
+        if width:
+            value = value.ljust(int(width)) if left else value.rjust(int(width))
+        return value
+
+    return _PATTERN_RE.sub(replace, pattern)
+
+
+def recordToJson(record: BinaryLogRecord) -> str:
+    """Convert a record to a single-line JSON object.
+
+    Parameters
+    ----------
+    record : `BinaryLogRecord`
+        Record to convert.
+
+    Returns
+    -------
+    text : `str`
+        JSON representation of a record, timestamp is in ISO format in UTC,
+        trace and span IDs are hex strings and are only present if event
+        was logged with trace context.
+    """
+    data = {
+        "timestamp": record.datetime.isoformat(),
+        "level": record.levelName,
+        "logger": record.logger,
+        "file": record.filename,
+        "line": record.lineno,
+        "function": record.funcName,
+        "lwp": record.lwp,
+        "mdc": record.mdc,
+        "message": record.message,
+    }
+    if record.traceId:
+        data["trace_id"] = f"{record.traceId:032x}"
+        data["span_id"] = f"{record.spanId:016x}"
+    return json.dumps(data)
+
+
+def main(argv=None):
+    """Command line tool which prints contents of binary log files."""
+    parser = argparse.ArgumentParser(description="Convert binary lsst.log files to text.")
+    parser.add_argument("files", nargs="+", metavar="FILE", help="Binary log file.")
+    group = parser.add_mutually_exclusive_group()
+    group.add_argument("--json", action="store_true", help="Print each record as a JSON object.")
+    group.add_argument("--pattern", default=DEFAULT_PATTERN,
+                       help="log4cxx conversion pattern, default: %(default)r.")
+    args = parser.parse_args(argv)
+
+    try:
+        for path in args.files:
+            for record in readBinaryLog(path):
+                if args.json:
+                    sys.stdout.write(recordToJson(record) + "\n")
+                else:
+                    sys.stdout.write(formatRecord(record, args.pattern))
+    except (OSError, ValueError) as exc:
+        print(exc, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
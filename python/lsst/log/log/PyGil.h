@@ -0,0 +1,74 @@
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LSST_LOG_PYGIL_H
+#define LSST_LOG_PYGIL_H
+
+// Python header has to be first to avoid compilation warnings
+#include "Python.h"
+
+namespace lsst::log::detail {
+
+/**
+ *  Acquires GIL in constructor and releases it in destructor, can be used
+ *  from any thread, including threads which already hold GIL.
+ */
+class GilGuard {
+public:
+
+    GilGuard() : gil_state(PyGILState_Ensure()) {}
+
+    ~GilGuard() { PyGILState_Release(gil_state); }
+
+    GilGuard(GilGuard const&) = delete;
+    GilGuard& operator=(GilGuard const&) = delete;
+
+private:
+    PyGILState_STATE gil_state;
+};
+
+/**
+ *  Temporarily releases GIL if this thread holds it.
+ */
+class GilRelease {
+public:
+
+    GilRelease() : _state(Py_IsInitialized() and PyGILState_Check() ? PyEval_SaveThread() : nullptr) {}
+
+    ~GilRelease() {
+        if (_state != nullptr) {
+            PyEval_RestoreThread(_state);
+        }
+    }
+
+    GilRelease(GilRelease const&) = delete;
+    GilRelease& operator=(GilRelease const&) = delete;
+
+private:
+    PyThreadState* _state;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_PYGIL_H
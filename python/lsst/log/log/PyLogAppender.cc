@@ -22,11 +22,21 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
 #include <memory>
+#include <set>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 #include "./PyLogAppender.h"
+#include "./PyGil.h"
 #include "log4cxx/patternlayout.h"
+#include "lsst/log/TraceContext.h"
+#include "log4cxx/helpers/loglog.h"
+#include "log4cxx/helpers/optionconverter.h"
 #include "log4cxx/helpers/stringhelper.h"
 
 // macro below dows not work without this using directive
@@ -38,18 +48,6 @@ using namespace log4cxx::helpers;
 
 namespace {
 
-// GIL wrapper class
-class GilGuard {
-public:
-
-    GilGuard() : gil_state(PyGILState_Ensure()) {}
-
-    ~GilGuard() { PyGILState_Release(gil_state); }
-
-private:
-    PyGILState_STATE gil_state;
-};
-
 /**
  *  Re-raise Python exception as C++ exception.
  */
@@ -67,8 +65,97 @@ std::string reraise(std::string const& message) {
     throw std::runtime_error(exc_msg);
 }
 
-// Maximum size of the logger name cache
-unsigned const MAX_LRU_CACHE_SIZE = 32;
+/*
+ *  Small per-thread cache of Python logger thresholds. Thresholds only
+ *  depend on Python logging configuration, so entries are shared by all
+ *  appender instances and are valid while level generation is the same.
+ */
+struct ThreadThresholds {
+    struct Entry {
+        std::string name;  // logger name, UTF-8
+        int threshold = 0;
+        unsigned generation = 0;  // zero is never valid
+    };
+
+    static constexpr std::size_t SIZE = 16;
+
+    Entry const* find(std::string_view name) const {
+        for (auto const& entry: entries) {
+            if (entry.generation != 0 and entry.name == name) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    void store(std::string_view name, int threshold, unsigned generation) {
+        Entry* slot = nullptr;
+        for (auto& entry: entries) {
+            if (entry.generation != 0 and entry.name == name) {
+                slot = &entry;
+                break;
+            }
+        }
+        if (slot == nullptr) {
+            // replace entries in round-robin order
+            slot = &entries[next];
+            next = (next + 1) % SIZE;
+            slot->name = name;
+        }
+        slot->threshold = threshold;
+        slot->generation = generation;
+    }
+
+    std::array<Entry, SIZE> entries;
+    std::size_t next = 0;  // slot replaced by the next new entry
+};
+
+// Return UTF-8 encoded logger name of the event, `buffer` holds the
+// name if it needs conversion
+std::string_view loggerName(const log4cxx::spi::LoggingEventPtr& event, std::string& buffer) {
+    if constexpr (std::is_same_v<log4cxx::LogString, std::string>) {
+        // LogString is already UTF-8
+        return event->getLoggerName();
+    } else {
+        log4cxx::helpers::Transcoder::encodeUTF8(event->getLoggerName(), buffer);
+        return buffer;
+    }
+}
+
+// In batching mode events are forwarded by the logging thread itself when
+// the number of queued events exceeds this multiple of batch size
+unsigned const MAX_PENDING_BATCHES = 64;
+
+// Instances which run batch forwarding thread, they have to be flushed
+// before Python interpreter is finalized
+std::mutex batchingMutex;
+std::set<PyLogAppender*> batchingAppenders;
+
+// Python callable for atexit
+PyObject* flushAllPy(PyObject*, PyObject*) {
+    PyLogAppender::flushAll();
+    Py_RETURN_NONE;
+}
+
+PyMethodDef flushAllDef = {"_flushPyLogAppenders", flushAllPy, METH_NOARGS, nullptr};
+
+// Register flushAll() with atexit, must be called with GIL held
+void registerAtExit() {
+    static bool registered = false;
+    if (registered) {
+        return;
+    }
+    registered = true;
+    lsst::log::detail::PyObjectPtr atexit(PyImport_ImportModule("atexit"));
+    lsst::log::detail::PyObjectPtr func(PyCFunction_New(&flushAllDef, nullptr));
+    lsst::log::detail::PyObjectPtr res;
+    if (atexit != nullptr and func != nullptr) {
+        res = lsst::log::detail::PyObjectPtr(PyObject_CallMethod(atexit, "register", "O", func.get()));
+    }
+    if (res == nullptr) {
+        ::reraise("Failed to register atexit handler");
+    }
+}
 
 }
 
@@ -95,71 +182,107 @@ PyLogAppender::PyLogAppender() {
     if (_mdc_class == nullptr) {
         ::reraise("AttributeError: lsst.log.MDCDict class does not exist");
     }
+
+    PyObjectPtr threading(PyImport_ImportModule("threading"));
+    if (threading == nullptr) {
+        ::reraise("ImportError: Failed to import Python threading module");
+    }
+    _threads = PyObject_GetAttrString(threading, "_active");
+    if (_threads == nullptr) {
+        ::reraise("AttributeError: threading._active does not exist");
+    }
 }
 
+PyLogAppender::~PyLogAppender() {
+    _stopBatching();
+}
+
+std::atomic<unsigned> PyLogAppender::_levelGeneration{1};
+
 void PyLogAppender::append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p) {
 
+    // Drop messages which Python is going to ignore without touching
+    // Python, this is where most of the DEBUG traffic ends.
+    std::string buffer;
+    if (_isRejected(::loggerName(event, buffer), event->getLevel()->toInt() / 1000)) {
+        return;
+    }
+
+    if (_batching.load(std::memory_order_acquire)) {
+        _enqueue(event);
+        return;
+    }
+
+    // Need Python at this point
+    GilGuard gil_guard;
+    _forward(event, p, 0);
+}
+
+void PyLogAppender::_forward(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p,
+                             unsigned long threadId) {
+
     // logger name, UTF-8 encoded
-    std::string logger_name;
-    log4cxx::helpers::Transcoder::encodeUTF8(event->getLoggerName(), logger_name);
+    std::string buffer;
+    std::string_view const logger_name = ::loggerName(event, buffer);
     int const level = event->getLevel()->toInt();
     int const pyLevel = level / 1000;
 
-    // Check logger name in cache first, this does not need GIL but needs
-    // synchronization
+    // Check logger name in cache first, this needs synchronization.
+    // Generation cannot change while we hold GIL.
+    unsigned const generation = _levelGeneration.load(std::memory_order_acquire);
     PyObjectPtr logger;
+    int threshold = 0;
+    bool valid = false;
     {
         std::lock_guard<std::mutex> lock(_cache_mutex);
         auto cache_iter = _cache.find(logger_name);
         if (cache_iter != _cache.end()) {
-            // use it, age is updated later
-            logger = cache_iter->second.logger;
+            // move to the front of LRU list
+            _lru.splice(_lru.begin(), _lru, cache_iter->second);
+            logger = cache_iter->second->logger;
+            threshold = cache_iter->second->threshold;
+            valid = cache_iter->second->generation == generation;
         }
     }
 
-    // Need Python at this point
-    GilGuard gil_guard;
-
-    if (logger == nullptr) {
+    bool const found = logger != nullptr;
+    if (not found) {
         // was not found in cache get one from Python
         if (logger_name == "root") {
-            logger = PyObject_CallFunction(_getLogger, nullptr);
+            logger = PyObjectPtr(PyObject_CallFunction(_getLogger, nullptr));
         } else {
-            logger = PyObject_CallFunction(_getLogger, "s", logger_name.c_str());
+            PyObjectPtr py_name(PyUnicode_FromStringAndSize(logger_name.data(), logger_name.size()));
+            if (py_name != nullptr) {
+                logger = PyObjectPtr(PyObject_CallFunctionObjArgs(_getLogger, py_name.get(), nullptr));
+            }
+        }
+        if (logger == nullptr) {
+            ::reraise("Failed to retrieve Python logger \"" + std::string(logger_name) + "\"");
         }
     }
-    if (logger == nullptr) {
-        ::reraise("Failed to retrieve Python logger \"" + logger_name + "\"");
-    } else {
-        // remember it in cache
+
+    // before doing anything check logging level, use cached value if it is
+    // still valid
+    if (not valid) {
+        threshold = _pyThreshold(logger, logger_name);
         std::lock_guard<std::mutex> lock(_cache_mutex);
-        _cache.emplace(logger_name, LRUEntry({logger, _lru_age ++}));
-        while (_cache.size() > ::MAX_LRU_CACHE_SIZE) {
-            // find oldest element and remove
-            auto iter = std::min_element(
-                _cache.begin(), _cache.end(),
-                [](const LRUCache::value_type& lhs, const LRUCache::value_type& rhs) {
-                    return lhs.second.age < rhs.second.age;
-                }
-            );
-            _cache.erase(iter);
-        }
-        // Age counter could potentially overflow (wrap to 0), reset age for
-        // all cache entries to avoid issues.
-        if (_lru_age == 0) {
-            for (auto& cache_value: _cache) {
-                // give them different but "random" ages
-                cache_value.second.age = _lru_age ++;
+        if (found) {
+            auto cache_iter = _cache.find(logger_name);
+            if (cache_iter != _cache.end()) {
+                cache_iter->second->threshold = threshold;
+                cache_iter->second->generation = generation;
+            }
+        } else {
+            // remember it in cache, key refers to the name in list element
+            _lru.push_front(LRUEntry{std::string(logger_name), logger, threshold, generation});
+            _cache.emplace(_lru.front().name, _lru.begin());
+            while (_lru.size() > _cacheSize) {
+                _cache.erase(_lru.back().name);
+                _lru.pop_back();
             }
         }
     }
-
-    // before doing anything check logging level
-    PyObjectPtr py_is_enabled(PyObject_CallMethod(logger, "isEnabledFor", "i", pyLevel));
-    if (py_is_enabled == nullptr) {
-        ::reraise("Failure when calling logger.isEnabledFor() method");
-    }
-    if (not PyObject_IsTrue(py_is_enabled)) {
+    if (pyLevel < threshold) {
         return;
     }
 
@@ -189,8 +312,12 @@ void PyLogAppender::append(const spi::LoggingEventPtr& event, log4cxx::helpers::
     //                            func=None, extra=None, sinfo=None)
     // I would like to pass MDC as an `extra` argument but that does not
     // work reliably in case we want to override record factory.
-    PyObjectPtr record(PyObject_CallMethod(logger, "makeRecord", "sisisOO",
-                                            logger_name.c_str(),
+    PyObjectPtr py_name(PyUnicode_FromStringAndSize(logger_name.data(), logger_name.size()));
+    if (py_name == nullptr) {
+        ::reraise("Failed to convert logger name");
+    }
+    PyObjectPtr record(PyObject_CallMethod(logger, "makeRecord", "OisisOO",
+                                            py_name.get(),
                                             pyLevel,
                                             file_name.c_str(),
                                             lineno,
@@ -201,6 +328,38 @@ void PyLogAppender::append(const spi::LoggingEventPtr& event, log4cxx::helpers::
         ::reraise("Failed to create LogRecord instance");
     }
 
+    if (threadId != 0) {
+        // Record was made in a forwarding thread, use time and thread of the
+        // original event instead.
+        double const created = event->getTimeStamp() / 1e6;
+        PyObjectPtr py_created(PyObject_GetAttrString(record, "created"));
+        PyObjectPtr py_relative(PyObject_GetAttrString(record, "relativeCreated"));
+        if (py_created == nullptr or py_relative == nullptr) {
+            ::reraise("Failed to get LogRecord time attributes");
+        }
+        double const relative = PyFloat_AsDouble(py_relative) -
+            (PyFloat_AsDouble(py_created) - created) * 1000;
+        PyObjectPtr py_thread(PyLong_FromUnsignedLong(threadId));
+        PyObjectPtr new_created(PyFloat_FromDouble(created));
+        PyObjectPtr new_msecs(PyFloat_FromDouble((created - std::floor(created)) * 1000));
+        PyObjectPtr new_relative(PyFloat_FromDouble(relative));
+        if (PyObject_SetAttrString(record, "created", new_created) == -1 or
+            PyObject_SetAttrString(record, "msecs", new_msecs) == -1 or
+            PyObject_SetAttrString(record, "relativeCreated", new_relative) == -1 or
+            PyObject_SetAttrString(record, "thread", py_thread) == -1) {
+            ::reraise("Failed to set LogRecord attributes");
+        }
+        // thread name is only known if thread is still running
+        if (PyObject* thread = PyDict_GetItem(_threads, py_thread)) {
+            PyObjectPtr name(PyObject_GetAttrString(thread, "name"));
+            if (name == nullptr) {
+                PyErr_Clear();
+            } else if (PyObject_SetAttrString(record, "threadName", name) == -1) {
+                ::reraise("Failed to set LogRecord threadName attribute");
+            }
+        }
+    }
+
     // Record should already have an `MDC` attribute added by a record factory,
     // and it may be pre-filled with some info by the same factory. Here we
     // assume that if it already exists then it is dict-like, if it does not
@@ -237,6 +396,29 @@ void PyLogAppender::append(const spi::LoggingEventPtr& event, log4cxx::helpers::
         }
     }
 
+    // Trace context as integers, same as in OpenTelemetry SpanContext,
+    // record.trace_id = (high << 64) | low; record.span_id = span
+    lsst::log::TraceContext const trace = lsst::log::detail::eventTraceContext(*event);
+    if (trace.valid()) {
+        PyObjectPtr high(PyLong_FromUnsignedLongLong(trace.traceIdHigh));
+        PyObjectPtr low(PyLong_FromUnsignedLongLong(trace.traceIdLow));
+        PyObjectPtr shift(PyLong_FromLong(64));
+        PyObjectPtr shifted;
+        PyObjectPtr trace_id;
+        if (high != nullptr and low != nullptr and shift != nullptr) {
+            shifted = PyObjectPtr(PyNumber_Lshift(high, shift));
+        }
+        if (shifted != nullptr) {
+            trace_id = PyObjectPtr(PyNumber_Or(shifted, low));
+        }
+        PyObjectPtr span_id(PyLong_FromUnsignedLongLong(trace.spanId));
+        if (trace_id == nullptr or span_id == nullptr or
+            PyObject_SetAttrString(record, "trace_id", trace_id) == -1 or
+            PyObject_SetAttrString(record, "span_id", span_id) == -1) {
+            ::reraise("Failed to set LogRecord trace attributes");
+        }
+    }
+
     // logger.handle(record)
     PyObjectPtr res(PyObject_CallMethod(logger, "handle", "O", record.get()));
     if (res == nullptr) {
@@ -244,7 +426,223 @@ void PyLogAppender::append(const spi::LoggingEventPtr& event, log4cxx::helpers::
     }
 }
 
+bool PyLogAppender::_isRejected(std::string_view logger_name, int pyLevel) {
+    unsigned const generation = _levelGeneration.load(std::memory_order_acquire);
+
+    // Most calls are answered by per-thread cache without locking, hits
+    // there do not update LRU order of the shared cache, which is fine as
+    // shared entries are only needed on a miss.
+    thread_local ::ThreadThresholds threadThresholds;
+    if (auto const* entry = threadThresholds.find(logger_name); entry and entry->generation == generation) {
+        return pyLevel < entry->threshold;
+    }
+
+    int threshold;
+    {
+        std::lock_guard<std::mutex> lock(_cache_mutex);
+        auto cache_iter = _cache.find(logger_name);
+        if (cache_iter == _cache.end()) {
+            return false;
+        }
+        LRUEntry const& entry = *cache_iter->second;
+        if (entry.generation != generation) {
+            return false;
+        }
+        _lru.splice(_lru.begin(), _lru, cache_iter->second);
+        threshold = entry.threshold;
+    }
+    threadThresholds.store(logger_name, threshold, generation);
+    return pyLevel < threshold;
+}
+
+int PyLogAppender::_pyThreshold(PyObject* logger, std::string_view logger_name) {
+
+    // Same logic as in logger.isEnabledFor(), except that `disabled`
+    // attribute is not cached, logger.handle() checks it anyway.
+    PyObjectPtr py_level(PyObject_CallMethod(logger, "getEffectiveLevel", nullptr));
+    if (py_level == nullptr) {
+        ::reraise("Failure when calling logger.getEffectiveLevel() method");
+    }
+    long threshold = PyLong_AsLong(py_level);
+    if (threshold == -1 and PyErr_Occurred()) {
+        ::reraise("Unexpected level returned by Python logger \"" + std::string(logger_name) + "\"");
+    }
+
+    // level of logging.disable() is in logger.manager.disable
+    PyObjectPtr manager(PyObject_GetAttrString(logger, "manager"));
+    PyObjectPtr py_disable;
+    if (manager != nullptr) {
+        py_disable = PyObjectPtr(PyObject_GetAttrString(manager, "disable"));
+    }
+    if (py_disable == nullptr) {
+        PyErr_Clear();
+    } else {
+        long const disable = PyLong_AsLong(py_disable);
+        if (disable == -1 and PyErr_Occurred()) {
+            PyErr_Clear();
+        } else {
+            threshold = std::max(threshold, disable + 1);
+        }
+    }
+    return static_cast<int>(std::min<long>(threshold, INT_MAX));
+}
+
+void PyLogAppender::invalidateLevels() {
+    _levelGeneration.fetch_add(1, std::memory_order_acq_rel);
+    // leave space for "unknown" value in case of wrap-around
+    unsigned expected = 0;
+    _levelGeneration.compare_exchange_strong(expected, 1, std::memory_order_acq_rel);
+}
+
+void PyLogAppender::_enqueue(const spi::LoggingEventPtr& event) {
+
+    // Capture per-thread context now, forwarding thread would see its own
+    // context otherwise.
+    LogString ndc;
+    event->getNDC(ndc);
+    event->getMDCCopy();
+    event->getThreadName();
+
+    auto node = new BatchNode{event, PyThread_get_thread_ident(), nullptr};
+    node->next = _head.load(std::memory_order_relaxed);
+    while (not _head.compare_exchange_weak(node->next, node, std::memory_order_seq_cst,
+                                           std::memory_order_relaxed)) {
+    }
+
+    std::size_t const pending = _pending.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (not _batching.load(std::memory_order_seq_cst)) {
+        // Batching was stopped after append() checked it. If the final
+        // drain in _stopBatching() already ran it did not see this event,
+        // forward it (and anything queued before it) now.
+        if (Py_IsInitialized()) {
+            GilGuard gil_guard;
+            Pool pool;
+            _drain(pool);
+        }
+    } else if (pending == _batchSize) {
+        std::lock_guard<std::mutex> lock(_batchMutex);
+        _batchCond.notify_one();
+    } else if (pending > _batchSize * ::MAX_PENDING_BATCHES) {
+        // Python does not keep up, forward everything from this thread to
+        // limit memory use, this also works if this thread holds GIL.
+        GilGuard gil_guard;
+        Pool pool;
+        _drain(pool);
+    }
+}
+
+void PyLogAppender::_drain(Pool& p) {
+
+    // This runs with GIL held which also serializes different threads
+    // draining the queue, so queue order is preserved.
+    BatchNode* head = _head.exchange(nullptr, std::memory_order_acquire);
+
+    // list is in reverse order
+    BatchNode* node = nullptr;
+    std::size_t count = 0;
+    while (head != nullptr) {
+        BatchNode* next = head->next;
+        head->next = node;
+        node = head;
+        head = next;
+        ++ count;
+    }
+    _pending.fetch_sub(count, std::memory_order_relaxed);
+
+    while (node != nullptr) {
+        std::unique_ptr<BatchNode> current(node);
+        node = node->next;
+        try {
+            _forward(current->event, p, current->threadId);
+        } catch (std::exception const& exc) {
+            // there is nobody to propagate exception to
+            LOG4CXX_DECODE_CHAR(msg, std::string("PyLogAppender: ") + exc.what());
+            LogLog::error(msg);
+        }
+    }
+}
+
+void PyLogAppender::_run() {
+    Pool pool;
+    std::unique_lock<std::mutex> lock(_batchMutex);
+    while (true) {
+        _batchCond.wait_for(lock, _maxLatency, [this]() {
+            return _stop or _pending.load(std::memory_order_relaxed) >= _batchSize;
+        });
+        bool const stop = _stop;
+        lock.unlock();
+        if (_head.load(std::memory_order_relaxed) != nullptr and Py_IsInitialized()) {
+            GilGuard gil_guard;
+            _drain(pool);
+        }
+        lock.lock();
+        if (stop) {
+            break;
+        }
+    }
+}
+
+void PyLogAppender::_stopBatching() {
+    if (not _thread.joinable()) {
+        return;
+    }
+
+    // New events go directly to Python from now on. Threads which saw the
+    // flag set still enqueue, they check it again after pushing and drain
+    // the queue themselves if they find it cleared; otherwise their event
+    // is seen by the final drain below.
+    _batching.store(false, std::memory_order_seq_cst);
+    {
+        std::lock_guard<std::mutex> lock(_batchMutex);
+        _stop = true;
+    }
+    _batchCond.notify_one();
+    {
+        // forwarding thread needs GIL to finish its work
+        GilRelease gil_release;
+        _thread.join();
+    }
+
+    // there may be stragglers which were queued after last drain
+    if (_head.load(std::memory_order_seq_cst) != nullptr and Py_IsInitialized()) {
+        GilGuard gil_guard;
+        Pool pool;
+        _drain(pool);
+    }
+
+    std::lock_guard<std::mutex> lock(::batchingMutex);
+    ::batchingAppenders.erase(this);
+}
+
+void PyLogAppender::flushAll() {
+    std::vector<PyLogAppender*> appenders;
+    {
+        std::lock_guard<std::mutex> lock(::batchingMutex);
+        appenders.assign(::batchingAppenders.begin(), ::batchingAppenders.end());
+    }
+    for (auto appender: appenders) {
+        appender->_stopBatching();
+    }
+}
+
 void PyLogAppender::close() {
+    _stopBatching();
+}
+
+void PyLogAppender::activateOptions(Pool& p) {
+    if (_batchSize <= 1 or _thread.joinable()) {
+        return;
+    }
+    {
+        GilGuard gil_guard;
+        ::registerAtExit();
+    }
+    {
+        std::lock_guard<std::mutex> lock(::batchingMutex);
+        ::batchingAppenders.insert(this);
+    }
+    _thread = std::thread(&PyLogAppender::_run, this);
+    _batching.store(true, std::memory_order_release);
 }
 
 bool PyLogAppender::requiresLayout() const {
@@ -256,6 +654,20 @@ void PyLogAppender::setOption(const LogString &option, const LogString &value) {
     if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("MESSAGEPATTERN"),
                                        LOG4CXX_STR("messagepattern"))) {
         setLayout(LayoutPtr(new PatternLayout(value)));
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("BATCHSIZE"),
+                                              LOG4CXX_STR("batchsize"))) {
+        int const size = OptionConverter::toInt(value, 0);
+        _batchSize = size > 0 ? size : 0;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("CACHESIZE"),
+                                              LOG4CXX_STR("cachesize"))) {
+        // new size is applied on next cache insertion
+        int const size = OptionConverter::toInt(value, DEFAULT_CACHE_SIZE);
+        std::lock_guard<std::mutex> lock(_cache_mutex);
+        _cacheSize = size > 0 ? size : 1;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("MAXLATENCY"),
+                                              LOG4CXX_STR("maxlatency"))) {
+        int const latency = OptionConverter::toInt(value, 100);
+        _maxLatency = std::chrono::milliseconds(latency > 0 ? latency : 1);
     } else {
         AppenderSkeleton::setOption(option, value);
     }
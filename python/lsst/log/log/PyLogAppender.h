@@ -27,10 +27,17 @@
 // Python header has to be first to avoid compilation warnings
 #include "Python.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
-#include <map>
+#include <list>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
 // Base class header
 #include "log4cxx/appenderskeleton.h"
@@ -54,6 +61,20 @@ using namespace log4cxx;
  *  log4j.appender.PyLog.layout = org.apache.log4j.PatternLayout
  *  log4j.appender.PyLog.layout.ConversionPattern = %m (%X{LABEL})
  *  \endcode
+ *
+ *  By default every event is forwarded to Python immediately, which needs
+ *  GIL for each message. With \c BatchSize option larger than one events
+ *  are instead queued without locking and a separate thread forwards them
+ *  to Python in batches, acquiring GIL once per batch. Batch is forwarded
+ *  when it reaches \c BatchSize events or when \c MaxLatency milliseconds
+ *  (100 by default) passed since previous batch:
+ *  \code
+ *  log4j.appender.PyLog.BatchSize = 256
+ *  log4j.appender.PyLog.MaxLatency = 50
+ *  \endcode
+ *
+ *  Python loggers are cached by name, \c CacheSize option sets the maximum
+ *  number of cached loggers (256 by default).
  */
 class PyLogAppender : public AppenderSkeleton {
 public:
@@ -67,6 +88,9 @@ public:
     // Make an instance
     PyLogAppender();
 
+    // Stops batch forwarding thread
+    ~PyLogAppender();
+
     // we do not support copying
     PyLogAppender(const PyLogAppender&) = delete;
     PyLogAppender& operator=(const PyLogAppender&) = delete;
@@ -77,10 +101,16 @@ public:
     void append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p) override;
 
     /**
-     * Close this appender instance, this is no-op.
+     * Close this appender instance, forwards all queued events in batching
+     * mode.
      */
     void close() override;
 
+    /**
+     * Start batch forwarding thread if batching is enabled.
+     */
+    void activateOptions(log4cxx::helpers::Pool& p) override;
+
     /**
      * Returns true if appender "requires" layout to be defined for it.
      *
@@ -93,21 +123,89 @@ public:
      */
     void setOption(const LogString &option, const LogString &value) override;
 
+    /**
+     * Forward queued events of all instances and stop batching, called when
+     * Python interpreter exits. Has to be called with GIL held.
+     */
+    static void flushAll();
+
+    /**
+     * Invalidate cached effective levels of Python loggers in all instances.
+     *
+     * Has to be called whenever level configuration of Python logging
+     * changes, lsst.log does it from a hook on logging.Manager._clear_cache.
+     */
+    static void invalidateLevels();
+
 private:
 
+    // queued event for batching mode
+    struct BatchNode {
+        spi::LoggingEventPtr event;
+        unsigned long threadId;  // Python thread identifier
+        BatchNode* next;
+    };
+
+    // Forward one event to Python, GIL has to be held. Non-zero threadId
+    // overrides thread and time attributes of the record.
+    void _forward(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p,
+                  unsigned long threadId);
+
+    // Add event to the queue in batching mode, drains the queue if
+    // batching was stopped meanwhile
+    void _enqueue(const spi::LoggingEventPtr& event);
+
+    // Forward all queued events, GIL has to be held
+    void _drain(log4cxx::helpers::Pool& p);
+
+    // Batch forwarding thread body
+    void _run();
+
+    // Stop batch forwarding thread, forwarding everything queued
+    void _stopBatching();
+
+    // Return true if cached level of Python logger says that message of
+    // this level will be discarded; does not need GIL, and only locks the
+    // cache when logger is not in per-thread cache
+    bool _isRejected(std::string_view logger_name, int pyLevel);
+
+    // Return lowest level accepted by a Python logger, GIL has to be held
+    static int _pyThreshold(PyObject* logger, std::string_view logger_name);
+
     // cache entry type
     struct LRUEntry {
+        std::string name;  // logger name, UTF-8
         PyObjectPtr logger;
-        uint32_t age = 0;
+        int threshold = 0;  // lowest Python level enabled for logger
+        unsigned generation = 0;  // value of _levelGeneration for threshold
     };
 
-    using LRUCache = std::map<std::string, LRUEntry>;
+    // Entries are kept in a list in the order of use, most recent first,
+    // hash map keys refer to names stored in list elements.
+    using LRUList = std::list<LRUEntry>;
+    using LRUCache = std::unordered_map<std::string_view, LRUList::iterator>;
+
+    static constexpr std::size_t DEFAULT_CACHE_SIZE = 256;
 
     PyObjectPtr _getLogger;  // logging.getLogger() method
     PyObjectPtr _mdc_class;  // lsst.log.MDCDict class
+    PyObjectPtr _threads;  // threading._active dictionary
     std::mutex _cache_mutex;
-    uint32_t _lru_age = 0;
-    LRUCache _cache;  // LRU cache for loggers
+    std::size_t _cacheSize = DEFAULT_CACHE_SIZE;  // maximum number of cached loggers
+    LRUList _lru;  // LRU list of cached loggers
+    LRUCache _cache;  // index of _lru by logger name
+    static std::atomic<unsigned> _levelGeneration;  // zero is never used
+
+    // batching mode
+    std::size_t _batchSize = 0;
+    std::chrono::milliseconds _maxLatency{100};
+    std::atomic<BatchNode*> _head{nullptr};  // queued events, newest first
+    std::atomic<std::size_t> _pending{0};
+    std::atomic<bool> _batching{false};
+    bool _stop = false;  // protected by _batchMutex
+    std::mutex _batchMutex;
+    std::condition_variable _batchCond;
+    std::thread _thread;
 };
 
 } // namespace lsst::log::detail
@@ -0,0 +1,403 @@
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "./PyStreamAppender.h"
+#include "./PyGil.h"
+#include "lsst/log/Log.h"
+#include "log4cxx/consoleappender.h"
+#include "log4cxx/logmanager.h"
+#include "log4cxx/helpers/loglog.h"
+#include "log4cxx/helpers/optionconverter.h"
+#include "log4cxx/helpers/stringhelper.h"
+#include "log4cxx/helpers/transcoder.h"
+
+// macro below dows not work without this using directive
+// (and it breaks if placed inside namespaces)
+using lsst::log::detail::PyStreamAppender;
+IMPLEMENT_LOG4CXX_OBJECT(PyStreamAppender)
+
+using namespace log4cxx::helpers;
+
+namespace {
+
+// Logging threads wait when this many buffers are not written yet
+std::size_t const MAX_PENDING_BUFFERS = 16;
+
+// Instances which run writing thread, they have to be flushed before
+// Python interpreter is finalized
+std::mutex instancesMutex;
+std::set<PyStreamAppender*> instances;
+
+// Python callable for atexit
+PyObject* flushAllPy(PyObject*, PyObject*) {
+    PyStreamAppender::flushAll();
+    Py_RETURN_NONE;
+}
+
+PyMethodDef flushAllDef = {"_flushPyStreamAppenders", flushAllPy, METH_NOARGS, nullptr};
+
+// Register flushAll() with atexit, must be called with GIL held
+void registerAtExit() {
+    static bool registered = false;
+    if (registered) {
+        return;
+    }
+    registered = true;
+    lsst::log::detail::PyObjectPtr atexit(PyImport_ImportModule("atexit"));
+    lsst::log::detail::PyObjectPtr func(PyCFunction_New(&flushAllDef, nullptr));
+    lsst::log::detail::PyObjectPtr res;
+    if (atexit != nullptr and func != nullptr) {
+        res = lsst::log::detail::PyObjectPtr(PyObject_CallMethod(atexit, "register", "O", func.get()));
+    }
+    if (res == nullptr) {
+        PyErr_Clear();
+        LogLog::error(LOG4CXX_STR("PyStreamAppender: failed to register atexit handler"));
+    }
+}
+
+// Console appender replaced by capture()
+struct Captured {
+    log4cxx::LoggerPtr logger;
+    log4cxx::AppenderPtr console;
+    log4cxx::AppenderPtr replacement;
+};
+
+// protected by GIL
+std::vector<Captured> captured;
+
+// Stream of active capture (owned reference) or null, protected by GIL
+PyObject* captureStream = nullptr;
+
+/*
+ * Replace console appenders writing to standard output which are currently
+ * attached to loggers, must be called with GIL held.
+ */
+void captureConsoles(PyObject* stream) {
+    auto loggers = log4cxx::LogManager::getCurrentLoggers();
+    loggers.push_back(log4cxx::Logger::getRootLogger());
+
+    // one replacement for each console appender, they can be shared
+    std::map<log4cxx::AppenderPtr, log4cxx::AppenderPtr> replacements;
+    std::vector<Captured> items;
+    for (auto const& logger: loggers) {
+        for (auto const& appender: logger->getAllAppenders()) {
+            auto console = std::dynamic_pointer_cast<log4cxx::ConsoleAppender>(appender);
+            if (not console or console->getTarget() != log4cxx::ConsoleAppender::getSystemOut()) {
+                continue;
+            }
+            auto& replacement = replacements[appender];
+            if (not replacement) {
+                auto streamAppender = std::make_shared<PyStreamAppender>();
+                streamAppender->setName(console->getName());
+                streamAppender->setLayout(console->getLayout());
+                streamAppender->setThreshold(console->getThreshold());
+                if (auto filter = console->getFilter()) {
+                    streamAppender->addFilter(filter);
+                }
+                streamAppender->setStream(stream);
+                Pool pool;
+                streamAppender->activateOptions(pool);
+                replacement = streamAppender;
+            }
+            items.push_back(Captured{logger, appender, replacement});
+        }
+    }
+
+    // new appender is attached before old one is removed so that nothing
+    // is lost, message logged in between may be duplicated
+    for (auto const& item: items) {
+        item.logger->addAppender(item.replacement);
+        item.logger->removeAppender(item.console);
+        ::captured.push_back(item);
+    }
+}
+
+/*
+ * Called after each re-configuration while capture is active. Entries
+ * whose replacement was removed by new configuration are dropped (their
+ * console appenders are closed or detached too), console appenders made
+ * by new configuration are replaced.
+ */
+void recapture() {
+    if (not Py_IsInitialized()) {
+        return;
+    }
+    lsst::log::detail::GilGuard gil_guard;
+    if (::captureStream == nullptr) {
+        return;
+    }
+    ::captured.erase(std::remove_if(::captured.begin(), ::captured.end(),
+                                    [](Captured const& item) {
+                                        return not item.logger->isAttached(item.replacement);
+                                    }),
+                     ::captured.end());
+    ::captureConsoles(::captureStream);
+}
+
+} // namespace
+
+namespace lsst::log::detail {
+
+PyStreamAppender::PyStreamAppender() = default;
+
+PyStreamAppender::~PyStreamAppender() {
+    _stop();
+    if (_stream != nullptr) {
+        if (Py_IsInitialized()) {
+            GilGuard gil_guard;
+            _stream = PyObjectPtr();
+        } else {
+            // too late to touch Python object
+            _stream.release();
+        }
+    }
+}
+
+void PyStreamAppender::doAppend(const spi::LoggingEventPtr& event, Pool& pool) {
+    // AppenderSkeleton::doAppend holds a mutex while calling append(),
+    // a thread waiting in append() for the writing thread would block
+    // all other threads, including those holding GIL which writing thread
+    // needs. Layout is protected by a separate mutex instead.
+    doAppendImpl(event, pool);
+}
+
+void PyStreamAppender::append(const spi::LoggingEventPtr& event, Pool& p) {
+
+    std::string message;
+    {
+        std::lock_guard<std::mutex> lock(_formatMutex);
+        LayoutPtr const layout = getLayout();
+        if (not layout) {
+            return;
+        }
+        if constexpr (std::is_same_v<LogString, std::string>) {
+            layout->format(message, event, p);
+        } else {
+            LogString msg;
+            layout->format(msg, event, p);
+            Transcoder::encodeUTF8(msg, message);
+        }
+    }
+
+    std::size_t const limit = _bufferSize * ::MAX_PENDING_BUFFERS;
+    bool full = false;
+    {
+        std::lock_guard<std::mutex> lock(_bufferMutex);
+        if (_running) {
+            full = _buffer.size() >= limit;
+            if (not full) {
+                _buffer += message;
+                if (_buffer.size() >= _bufferSize) {
+                    _cond.notify_all();
+                }
+                return;
+            }
+        }
+    }
+    if (full) {
+        // Python does not keep up, wait until writing thread makes room,
+        // it needs GIL which this thread may hold
+        GilRelease gil_release;
+        std::unique_lock<std::mutex> lock(_bufferMutex);
+        _cond.wait(lock, [this, limit]() { return not _running or _buffer.size() < limit; });
+        if (_running) {
+            _buffer += message;
+            return;
+        }
+    }
+
+    // no writing thread, write it now
+    if (Py_IsInitialized()) {
+        GilGuard gil_guard;
+        _write(message);
+    }
+}
+
+void PyStreamAppender::_write(std::string const& data) {
+    PyObject* stream = _stream != nullptr ? static_cast<PyObject*>(_stream) : PySys_GetObject(_target.c_str());
+    if (stream == nullptr or stream == Py_None) {
+        return;
+    }
+    PyObjectPtr text(PyUnicode_DecodeUTF8(data.data(), data.size(), "replace"));
+    PyObjectPtr res;
+    if (text != nullptr) {
+        res = PyObjectPtr(PyObject_CallMethod(stream, "write", "O", text.get()));
+    }
+    if (res == nullptr) {
+        // there is nobody to propagate exception to
+        PyErr_WriteUnraisable(stream);
+    }
+}
+
+void PyStreamAppender::_run() {
+    std::string data;
+    std::unique_lock<std::mutex> lock(_bufferMutex);
+    while (_running or not _buffer.empty()) {
+        _cond.wait_for(lock, _maxLatency, [this]() {
+            return not _running or _buffer.size() >= _bufferSize;
+        });
+        if (_buffer.empty()) {
+            continue;
+        }
+        data.clear();
+        data.swap(_buffer);
+        lock.unlock();
+        // wake up threads waiting for space
+        _cond.notify_all();
+        if (Py_IsInitialized()) {
+            GilGuard gil_guard;
+            _write(data);
+        }
+        lock.lock();
+    }
+}
+
+void PyStreamAppender::_stop() {
+    {
+        std::lock_guard<std::mutex> lock(_bufferMutex);
+        _running = false;
+    }
+    _cond.notify_all();
+    if (_thread.joinable()) {
+        // writing thread needs GIL to finish its work
+        GilRelease gil_release;
+        _thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(::instancesMutex);
+    ::instances.erase(this);
+}
+
+void PyStreamAppender::flushAll() {
+    std::vector<PyStreamAppender*> appenders;
+    {
+        std::lock_guard<std::mutex> lock(::instancesMutex);
+        appenders.assign(::instances.begin(), ::instances.end());
+    }
+    for (auto appender: appenders) {
+        appender->_stop();
+    }
+}
+
+void PyStreamAppender::close() {
+    _stop();
+    if (Py_IsInitialized()) {
+        GilGuard gil_guard;
+        PyObject* stream = _stream != nullptr ? static_cast<PyObject*>(_stream) : PySys_GetObject(_target.c_str());
+        if (stream != nullptr and stream != Py_None and PyObject_HasAttrString(stream, "flush")) {
+            PyObjectPtr res(PyObject_CallMethod(stream, "flush", nullptr));
+            if (res == nullptr) {
+                PyErr_WriteUnraisable(stream);
+            }
+        }
+    }
+}
+
+void PyStreamAppender::activateOptions(Pool& p) {
+    if (_thread.joinable() or not Py_IsInitialized()) {
+        return;
+    }
+    {
+        GilGuard gil_guard;
+        ::registerAtExit();
+    }
+    {
+        std::lock_guard<std::mutex> lock(::instancesMutex);
+        ::instances.insert(this);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_bufferMutex);
+        _running = true;
+    }
+    _thread = std::thread(&PyStreamAppender::_run, this);
+}
+
+bool PyStreamAppender::requiresLayout() const {
+    return true;
+}
+
+void PyStreamAppender::setOption(const LogString &option, const LogString &value) {
+
+    if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("TARGET"), LOG4CXX_STR("target"))) {
+        LOG4CXX_ENCODE_CHAR(target, value);
+        _target = target;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("BUFFERSIZE"),
+                                              LOG4CXX_STR("buffersize"))) {
+        long const size = OptionConverter::toFileSize(value, DEFAULT_BUFFER_SIZE);
+        _bufferSize = size > 0 ? size : 1;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("MAXLATENCY"),
+                                              LOG4CXX_STR("maxlatency"))) {
+        int const latency = OptionConverter::toInt(value, 100);
+        _maxLatency = std::chrono::milliseconds(latency > 0 ? latency : 1);
+    } else {
+        AppenderSkeleton::setOption(option, value);
+    }
+}
+
+void PyStreamAppender::setStream(PyObject* stream) {
+    _stream = stream;
+}
+
+void PyStreamAppender::capture(PyObject* stream) {
+    release();
+
+    Py_INCREF(stream);
+    ::captureStream = stream;
+    ::captureConsoles(stream);
+
+    // configure() and reconfigure() replace appenders, capture new ones
+    setConfigureHook(::recapture);
+}
+
+void PyStreamAppender::release() {
+    setConfigureHook(std::function<void()>());
+    Py_CLEAR(::captureStream);
+
+    std::vector<Captured> items;
+    items.swap(::captured);
+    std::set<log4cxx::AppenderPtr> replacements;
+    for (auto const& item: items) {
+        // skip loggers which were re-configured since capture, their
+        // original appenders may be closed already
+        if (item.logger->isAttached(item.replacement)) {
+            item.logger->addAppender(item.console);
+            item.logger->removeAppender(item.replacement);
+        }
+        replacements.insert(item.replacement);
+    }
+    for (auto const& replacement: replacements) {
+        replacement->close();
+    }
+}
+
+} // namespace lsst::log::detail
@@ -0,0 +1,178 @@
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LSST_LOG_PYSTREAMAPPENDER_H
+#define LSST_LOG_PYSTREAMAPPENDER_H
+
+// Python header has to be first to avoid compilation warnings
+#include "Python.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Base class header
+#include "log4cxx/appenderskeleton.h"
+
+#include "log4cxx/helpers/object.h"
+#include "PyObjectPtr.h"
+
+namespace lsst::log::detail {
+
+// This needs to be here for all LOG4CXX macros to work
+using namespace log4cxx;
+
+/**
+ *  This class defines log4cxx appender which writes formatted messages to
+ *  a Python text stream, e.g. to \c sys.stdout in a Jupyter notebook.
+ *
+ *  Messages are formatted by the layout and collected in a buffer in the
+ *  calling thread, without GIL. A separate thread writes the buffer to the
+ *  stream acquiring GIL once per batch, when buffer reaches \c BufferSize
+ *  bytes (64 KiB by default) or \c MaxLatency milliseconds (100 by default)
+ *  passed since previous write. If Python does not keep up, logging thread
+ *  writes the buffer itself.
+ *
+ *  Stream is set with setStream(). When appender is configured from a file,
+ *  \c Target option names an attribute of \c sys module which is looked up
+ *  for each batch, \c stderr by default:
+ *  \code
+ *  log4j.appender.PyStream = PyStreamAppender
+ *  log4j.appender.PyStream.Target = stdout
+ *  log4j.appender.PyStream.layout = org.apache.log4j.PatternLayout
+ *  log4j.appender.PyStream.layout.ConversionPattern = %c %p: %m%n
+ *  \endcode
+ *
+ *  lsst.log.utils.enable_notebook_logging() uses capture() to replace all
+ *  console appenders writing to standard output with instances of this
+ *  class.
+ */
+class PyStreamAppender : public AppenderSkeleton {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(PyStreamAppender)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(PyStreamAppender)
+            LOG4CXX_CAST_ENTRY_CHAIN(AppenderSkeleton)
+    END_LOG4CXX_CAST_MAP()
+
+    // Make an instance
+    PyStreamAppender();
+
+    // Stops writing thread
+    ~PyStreamAppender();
+
+    // we do not support copying
+    PyStreamAppender(const PyStreamAppender&) = delete;
+    PyStreamAppender& operator=(const PyStreamAppender&) = delete;
+
+    /**
+     * Same as AppenderSkeleton::doAppend() but without locking.
+     */
+    void doAppend(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& pool) override;
+
+    /**
+     * Format the event and add it to the buffer.
+     */
+    void append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Close this appender instance, writes everything buffered.
+     */
+    void close() override;
+
+    /**
+     * Start writing thread.
+     */
+    void activateOptions(log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Returns true if appender "requires" layout to be defined for it.
+     */
+    bool requiresLayout() const override;
+
+    /**
+     * Handle configuration options.
+     */
+    void setOption(const LogString &option, const LogString &value) override;
+
+    /**
+     * Set Python stream, has to be called with GIL held. Stream has to
+     * have a \c write() method accepting a string.
+     */
+    void setStream(PyObject* stream);
+
+    /**
+     * Replace all console appenders writing to standard output with
+     * instances of this class writing to a given stream, using the same
+     * layouts. Capture stays active until release(), console appenders
+     * created by later Log::configure() or Log::reconfigure() are replaced
+     * too. Has to be called with GIL held.
+     */
+    static void capture(PyObject* stream);
+
+    /**
+     * Undo capture(), write everything buffered and restore console
+     * appenders. Has to be called with GIL held.
+     */
+    static void release();
+
+    /**
+     * Write buffered messages of all instances and stop their threads,
+     * called when Python interpreter exits. Has to be called with GIL held.
+     */
+    static void flushAll();
+
+private:
+
+    // Write buffer contents to stream, GIL has to be held
+    void _write(std::string const& data);
+
+    // Writing thread body
+    void _run();
+
+    // Stop writing thread and write everything buffered
+    void _stop();
+
+    static constexpr std::size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+    PyObjectPtr _stream;  // explicit stream, protected by GIL
+    std::string _target = "stderr";  // name of attribute in sys module
+    std::size_t _bufferSize = DEFAULT_BUFFER_SIZE;
+    std::chrono::milliseconds _maxLatency{100};
+
+    std::mutex _formatMutex;  // layouts are not thread-safe
+    std::mutex _bufferMutex;
+    std::condition_variable _cond;
+    std::string _buffer;  // protected by _bufferMutex
+    bool _running = false;  // writing thread is active, protected by _bufferMutex
+    std::thread _thread;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_PYSTREAMAPPENDER_H
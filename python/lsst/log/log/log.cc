@@ -22,10 +22,179 @@
 
 #include "pybind11/pybind11.h"
 
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "frameobject.h"
+
 #include "lsst/log/Log.h"
+#include "./PyLogAppender.h"
+#include "./PyStreamAppender.h"
 
 namespace py = pybind11;
 
+namespace {
+
+// Maximum number of code objects in location cache
+std::size_t const MAX_CODE_CACHE_SIZE = 4096;
+
+// Return pointer to a copy of the string which is never freed. LocationInfo
+// does not copy strings, they have to live as long as any logging event.
+// Needs GIL.
+char const* internString(std::string_view str) {
+    // keys refer to strings owned by values
+    static auto strings = new std::unordered_map<std::string_view, std::unique_ptr<std::string>>();
+    auto iter = strings->find(str);
+    if (iter == strings->end()) {
+        auto copy = std::make_unique<std::string>(str);
+        iter = strings->emplace(*copy, std::move(copy)).first;
+    }
+    return iter->second->c_str();
+}
+
+// Location of Python code, pointers refer to interned strings.
+struct CodeLocation {
+    py::object code;  // reference keeps code object address unique
+    char const* fileName;  // file base name
+    char const* funcName;
+    py::object pyFileName;
+    py::object pyFuncName;
+    py::object pyPathName;  // full file name
+};
+
+// Cache of code object locations, all methods need GIL.
+class CodeLocationCache {
+public:
+
+    CodeLocation const& get(py::handle code) {
+        auto iter = _cache.find(code.ptr());
+        if (iter != _cache.end()) {
+            return iter->second;
+        }
+        if (_cache.size() >= MAX_CODE_CACHE_SIZE) {
+            // code objects can be created dynamically, do not keep them
+            // forever; interned strings stay
+            _cache.clear();
+        }
+
+        py::str pathName = code.attr("co_filename");
+        py::str funcName = code.attr("co_name");
+        std::string_view const path = utf8(pathName);
+        std::string_view fileName = path;
+        auto const pos = path.rfind('/');
+        if (pos != std::string_view::npos) {
+            fileName.remove_prefix(pos + 1);
+        }
+        CodeLocation location{py::reinterpret_borrow<py::object>(code),
+                              internString(fileName),
+                              internString(utf8(funcName)),
+                              py::str(fileName.data(), fileName.size()),
+                              funcName,
+                              pathName};
+        return _cache.emplace(code.ptr(), std::move(location)).first->second;
+    }
+
+    // Return UTF-8 representation of a Python string, it is owned by string
+    static std::string_view utf8(py::handle str) {
+        Py_ssize_t size = 0;
+        char const* data = PyUnicode_AsUTF8AndSize(str.ptr(), &size);
+        if (data == nullptr) {
+            throw py::error_already_set();
+        }
+        return std::string_view(data, size);
+    }
+
+private:
+
+    std::unordered_map<PyObject*, CodeLocation> _cache;
+};
+
+// Instance is never destroyed, it holds Python objects and may outlive
+// Python interpreter.
+CodeLocationCache& codeLocationCache() {
+    static auto cache = new CodeLocationCache();
+    return *cache;
+}
+
+// Logger used by LogHandler for a given Python logger name, threshold of
+// the logger is cached by Log itself. Needs GIL. Python never forgets its
+// loggers so the size of this cache is not limited.
+lsst::log::Log const& handlerLogger(std::string_view name) {
+    struct Entry {
+        std::string name;
+        lsst::log::detail::LogCallSite site;
+    };
+    static auto cache = new std::unordered_map<std::string_view, std::unique_ptr<Entry>>();
+    auto iter = cache->find(name);
+    if (iter == cache->end()) {
+        auto entry = std::make_unique<Entry>();
+        entry->name = name;
+        iter = cache->emplace(entry->name, std::move(entry)).first;
+    }
+    Entry& entry = *iter->second;
+    return entry.site.getNamed(entry.name.c_str());
+}
+
+// Format message as `fmt % args` or `fmt.format(*args, **kwargs)`.
+py::str formatMessage(py::object const& fmt, bool use_format, py::args const& args,
+                      py::kwargs const& kwargs) {
+    py::object msg = fmt;
+    if (use_format) {
+        if (args.size() > 0 or kwargs.size() > 0) {
+            msg = fmt.attr("format")(*args, **kwargs);
+        }
+    } else if (args.size() > 0) {
+        msg = py::reinterpret_steal<py::object>(PyNumber_Remainder(fmt.ptr(), args.ptr()));
+        if (not msg) {
+            throw py::error_already_set();
+        }
+    }
+    return py::str(msg);
+}
+
+/*
+ *  Python-side implementation of logging methods. Location of the message
+ *  is taken from the frame `depth` levels above the innermost Python frame
+ *  (which is the caller of this native method). Message is passed to
+ *  log4cxx directly from UTF-8 buffer of the Python string.
+ */
+void logFromPython(py::object const& self, int level, int depth, bool use_format,
+                   py::object const& fmt, py::args const& args, py::kwargs const& kwargs) {
+    auto const& log = self.cast<lsst::log::Log const&>();
+    if (not log.isEnabledFor(level)) {
+        return;
+    }
+
+    auto frame = py::reinterpret_borrow<py::object>(reinterpret_cast<PyObject*>(PyEval_GetFrame()));
+    for (int i = 0; i < depth and frame; ++i) {
+        frame = py::reinterpret_steal<py::object>(
+            reinterpret_cast<PyObject*>(PyFrame_GetBack(reinterpret_cast<PyFrameObject*>(frame.ptr()))));
+    }
+    if (not frame) {
+        throw std::runtime_error("Cannot determine location of logging call");
+    }
+    auto* const frameObj = reinterpret_cast<PyFrameObject*>(frame.ptr());
+    auto code = py::reinterpret_steal<py::object>(reinterpret_cast<PyObject*>(PyFrame_GetCode(frameObj)));
+    CodeLocation const& location = codeLocationCache().get(code);
+    int const lineno = PyFrame_GetLineNumber(frameObj);
+
+    py::str msg = formatMessage(fmt, use_format, args, kwargs);
+
+    if (self.attr("UsePythonLogging").cast<bool>()) {
+        self.attr("_logToPython")(level, msg, location.pyFileName, location.pyFuncName,
+                                  location.pyPathName, lineno);
+        return;
+    }
+
+    log.logMsg(log4cxx::Level::toLevel(level),
+               log4cxx::spi::LocationInfo(location.fileName, location.fileName, location.funcName, lineno),
+               CodeLocationCache::utf8(msg));
+}
+
+}  // namespace
+
 namespace lsst {
 namespace log {
 
@@ -54,6 +223,13 @@ private:
 PYBIND11_MODULE(log, mod) {
     py::class_<Log> cls(mod, "Log");
 
+    // Called by Python code when levels of Python loggers change
+    mod.def("_invalidatePyLevelCache", detail::PyLogAppender::invalidateLevels);
+
+    // Used by lsst.log.utils.enable_notebook_logging()
+    mod.def("_captureToStream", [](py::object stream) { detail::PyStreamAppender::capture(stream.ptr()); });
+    mod.def("_releaseCapture", detail::PyStreamAppender::release);
+
     /* Constructors */
     cls.def(py::init<>());
 
@@ -73,30 +249,133 @@ PYBIND11_MODULE(log, mod) {
     cls.def("isWarnEnabled", &Log::isWarnEnabled);
     cls.def("getName", &Log::getName);
     cls.def("setLevel", &Log::setLevel);
+    cls.def_static("setLevels", [](py::iterable rules) {
+        std::vector<LogLevelRule> levelRules;
+        for (auto item: rules) {
+            auto rule = item.cast<std::pair<std::string, int>>();
+            levelRules.push_back(LogLevelRule{std::move(rule.first), rule.second});
+        }
+        py::list saved;
+        for (auto const& rule: Log::setLevels(levelRules)) {
+            saved.append(py::make_tuple(rule.pattern, rule.level));
+        }
+        return saved;
+    });
     cls.def("getLevel", &Log::getLevel);
     cls.def("getEffectiveLevel", &Log::getEffectiveLevel);
     cls.def("isEnabledFor", &Log::isEnabledFor);
     cls.def("getChild", &Log::getChild);
-    cls.def("logMsg", [](Log &log, int level, std::string const &filename, std::string const &funcname,
-                         unsigned int lineno, std::string const &msg) {
+    cls.def("logMsg", [](Log &log, int level, std::string_view filename, std::string_view funcname,
+                         unsigned int lineno, std::string_view msg) {
+        // location can be used after the call returns (async appenders,
+        // flight recorder), strings have to outlive the arguments
+        char const* const fileName = internString(filename);
+        char const* const funcName = internString(funcname);
         log.logMsg(log4cxx::Level::toLevel(level),
-                   log4cxx::spi::LocationInfo(filename.c_str(), log4cxx::spi::LocationInfo::calcShortFileName(filename.c_str()), funcname.c_str(), lineno),
+                   log4cxx::spi::LocationInfo(fileName, log4cxx::spi::LocationInfo::calcShortFileName(fileName), funcName, lineno),
                    msg);
     });
     cls.def("lwpID", [](Log const& log) -> unsigned { return lsst::log::lwpID(); });
 
+    // `_log` is called by Python wrappers, caller location is one level up
+    cls.def("_log", [](py::object self, int level, bool use_format, py::object fmt, py::args args,
+                       py::kwargs kwargs) {
+        logFromPython(self, level, 1, use_format, fmt, args, kwargs);
+    });
+    auto const addLogMethod = [&cls](char const* name, int level) {
+        cls.def(name, [level](py::object self, py::object fmt, py::args args) {
+            logFromPython(self, level, 0, false, fmt, args, py::kwargs());
+        });
+    };
+    addLogMethod("trace", LOG_LVL_TRACE);
+    addLogMethod("debug", LOG_LVL_DEBUG);
+    addLogMethod("info", LOG_LVL_INFO);
+    addLogMethod("warn", LOG_LVL_WARN);
+    addLogMethod("warning", LOG_LVL_WARN);
+    addLogMethod("error", LOG_LVL_ERROR);
+    addLogMethod("fatal", LOG_LVL_FATAL);
+    addLogMethod("critical", LOG_LVL_FATAL);
+
+    // Fast path for LogHandler, level is Python logging level
+    cls.def_static("_isEnabledForRecord", [](std::string_view name, int levelno) {
+        return handlerLogger(name).isEnabledFor(levelno * 1000);
+    });
+    cls.def_static("_emitRecord", [](std::string_view name, int levelno, std::string_view filename,
+                                     py::object funcName, int lineno, std::string_view msg) {
+        char const* const fileName = internString(filename);
+        char const* const funcNameStr = funcName.is_none() ?
+            log4cxx::spi::LocationInfo::NA_METHOD : internString(CodeLocationCache::utf8(py::str(funcName)));
+        handlerLogger(name).logMsg(log4cxx::Level::toLevel(levelno * 1000),
+                                   log4cxx::spi::LocationInfo(fileName, fileName, funcNameStr, lineno),
+                                   msg);
+    });
+
     cls.def_static("getDefaultLogger", Log::getDefaultLogger);
     cls.def_static("configure", (void (*)())Log::configure);
     cls.def_static("configure", (void (*)(std::string const&))Log::configure);
     cls.def_static("configure_prop", Log::configure_prop);
+    // watcher thread may need GIL while it holds configuration lock
+    cls.def_static("reconfigure", Log::reconfigure, py::call_guard<py::gil_scoped_release>());
+    cls.def_static("reconfigure_prop", Log::reconfigure_prop, py::call_guard<py::gil_scoped_release>());
+    cls.def_static("watchConfig", Log::watchConfig, py::arg("filename") = std::string(),
+                   py::arg("interval") = 1.0, py::call_guard<py::gil_scoped_release>());
+    cls.def_static("unwatchConfig", Log::unwatchConfig, py::call_guard<py::gil_scoped_release>());
     cls.def_static("getLogger", (Log(*)(Log const&))Log::getLogger);
     cls.def_static("getLogger", (Log(*)(std::string const&))Log::getLogger);
-    cls.def_static("MDC", Log::MDC);
-    cls.def_static("MDCRemove", Log::MDCRemove);
+    cls.def_static("MDC", (std::string(*)(std::string const&, std::string const&))Log::MDC);
+    cls.def_static("MDCRemove", (void(*)(std::string const&))Log::MDCRemove);
     cls.def_static("MDCRegisterInit", [](py::function func) {
         auto handle = func.release();  // will leak as described in callable_wrapper
         Log::MDCRegisterInit(std::function<void()>(callable_wrapper(handle.ptr())));
     });
+    cls.def_static("setStatisticsEnabled", Log::setStatisticsEnabled);
+    cls.def_static("isStatisticsEnabled", Log::isStatisticsEnabled);
+    cls.def_static("resetStatistics", Log::resetStatistics);
+    cls.def_static("enableFlightRecorder", Log::enableFlightRecorder, py::arg("filename"),
+                   py::arg("level") = static_cast<int>(log4cxx::Level::TRACE_INT),
+                   py::arg("dumpLevel") = static_cast<int>(log4cxx::Level::WARN_INT),
+                   py::arg("capacity") = 1024);
+    cls.def_static("disableFlightRecorder", Log::disableFlightRecorder);
+    cls.def_static("isFlightRecorderEnabled", Log::isFlightRecorderEnabled);
+    cls.def_static("dumpFlightRecorder", Log::dumpFlightRecorder);
+    cls.def_static("dumpFlightRecorderOnSignal", Log::dumpFlightRecorderOnSignal);
+    cls.def_static("setConfigCacheEnabled", Log::setConfigCacheEnabled);
+    cls.def_static("isConfigCacheEnabled", Log::isConfigCacheEnabled);
+    cls.def_static("setLazyAppendersEnabled", Log::setLazyAppendersEnabled);
+    cls.def_static("isLazyAppendersEnabled", Log::isLazyAppendersEnabled);
+    // trace ID is a 128-bit Python integer
+    cls.def_static("getTraceContext", []() {
+        TraceContext const trace = TraceContext::current();
+        py::int_ traceId = (py::int_(trace.traceIdHigh) << py::int_(64)) | py::int_(trace.traceIdLow);
+        return py::make_tuple(traceId, trace.spanId);
+    });
+    cls.def_static("setTraceContext", [](py::int_ traceId, std::uint64_t spanId) {
+        TraceContext trace;
+        trace.traceIdHigh = py::int_(traceId >> py::int_(64)).cast<std::uint64_t>();
+        trace.traceIdLow = py::int_(traceId & py::int_(UINT64_MAX)).cast<std::uint64_t>();
+        trace.spanId = spanId;
+        TraceContext::exchange(trace);
+    }, py::arg("traceId"), py::arg("spanId"));
+    cls.def_static("getStatistics", []() {
+        LogStatistics const stats = Log::getStatistics();
+        py::list messages;
+        for (auto const& item: stats.messages) {
+            py::dict record;
+            record["logger"] = item.logger;
+            record["level"] = item.level;
+            record["count"] = item.count;
+            record["nanoseconds"] = item.nanoseconds;
+            messages.append(record);
+        }
+        py::list histogram;
+        for (auto count: stats.latencyHistogram) {
+            histogram.append(count);
+        }
+        py::dict result;
+        result["messages"] = messages;
+        result["latencyHistogram"] = histogram;
+        return result;
+    });
 }
 
 }  // log
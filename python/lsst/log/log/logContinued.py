@@ -24,21 +24,25 @@
 
 __all__ = ["TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL", "CRITICAL", "WARNING",
            "Log", "configure", "configure_prop", "configure_pylog_MDC", "getDefaultLogger",
+           "reconfigure", "reconfigure_prop", "watchConfig", "unwatchConfig",
            "getLogger", "MDC", "MDCDict", "MDCRemove", "MDCRegisterInit", "setLevel",
-           "getLevel", "isEnabledFor", "log", "trace", "debug", "info", "warn", "warning",
+           "setLevels", "getLevel", "isEnabledFor", "log", "trace", "debug", "info", "warn", "warning",
            "error", "fatal", "critical",
            "lwpID", "usePythonLogging", "doNotUsePythonLogging", "UsePythonLogging",
-           "LevelTranslator", "LogHandler", "getEffectiveLevel", "getLevelName"]
+           "LevelTranslator", "LogHandler", "getEffectiveLevel", "getLevelName",
+           "setStatisticsEnabled", "getStatistics", "resetStatistics",
+           "enableFlightRecorder", "disableFlightRecorder", "dumpFlightRecorder",
+           "dumpFlightRecorderOnSignal", "setConfigCacheEnabled", "setLazyAppendersEnabled",
+           "getTraceContext", "setTraceContext", "TraceContextScope"]
 
 import logging
-import inspect
-import os
 
+from collections.abc import Mapping
 from typing import Optional
 
 from lsst.utils import continueClass
 
-from .log import Log
+from .log import Log, _invalidatePyLevelCache
 
 TRACE = 5000
 DEBUG = 10000
@@ -103,60 +107,27 @@ class Log:  # noqa: F811
             return self.getDefaultLogger()
         return self.getLogger(parent_name)
 
-    def trace(self, fmt, *args):
-        self._log(Log.TRACE, False, fmt, *args)
-
-    def debug(self, fmt, *args):
-        self._log(Log.DEBUG, False, fmt, *args)
-
-    def info(self, fmt, *args):
-        self._log(Log.INFO, False, fmt, *args)
-
-    def warn(self, fmt, *args):
-        self._log(Log.WARN, False, fmt, *args)
-
-    def warning(self, fmt, *args):
-        # Do not call warn() because that will result in an incorrect
-        # line number in the log.
-        self._log(Log.WARN, False, fmt, *args)
-
-    def error(self, fmt, *args):
-        self._log(Log.ERROR, False, fmt, *args)
-
-    def fatal(self, fmt, *args):
-        self._log(Log.FATAL, False, fmt, *args)
-
-    def critical(self, fmt, *args):
-        # Do not call fatal() because that will result in an incorrect
-        # line number in the log.
-        self._log(Log.FATAL, False, fmt, *args)
-
-    def _log(self, level, use_format, fmt, *args, **kwargs):
-        if self.isEnabledFor(level):
-            frame = inspect.currentframe().f_back    # calling method
-            frame = frame.f_back    # original log location
-            filename = os.path.split(frame.f_code.co_filename)[1]
-            funcname = frame.f_code.co_name
-            if use_format:
-                msg = fmt.format(*args, **kwargs) if args or kwargs else fmt
-            else:
-                msg = fmt % args if args else fmt
-            if self.UsePythonLogging:
-                levelno = LevelTranslator.lsstLog2logging(level)
-                levelName = logging.getLevelName(levelno)
-
-                pylog = logging.getLogger(self.getName())
-                record = logging.makeLogRecord(dict(name=self.getName(),
-                                                    levelno=levelno,
-                                                    levelname=levelName,
-                                                    msg=msg,
-                                                    funcName=funcname,
-                                                    filename=filename,
-                                                    pathname=frame.f_code.co_filename,
-                                                    lineno=frame.f_lineno))
-                pylog.handle(record)
-            else:
-                self.logMsg(level, filename, funcname, frame.f_lineno, msg)
+    # Logging methods (trace, debug, info, warn, warning, error, fatal,
+    # critical) and ``_log(level, use_format, fmt, *args, **kwargs)`` are
+    # implemented in C++, they take caller location from Python frame.
+
+    def _logToPython(self, level, msg, filename, funcname, pathname, lineno):
+        """Forward already formatted message to Python `logging`, called
+        by ``_log`` when `UsePythonLogging` is set.
+        """
+        levelno = LevelTranslator.lsstLog2logging(level)
+        levelName = logging.getLevelName(levelno)
+
+        pylog = logging.getLogger(self.getName())
+        record = logging.makeLogRecord(dict(name=self.getName(),
+                                            levelno=levelno,
+                                            levelname=levelName,
+                                            msg=msg,
+                                            funcName=funcname,
+                                            filename=filename,
+                                            pathname=pathname,
+                                            lineno=lineno))
+        pylog.handle(record)
 
     def __reduce__(self):
         """Implement pickle support.
@@ -198,6 +169,28 @@ class MDCDict(dict):
         return str(self)
 
 
+def _install_level_hook():
+    """Make PyLogAppender forget cached levels of Python loggers whenever
+    Python logging level configuration changes.
+
+    `logging.Logger.setLevel` and `logging.disable` reset the level cache of
+    `logging.Manager`, we hook into the same method.
+    """
+    clear_cache = logging.Manager._clear_cache
+    if getattr(clear_cache, "_lsst_log_hook", False):
+        return
+
+    def _clear_cache(self):
+        clear_cache(self)
+        _invalidatePyLevelCache()
+
+    _clear_cache._lsst_log_hook = True
+    logging.Manager._clear_cache = _clear_cache
+
+
+_install_level_hook()
+
+
 # Export static functions from Log class to module namespace
 
 
@@ -209,7 +202,24 @@ def configure_prop(properties):
     Log.configure_prop(properties)
 
 
-def configure_pylog_MDC(level: str, MDC_class: Optional[type] = MDCDict):
+def reconfigure(filename):
+    Log.reconfigure(filename)
+
+
+def reconfigure_prop(properties):
+    Log.reconfigure_prop(properties)
+
+
+def watchConfig(filename="", interval=1.0):
+    Log.watchConfig(filename, interval)
+
+
+def unwatchConfig():
+    Log.unwatchConfig()
+
+
+def configure_pylog_MDC(level: str, MDC_class: Optional[type] = MDCDict,
+                        batch_size: int = 0, max_latency_ms: int = 100):
     """Configure log4cxx to send messages to Python logging, with MDC support.
 
     Parameters
@@ -220,6 +230,13 @@ def configure_pylog_MDC(level: str, MDC_class: Optional[type] = MDCDict):
         Type of dictionary which is added to `logging.LogRecord` as an ``MDC``
         attribute. Any dictionary or ``defaultdict``-like class can be used as
         a type. If `None` the `logging.LogRecord` will not be augmented.
+    batch_size : `int`, optional
+        If larger than one then messages are forwarded to Python in batches
+        of up to this size by a separate thread, which acquires GIL only once
+        per batch.
+    max_latency_ms : `int`, optional
+        In batching mode, maximum time in milliseconds that messages can stay
+        in a queue before they are forwarded.
 
     Notes
     -----
@@ -245,6 +262,11 @@ def configure_pylog_MDC(level: str, MDC_class: Optional[type] = MDCDict):
     properties = f"""\
 log4j.rootLogger = {level}, PyLog
 log4j.appender.PyLog = PyLogAppender
+"""
+    if batch_size > 1:
+        properties += f"""\
+log4j.appender.PyLog.BatchSize = {batch_size}
+log4j.appender.PyLog.MaxLatency = {max_latency_ms}
 """
     configure_prop(properties)
 
@@ -273,6 +295,30 @@ def setLevel(loggername, level):
     Log.getLogger(loggername).setLevel(level)
 
 
+def setLevels(rules):
+    """Set levels of many loggers at once.
+
+    Parameters
+    ----------
+    rules : `dict` or iterable of `tuple`
+        Mapping of logger name or glob pattern to level, or a sequence of
+        ``(pattern, level)`` pairs. Empty name means root logger, ``*``
+        matches any sequence of characters and ``?`` matches any single
+        character. If several rules match the same logger then the last one
+        wins. Negative level removes logger level.
+
+    Returns
+    -------
+    saved : `list` [`tuple`]
+        Previous levels of all changed loggers as ``(name, level)`` pairs,
+        level is -1 for loggers which had no level. Passing this list to
+        `setLevels` restores previous levels.
+    """
+    if isinstance(rules, Mapping):
+        rules = rules.items()
+    return Log.setLevels(rules)
+
+
 def getLevel(loggername):
     return Log.getLogger(loggername).getLevel()
 
@@ -285,6 +331,121 @@ def isEnabledFor(loggername, level):
     return Log.getLogger(loggername).isEnabledFor(level)
 
 
+def setStatisticsEnabled(enabled):
+    """Enable or disable collection of message statistics.
+
+    Parameters
+    ----------
+    enabled : `bool`
+        If `True` then count messages for each logger and level and measure
+        time spent in appenders.
+    """
+    Log.setStatisticsEnabled(enabled)
+
+
+def getStatistics():
+    """Return message statistics collected so far by all threads.
+
+    Returns
+    -------
+    statistics : `dict`
+        Dictionary with two items: "messages" is a list of dictionaries
+        with "logger", "level", "count" and "nanoseconds" (total time spent
+        in appenders) keys, one for each logger and level which had
+        messages; "latencyHistogram" is a list of message counts, item
+        ``i`` counts messages which spent between ``2**i`` and
+        ``2**(i+1)`` nanoseconds in appenders.
+    """
+    return Log.getStatistics()
+
+
+def resetStatistics():
+    """Reset all collected message statistics."""
+    Log.resetStatistics()
+
+
+def enableFlightRecorder(filename, level=TRACE, dumpLevel=WARN, capacity=1024):
+    """Keep messages below logger thresholds in memory and dump them on
+    important messages.
+
+    Parameters
+    ----------
+    filename : `str`
+        Name of the file to which recorded messages are appended when
+        dumped, standard error is used if empty.
+    level : `int`, optional
+        Lowest level of recorded messages.
+    dumpLevel : `int`, optional
+        Messages at this or higher level dump recorded messages before
+        they are logged.
+    capacity : `int`, optional
+        Number of messages kept for each thread, older messages are
+        overwritten.
+
+    Notes
+    -----
+    Level checks (e.g. `isEnabledFor`) return `True` for recorded levels,
+    so the messages are still generated and formatted (truncated to about
+    200 bytes), but they are not passed to appenders. Python messages are
+    formatted in full before they are recorded.
+    """
+    Log.enableFlightRecorder(filename, level, dumpLevel, capacity)
+
+
+def disableFlightRecorder():
+    """Stop recording messages, recorded messages can still be dumped."""
+    Log.disableFlightRecorder()
+
+
+def dumpFlightRecorder():
+    """Write recorded messages which have not been dumped yet.
+
+    Returns
+    -------
+    count : `int`
+        Number of messages written.
+    """
+    return Log.dumpFlightRecorder()
+
+
+def dumpFlightRecorderOnSignal(signum):
+    """Dump recorded messages when process receives a signal.
+
+    Parameters
+    ----------
+    signum : `int`
+        Signal number, e.g. ``signal.SIGUSR1``. For signals which terminate
+        process (e.g. ``signal.SIGSEGV``) the process is terminated after
+        the dump. This replaces Python handler for the signal.
+    """
+    Log.dumpFlightRecorderOnSignal(signum)
+
+
+def setConfigCacheEnabled(enabled):
+    """Enable or disable cache of parsed configuration files.
+
+    Parameters
+    ----------
+    enabled : `bool`
+        If `True` then properties parsed from a configuration file are
+        saved in a per-user cache directory (``$XDG_CACHE_HOME/lsst_log``
+        or ``~/.cache/lsst_log``) and re-used until the file changes.
+    """
+    Log.setConfigCacheEnabled(enabled)
+
+
+def setLazyAppendersEnabled(enabled):
+    """Enable or disable lazy construction of appenders.
+
+    Parameters
+    ----------
+    enabled : `bool`
+        If `True` then appenders in configurations made after this call
+        are constructed when the first message reaches them.
+    """
+    Log.setLazyAppendersEnabled(enabled)
+
+
 # This will cause a warning in Sphinx documentation due to confusion between
 # Log and log. https://github.com/astropy/sphinx-automodapi/issues/73 (but
 # note that this does not seem to be Mac-only).
@@ -367,6 +528,64 @@ class UsePythonLogging:
         Log.UsePythonLogging = self.current
 
 
+def getTraceContext():
+    """Return trace context of the current thread.
+
+    Returns
+    -------
+    traceId : `int`
+        128-bit trace ID, 0 if trace context is not set.
+    spanId : `int`
+        64-bit span ID, 0 if trace context is not set.
+    """
+    return Log.getTraceContext()
+
+
+def setTraceContext(traceId, spanId):
+    """Set trace context of the current thread.
+
+    Messages logged by this thread include trace and span IDs, they are
+    rendered by ``%traceid`` and ``%spanid`` conversions of
+    ``lsst.log.ExtendedPatternLayout`` and by ``lsst.log.JsonLinesLayout``,
+    and records forwarded to Python logging have ``trace_id`` and
+    ``span_id`` attributes (integers, same as in OpenTelemetry
+    ``SpanContext``).
+
+    Parameters
+    ----------
+    traceId : `int`
+        128-bit trace ID, 0 to clear trace context.
+    spanId : `int`
+        64-bit span ID, 0 to clear trace context.
+    """
+    Log.setTraceContext(traceId, spanId)
+
+
+class TraceContextScope:
+    """Context manager which sets trace context of the current thread and
+    restores previous context on exit.
+
+    Parameters
+    ----------
+    traceId : `int`
+        128-bit trace ID.
+    spanId : `int`
+        64-bit span ID.
+    """
+
+    def __init__(self, traceId, spanId):
+        self.context = (traceId, spanId)
+        self.saved = None
+
+    def __enter__(self):
+        self.saved = Log.getTraceContext()
+        Log.setTraceContext(*self.context)
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        Log.setTraceContext(*self.saved)
+
+
 class LevelTranslator:
     """Helper class to translate levels between ``lsst.log`` and Python
     `logging`.
@@ -436,10 +655,11 @@ class LogHandler(logging.Handler):
         # Format as a simple message because lsst.log will format the
         # message a second time.
         self.formatter = logging.Formatter(fmt="%(message)s")
+        self._messageFormatter = self.formatter
 
     def handle(self, record):
-        logger = Log.getLogger(record.name)
-        if logger.isEnabledFor(LevelTranslator.logging2lsstLog(record.levelno)):
+        # lsst.log loggers and their levels are cached on C++ side
+        if Log._isEnabledForRecord(record.name, record.levelno):
             logging.Handler.handle(self, record)
 
     def emit(self, record):
@@ -470,10 +690,14 @@ class LogHandler(logging.Handler):
             stream.handle(record)
             return
 
-        logger = Log.getLogger(record.name)
-        # Use standard formatting class to format message part of the record
-        message = self.formatter.format(record)
-
-        logger.logMsg(LevelTranslator.logging2lsstLog(record.levelno),
-                      record.filename, record.funcName,
-                      record.lineno, message)
+        if (self.formatter is self._messageFormatter and not record.exc_info
+                and not record.exc_text and not record.stack_info):
+            # Default formatter only renders the message
+            message = record.getMessage()
+        else:
+            # Use standard formatting class to format message part of the
+            # record
+            message = self.format(record)
+
+        Log._emitRecord(record.name, record.levelno, record.filename, record.funcName,
+                        record.lineno, message)
@@ -0,0 +1,175 @@
+# This file is part of log.
+#
+# Developed for the LSST Data Management System.
+# This product includes software developed by the LSST Project
+# (https://www.lsst.org).
+# See the COPYRIGHT file at the top-level directory of this distribution
+# for details of code ownership.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Merge per-process log files written by ``lsst.log.ShardedFileAppender``.
+
+Can be used as a command line tool::
+
+    python -m lsst.log.shardmerge [--label] PATH [PATH ...]
+
+where each ``PATH`` is a shard file or a directory containing shard files.
+"""
+
+__all__ = ["ShardRecord", "readShard", "mergeShards", "main"]
+
+import argparse
+import dataclasses
+import heapq
+import itertools
+import os
+import sys
+from typing import BinaryIO, Iterable, Iterator, List
+
+_RECORD_SEPARATOR = b"\x1e"
+
+_READ_SIZE = 64 * 1024
+
+
+@dataclasses.dataclass(order=True)
+class ShardRecord:
+    """Single formatted record read from a shard file."""
+
+    timestamp: int
+    """Time of the event in microseconds since epoch."""
+
+    shard: str = dataclasses.field(compare=False)
+    """Name of the shard file without directory and extension."""
+
+    text: str = dataclasses.field(compare=False)
+    """Record formatted by appender layout."""
+
+
+def _splitRecords(file: BinaryIO) -> Iterator[bytes]:
+    """Read file in blocks and yield its parts between record separators,
+    only one incomplete part is kept in memory."""
+    pending: List[bytes] = []
+    while True:
+        block = file.read(_READ_SIZE)
+        if not block:
+            break
+        parts = block.split(_RECORD_SEPARATOR)
+        pending.append(parts[0])
+        if len(parts) > 1:
+            yield b"".join(pending)
+            yield from parts[1:-1]
+            pending = [parts[-1]]
+    yield b"".join(pending)
+
+
+def readShard(path: str) -> Iterator[ShardRecord]:
+    """Read records from a shard file.
+
+    Parameters
+    ----------
+    path : `str`
+        Name of the file written by ``ShardedFileAppender``.
+
+    Yields
+    ------
+    record : `ShardRecord`
+        Records in the order they were written.
+
+    Raises
+    ------
+    ValueError
+        Raised if file was written without timestamps.
+
+    Notes
+    -----
+    Text preceding the first record (e.g. written by another appender to
+    the same file) is returned as a record with zero timestamp. File is
+    read in blocks as records are consumed, so that merging many large
+    shards only keeps one pending record per shard in memory.
+    """
+    shard = os.path.splitext(os.path.basename(path))[0]
+    with open(path, "rb") as file:
+        chunks = _splitRecords(file)
+        preamble = next(chunks)
+        first = next(chunks, None)
+        if first is None:
+            if preamble:
+                raise ValueError(f"{path}: file has no record timestamps")
+            return
+        if preamble:
+            yield ShardRecord(0, shard, preamble.decode("utf-8", errors="replace"))
+        for chunk in itertools.chain([first], chunks):
+            stamp, _, text = chunk.partition(b" ")
+            try:
+                timestamp = int(stamp)
+            except ValueError:
+                raise ValueError(f"{path}: corrupted record timestamp {stamp!r}") from None
+            yield ShardRecord(timestamp, shard, text.decode("utf-8", errors="replace"))
+
+
+def _expandPaths(paths: Iterable[str]) -> List[str]:
+    files = []
+    for path in paths:
+        if os.path.isdir(path):
+            files += sorted(os.path.join(path, name) for name in os.listdir(path)
+                            if os.path.isfile(os.path.join(path, name)))
+        else:
+            files.append(path)
+    return files
+
+
+def mergeShards(paths: Iterable[str]) -> Iterator[ShardRecord]:
+    """Merge records from several shard files in time order.
+
+    Parameters
+    ----------
+    paths : iterable of `str`
+        Names of shard files or directories containing shard files.
+
+    Yields
+    ------
+    record : `ShardRecord`
+        Records from all files ordered by timestamp.
+
+    Notes
+    -----
+    Each file is expected to be ordered by time, which is true for files
+    written by a single process except for events from different threads
+    which are logged at nearly the same time; those keep the order of the
+    file. Records with equal timestamps are returned in the order of files.
+    """
+    return heapq.merge(*(readShard(path) for path in _expandPaths(paths)))
+
+
+def main(argv=None):
+    """Command line tool which prints merged contents of shard files."""
+    parser = argparse.ArgumentParser(description="Merge per-process lsst.log files in time order.")
+    parser.add_argument("paths", nargs="+", metavar="PATH", help="Shard file or directory.")
+    parser.add_argument("--label", action="store_true", help="Prefix each record with the shard name.")
+    args = parser.parse_args(argv)
+
+    try:
+        for record in mergeShards(args.paths):
+            if args.label:
+                sys.stdout.write(f"[{record.shard}] ")
+            sys.stdout.write(record.text)
+    except (OSError, ValueError) as exc:
+        print(exc, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
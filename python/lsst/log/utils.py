@@ -25,17 +25,20 @@
 __all__ = [
     "traceSetAt",
     "temporaryLogLevel",
+    "temporaryLogLevels",
     "LogRedirect",
     "enable_notebook_logging",
     "disable_notebook_logging",
 ]
 
+from collections.abc import Mapping
 from contextlib import contextmanager
 import os
 import sys
 import threading
 
 from lsst.log import Log
+from lsst.log.log.log import _captureToStream, _releaseCapture
 
 
 def traceSetAt(name, number):
@@ -49,9 +52,8 @@ def traceSetAt(name, number):
     number : `int`
         The trace number threshold for display.
     """
-    for i in range(6):
-        level = Log.INFO if i > number else Log.DEBUG
-        Log.getLogger('TRACE%d.%s' % (i, name)).setLevel(level)
+    Log.setLevels([('TRACE%d.%s' % (i, name), Log.INFO if i > number else Log.DEBUG)
+                   for i in range(6)])
 
 
 @contextmanager
@@ -65,13 +67,27 @@ def temporaryLogLevel(name, level):
     level : `int`
         Integer enumeration constant indicating the temporary log level.
     """
-    log = Log.getLogger(name)
-    old = log.getLevel()
-    log.setLevel(level)
+    with temporaryLogLevels([(name, level)]):
+        yield
+
+
+@contextmanager
+def temporaryLogLevels(rules):
+    """A context manager that temporarily sets levels of many loggers.
+
+    Parameters
+    ----------
+    rules : `dict` or iterable of `tuple`
+        Mapping of logger name or glob pattern to level, or a sequence of
+        ``(pattern, level)`` pairs, see `lsst.log.setLevels`.
+    """
+    if isinstance(rules, Mapping):
+        rules = rules.items()
+    saved = Log.setLevels(rules)
     try:
         yield
     finally:
-        log.setLevel(old)
+        Log.setLevels(saved)
 
 
 class LogRedirect:
@@ -138,15 +154,31 @@ _redirect = None
 
 
 def enable_notebook_logging(dest=sys.stderr):
-    """Enable notebook output for log4cxx messages."""
+    """Enable notebook output for log4cxx messages.
+
+    Parameters
+    ----------
+    dest : `io.TextIOBase`
+        Destination text stream.
+
+    Notes
+    -----
+    All log4cxx console appenders writing to standard output are replaced
+    with appenders which send formatted messages directly to ``dest`` in
+    batches, without redirecting file descriptor. Console appenders created
+    by later `lsst.log.configure` or `lsst.log.reconfigure` calls are
+    replaced too, until `disable_notebook_logging` is called. Use
+    `LogRedirect` to capture other output written to standard output.
+    """
     global _redirect
     if _redirect is None:
-        _redirect = LogRedirect(dest=dest)
+        _captureToStream(dest)
+        _redirect = dest
 
 
 def disable_notebook_logging():
     """Stop notebook output for log4cxx messages."""
     global _redirect
     if _redirect is not None:
-        _redirect.finish()
+        _releaseCapture()
         _redirect = None
@@ -0,0 +1,292 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Third-party headers
+#include "log4cxx/helpers/loglog.h"
+#include "log4cxx/helpers/optionconverter.h"
+#include "log4cxx/helpers/stringhelper.h"
+#include "log4cxx/helpers/transcoder.h"
+#include "log4cxx/layout.h"
+
+// Local headers
+#include "AsyncRingAppender.h"
+
+// macro below dows not work without this using directive
+// (and it breaks if placed inside namespaces)
+using lsst::log::detail::AsyncRingAppender;
+IMPLEMENT_LOG4CXX_OBJECT(AsyncRingAppender)
+
+using namespace log4cxx::helpers;
+
+namespace {
+
+// Writer thread sends data to output in chunks of about this size
+std::size_t const MAX_BATCH_BYTES = 64 * 1024;
+
+// Safety net for missed wake-ups, waiting threads re-check their
+// condition at least this often
+auto const WRITER_WAIT = std::chrono::milliseconds(100);
+auto const PRODUCER_WAIT = std::chrono::milliseconds(10);
+
+}
+
+namespace lsst::log::detail {
+
+AsyncRingAppender::AsyncRingAppender() {
+}
+
+AsyncRingAppender::~AsyncRingAppender() {
+    close();
+}
+
+void AsyncRingAppender::doAppend(const spi::LoggingEventPtr& event, Pool& pool) {
+    // AppenderSkeleton::doAppend serializes all callers on a mutex which
+    // is exactly what this appender tries to avoid. Threshold and filters
+    // only change during configuration so it is safe to check them here.
+    doAppendImpl(event, pool);
+}
+
+void AsyncRingAppender::append(const spi::LoggingEventPtr& event, Pool& p) {
+    if (_closed.load(std::memory_order_acquire) or not _ring) {
+        return;
+    }
+
+    // Capture per-thread context now, writer thread would see its own
+    // context otherwise.
+    LogString ndc;
+    event->getNDC(ndc);
+    event->getMDCCopy();
+    event->getThreadName();
+
+    _enqueue(event);
+}
+
+void AsyncRingAppender::_enqueue(spi::LoggingEventPtr event) {
+    while (not _ring->tryPush(event)) {
+        if (_policy == OverflowPolicy::Discard) {
+            _drop();
+            return;
+        }
+        if (_policy == OverflowPolicy::DropOldest) {
+            spi::LoggingEventPtr oldest;
+            if (_ring->tryPop(oldest)) {
+                _drop();
+            }
+            continue;
+        }
+
+        // Block until writer makes some space, counter is checked by
+        // writer after it pops events.
+        std::unique_lock<std::mutex> lock(_mutex);
+        _blockedProducers.fetch_add(1, std::memory_order_seq_cst);
+        bool const pushed = _ring->tryPush(event);
+        if (not pushed and not _closed.load(std::memory_order_acquire)) {
+            _spaceCond.wait_for(lock, PRODUCER_WAIT);
+        }
+        _blockedProducers.fetch_sub(1, std::memory_order_relaxed);
+        if (pushed) {
+            break;
+        }
+        if (_closed.load(std::memory_order_acquire)) {
+            return;
+        }
+    }
+
+    // Wake up writer only if it is waiting, this is paired with the fence
+    // in _run() so that either we see the flag or writer sees our event.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_writerSleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _dataCond.notify_one();
+    }
+}
+
+void AsyncRingAppender::_run() {
+    Pool pool;
+    LogString formatted;
+    std::string buffer;
+    LayoutPtr layout = getLayout();
+    spi::LoggingEventPtr event;
+
+    while (true) {
+        bool popped = false;
+        while (buffer.size() < MAX_BATCH_BYTES and _ring->tryPop(event)) {
+            popped = true;
+            formatted.clear();
+            if (layout) {
+                layout->format(formatted, event, pool);
+            } else {
+                appendEventMessage(*event, formatted);
+                formatted += LOG4CXX_STR("\n");
+            }
+            event.reset();
+            LOG4CXX_ENCODE_CHAR(encoded, formatted);
+            buffer += encoded;
+        }
+
+        if (popped and _blockedProducers.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _spaceCond.notify_all();
+        }
+
+        std::uint64_t const dropped = _dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            LOG4CXX_ENCODE_CHAR(name, getName());
+            buffer += "AsyncRingAppender[" + name + "]: " + std::to_string(dropped) +
+                      " messages dropped due to buffer overflow\n";
+        }
+
+        if (not buffer.empty()) {
+            _write(buffer);
+            buffer.clear();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_closed.load(std::memory_order_acquire) and _ring->empty()) {
+            break;
+        }
+        _writerSleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_ring->empty() and not _closed.load(std::memory_order_acquire)) {
+            _dataCond.wait_for(lock, WRITER_WAIT);
+        }
+        _writerSleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+void AsyncRingAppender::_write(std::string const& data) {
+    char const* ptr = data.data();
+    std::size_t size = data.size();
+    while (size > 0) {
+        ssize_t const n = ::write(_fd, ptr, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (not _writeError) {
+                _writeError = true;
+                LOG4CXX_DECODE_CHAR(msg, std::string("AsyncRingAppender: write failed: ") +
+                                         std::strerror(errno));
+                LogLog::error(msg);
+            }
+            return;
+        }
+        ptr += n;
+        size -= n;
+    }
+}
+
+void AsyncRingAppender::close() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_closed.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+        _dataCond.notify_all();
+        _spaceCond.notify_all();
+    }
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    if (_fd > 2) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+bool AsyncRingAppender::requiresLayout() const {
+    return true;
+}
+
+bool AsyncRingAppender::supportsDeferredMessages() const {
+    if (getFilter()) {
+        return false;
+    }
+    auto const support = std::dynamic_pointer_cast<DeferredMessageSupport>(getLayout());
+    return support and support->supportsDeferredMessages();
+}
+
+void AsyncRingAppender::activateOptions(Pool& p) {
+    if (_thread.joinable() or _closed.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (not _fileName.empty()) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+        flags |= _fileAppend ? O_APPEND : O_TRUNC;
+        int const fd = ::open(_fileName.c_str(), flags, 0666);
+        if (fd < 0) {
+            LOG4CXX_DECODE_CHAR(msg, "AsyncRingAppender: failed to open file " + _fileName +
+                                     ": " + std::strerror(errno));
+            LogLog::error(msg);
+            return;
+        }
+        _fd = fd;
+    }
+    _ring = std::make_unique<Ring>(_bufferSize);
+    _thread = std::thread(&AsyncRingAppender::_run, this);
+}
+
+void AsyncRingAppender::setOption(const LogString &option, const LogString &value) {
+
+    if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("FILE"), LOG4CXX_STR("file"))) {
+        LOG4CXX_ENCODE_CHAR(fileName, value);
+        _fileName = fileName;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("APPEND"), LOG4CXX_STR("append"))) {
+        _fileAppend = OptionConverter::toBoolean(value, true);
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("TARGET"), LOG4CXX_STR("target"))) {
+        if (StringHelper::equalsIgnoreCase(value, LOG4CXX_STR("SYSTEM.ERR"), LOG4CXX_STR("system.err"))) {
+            _fd = 2;
+        } else {
+            _fd = 1;
+        }
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("BUFFERSIZE"),
+                                              LOG4CXX_STR("buffersize"))) {
+        int const size = OptionConverter::toInt(value, 8192);
+        _bufferSize = size > 0 ? size : 1;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("OVERFLOWPOLICY"),
+                                              LOG4CXX_STR("overflowpolicy"))) {
+        if (StringHelper::equalsIgnoreCase(value, LOG4CXX_STR("BLOCK"), LOG4CXX_STR("block"))) {
+            _policy = OverflowPolicy::Block;
+        } else if (StringHelper::equalsIgnoreCase(value, LOG4CXX_STR("DROPOLDEST"),
+                                                  LOG4CXX_STR("dropoldest"))) {
+            _policy = OverflowPolicy::DropOldest;
+        } else if (StringHelper::equalsIgnoreCase(value, LOG4CXX_STR("DISCARD"), LOG4CXX_STR("discard"))) {
+            _policy = OverflowPolicy::Discard;
+        } else {
+            LogLog::warn(LOG4CXX_STR("AsyncRingAppender: unknown OverflowPolicy value: ") + value);
+        }
+    } else {
+        AppenderSkeleton::setOption(option, value);
+    }
+}
+
+} // namespace lsst::log::detail
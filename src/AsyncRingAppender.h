@@ -0,0 +1,191 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_ASYNCRINGAPPENDER_H
+#define LSST_LOG_ASYNCRINGAPPENDER_H
+
+// System headers
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Base class header
+#include "log4cxx/appenderskeleton.h"
+
+#include "log4cxx/helpers/object.h"
+
+// Local headers
+#include "EventPool.h"
+#include "RingBuffer.h"
+
+namespace lsst::log::detail {
+
+// This needs to be here for all LOG4CXX macros to work
+using namespace log4cxx;
+
+/**
+ *  Appender which moves formatting and I/O off the logging thread.
+ *
+ *  Logging thread only captures thread-dependent parts of the event (MDC,
+ *  NDC, thread name) and pushes event into a bounded lock-free ring; a
+ *  dedicated writer thread formats events with the configured layout and
+ *  writes them in batches to a file or to standard output/error. Example
+ *  configuration:
+ *  \code
+ *  log4j.rootLogger = INFO, ASYNC
+ *  log4j.appender.ASYNC = lsst.log.AsyncRingAppender
+ *  log4j.appender.ASYNC.File = /tmp/app.log
+ *  log4j.appender.ASYNC.BufferSize = 4096
+ *  log4j.appender.ASYNC.OverflowPolicy = DropOldest
+ *  log4j.appender.ASYNC.layout = org.apache.log4j.PatternLayout
+ *  log4j.appender.ASYNC.layout.ConversionPattern = %-5p %c - %m%n
+ *  \endcode
+ *
+ *  Supported options:
+ *  - \c File - output file name; if not set output goes to \c Target
+ *  - \c Append - if false then truncate output file, default is true
+ *  - \c Target - \c System.out (default) or \c System.err
+ *  - \c BufferSize - ring capacity in events, default is 8192
+ *  - \c OverflowPolicy - what to do when ring is full: \c Block (default)
+ *    waits for free space, \c DropOldest discards oldest queued event,
+ *    \c Discard discards new event. Number of discarded events is
+ *    reported by the writer thread as a separate output line.
+ *
+ *  With a layout that supports deferred rendering (ExtendedPatternLayout
+ *  or JsonLinesLayout) and no filters, messages of LOGF* macros are
+ *  rendered from their captured arguments by the writer thread, logging
+ *  thread only copies the arguments.
+ *
+ *  Buffered events are written out when appender is closed, e.g. when
+ *  logging is re-configured.
+ */
+class AsyncRingAppender : public AppenderSkeleton, public DeferredMessageSupport {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(AsyncRingAppender)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(AsyncRingAppender)
+            LOG4CXX_CAST_ENTRY_CHAIN(AppenderSkeleton)
+    END_LOG4CXX_CAST_MAP()
+
+    /// Behavior when ring buffer is full.
+    enum class OverflowPolicy { Block, DropOldest, Discard };
+
+    // Make an instance
+    AsyncRingAppender();
+
+    // Flushes pending events and stops writer thread
+    ~AsyncRingAppender();
+
+    // we do not support copying
+    AsyncRingAppender(const AsyncRingAppender&) = delete;
+    AsyncRingAppender& operator=(const AsyncRingAppender&) = delete;
+
+    /**
+     * Filter and append the event without taking appender-wide mutex.
+     */
+    void doAppend(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& pool) override;
+
+    /**
+     * Queue the event for writer thread.
+     */
+    void append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Write out all queued events and stop writer thread.
+     */
+    void close() override;
+
+    /**
+     * Returns true, this appender needs a layout to format events.
+     */
+    bool requiresLayout() const override;
+
+    /**
+     * Returns true if layout supports deferred messages and there are no
+     * filters, which could look at the message in the logging thread.
+     */
+    bool supportsDeferredMessages() const override;
+
+    /**
+     * Open output and start writer thread.
+     */
+    void activateOptions(log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Handle configuration options.
+     */
+    void setOption(const LogString &option, const LogString &value) override;
+
+    /**
+     * Return total number of events discarded due to buffer overflow.
+     */
+    std::uint64_t getDroppedCount() const { return _droppedTotal.load(std::memory_order_relaxed); }
+
+private:
+
+    using Ring = RingBuffer<spi::LoggingEventPtr>;
+
+    // Push event into a ring according to overflow policy
+    void _enqueue(spi::LoggingEventPtr event);
+
+    // Writer thread body
+    void _run();
+
+    // Write whole buffer to output
+    void _write(std::string const& data);
+
+    // Add to dropped event counters
+    void _drop() {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        _droppedTotal.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::string _fileName;
+    bool _fileAppend = true;
+    int _fd = 1;
+    std::size_t _bufferSize = 8192;
+    OverflowPolicy _policy = OverflowPolicy::Block;
+
+    std::unique_ptr<Ring> _ring;
+    std::thread _thread;
+    std::mutex _mutex;  // only used for waiting on condition variables
+    std::condition_variable _dataCond;  // writer waits for data
+    std::condition_variable _spaceCond;  // producers wait for space
+    std::atomic<bool> _closed{false};
+    std::atomic<bool> _writerSleeping{false};
+    std::atomic<unsigned> _blockedProducers{0};
+    std::atomic<std::uint64_t> _dropped{0};  // not reported yet
+    std::atomic<std::uint64_t> _droppedTotal{0};
+    bool _writeError = false;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_ASYNCRINGAPPENDER_H
@@ -0,0 +1,391 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+// Third-party headers
+#include "log4cxx/helpers/loglog.h"
+#include "log4cxx/helpers/optionconverter.h"
+#include "log4cxx/helpers/stringhelper.h"
+#include "log4cxx/helpers/transcoder.h"
+#include "log4cxx/spi/loggingevent.h"
+
+// Local headers
+#include "lsst/log/TraceContext.h"
+#include "BinaryFileAppender.h"
+#include "EventPool.h"
+
+// macro below dows not work without this using directive
+// (and it breaks if placed inside namespaces)
+using lsst::log::detail::BinaryFileAppender;
+IMPLEMENT_LOG4CXX_OBJECT(BinaryFileAppender)
+
+using namespace log4cxx::helpers;
+
+namespace {
+
+char const MAGIC[8] = {'L', 'S', 'S', 'T', 'B', 'L', 'O', 'G'};
+std::size_t const HEADER_SIZE = 16;
+std::uint32_t const BYTE_ORDER_MARK = 0x01020304;
+
+// size and type
+std::size_t const RECORD_HEADER_SIZE = sizeof(std::uint32_t) + sizeof(std::uint8_t);
+
+// Smallest accepted MapSize
+std::size_t const MIN_MAP_SIZE = 64 * 1024;
+
+// Store a number, return pointer past it
+template <typename T>
+char* put(char* ptr, T value) {
+    std::memcpy(ptr, &value, sizeof(value));
+    return ptr + sizeof(value);
+}
+
+// Store length-prefixed bytes, return pointer past them
+char* putBytes(char* ptr, std::string_view bytes) {
+    ptr = put(ptr, static_cast<std::uint32_t>(bytes.size()));
+    std::memcpy(ptr, bytes.data(), bytes.size());
+    return ptr + bytes.size();
+}
+
+// Return UTF-8 view of a LogString, `buffer` holds converted string if
+// conversion is needed
+std::string_view utf8(log4cxx::LogString const& str, std::string& buffer) {
+    if constexpr (std::is_same_v<log4cxx::LogString, std::string>) {
+        return str;
+    } else {
+        buffer.clear();
+        Transcoder::encodeUTF8(str, buffer);
+        return buffer;
+    }
+}
+
+// Read exactly `size` bytes at given offset
+bool readAt(int fd, void* data, std::size_t size, std::uint64_t offset) {
+    char* ptr = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t const n = ::pread(fd, ptr, size, offset);
+        if (n < 0 and errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+}
+
+namespace lsst::log::detail {
+
+BinaryFileAppender::BinaryFileAppender() {
+}
+
+BinaryFileAppender::~BinaryFileAppender() {
+    close();
+}
+
+void BinaryFileAppender::append(const spi::LoggingEventPtr& event, Pool& p) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_fd < 0) {
+        return;
+    }
+
+    // intern all strings first, this writes their records
+    auto const& loc = event->getLocationInformation();
+    std::uint32_t const loggerId = _intern(utf8(event->getLoggerName(), _buffer));
+    std::uint32_t const fileId = _intern(loc.getFileName() != nullptr ? loc.getFileName() : "");
+    std::uint32_t const funcId = _intern(loc.getMethodName());
+
+    auto const keys = event->getMDCKeySet();
+    std::vector<std::pair<std::uint32_t, std::string>> mdc;
+    mdc.reserve(keys.size());
+    for (auto const& key: keys) {
+        LogString value;
+        event->getMDC(key, value);
+        std::string encoded;
+        mdc.emplace_back(_intern(utf8(key, _buffer)), utf8(value, encoded));
+        if (mdc.size() == UINT16_MAX) {
+            break;
+        }
+    }
+
+    // LOGF* message is stored as format string and its arguments
+    auto const* formatEvent = dynamic_cast<FormatLoggingEvent const*>(event.get());
+    std::uint32_t const formatId = formatEvent != nullptr ? _intern(formatEvent->format) : 0;
+    std::size_t const formatSize =
+            formatEvent != nullptr ? RECORD_HEADER_SIZE + sizeof(std::uint32_t) + formatEvent->args.size() : 0;
+
+    std::string encoded;
+    std::string_view const message = utf8(event->getMessage(), encoded);
+
+    // timestamp, six 32-bit fields, MDC count, MDC and message
+    std::size_t size = RECORD_HEADER_SIZE + sizeof(std::int64_t) + 6 * sizeof(std::uint32_t) +
+                       sizeof(std::uint16_t) + sizeof(std::uint32_t) + message.size();
+    for (auto const& entry: mdc) {
+        size += 2 * sizeof(std::uint32_t) + entry.second.size();
+    }
+    if (size > UINT32_MAX or formatSize > UINT32_MAX) {
+        return;
+    }
+
+    // trace record goes together with the event
+    TraceContext const trace = eventTraceContext(*event);
+    std::size_t const traceSize = trace.valid() ? RECORD_HEADER_SIZE + 3 * sizeof(std::uint64_t) : 0;
+
+    char* record = _reserve(traceSize + formatSize + size);
+    if (record == nullptr) {
+        return;
+    }
+    if (traceSize != 0) {
+        char* ptr = put(record + sizeof(std::uint32_t), static_cast<std::uint8_t>(RecordType::Trace));
+        ptr = put(ptr, trace.traceIdHigh);
+        ptr = put(ptr, trace.traceIdLow);
+        put(ptr, trace.spanId);
+        _commit(record, traceSize);
+        record += traceSize;
+    }
+    if (formatSize != 0) {
+        char* ptr = put(record + sizeof(std::uint32_t), static_cast<std::uint8_t>(RecordType::Format));
+        ptr = put(ptr, formatId);
+        std::memcpy(ptr, formatEvent->args.data(), formatEvent->args.size());
+        _commit(record, formatSize);
+        record += formatSize;
+    }
+    char* ptr = put(record + sizeof(std::uint32_t), static_cast<std::uint8_t>(RecordType::Event));
+    ptr = put(ptr, static_cast<std::int64_t>(event->getTimeStamp()));
+    ptr = put(ptr, static_cast<std::int32_t>(event->getLevel()->toInt()));
+    ptr = put(ptr, loggerId);
+    ptr = put(ptr, fileId);
+    ptr = put(ptr, funcId);
+    ptr = put(ptr, static_cast<std::int32_t>(loc.getLineNumber()));
+    ptr = put(ptr, static_cast<std::uint32_t>(eventLwpID(*event)));
+    ptr = put(ptr, static_cast<std::uint16_t>(mdc.size()));
+    for (auto const& entry: mdc) {
+        ptr = put(ptr, entry.first);
+        ptr = putBytes(ptr, entry.second);
+    }
+    putBytes(ptr, message);
+    _commit(record, size);
+}
+
+bool BinaryFileAppender::supportsDeferredMessages() const {
+    return not getFilter();
+}
+
+std::uint32_t BinaryFileAppender::_intern(std::string_view str) {
+    auto iter = _ids.find(str);
+    if (iter != _ids.end()) {
+        return iter->second;
+    }
+
+    auto const id = static_cast<std::uint32_t>(_ids.size());
+    _strings.emplace_back(str);
+    _ids.emplace(_strings.back(), id);
+
+    std::size_t const size = RECORD_HEADER_SIZE + 2 * sizeof(std::uint32_t) + str.size();
+    if (char* const record = _reserve(size)) {
+        char* ptr = put(record + sizeof(std::uint32_t), static_cast<std::uint8_t>(RecordType::String));
+        ptr = put(ptr, id);
+        putBytes(ptr, str);
+        _commit(record, size);
+    }
+    return id;
+}
+
+char* BinaryFileAppender::_reserve(std::size_t size) {
+    if (_fd < 0) {
+        return nullptr;
+    }
+    if (_end + size > _mapOffset + _mapLength and not _remap(size)) {
+        return nullptr;
+    }
+    return _map + (_end - _mapOffset);
+}
+
+void BinaryFileAppender::_commit(char* record, std::uint32_t size) {
+    // size goes last, file never contains partial records with non-zero size
+    std::memcpy(record, &size, sizeof(size));
+    _end += size;
+}
+
+bool BinaryFileAppender::_remap(std::size_t size) {
+    if (_map != nullptr) {
+        ::munmap(_map, _mapLength);
+        _map = nullptr;
+        _mapLength = 0;
+    }
+
+    std::uint64_t const page = ::sysconf(_SC_PAGESIZE);
+    std::uint64_t const offset = _end / page * page;
+    std::uint64_t length = std::max<std::uint64_t>(_mapSize, _end - offset + size);
+    length = (length + page - 1) / page * page;
+
+    if (offset + length > _fileSize) {
+        if (::ftruncate(_fd, offset + length) != 0) {
+            _fail("failed to extend file");
+            return false;
+        }
+        _fileSize = offset + length;
+    }
+
+    void* const addr = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, offset);
+    if (addr == MAP_FAILED) {
+        _fail("failed to map file");
+        return false;
+    }
+    _map = static_cast<char*>(addr);
+    _mapOffset = offset;
+    _mapLength = length;
+    return true;
+}
+
+bool BinaryFileAppender::_open() {
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC;
+    if (not _fileAppend) {
+        flags |= O_TRUNC;
+    }
+    _fd = ::open(_fileName.c_str(), flags, 0666);
+    if (_fd < 0) {
+        _fail("failed to open file");
+        return false;
+    }
+    struct stat st;
+    if (::fstat(_fd, &st) != 0) {
+        _fail("failed to stat file");
+        return false;
+    }
+    _fileSize = st.st_size;
+
+    if (_fileSize == 0) {
+        char header[HEADER_SIZE];
+        std::memcpy(header, MAGIC, sizeof(MAGIC));
+        put(put(header + sizeof(MAGIC), VERSION), BYTE_ORDER_MARK);
+        if (::pwrite(_fd, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+            _fail("failed to write file header");
+            return false;
+        }
+        _fileSize = _end = HEADER_SIZE;
+        return true;
+    }
+
+    // appending, check header and skip existing records
+    char header[HEADER_SIZE];
+    std::uint32_t version, mark;
+    if (not readAt(_fd, header, sizeof(header), 0) or std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0) {
+        _fail("existing file is not a binary log file");
+        return false;
+    }
+    std::memcpy(&version, header + sizeof(MAGIC), sizeof(version));
+    std::memcpy(&mark, header + sizeof(MAGIC) + sizeof(version), sizeof(mark));
+    if (version != VERSION or mark != BYTE_ORDER_MARK) {
+        _fail("existing file has incompatible format version or byte order");
+        return false;
+    }
+    _end = HEADER_SIZE;
+    std::uint32_t size;
+    while (_end + sizeof(size) <= _fileSize and readAt(_fd, &size, sizeof(size), _end) and
+           size >= RECORD_HEADER_SIZE and _end + size <= _fileSize) {
+        _end += size;
+    }
+    return true;
+}
+
+void BinaryFileAppender::_fail(std::string const& message) {
+    LOG4CXX_DECODE_CHAR(msg, "BinaryFileAppender: " + message + " " + _fileName + ": " +
+                             std::strerror(errno));
+    LogLog::error(msg);
+    _close();
+}
+
+void BinaryFileAppender::_close() {
+    if (_map != nullptr) {
+        ::munmap(_map, _mapLength);
+        _map = nullptr;
+        _mapLength = 0;
+    }
+    if (_fd >= 0) {
+        // drop zero-filled tail
+        if (_end > 0 and _end < _fileSize) {
+            if (::ftruncate(_fd, _end) != 0) {
+                LogLog::warn(LOG4CXX_STR("BinaryFileAppender: failed to truncate file"));
+            }
+        }
+        ::close(_fd);
+        _fd = -1;
+    }
+    _ids.clear();
+    _strings.clear();
+}
+
+void BinaryFileAppender::close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _close();
+}
+
+bool BinaryFileAppender::requiresLayout() const {
+    return false;
+}
+
+void BinaryFileAppender::activateOptions(Pool& p) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_fd >= 0) {
+        return;
+    }
+    if (_fileName.empty()) {
+        LogLog::error(LOG4CXX_STR("BinaryFileAppender: File option is not set"));
+        return;
+    }
+    _open();
+}
+
+void BinaryFileAppender::setOption(const LogString &option, const LogString &value) {
+
+    if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("FILE"), LOG4CXX_STR("file"))) {
+        LOG4CXX_ENCODE_CHAR(fileName, value);
+        _fileName = fileName;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("APPEND"), LOG4CXX_STR("append"))) {
+        _fileAppend = OptionConverter::toBoolean(value, true);
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("MAPSIZE"), LOG4CXX_STR("mapsize"))) {
+        int const size = OptionConverter::toInt(value, 0);
+        _mapSize = std::max<std::size_t>(size > 0 ? size : 0, ::MIN_MAP_SIZE);
+    } else {
+        AppenderSkeleton::setOption(option, value);
+    }
+}
+
+} // namespace lsst::log::detail
@@ -0,0 +1,196 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_BINARYFILEAPPENDER_H
+#define LSST_LOG_BINARYFILEAPPENDER_H
+
+// System headers
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Base class header
+#include "log4cxx/appenderskeleton.h"
+
+#include "log4cxx/helpers/object.h"
+
+// Local headers
+#include "EventPool.h"
+
+namespace lsst::log::detail {
+
+// This needs to be here for all LOG4CXX macros to work
+using namespace log4cxx;
+
+/**
+ *  Appender which writes events as compact binary records into a
+ *  memory-mapped, append-only file.
+ *
+ *  Events are not formatted, each record contains timestamp, level,
+ *  logger, location, LWP ID, MDC and message. Logger names, file and
+ *  function names and MDC keys are interned, they are written once as
+ *  separate string records and referred to by numeric ID. Files are
+ *  converted to text or JSON with `python -m lsst.log.binlog`. Example
+ *  configuration:
+ *  \code
+ *  log4j.rootLogger = DEBUG, BIN
+ *  log4j.appender.BIN = lsst.log.BinaryFileAppender
+ *  log4j.appender.BIN.File = /tmp/app.blog
+ *  \endcode
+ *
+ *  Supported options:
+ *  - \c File - output file name, required
+ *  - \c Append - if false then truncate output file, default is true
+ *  - \c MapSize - size in bytes of the file region mapped at a time,
+ *    default is 8 MiB
+ *
+ *  File starts with a 16-byte header: magic "LSSTBLOG", 32-bit format
+ *  version and 32-bit byte order mark 0x01020304, all numbers are in
+ *  native byte order. Each record starts with 32-bit record size (which
+ *  includes size itself) and 8-bit record type:
+ *  - \c String record: 32-bit ID, 32-bit length, UTF-8 bytes
+ *  - \c Event record: 64-bit timestamp (microseconds since epoch), 32-bit
+ *    level, 32-bit IDs of logger, file and function names, 32-bit line
+ *    number, 32-bit LWP ID, 16-bit number of MDC entries followed by
+ *    that many entries of 32-bit key ID, 32-bit value length and value,
+ *    32-bit message length and message.
+ *  - \c Trace record: 64-bit upper and lower halves of trace ID and 64-bit
+ *    span ID (see TraceContext), written immediately before the \c Event
+ *    record it applies to, only for events logged with trace context set.
+ *    Readers which do not know this type skip it.
+ *  - \c Format record: 32-bit ID of the format string followed by encoded
+ *    arguments (see FormatRecord, numbers in native byte order) of a LOGF*
+ *    message, written immediately before the \c Event record it applies
+ *    to, whose message is empty then. Message is rendered by the reader.
+ *
+ *  Size is written after the rest of the record, zero size marks the end
+ *  of data (file is extended in chunks, unused tail is zero-filled and it
+ *  is truncated when appender is closed). String IDs are only valid in the
+ *  part of the file following their definition, appending to an existing
+ *  file starts a new ID sequence.
+ */
+class BinaryFileAppender : public AppenderSkeleton, public DeferredMessageSupport {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(BinaryFileAppender)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(BinaryFileAppender)
+            LOG4CXX_CAST_ENTRY_CHAIN(AppenderSkeleton)
+    END_LOG4CXX_CAST_MAP()
+
+    /// Version of the file format.
+    static constexpr std::uint32_t VERSION = 1;
+
+    /// Record types.
+    enum class RecordType : std::uint8_t { String = 1, Event = 2, Trace = 3, Format = 4 };
+
+    // Make an instance
+    BinaryFileAppender();
+
+    // Closes the file
+    ~BinaryFileAppender();
+
+    // we do not support copying
+    BinaryFileAppender(const BinaryFileAppender&) = delete;
+    BinaryFileAppender& operator=(const BinaryFileAppender&) = delete;
+
+    /**
+     * Write the event to a file.
+     */
+    void append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Unmap and truncate the file to the size of data.
+     */
+    void close() override;
+
+    /**
+     * Returns false, events are not formatted.
+     */
+    bool requiresLayout() const override;
+
+    /**
+     * Returns true if there are no filters, LOGF* messages are stored
+     * unrendered.
+     */
+    bool supportsDeferredMessages() const override;
+
+    /**
+     * Open output file.
+     */
+    void activateOptions(log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Handle configuration options.
+     */
+    void setOption(const LogString &option, const LogString &value) override;
+
+private:
+
+    // Open the file and find the end of existing data
+    bool _open();
+
+    // Return ID of interned string, writes its definition on first use
+    std::uint32_t _intern(std::string_view str);
+
+    // Return pointer to space for a record of `size` bytes at the end of
+    // data, nullptr on errors. Pointer is valid until next call.
+    char* _reserve(std::size_t size);
+
+    // Make record written into reserved space visible
+    void _commit(char* record, std::uint32_t size);
+
+    // Map region of the file which can hold `size` bytes after the end
+    bool _remap(std::size_t size);
+
+    // Report error and close the file
+    void _fail(std::string const& message);
+
+    // Release mapping and file
+    void _close();
+
+    std::string _fileName;
+    bool _fileAppend = true;
+    std::size_t _mapSize = 8 * 1024 * 1024;
+
+    std::mutex _mutex;
+    int _fd = -1;
+    char* _map = nullptr;
+    std::uint64_t _mapOffset = 0;  // file offset of mapped region
+    std::size_t _mapLength = 0;
+    std::uint64_t _end = 0;  // file offset of the end of data
+    std::uint64_t _fileSize = 0;
+
+    std::unordered_map<std::string_view, std::uint32_t> _ids;  // interned strings
+    std::deque<std::string> _strings;  // storage for _ids keys
+    std::string _buffer;  // conversion buffer
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_BINARYFILEAPPENDER_H
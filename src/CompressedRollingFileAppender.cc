@@ -0,0 +1,323 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <zlib.h>
+
+// Third-party headers
+#include "log4cxx/helpers/loglog.h"
+#include "log4cxx/helpers/optionconverter.h"
+#include "log4cxx/helpers/stringhelper.h"
+#include "log4cxx/helpers/transcoder.h"
+#include "log4cxx/layout.h"
+#include "log4cxx/spi/loggingevent.h"
+
+// Local headers
+#include "CompressedRollingFileAppender.h"
+
+// macro below dows not work without this using directive
+// (and it breaks if placed inside namespaces)
+using lsst::log::detail::CompressedRollingFileAppender;
+IMPLEMENT_LOG4CXX_OBJECT(CompressedRollingFileAppender)
+
+using namespace log4cxx::helpers;
+
+namespace {
+
+// Size of compressed output chunk
+std::size_t const OUTPUT_CHUNK = 64 * 1024;
+
+// Window bits for deflateInit2 which produce gzip format
+int const GZIP_WINDOW_BITS = 15 + 16;
+
+}
+
+namespace lsst::log::detail {
+
+CompressedRollingFileAppender::CompressedRollingFileAppender() {
+}
+
+CompressedRollingFileAppender::~CompressedRollingFileAppender() {
+    close();
+}
+
+void CompressedRollingFileAppender::append(const spi::LoggingEventPtr& event, Pool& p) {
+    // called with appender lock held, which also protects layout
+    _formatted.clear();
+    getLayout()->format(_formatted, event, p);
+    std::string_view text;
+    std::string encoded;
+    if constexpr (std::is_same_v<LogString, std::string>) {
+        text = _formatted;
+    } else {
+        Transcoder::encode(_formatted, encoded);
+        text = encoded;
+    }
+
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_closed or not _thread.joinable()) {
+            return;
+        }
+        if (_active.size() + text.size() > _maxBufferSize) {
+            ++_dropped;
+            return;
+        }
+        _active += text;
+        if (_active.size() >= _bufferSize and not _wakeRequested) {
+            _wakeRequested = notify = true;
+        }
+    }
+    if (notify) {
+        _cond.notify_one();
+    }
+}
+
+void CompressedRollingFileAppender::_run() {
+    // batch keeps its capacity between swaps, so in steady state two
+    // buffers are used alternately without reallocation
+    std::string batch;
+    bool closed = false;
+    while (not closed) {
+        std::uint64_t dropped;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait_for(lock, _flushInterval, [this]() { return _wakeRequested or _closed; });
+            _wakeRequested = false;
+            std::swap(_active, batch);
+            dropped = _dropped;
+            _dropped = 0;
+            closed = _closed;
+        }
+        if (dropped > 0) {
+            batch += "CompressedRollingFileAppender: discarded " + std::to_string(dropped) +
+                     " messages, compression cannot keep up\n";
+        }
+        // file may have failed to open on rollover, retry with every batch
+        if (_fd < 0 and not _open(false)) {
+            _lost += std::count(batch.begin(), batch.end(), '\n');
+        } else {
+            if (_lost > 0) {
+                batch += "CompressedRollingFileAppender: discarded " + std::to_string(_lost) +
+                         " messages, file could not be opened\n";
+                _lost = 0;
+            }
+            _compress(batch);
+        }
+        batch.clear();
+
+        auto const age = std::chrono::steady_clock::now() - _openTime;
+        if (not closed and ((_maxFileSize > 0 and _fileSize >= _maxFileSize) or
+                            (_rolloverInterval.count() > 0 and _fileSize > 0 and age >= _rolloverInterval))) {
+            _rollover();
+        }
+    }
+}
+
+void CompressedRollingFileAppender::_compress(std::string const& data) {
+    if (data.empty() or _fd < 0) {
+        return;
+    }
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, _compressionLevel, Z_DEFLATED, ::GZIP_WINDOW_BITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        _error("failed to initialize compression");
+        return;
+    }
+    _output.resize(::OUTPUT_CHUNK);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = data.size();
+    int status;
+    do {
+        stream.next_out = _output.data();
+        stream.avail_out = _output.size();
+        status = deflate(&stream, Z_FINISH);
+        _write(reinterpret_cast<char const*>(_output.data()), _output.size() - stream.avail_out);
+    } while (status == Z_OK or status == Z_BUF_ERROR);
+    if (status != Z_STREAM_END) {
+        _error("compression failed");
+    }
+    deflateEnd(&stream);
+}
+
+void CompressedRollingFileAppender::_write(char const* data, std::size_t size) {
+    while (size > 0 and _fd >= 0) {
+        ssize_t const n = ::write(_fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _error(std::string("write failed: ") + std::strerror(errno));
+            return;
+        }
+        data += n;
+        size -= n;
+        _fileSize += n;
+    }
+}
+
+bool CompressedRollingFileAppender::_open(bool truncate) {
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+    if (truncate) {
+        flags |= O_TRUNC;
+    }
+    _fd = ::open(_fileName.c_str(), flags, 0666);
+    if (_fd < 0) {
+        _error("failed to open file " + _fileName + ": " + std::strerror(errno));
+        return false;
+    }
+    struct stat st;
+    _fileSize = ::fstat(_fd, &st) == 0 ? st.st_size : 0;
+    _openTime = std::chrono::steady_clock::now();
+    _failed = false;
+    return true;
+}
+
+std::string CompressedRollingFileAppender::_backupName(int index) const {
+    std::string const suffix = ".gz";
+    std::string const number = "." + std::to_string(index);
+    if (_fileName.size() > suffix.size() and
+            _fileName.compare(_fileName.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        return _fileName.substr(0, _fileName.size() - suffix.size()) + number + suffix;
+    }
+    return _fileName + number;
+}
+
+void CompressedRollingFileAppender::_rollover() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    if (_maxBackupIndex > 0) {
+        std::remove(_backupName(_maxBackupIndex).c_str());
+        for (int index = _maxBackupIndex - 1; index >= 1; --index) {
+            std::rename(_backupName(index).c_str(), _backupName(index + 1).c_str());
+        }
+        if (std::rename(_fileName.c_str(), _backupName(1).c_str()) != 0) {
+            _error("failed to rename " + _fileName + ": " + std::strerror(errno));
+        }
+    }
+    _open(true);
+}
+
+void CompressedRollingFileAppender::_error(std::string const& message) {
+    if (not _failed) {
+        _failed = true;
+        LOG4CXX_DECODE_CHAR(msg, "CompressedRollingFileAppender: " + message);
+        LogLog::error(msg);
+    }
+}
+
+void CompressedRollingFileAppender::close() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_closed) {
+            return;
+        }
+        _closed = true;
+    }
+    _cond.notify_one();
+    // thread compresses everything left before it stops
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+bool CompressedRollingFileAppender::requiresLayout() const {
+    return true;
+}
+
+void CompressedRollingFileAppender::activateOptions(Pool& p) {
+    if (_thread.joinable() or _closed) {
+        return;
+    }
+    if (_fileName.empty()) {
+        LogLog::error(LOG4CXX_STR("CompressedRollingFileAppender: File option is not set"));
+        return;
+    }
+    if (not getLayout()) {
+        LogLog::error(LOG4CXX_STR("CompressedRollingFileAppender: layout is not set"));
+        return;
+    }
+    if (not _open(not _fileAppend)) {
+        return;
+    }
+    _active.reserve(_bufferSize);
+    _thread = std::thread(&CompressedRollingFileAppender::_run, this);
+}
+
+void CompressedRollingFileAppender::setOption(const LogString &option, const LogString &value) {
+
+    if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("FILE"), LOG4CXX_STR("file"))) {
+        LOG4CXX_ENCODE_CHAR(fileName, value);
+        _fileName = fileName;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("APPEND"), LOG4CXX_STR("append"))) {
+        _fileAppend = OptionConverter::toBoolean(value, true);
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("COMPRESSIONLEVEL"),
+                                              LOG4CXX_STR("compressionlevel"))) {
+        _compressionLevel = std::clamp(OptionConverter::toInt(value, 6), 1, 9);
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("BUFFERSIZE"),
+                                              LOG4CXX_STR("buffersize"))) {
+        int const size = OptionConverter::toInt(value, 256 * 1024);
+        _bufferSize = size > 0 ? size : 1;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("FLUSHINTERVAL"),
+                                              LOG4CXX_STR("flushinterval"))) {
+        int const interval = OptionConverter::toInt(value, 1000);
+        _flushInterval = std::chrono::milliseconds(std::max(interval, 1));
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("MAXBUFFERSIZE"),
+                                              LOG4CXX_STR("maxbuffersize"))) {
+        long const size = OptionConverter::toFileSize(value, 64 * 1024 * 1024);
+        _maxBufferSize = size > 0 ? size : 1;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("MAXFILESIZE"),
+                                              LOG4CXX_STR("maxfilesize"))) {
+        long const size = OptionConverter::toFileSize(value, 0);
+        _maxFileSize = size > 0 ? size : 0;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("ROLLOVERINTERVAL"),
+                                              LOG4CXX_STR("rolloverinterval"))) {
+        int const interval = OptionConverter::toInt(value, 0);
+        _rolloverInterval = std::chrono::seconds(std::max(interval, 0));
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("MAXBACKUPINDEX"),
+                                              LOG4CXX_STR("maxbackupindex"))) {
+        _maxBackupIndex = std::max(OptionConverter::toInt(value, 1), 0);
+    } else {
+        AppenderSkeleton::setOption(option, value);
+    }
+}
+
+} // namespace lsst::log::detail
@@ -0,0 +1,193 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_COMPRESSEDROLLINGFILEAPPENDER_H
+#define LSST_LOG_COMPRESSEDROLLINGFILEAPPENDER_H
+
+// System headers
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Base class header
+#include "log4cxx/appenderskeleton.h"
+
+#include "log4cxx/helpers/object.h"
+
+namespace lsst::log::detail {
+
+// This needs to be here for all LOG4CXX macros to work
+using namespace log4cxx;
+
+/**
+ *  Appender which writes gzip-compressed output and rotates files.
+ *
+ *  Logging thread only formats the event and appends it to a memory
+ *  buffer. Filled buffers are swapped out (double-buffering) by a
+ *  background thread which compresses each one into a separate gzip
+ *  member, writes it to the file and performs rollover, so neither
+ *  compression nor rollover ever blocks logging threads. Concatenated
+ *  gzip members form a valid gzip file, any complete member can be
+ *  decompressed even if the process was killed. Example configuration:
+ *  \code
+ *  log4j.rootLogger = INFO, GZ
+ *  log4j.appender.GZ = lsst.log.CompressedRollingFileAppender
+ *  log4j.appender.GZ.File = /var/log/app.log.gz
+ *  log4j.appender.GZ.MaxFileSize = 100MB
+ *  log4j.appender.GZ.MaxBackupIndex = 5
+ *  log4j.appender.GZ.layout = PatternLayout
+ *  log4j.appender.GZ.layout.ConversionPattern = %d %-5p %c - %m%n
+ *  \endcode
+ *
+ *  Supported options:
+ *  - \c File - output file name, required
+ *  - \c Append - if false then truncate output file, default is true
+ *  - \c CompressionLevel - zlib compression level from 1 (fastest) to 9
+ *    (best), default is 6
+ *  - \c BufferSize - size of a buffer in bytes which triggers compression,
+ *    default is 256 KiB
+ *  - \c FlushInterval - maximum time in milliseconds that events stay in
+ *    a buffer, default is 1000
+ *  - \c MaxBufferSize - if compression cannot keep up and buffered data
+ *    reaches this size then new events are discarded (and counted), default
+ *    is 64 MiB
+ *  - \c MaxFileSize - compressed size of a file which triggers rollover,
+ *    e.g. "100MB", default is 0 (no size limit)
+ *  - \c RolloverInterval - age of a file in seconds which triggers
+ *    rollover, default is 0 (no time limit)
+ *  - \c MaxBackupIndex - number of kept rolled-over files, default is 1,
+ *    0 means that file is truncated on rollover
+ *
+ *  On rollover, file "app.log.gz" is renamed to "app.log.1.gz" (previous
+ *  "app.log.1.gz" to "app.log.2.gz" and so on), for names without ".gz"
+ *  extension index is appended to the name. If new file cannot be opened
+ *  after rollover, opening is retried with every batch and messages lost
+ *  in the meantime are counted and reported in the file.
+ */
+class CompressedRollingFileAppender : public AppenderSkeleton {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(CompressedRollingFileAppender)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(CompressedRollingFileAppender)
+            LOG4CXX_CAST_ENTRY_CHAIN(AppenderSkeleton)
+    END_LOG4CXX_CAST_MAP()
+
+    // Make an instance
+    CompressedRollingFileAppender();
+
+    // Compresses buffered events and stops compression thread
+    ~CompressedRollingFileAppender();
+
+    // we do not support copying
+    CompressedRollingFileAppender(const CompressedRollingFileAppender&) = delete;
+    CompressedRollingFileAppender& operator=(const CompressedRollingFileAppender&) = delete;
+
+    /**
+     * Format the event and add it to a buffer.
+     */
+    void append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Compress all buffered events, close the file and stop the thread.
+     */
+    void close() override;
+
+    /**
+     * Returns true, layout is used to format events.
+     */
+    bool requiresLayout() const override;
+
+    /**
+     * Open output file and start compression thread.
+     */
+    void activateOptions(log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Handle configuration options.
+     */
+    void setOption(const LogString &option, const LogString &value) override;
+
+private:
+
+    // Compression thread
+    void _run();
+
+    // Compress data into a gzip member and write it
+    void _compress(std::string const& data);
+
+    // Open output file, truncating it if `truncate` is true
+    bool _open(bool truncate);
+
+    // Rename files and open new one
+    void _rollover();
+
+    // Return name of the backup file with given index
+    std::string _backupName(int index) const;
+
+    // Write all data to the file
+    void _write(char const* data, std::size_t size);
+
+    // Report error once
+    void _error(std::string const& message);
+
+    // options
+    std::string _fileName;
+    bool _fileAppend = true;
+    int _compressionLevel = 6;
+    std::size_t _bufferSize = 256 * 1024;
+    std::chrono::milliseconds _flushInterval{1000};
+    std::size_t _maxBufferSize = 64 * 1024 * 1024;
+    std::uint64_t _maxFileSize = 0;
+    std::chrono::seconds _rolloverInterval{0};
+    int _maxBackupIndex = 1;
+
+    // shared between logging threads and compression thread
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::string _active;  // buffer which receives new events
+    std::uint64_t _dropped = 0;  // events discarded since last batch
+    bool _wakeRequested = false;
+    bool _closed = false;
+    std::thread _thread;
+
+    LogString _formatted;  // protected by appender lock
+
+    // owned by compression thread
+    int _fd = -1;
+    std::uint64_t _lost = 0;  // messages discarded while file is not open
+    std::uint64_t _fileSize = 0;
+    std::chrono::steady_clock::time_point _openTime;
+    std::vector<unsigned char> _output;
+    bool _failed = false;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_COMPRESSEDROLLINGFILEAPPENDER_H
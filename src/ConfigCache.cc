@@ -0,0 +1,283 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Third-party headers
+#include "log4cxx/helpers/loglog.h"
+#include "log4cxx/helpers/transcoder.h"
+
+// Local headers
+#include "ConfigCache.h"
+
+namespace {
+
+/*
+ *  Cache file consists of a header followed by `count` entries, all
+ *  integers are in native byte order (cache made on a different platform
+ *  is simply re-made). Header is followed by absolute path of the
+ *  configuration file (to detect hash collisions) and then each entry is a
+ *  key and a value, all encoded as uint32 size followed by UTF-8 bytes.
+ */
+char const MAGIC[8] = {'L', 'S', 'S', 'T', 'L', 'C', 'F', 'G'};
+std::uint32_t const VERSION = 2;
+std::uint32_t const BYTE_ORDER_MARK = 0x01020304;
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrderMark;
+    std::int64_t mtime;
+    std::uint64_t size;
+    std::uint64_t inode;
+    std::uint32_t count;
+    std::uint32_t reserved;
+};
+
+// Read whole file, returns false on errors
+bool readFile(std::string const& filename, std::string& data) {
+    int const fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool ok = ::fstat(fd, &st) == 0;
+    if (ok) {
+        data.resize(st.st_size);
+        std::size_t pos = 0;
+        while (pos < data.size()) {
+            ssize_t const n = ::read(fd, &data[pos], data.size() - pos);
+            if (n < 0 and errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                ok = false;
+                break;
+            }
+            pos += n;
+        }
+    }
+    ::close(fd);
+    return ok;
+}
+
+// Write whole buffer, returns false on errors
+bool writeFile(int fd, std::string const& data) {
+    std::size_t pos = 0;
+    while (pos < data.size()) {
+        ssize_t const n = ::write(fd, data.data() + pos, data.size() - pos);
+        if (n < 0 and errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        pos += n;
+    }
+    return true;
+}
+
+void putBytes(std::string& out, std::string const& bytes) {
+    auto const size = static_cast<std::uint32_t>(bytes.size());
+    out.append(reinterpret_cast<char const*>(&size), sizeof(size));
+    out += bytes;
+}
+
+void putString(std::string& out, log4cxx::LogString const& str) {
+    std::string bytes;
+    log4cxx::helpers::Transcoder::encodeUTF8(str, bytes);
+    putBytes(out, bytes);
+}
+
+// Extract bytes at `pos` and advance it, returns false if data is truncated
+bool getBytes(std::string const& data, std::size_t& pos, std::string& bytes) {
+    std::uint32_t size;
+    if (data.size() - pos < sizeof(size)) {
+        return false;
+    }
+    std::memcpy(&size, data.data() + pos, sizeof(size));
+    pos += sizeof(size);
+    if (data.size() - pos < size) {
+        return false;
+    }
+    bytes.assign(data, pos, size);
+    pos += size;
+    return true;
+}
+
+// Decode string at `pos` and advance it, returns false if data is truncated
+bool getString(std::string const& data, std::size_t& pos, log4cxx::LogString& str) {
+    std::string bytes;
+    if (not getBytes(data, pos, bytes)) {
+        return false;
+    }
+    str.clear();
+    log4cxx::helpers::Transcoder::decodeUTF8(bytes, str);
+    return true;
+}
+
+// Return absolute normalized path, empty on errors
+std::string absolutePath(std::string const& filename) {
+    std::error_code ec;
+    auto const path = std::filesystem::absolute(filename, ec);
+    return ec ? std::string() : path.lexically_normal().string();
+}
+
+// Return cache directory, empty if neither XDG_CACHE_HOME nor HOME is set
+std::filesystem::path cacheDirectory() {
+    char const* xdg = std::getenv("XDG_CACHE_HOME");
+    // XDG specification says relative paths are to be ignored
+    if (xdg != nullptr and xdg[0] == '/') {
+        return std::filesystem::path(xdg) / "lsst_log";
+    }
+    char const* home = std::getenv("HOME");
+    if (home != nullptr and home[0] == '/') {
+        return std::filesystem::path(home) / ".cache" / "lsst_log";
+    }
+    return std::filesystem::path();
+}
+
+// 64-bit FNV-1a hash
+std::uint64_t fnv1a(std::string const& bytes) {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c: bytes) {
+        hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+} // namespace
+
+namespace lsst::log::detail {
+
+ConfigSignature configSignature(std::string const& filename) {
+    ConfigSignature signature;
+    struct stat st;
+    if (::stat(filename.c_str(), &st) != 0) {
+        return signature;
+    }
+    signature.valid = true;
+#ifdef __APPLE__
+    signature.mtime = std::int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    signature.mtime = std::int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    signature.size = st.st_size;
+    signature.inode = st.st_ino;
+    return signature;
+}
+
+std::string configCacheName(std::string const& filename) {
+    std::string const path = ::absolutePath(filename);
+    auto const dir = ::cacheDirectory();
+    if (path.empty() or dir.empty()) {
+        return std::string();
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.cfg", static_cast<unsigned long long>(::fnv1a(path)));
+    return (dir / name).string();
+}
+
+bool readConfigCache(std::string const& filename, ConfigSignature const& signature, PropertyMap& props) {
+    std::string const cacheName = configCacheName(filename);
+    std::string data;
+    if (cacheName.empty() or not ::readFile(cacheName, data) or data.size() < sizeof(::Header)) {
+        return false;
+    }
+    ::Header header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, ::MAGIC, sizeof(::MAGIC)) != 0 or header.version != ::VERSION or
+            header.byteOrderMark != ::BYTE_ORDER_MARK or header.mtime != signature.mtime or
+            header.size != signature.size or header.inode != signature.inode) {
+        return false;
+    }
+
+    std::size_t pos = sizeof(header);
+    std::string path;
+    if (not ::getBytes(data, pos, path) or path != ::absolutePath(filename)) {
+        return false;
+    }
+
+    PropertyMap result;
+    log4cxx::LogString key, value;
+    for (std::uint32_t i = 0; i < header.count; ++i) {
+        if (not ::getString(data, pos, key) or not ::getString(data, pos, value)) {
+            return false;
+        }
+        result.emplace(key, value);
+    }
+    if (pos != data.size()) {
+        return false;
+    }
+    props.swap(result);
+    return true;
+}
+
+void writeConfigCache(std::string const& filename, ConfigSignature const& signature, PropertyMap const& props) {
+    ::Header header = {};
+    std::memcpy(header.magic, ::MAGIC, sizeof(::MAGIC));
+    header.version = ::VERSION;
+    header.byteOrderMark = ::BYTE_ORDER_MARK;
+    header.mtime = signature.mtime;
+    header.size = signature.size;
+    header.inode = signature.inode;
+    header.count = static_cast<std::uint32_t>(props.size());
+    std::string data(reinterpret_cast<char const*>(&header), sizeof(header));
+    ::putBytes(data, ::absolutePath(filename));
+    for (auto const& item: props) {
+        ::putString(data, item.first);
+        ::putString(data, item.second);
+    }
+
+    // write to a temporary file and rename it so that readers never see
+    // partial cache
+    std::string const cacheName = configCacheName(filename);
+    if (cacheName.empty()) {
+        return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(cacheName).parent_path(), ec);
+    std::string const tmpName = cacheName + ".tmp" + std::to_string(::getpid());
+    int const fd = ::open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        LOG4CXX_DECODE_CHAR(lsname, cacheName);
+        log4cxx::helpers::LogLog::debug(LOG4CXX_STR("Cannot write configuration cache [") + lsname +
+                                        LOG4CXX_STR("]."));
+        return;
+    }
+    bool const ok = ::writeFile(fd, data);
+    if (::close(fd) != 0 or not ok or std::rename(tmpName.c_str(), cacheName.c_str()) != 0) {
+        ::unlink(tmpName.c_str());
+    }
+}
+
+} // namespace lsst::log::detail
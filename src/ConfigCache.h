@@ -0,0 +1,84 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_CONFIGCACHE_H
+#define LSST_LOG_CONFIGCACHE_H
+
+// System headers
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Third-party headers
+#include "log4cxx/log4cxx.h"
+
+namespace lsst::log::detail {
+
+using PropertyMap = std::map<log4cxx::LogString, log4cxx::LogString>;
+
+/**
+ *  Identity of a configuration file version, cache is only used if it was
+ *  made from the file with the same modification time, size and inode.
+ */
+struct ConfigSignature {
+    bool valid = false;  // false if file cannot be stat'ed
+    std::int64_t mtime = 0;  // nanoseconds
+    std::uint64_t size = 0;
+    std::uint64_t inode = 0;
+};
+
+/// Return signature of a configuration file.
+ConfigSignature configSignature(std::string const& filename);
+
+/**
+ *  Return name of the cache file for a configuration file.
+ *
+ *  Cache files live in `$XDG_CACHE_HOME/lsst_log` (or `~/.cache/lsst_log`)
+ *  so that configurations in read-only install trees are cached too, name
+ *  is made from a hash of the absolute path of configuration file. Returns
+ *  empty string if there is no cache directory.
+ */
+std::string configCacheName(std::string const& filename);
+
+/**
+ *  Read parsed properties of a configuration file from its cache file.
+ *
+ *  Returns false if cache file does not exist, it was made from a
+ *  different file or a different version of the file (`signature` does
+ *  not match), or it is corrupted.
+ */
+bool readConfigCache(std::string const& filename, ConfigSignature const& signature, PropertyMap& props);
+
+/**
+ *  Write parsed properties of a configuration file to its cache file.
+ *
+ *  `signature` has to be taken before the file was parsed, so that changes
+ *  made during parsing invalidate the cache. Cache directory is created if
+ *  needed, cache is replaced atomically, failures are ignored.
+ */
+void writeConfigCache(std::string const& filename, ConfigSignature const& signature, PropertyMap const& props);
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_CONFIGCACHE_H
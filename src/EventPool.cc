@@ -0,0 +1,245 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// Third-party headers
+#include "log4cxx/helpers/transcoder.h"
+
+// Local headers
+#include "EventPool.h"
+#include "lwpID.h"
+
+namespace {
+
+using lsst::log::detail::EVENT_BLOCK_SIZE;
+
+struct EventArena;
+
+// Header in front of each block, keeps payload aligned for any type
+struct alignas(std::max_align_t) BlockHeader {
+    BlockHeader* next;
+    EventArena* owner;  // null for heap blocks
+};
+
+/*
+ *  Free list of one thread. Only the owning thread touches `local`, other
+ *  threads push released blocks onto `remote` which the owner takes over
+ *  as a whole when `local` runs out, so there is no ABA problem.
+ */
+struct EventArena {
+    BlockHeader* local = nullptr;
+    std::atomic<BlockHeader*> remote{nullptr};
+};
+
+/*
+ *  Arenas are never destroyed because blocks may outlive their thread (e.g.
+ *  events queued in asynchronous appender), arena of a finished thread is
+ *  re-used by the next new thread.
+ */
+struct ArenaRegistry {
+    std::mutex mutex;
+    std::vector<EventArena*> idle;
+};
+
+ArenaRegistry& arenaRegistry() {
+    static ArenaRegistry* registry = new ArenaRegistry();
+    return *registry;
+}
+
+EventArena* acquireArena() {
+    auto& registry = arenaRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (registry.idle.empty()) {
+        return new EventArena();
+    }
+    EventArena* arena = registry.idle.back();
+    registry.idle.pop_back();
+    return arena;
+}
+
+void releaseArena(EventArena* arena) {
+    auto& registry = arenaRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.idle.push_back(arena);
+}
+
+// Per-thread state, all trivially destructible so that it is
+// safe to use during destruction of other thread-local objects
+thread_local EventArena* currentArena = nullptr;
+thread_local log4cxx::helpers::Pool* currentPool = nullptr;
+thread_local unsigned poolUseCount = 0;
+thread_local unsigned poolDepth = 0;
+thread_local bool threadExiting = false;
+
+// Number of messages after which per-thread log4cxx pool is replaced
+unsigned const POOL_RECYCLE_COUNT = 1024;
+
+// Releases per-thread resources at thread exit
+struct ThreadResources {
+    std::optional<log4cxx::helpers::Pool> pool;
+
+    ~ThreadResources() {
+        threadExiting = true;
+        currentPool = nullptr;
+        if (currentArena != nullptr) {
+            releaseArena(currentArena);
+            currentArena = nullptr;
+        }
+    }
+};
+
+ThreadResources* threadResources() {
+    if (threadExiting) {
+        return nullptr;
+    }
+    thread_local ThreadResources resources;
+    return &resources;
+}
+
+EventArena* threadArena() {
+    if (currentArena == nullptr) {
+        if (threadResources() == nullptr) {
+            return nullptr;
+        }
+        currentArena = acquireArena();
+    }
+    return currentArena;
+}
+
+}  // namespace
+
+namespace lsst::log::detail {
+
+void* allocateEventBlock(std::size_t size) {
+    BlockHeader* block = nullptr;
+    EventArena* arena = size <= EVENT_BLOCK_SIZE ? threadArena() : nullptr;
+    if (arena != nullptr) {
+        if (arena->local == nullptr) {
+            arena->local = arena->remote.exchange(nullptr, std::memory_order_acquire);
+        }
+        if (arena->local != nullptr) {
+            block = arena->local;
+            arena->local = block->next;
+        } else {
+            block = static_cast<BlockHeader*>(::operator new(sizeof(BlockHeader) + EVENT_BLOCK_SIZE));
+        }
+    } else {
+        block = static_cast<BlockHeader*>(::operator new(sizeof(BlockHeader) + size));
+    }
+    block->owner = arena;
+    return block + 1;
+}
+
+void deallocateEventBlock(void* ptr) noexcept {
+    BlockHeader* block = static_cast<BlockHeader*>(ptr) - 1;
+    EventArena* owner = block->owner;
+    if (owner == nullptr) {
+        ::operator delete(block);
+    } else if (owner == currentArena) {
+        block->next = owner->local;
+        owner->local = block;
+    } else {
+        block->next = owner->remote.load(std::memory_order_relaxed);
+        while (not owner->remote.compare_exchange_weak(block->next, block, std::memory_order_release,
+                                                       std::memory_order_relaxed)) {
+        }
+    }
+}
+
+log4cxx::spi::LoggingEventPtr makeLoggingEvent(log4cxx::LogString const& logger,
+                                               log4cxx::LevelPtr const& level,
+                                               log4cxx::LogString const& message,
+                                               log4cxx::spi::LocationInfo const& location) {
+    return std::allocate_shared<LsstLoggingEvent>(EventAllocator<LsstLoggingEvent>(), logger, level, message,
+                                                  location, lwpID(), currentTraceContext);
+}
+
+log4cxx::spi::LoggingEventPtr makeLoggingEvent(log4cxx::LogString const& logger,
+                                               log4cxx::LevelPtr const& level,
+                                               FormatRecord const& record,
+                                               log4cxx::spi::LocationInfo const& location) {
+    return std::allocate_shared<FormatLoggingEvent>(EventAllocator<FormatLoggingEvent>(), logger, level, record,
+                                                    location, lwpID(), currentTraceContext);
+}
+
+void appendEventMessage(log4cxx::spi::LoggingEvent const& event, log4cxx::LogString& out) {
+    auto const* deferred = dynamic_cast<FormatLoggingEvent const*>(&event);
+    if (deferred == nullptr) {
+        out += event.getRenderedMessage();
+        return;
+    }
+    if constexpr (std::is_same_v<log4cxx::LogString, std::string>) {
+        deferred->render(out);
+    } else {
+        std::string message;
+        deferred->render(message);
+        log4cxx::helpers::Transcoder::decodeUTF8(message, out);
+    }
+}
+
+unsigned eventLwpID(log4cxx::spi::LoggingEvent const& event) {
+    if (auto const* lsstEvent = dynamic_cast<LsstLoggingEvent const*>(&event)) {
+        return lsstEvent->lwp;
+    }
+    return lwpID();
+}
+
+EventPoolScope::EventPoolScope() : _pool(nullptr), _owned(false) {
+    ThreadResources* resources = threadResources();
+    if (resources == nullptr) {
+        // thread is exiting, use temporary pool
+        _pool = new log4cxx::helpers::Pool();
+        _owned = true;
+        return;
+    }
+    if (currentPool == nullptr) {
+        currentPool = &resources->pool.emplace();
+    }
+    _pool = currentPool;
+    ++poolDepth;
+}
+
+EventPoolScope::~EventPoolScope() {
+    if (_owned) {
+        delete _pool;
+        return;
+    }
+    if (--poolDepth == 0 and ++poolUseCount >= POOL_RECYCLE_COUNT) {
+        poolUseCount = 0;
+        if (ThreadResources* resources = threadResources()) {
+            resources->pool.reset();
+            currentPool = nullptr;
+        }
+    }
+}
+
+} // namespace lsst::log::detail
@@ -0,0 +1,217 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_EVENTPOOL_H
+#define LSST_LOG_EVENTPOOL_H
+
+// System headers
+#include <cstddef>
+#include <string>
+
+// Third-party headers
+#include "log4cxx/helpers/pool.h"
+#include "log4cxx/level.h"
+#include "log4cxx/spi/location/locationinfo.h"
+#include "log4cxx/spi/loggingevent.h"
+
+// Local headers
+#include "lsst/log/FormatRecord.h"
+#include "lsst/log/TraceContext.h"
+
+namespace lsst::log::detail {
+
+/**
+ *  Allocate memory block for a logging event.
+ *
+ *  Blocks of up to EVENT_BLOCK_SIZE bytes come from a per-thread free list,
+ *  larger blocks (and blocks requested after thread-local storage has been
+ *  destroyed) come from the heap.
+ */
+void* allocateEventBlock(std::size_t size);
+
+/**
+ *  Return memory block allocated with allocateEventBlock().
+ *
+ *  Block can be returned by any thread, blocks released by other threads
+ *  are handed back to the allocating thread through a lock-free list.
+ */
+void deallocateEventBlock(void* ptr) noexcept;
+
+/// Largest block size served from per-thread free lists.
+constexpr std::size_t EVENT_BLOCK_SIZE = 512;
+
+/**
+ *  Standard allocator which uses allocateEventBlock(), all instances are
+ *  interchangeable.
+ */
+template <typename T>
+class EventAllocator {
+public:
+
+    using value_type = T;
+
+    EventAllocator() noexcept = default;
+
+    template <typename U>
+    EventAllocator(EventAllocator<U> const&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(allocateEventBlock(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t) noexcept {
+        deallocateEventBlock(ptr);
+    }
+
+    template <typename U>
+    bool operator==(EventAllocator<U> const&) const noexcept { return true; }
+
+    template <typename U>
+    bool operator!=(EventAllocator<U> const&) const noexcept { return false; }
+};
+
+/**
+ *  Logging event made by Log, carries LWP ID and trace context of the
+ *  thread which made it, see detail::eventLwpID() and
+ *  detail::eventTraceContext().
+ */
+class LsstLoggingEvent : public log4cxx::spi::LoggingEvent {
+public:
+
+    LsstLoggingEvent(log4cxx::LogString const& logger, log4cxx::LevelPtr const& level,
+                     log4cxx::LogString const& message, log4cxx::spi::LocationInfo const& location,
+                     unsigned lwp_, TraceContext const& trace_)
+        : LoggingEvent(logger, level, message, location), lwp(lwp_), trace(trace_) {}
+
+    unsigned const lwp;
+    TraceContext const trace;
+};
+
+/**
+ *  Logging event of LOGF* macros with deferred message rendering.
+ *
+ *  Message of the event itself is empty, format string and encoded
+ *  arguments of FormatRecord are kept instead and the message is rendered
+ *  only by appenders or layouts which need it, possibly in another thread.
+ *  Log makes these events only when all appenders that would see them
+ *  support it (see DeferredMessageSupport), code which reads message of
+ *  an arbitrary event should use appendEventMessage().
+ */
+class FormatLoggingEvent : public LsstLoggingEvent {
+public:
+
+    /// Type of argument storage, memory comes from per-thread free lists.
+    using Args = std::basic_string<char, std::char_traits<char>, EventAllocator<char>>;
+
+    FormatLoggingEvent(log4cxx::LogString const& logger, log4cxx::LevelPtr const& level,
+                       FormatRecord const& record, log4cxx::spi::LocationInfo const& location,
+                       unsigned lwp_, TraceContext const& trace_)
+        : LsstLoggingEvent(logger, level, log4cxx::LogString(), location, lwp_, trace_),
+          format(record.format()), args(record.data(), record.size()) {}
+
+    /// Render the message and append it to a string.
+    void render(std::string& out) const { FormatRecord::render(out, format, args.data(), args.size()); }
+
+    char const* const format;  ///< format string, has static storage duration
+    Args const args;  ///< encoded arguments
+};
+
+/**
+ *  Interface for appenders and layouts which can handle FormatLoggingEvent,
+ *  i.e. which use appendEventMessage() (or render the event themselves)
+ *  instead of event message.
+ */
+class DeferredMessageSupport {
+public:
+
+    virtual ~DeferredMessageSupport() = default;
+
+    /// Return true if events with deferred message can be passed to this instance.
+    virtual bool supportsDeferredMessages() const = 0;
+};
+
+/**
+ *  Append message of the event to a string, deferred messages of
+ *  FormatLoggingEvent are rendered.
+ */
+void appendEventMessage(log4cxx::spi::LoggingEvent const& event, log4cxx::LogString& out);
+
+/**
+ *  Return LWP ID of the thread which made the event. Events which were
+ *  not made by makeLoggingEvent() do not have it, LWP ID of the current
+ *  thread is returned for them.
+ */
+unsigned eventLwpID(log4cxx::spi::LoggingEvent const& event);
+
+/**
+ *  Make new logging event, event and its shared pointer control block
+ *  reside in a single block from per-thread free list which is recycled
+ *  when last reference to the event is released (after synchronous
+ *  appenders are done or when asynchronous appender drops it). Event
+ *  records LWP ID and trace context of the current thread so that
+ *  appenders which format it in other threads report correct values.
+ */
+log4cxx::spi::LoggingEventPtr makeLoggingEvent(log4cxx::LogString const& logger,
+                                               log4cxx::LevelPtr const& level,
+                                               log4cxx::LogString const& message,
+                                               log4cxx::spi::LocationInfo const& location);
+
+/**
+ *  Make new FormatLoggingEvent in the same way as makeLoggingEvent()
+ *  does, record arguments are copied.
+ */
+log4cxx::spi::LoggingEventPtr makeLoggingEvent(log4cxx::LogString const& logger,
+                                               log4cxx::LevelPtr const& level,
+                                               FormatRecord const& record,
+                                               log4cxx::spi::LocationInfo const& location);
+
+/**
+ *  Gives access to per-thread log4cxx memory pool passed to appenders.
+ *
+ *  log4cxx makes a new pool for every message, here the pool is re-used
+ *  by all messages from the same thread and is replaced periodically (when
+ *  no scope is active in the thread) to release memory that appenders may
+ *  have allocated from it. Scopes can be nested, e.g. when appender itself
+ *  logs a message.
+ */
+class EventPoolScope {
+public:
+
+    EventPoolScope();
+    ~EventPoolScope();
+
+    EventPoolScope(EventPoolScope const&) = delete;
+    EventPoolScope& operator=(EventPoolScope const&) = delete;
+
+    /// Return pool to use for appending events.
+    log4cxx::helpers::Pool& pool() { return *_pool; }
+
+private:
+    log4cxx::helpers::Pool* _pool;
+    bool _owned;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_EVENTPOOL_H
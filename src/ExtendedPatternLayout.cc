@@ -0,0 +1,131 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <charconv>
+
+// Third-party headers
+#include "log4cxx/spi/loggingevent.h"
+
+// Local headers
+#include "lsst/log/TraceContext.h"
+#include "EventPool.h"
+#include "ExtendedPatternLayout.h"
+
+// macro below dows not work without this using directive
+// (and it breaks if placed inside namespaces)
+using lsst::log::detail::EventMessagePatternConverter;
+using lsst::log::detail::ExtendedPatternLayout;
+using lsst::log::detail::LwpPatternConverter;
+using lsst::log::detail::TraceContextPatternConverter;
+IMPLEMENT_LOG4CXX_OBJECT(EventMessagePatternConverter)
+IMPLEMENT_LOG4CXX_OBJECT(ExtendedPatternLayout)
+IMPLEMENT_LOG4CXX_OBJECT(LwpPatternConverter)
+IMPLEMENT_LOG4CXX_OBJECT(TraceContextPatternConverter)
+
+namespace lsst::log::detail {
+
+LwpPatternConverter::LwpPatternConverter()
+    : LoggingEventPatternConverter(LOG4CXX_STR("LWP"), LOG4CXX_STR("lwp")) {
+}
+
+pattern::PatternConverterPtr LwpPatternConverter::newInstance(std::vector<LogString> const& options) {
+    // there is no state, same instance can be shared
+    static pattern::PatternConverterPtr instance = std::make_shared<LwpPatternConverter>();
+    return instance;
+}
+
+void LwpPatternConverter::format(const spi::LoggingEventPtr& event, LogString& toAppendTo,
+                                 log4cxx::helpers::Pool& p) const {
+    char buffer[16];
+    auto const res = std::to_chars(buffer, buffer + sizeof(buffer), eventLwpID(*event));
+    toAppendTo.append(buffer, res.ptr);
+}
+
+TraceContextPatternConverter::TraceContextPatternConverter(bool span)
+    : LoggingEventPatternConverter(span ? LOG4CXX_STR("SpanId") : LOG4CXX_STR("TraceId"),
+                                   span ? LOG4CXX_STR("spanid") : LOG4CXX_STR("traceid")),
+      _span(span) {
+}
+
+pattern::PatternConverterPtr TraceContextPatternConverter::newTraceIdInstance(
+        std::vector<LogString> const& options) {
+    static pattern::PatternConverterPtr instance = std::make_shared<TraceContextPatternConverter>(false);
+    return instance;
+}
+
+pattern::PatternConverterPtr TraceContextPatternConverter::newSpanIdInstance(
+        std::vector<LogString> const& options) {
+    static pattern::PatternConverterPtr instance = std::make_shared<TraceContextPatternConverter>(true);
+    return instance;
+}
+
+void TraceContextPatternConverter::format(const spi::LoggingEventPtr& event, LogString& toAppendTo,
+                                          log4cxx::helpers::Pool& p) const {
+    TraceContext const trace = eventTraceContext(*event);
+    if (not trace.valid()) {
+        return;
+    }
+    char buffer[32];
+    char* const end = _span ? trace.formatSpanId(buffer) : trace.formatTraceId(buffer);
+    toAppendTo.append(buffer, end);
+}
+
+EventMessagePatternConverter::EventMessagePatternConverter()
+    : LoggingEventPatternConverter(LOG4CXX_STR("Message"), LOG4CXX_STR("message")) {
+}
+
+pattern::PatternConverterPtr EventMessagePatternConverter::newInstance(std::vector<LogString> const& options) {
+    static pattern::PatternConverterPtr instance = std::make_shared<EventMessagePatternConverter>();
+    return instance;
+}
+
+void EventMessagePatternConverter::format(const spi::LoggingEventPtr& event, LogString& toAppendTo,
+                                          log4cxx::helpers::Pool& p) const {
+    appendEventMessage(*event, toAppendTo);
+}
+
+ExtendedPatternLayout::ExtendedPatternLayout() {
+}
+
+ExtendedPatternLayout::ExtendedPatternLayout(const LogString& pattern) {
+    // base class constructor taking pattern would not see our conversions
+    setConversionPattern(pattern);
+}
+
+bool ExtendedPatternLayout::supportsDeferredMessages() const {
+    return true;
+}
+
+pattern::PatternMap ExtendedPatternLayout::getFormatSpecifiers() {
+    pattern::PatternMap specifiers = PatternLayout::getFormatSpecifiers();
+    specifiers[LOG4CXX_STR("m")] = EventMessagePatternConverter::newInstance;
+    specifiers[LOG4CXX_STR("message")] = EventMessagePatternConverter::newInstance;
+    specifiers.emplace(LOG4CXX_STR("lwp"), LwpPatternConverter::newInstance);
+    specifiers.emplace(LOG4CXX_STR("traceid"), TraceContextPatternConverter::newTraceIdInstance);
+    specifiers.emplace(LOG4CXX_STR("spanid"), TraceContextPatternConverter::newSpanIdInstance);
+    return specifiers;
+}
+
+} // namespace lsst::log::detail
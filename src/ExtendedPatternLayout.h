@@ -0,0 +1,185 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_EXTENDEDPATTERNLAYOUT_H
+#define LSST_LOG_EXTENDEDPATTERNLAYOUT_H
+
+// System headers
+#include <vector>
+
+// Base class header
+#include "log4cxx/patternlayout.h"
+
+#include "log4cxx/helpers/object.h"
+#include "log4cxx/pattern/loggingeventpatternconverter.h"
+
+// Local headers
+#include "EventPool.h"
+
+namespace lsst::log::detail {
+
+// This needs to be here for all LOG4CXX macros to work
+using namespace log4cxx;
+
+/**
+ *  Pattern converter for \c %lwp conversion, renders LWP ID (as returned
+ *  by lwpID()) of the thread which logged the message, also when the
+ *  event is formatted by another thread.
+ */
+class LwpPatternConverter : public pattern::LoggingEventPatternConverter {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(LwpPatternConverter)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(LwpPatternConverter)
+            LOG4CXX_CAST_ENTRY_CHAIN(pattern::LoggingEventPatternConverter)
+    END_LOG4CXX_CAST_MAP()
+
+    LwpPatternConverter();
+
+    /// Factory method used by ExtendedPatternLayout
+    static pattern::PatternConverterPtr newInstance(std::vector<LogString> const& options);
+
+    using pattern::LoggingEventPatternConverter::format;
+
+    /**
+     * Append LWP ID of the thread which made the event.
+     */
+    void format(const spi::LoggingEventPtr& event, LogString& toAppendTo,
+                log4cxx::helpers::Pool& p) const override;
+};
+
+/**
+ *  Pattern converter for \c %traceid and \c %spanid conversions, renders
+ *  trace ID or span ID of the trace context (see TraceContext) which was
+ *  current when the event was logged, nothing if there was none.
+ */
+class TraceContextPatternConverter : public pattern::LoggingEventPatternConverter {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(TraceContextPatternConverter)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(TraceContextPatternConverter)
+            LOG4CXX_CAST_ENTRY_CHAIN(pattern::LoggingEventPatternConverter)
+    END_LOG4CXX_CAST_MAP()
+
+    /// Make converter for span ID if `span` is true, trace ID otherwise.
+    explicit TraceContextPatternConverter(bool span = false);
+
+    /// Factory methods used by ExtendedPatternLayout
+    static pattern::PatternConverterPtr newTraceIdInstance(std::vector<LogString> const& options);
+    static pattern::PatternConverterPtr newSpanIdInstance(std::vector<LogString> const& options);
+
+    using pattern::LoggingEventPatternConverter::format;
+
+    /**
+     * Append trace or span ID of the event as lower-case hex digits.
+     */
+    void format(const spi::LoggingEventPtr& event, LogString& toAppendTo,
+                log4cxx::helpers::Pool& p) const override;
+
+private:
+    bool _span;
+};
+
+/**
+ *  Pattern converter for \c %m and \c %message conversions, same as
+ *  standard converter but also renders deferred messages of
+ *  FormatLoggingEvent.
+ */
+class EventMessagePatternConverter : public pattern::LoggingEventPatternConverter {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(EventMessagePatternConverter)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(EventMessagePatternConverter)
+            LOG4CXX_CAST_ENTRY_CHAIN(pattern::LoggingEventPatternConverter)
+    END_LOG4CXX_CAST_MAP()
+
+    EventMessagePatternConverter();
+
+    /// Factory method used by ExtendedPatternLayout
+    static pattern::PatternConverterPtr newInstance(std::vector<LogString> const& options);
+
+    using pattern::LoggingEventPatternConverter::format;
+
+    /**
+     * Append message of the event.
+     */
+    void format(const spi::LoggingEventPtr& event, LogString& toAppendTo,
+                log4cxx::helpers::Pool& p) const override;
+};
+
+/**
+ *  PatternLayout which supports additional conversions:
+ *  - \c %lwp - LWP ID of the logging thread (see lwpID()), same value that can be
+ *    added to MDC with LOG_MDC("LWP", ...) but without MDC lookup or a
+ *    system call per message.
+ *  - \c %traceid and \c %spanid - trace ID (32 hex digits) and span ID
+ *    (16 hex digits) of the trace context which was current in the
+ *    logging thread (see TraceContext), empty if it was not set.
+ *
+ *  Example configuration:
+ *  \code
+ *  log4j.appender.A1.layout = lsst.log.ExtendedPatternLayout
+ *  log4j.appender.A1.layout.ConversionPattern = %d [%lwp] %-5p %c - %m%n
+ *  \endcode
+ *
+ *  LWP ID is that of the thread which logged the message, it is recorded
+ *  in the event so it is also correct for AsyncRingAppender which formats
+ *  messages in its writer thread.
+ *
+ *  Messages of LOGF* macros can be rendered by this layout from their
+ *  format and arguments (see DeferredMessageSupport), so that appenders
+ *  which format in another thread take rendering off the logging thread.
+ */
+class ExtendedPatternLayout : public PatternLayout, public DeferredMessageSupport {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(ExtendedPatternLayout)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(ExtendedPatternLayout)
+            LOG4CXX_CAST_ENTRY_CHAIN(PatternLayout)
+    END_LOG4CXX_CAST_MAP()
+
+    ExtendedPatternLayout();
+
+    explicit ExtendedPatternLayout(const LogString& pattern);
+
+    /**
+     * Returns true, %m renders deferred messages.
+     */
+    bool supportsDeferredMessages() const override;
+
+protected:
+
+    /**
+     * Returns standard conversions with the additional ones.
+     */
+    pattern::PatternMap getFormatSpecifiers() override;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_EXTENDEDPATTERNLAYOUT_H
@@ -0,0 +1,589 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Third-party headers
+#include "log4cxx/helpers/transcoder.h"
+
+// Local headers
+#include "FlightRecorder.h"
+#include "lwpID.h"
+
+namespace {
+
+using lsst::log::detail::FormatRecord;
+
+// Total size of a slot, payload takes what is left after header
+std::size_t const SLOT_SIZE = 256;
+
+struct SlotHeader {
+    std::int64_t timestamp;  // microseconds since epoch
+    log4cxx::Logger const* logger;
+    char const* file;
+    char const* fmt;  // format string of unformatted record, null for plain message
+    std::int32_t level;
+    std::int32_t line;
+    std::uint32_t lwp;
+    std::uint32_t size;  // payload size
+    bool truncated;
+};
+
+std::size_t const PAYLOAD_SIZE = SLOT_SIZE - sizeof(std::atomic<std::uint64_t>) - sizeof(SlotHeader);
+
+// Record is a copy of a slot, slot uses a sequence number to detect
+// concurrent updates (seqlock): it is odd while slot is being written.
+struct Record {
+    SlotHeader header;
+    char payload[PAYLOAD_SIZE];
+};
+
+struct Slot {
+    std::atomic<std::uint64_t> sequence{0};
+    Record record;
+};
+
+/*
+ *  Ring of one thread, only owner thread writes, dump can read it from any
+ *  thread or from a signal handler. Rings are never destroyed so that dump
+ *  can see messages of threads which have finished, ring of a finished
+ *  thread is re-used by the next new thread.
+ */
+struct Ring {
+    explicit Ring(std::size_t capacity_) : capacity(capacity_), slots(new Slot[capacity_]) {}
+
+    std::size_t const capacity;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<std::uint64_t> written{0};  // number of records ever written
+    std::atomic<std::uint64_t> dumped{0};  // number of records already dumped
+    Ring* next = nullptr;  // list of all rings
+};
+
+struct RecorderState {
+    std::mutex mutex;  // protects everything except `rings` and `fileName`
+    std::atomic<Ring*> rings{nullptr};  // all rings, only grows
+    std::vector<Ring*> idle;  // rings of finished threads
+    std::size_t capacity = 1024;
+    std::mutex dumpMutex;  // serializes regular dumps
+    // Dump file name, fixed buffer so that signal handler can use it
+    char fileName[4096] = {0};
+};
+
+RecorderState& recorderState() {
+    static RecorderState* state = new RecorderState();
+    return *state;
+}
+
+// trivially destructible so that it can be used during thread exit
+thread_local Ring* currentRing = nullptr;
+thread_local bool threadExiting = false;
+
+struct RingRelease {
+    ~RingRelease() {
+        threadExiting = true;
+        if (currentRing != nullptr) {
+            auto& state = recorderState();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.idle.push_back(currentRing);
+            currentRing = nullptr;
+        }
+    }
+};
+
+Ring* threadRing() {
+    if (currentRing != nullptr) {
+        return currentRing;
+    }
+    if (threadExiting) {
+        return nullptr;
+    }
+    thread_local RingRelease release;
+    auto& state = recorderState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto iter = std::find_if(state.idle.begin(), state.idle.end(),
+                             [&state](Ring const* ring) { return ring->capacity == state.capacity; });
+    if (iter != state.idle.end()) {
+        currentRing = *iter;
+        state.idle.erase(iter);
+    } else {
+        currentRing = new Ring(state.capacity);
+        currentRing->next = state.rings.load(std::memory_order_relaxed);
+        state.rings.store(currentRing, std::memory_order_release);
+    }
+    return currentRing;
+}
+
+// Start writing next slot, returns null if there is no ring
+Record* beginRecord(Ring*& ring, std::uint64_t& index) {
+    ring = threadRing();
+    if (ring == nullptr) {
+        return nullptr;
+    }
+    index = ring->written.load(std::memory_order_relaxed);
+    Slot& slot = ring->slots[index % ring->capacity];
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return &slot.record;
+}
+
+void commitRecord(Ring* ring, std::uint64_t index) {
+    Slot& slot = ring->slots[index % ring->capacity];
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+    ring->written.store(index + 1, std::memory_order_release);
+}
+
+void fillHeader(SlotHeader& header, log4cxx::Logger const* logger, int level,
+                log4cxx::spi::LocationInfo const& location) {
+    header.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    header.logger = logger;
+    header.file = location.getShortFileName();
+    header.level = level;
+    header.line = location.getLineNumber();
+    header.lwp = lsst::log::detail::lwpID();
+}
+
+// Copy slot contents, returns false if slot was overwritten or is being written
+bool readSlot(Ring const& ring, std::uint64_t index, Record& record) {
+    Slot const& slot = ring.slots[index % ring.capacity];
+    std::uint64_t const sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * index + 2) {
+        return false;
+    }
+    std::memcpy(&record.header, &slot.record.header, sizeof(record.header));
+    std::size_t const size = std::min<std::size_t>(record.header.size, PAYLOAD_SIZE);
+    std::memcpy(record.payload, slot.record.payload, size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+// Fixed-size output buffer, safe to use in signal handler
+class LineBuffer {
+public:
+    void append(char const* str, std::size_t size) {
+        size = std::min(size, sizeof(_data) - _size);
+        std::memcpy(_data + _size, str, size);
+        _size += size;
+    }
+    void append(char const* str) { append(str, std::strlen(str)); }
+    void append(char ch) { append(&ch, 1); }
+    void appendNumber(std::uint64_t value, int width = 0) {
+        char digits[24];
+        int n = 0;
+        do {
+            digits[n++] = '0' + value % 10;
+            value /= 10;
+        } while (value != 0);
+        while (n < width) {
+            digits[n++] = '0';
+        }
+        while (n > 0) {
+            append(digits[--n]);
+        }
+    }
+    void appendSigned(std::int64_t value) {
+        if (value < 0) {
+            append('-');
+            appendNumber(-static_cast<std::uint64_t>(value));
+        } else {
+            appendNumber(value);
+        }
+    }
+    char const* data() const { return _data; }
+    std::size_t size() const { return _size; }
+    void clear() { _size = 0; }
+private:
+    char _data[2048];
+    std::size_t _size = 0;
+};
+
+char const* levelName(int level) {
+    static std::pair<int, char const*> const names[] = {
+        {log4cxx::Level::FATAL_INT, "FATAL"}, {log4cxx::Level::ERROR_INT, "ERROR"},
+        {log4cxx::Level::WARN_INT, "WARN"}, {log4cxx::Level::INFO_INT, "INFO"},
+        {log4cxx::Level::DEBUG_INT, "DEBUG"}};
+    for (auto const& item: names) {
+        if (level >= item.first) {
+            return item.second;
+        }
+    }
+    return "TRACE";
+}
+
+/*
+ *  Render unformatted record without memory allocation, only for use in
+ *  signal handler: printf specifications are ignored, numbers are printed
+ *  in default format with limited precision for doubles.
+ */
+void renderSafe(LineBuffer& out, char const* fmt, char const* data, std::size_t size) {
+    char const* const end = data + size;
+    char const* arg = data;
+    for (char const* ptr = fmt; *ptr != '\0'; ++ptr) {
+        if ((ptr[0] == '{' or ptr[0] == '}') and ptr[1] == ptr[0]) {
+            out.append(*ptr++);
+            continue;
+        }
+        char const* close = ptr[0] == '{' ? std::strchr(ptr, '}') : nullptr;
+        if (close == nullptr or arg == nullptr or arg >= end) {
+            out.append(*ptr);
+            continue;
+        }
+        ptr = close;
+        auto const type = static_cast<FormatRecord::ArgType>(*arg++);
+        switch (type) {
+        case FormatRecord::ArgType::Bool:
+            out.append(*arg ? "true" : "false");
+            arg += sizeof(bool);
+            break;
+        case FormatRecord::ArgType::Char:
+            out.append(*arg);
+            arg += sizeof(char);
+            break;
+        case FormatRecord::ArgType::Int: {
+            std::int64_t value;
+            std::memcpy(&value, arg, sizeof(value));
+            out.appendSigned(value);
+            arg += sizeof(value);
+            break;
+        }
+        case FormatRecord::ArgType::UInt: {
+            std::uint64_t value;
+            std::memcpy(&value, arg, sizeof(value));
+            out.appendNumber(value);
+            arg += sizeof(value);
+            break;
+        }
+        case FormatRecord::ArgType::Double: {
+            double value;
+            std::memcpy(&value, arg, sizeof(value));
+            arg += sizeof(value);
+            if (value != value) {
+                out.append("nan");
+                break;
+            }
+            if (value < 0) {
+                out.append('-');
+                value = -value;
+            }
+            if (value >= 1e18) {
+                out.append("inf");
+                break;
+            }
+            auto whole = static_cast<std::uint64_t>(value);
+            auto fraction = static_cast<std::uint64_t>((value - whole) * 1e6 + 0.5);
+            if (fraction >= 1000000) {
+                ++whole;
+                fraction -= 1000000;
+            }
+            out.appendNumber(whole);
+            out.append('.');
+            out.appendNumber(fraction, 6);
+            break;
+        }
+        case FormatRecord::ArgType::Pointer: {
+            void const* value;
+            std::memcpy(&value, arg, sizeof(value));
+            arg += sizeof(value);
+            char hex[2 * sizeof(value) + 2] = {'0', 'x'};
+            auto bits = reinterpret_cast<std::uintptr_t>(value);
+            for (std::size_t i = 0; i != 2 * sizeof(value); ++i) {
+                hex[sizeof(hex) - 1 - i] = "0123456789abcdef"[bits & 0xf];
+                bits >>= 4;
+            }
+            out.append(hex, sizeof(hex));
+            break;
+        }
+        case FormatRecord::ArgType::String: {
+            std::uint32_t length;
+            std::memcpy(&length, arg, sizeof(length));
+            arg += sizeof(length);
+            out.append(arg, std::min<std::size_t>(length, end - arg));
+            arg += length;
+            break;
+        }
+        default:
+            arg = nullptr;
+        }
+    }
+}
+
+// Format record header: "<seconds>.<microseconds> LEVEL [lwp] logger (file:line) - "
+void formatPrefix(LineBuffer& out, SlotHeader const& header) {
+    out.appendSigned(header.timestamp / 1000000);
+    out.append('.');
+    out.appendNumber(header.timestamp % 1000000, 6);
+    out.append(' ');
+    out.append(levelName(header.level));
+    out.append(" [");
+    out.appendNumber(header.lwp);
+    out.append("] ");
+    if constexpr (std::is_same_v<log4cxx::LogString, std::string>) {
+        auto const& name = header.logger->getName();
+        out.append(name.data(), name.size());
+    }
+    out.append(" (");
+    out.append(header.file != nullptr ? header.file : "?");
+    out.append(':');
+    out.appendSigned(header.line);
+    out.append(") - ");
+}
+
+int openDumpFile() {
+    char const* const fileName = recorderState().fileName;
+    if (fileName[0] == '\0') {
+        return STDERR_FILENO;
+    }
+    return ::open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+}
+
+void writeAll(int fd, char const* ptr, std::size_t size) {
+    while (size > 0) {
+        ssize_t const n = ::write(fd, ptr, size);
+        if (n < 0 and errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        ptr += n;
+        size -= n;
+    }
+}
+
+bool isFatalSignal(int signum) {
+    return signum == SIGSEGV or signum == SIGBUS or signum == SIGILL or signum == SIGFPE or signum == SIGABRT;
+}
+
+// Dump from signal handler, only uses async-signal-safe calls
+void signalDump(int signum) {
+    int const savedErrno = errno;
+    int const fd = openDumpFile();
+    if (fd >= 0) {
+        LineBuffer line;
+        line.append("=== flight recorder dump on signal ");
+        line.appendNumber(signum);
+        line.append(" ===\n");
+        writeAll(fd, line.data(), line.size());
+        Record record;
+        for (Ring* ring = recorderState().rings.load(std::memory_order_acquire); ring != nullptr;
+             ring = ring->next) {
+            std::uint64_t const written = ring->written.load(std::memory_order_acquire);
+            std::uint64_t const dumped = ring->dumped.load(std::memory_order_relaxed);
+            std::uint64_t const first = std::max(dumped, written > ring->capacity ? written - ring->capacity : 0);
+            for (std::uint64_t index = first; index < written; ++index) {
+                if (not readSlot(*ring, index, record)) {
+                    continue;
+                }
+                line.clear();
+                formatPrefix(line, record.header);
+                if (record.header.fmt != nullptr) {
+                    renderSafe(line, record.header.fmt, record.payload, record.header.size);
+                } else {
+                    line.append(record.payload, record.header.size);
+                }
+                line.append(record.header.truncated ? "...\n" : "\n");
+                writeAll(fd, line.data(), line.size());
+            }
+            ring->dumped.store(written, std::memory_order_relaxed);
+        }
+        if (fd != STDERR_FILENO) {
+            ::close(fd);
+        }
+    }
+    errno = savedErrno;
+    if (isFatalSignal(signum)) {
+        // handler was reset to default, re-raise to terminate
+        ::raise(signum);
+    }
+}
+
+}  // namespace
+
+namespace lsst::log::detail {
+
+void enableFlightRecorder(std::string const& filename, int level, int dumpLevel, std::size_t capacity) {
+    auto& state = recorderState();
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.capacity = std::max<std::size_t>(capacity, 1);
+    }
+    {
+        std::lock_guard<std::mutex> lock(state.dumpMutex);
+        std::size_t const size = std::min(filename.size(), sizeof(state.fileName) - 1);
+        std::memcpy(state.fileName, filename.data(), size);
+        state.fileName[size] = '\0';
+    }
+    flightRecorderDumpLevel.store(dumpLevel, std::memory_order_relaxed);
+    flightRecorderLevel.store(level, std::memory_order_release);
+}
+
+void disableFlightRecorder() {
+    flightRecorderLevel.store(log4cxx::Level::OFF_INT, std::memory_order_release);
+    flightRecorderDumpLevel.store(log4cxx::Level::OFF_INT, std::memory_order_relaxed);
+}
+
+void recordMessage(log4cxx::Logger const* logger, int level, log4cxx::spi::LocationInfo const& location,
+                   std::string_view msg) {
+    Ring* ring;
+    std::uint64_t index;
+    Record* record = beginRecord(ring, index);
+    if (record == nullptr) {
+        return;
+    }
+    fillHeader(record->header, logger, level, location);
+    std::size_t const size = std::min(msg.size(), PAYLOAD_SIZE);
+    std::memcpy(record->payload, msg.data(), size);
+    record->header.fmt = nullptr;
+    record->header.size = size;
+    record->header.truncated = size < msg.size();
+    commitRecord(ring, index);
+}
+
+void recordPrintf(log4cxx::Logger const* logger, int level, log4cxx::spi::LocationInfo const& location,
+                  char const* fmt, va_list args) {
+    Ring* ring;
+    std::uint64_t index;
+    Record* record = beginRecord(ring, index);
+    if (record == nullptr) {
+        return;
+    }
+    fillHeader(record->header, logger, level, location);
+    va_list copy;
+    va_copy(copy, args);
+    int const size = std::vsnprintf(record->payload, PAYLOAD_SIZE, fmt, copy);
+    va_end(copy);
+    // vsnprintf reserves one byte for terminating zero
+    std::size_t const stored = size < 0 ? 0 : std::min<std::size_t>(size, PAYLOAD_SIZE - 1);
+    record->header.fmt = nullptr;
+    record->header.size = stored;
+    record->header.truncated = size >= 0 and stored < static_cast<std::size_t>(size);
+    commitRecord(ring, index);
+}
+
+void recordFormat(log4cxx::Logger const* logger, int level, log4cxx::spi::LocationInfo const& location,
+                  FormatRecord const& record) {
+    if (record.size() > PAYLOAD_SIZE) {
+        // arguments do not fit, keep (truncated) rendered text instead
+        thread_local std::string msg;
+        msg.clear();
+        record.render(msg);
+        recordMessage(logger, level, location, msg);
+        return;
+    }
+    Ring* ring;
+    std::uint64_t index;
+    Record* slot = beginRecord(ring, index);
+    if (slot == nullptr) {
+        return;
+    }
+    fillHeader(slot->header, logger, level, location);
+    std::memcpy(slot->payload, record.data(), record.size());
+    slot->header.fmt = record.format();
+    slot->header.size = record.size();
+    slot->header.truncated = false;
+    commitRecord(ring, index);
+}
+
+std::size_t dumpFlightRecorder(std::string_view reason) {
+    auto& state = recorderState();
+    std::lock_guard<std::mutex> lock(state.dumpMutex);
+
+    // collect everything first, messages are sorted by time
+    std::vector<Record> records;
+    for (Ring* ring = state.rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+        std::uint64_t const written = ring->written.load(std::memory_order_acquire);
+        std::uint64_t const dumped = ring->dumped.load(std::memory_order_relaxed);
+        std::uint64_t const first = std::max(dumped, written > ring->capacity ? written - ring->capacity : 0);
+        for (std::uint64_t index = first; index < written; ++index) {
+            records.emplace_back();
+            if (not readSlot(*ring, index, records.back())) {
+                records.pop_back();
+            }
+        }
+        ring->dumped.store(written, std::memory_order_relaxed);
+    }
+    if (records.empty()) {
+        return 0;
+    }
+    std::stable_sort(records.begin(), records.end(), [](Record const& lhs, Record const& rhs) {
+        return lhs.header.timestamp < rhs.header.timestamp;
+    });
+
+    std::string output = "=== flight recorder dump: ";
+    output += reason;
+    output += " ===\n";
+    LineBuffer prefix;
+    std::string message;
+    for (auto const& record: records) {
+        prefix.clear();
+        formatPrefix(prefix, record.header);
+        output.append(prefix.data(), prefix.size());
+        if (record.header.fmt != nullptr) {
+            message.clear();
+            FormatRecord::render(message, record.header.fmt, record.payload, record.header.size);
+            output += message;
+        } else {
+            output.append(record.payload, record.header.size);
+        }
+        output += record.header.truncated ? "...\n" : "\n";
+    }
+
+    int const fd = openDumpFile();
+    if (fd < 0) {
+        return 0;
+    }
+    writeAll(fd, output.data(), output.size());
+    if (fd != STDERR_FILENO) {
+        ::close(fd);
+    }
+    return records.size();
+}
+
+void dumpFlightRecorderOnSignal(int signum) {
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = signalDump;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (isFatalSignal(signum)) {
+        action.sa_flags |= SA_RESETHAND | SA_NODEFER;
+    }
+    ::sigaction(signum, &action, nullptr);
+}
+
+} // namespace lsst::log::detail
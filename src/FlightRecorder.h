@@ -0,0 +1,100 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_FLIGHTRECORDER_H
+#define LSST_LOG_FLIGHTRECORDER_H
+
+// System headers
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Third-party headers
+#include "log4cxx/level.h"
+#include "log4cxx/logger.h"
+#include "log4cxx/spi/location/locationinfo.h"
+
+// Local headers
+#include "lsst/log/FormatRecord.h"
+
+namespace lsst::log::detail {
+
+/**
+ *  Lowest level of messages kept by flight recorder, OFF when recorder is
+ *  disabled. Messages at this or higher level which are below logger
+ *  threshold are recorded instead of being passed to appenders.
+ */
+inline std::atomic<int> flightRecorderLevel{log4cxx::Level::OFF_INT};
+
+/// Messages at this or higher level dump recorded messages.
+inline std::atomic<int> flightRecorderDumpLevel{log4cxx::Level::OFF_INT};
+
+/**
+ *  Enable flight recorder.
+ *
+ *  @param filename  Dump file, messages are appended to it; standard error
+ *                   is used if empty.
+ *  @param level     Lowest level of recorded messages.
+ *  @param dumpLevel Messages at this level or higher trigger dump.
+ *  @param capacity  Number of messages kept per thread, only applies to
+ *                   threads which record first message after this call.
+ */
+void enableFlightRecorder(std::string const& filename, int level, int dumpLevel, std::size_t capacity);
+
+/// Stop recording, already recorded messages are kept.
+void disableFlightRecorder();
+
+/// Record plain message in the current thread's ring.
+void recordMessage(log4cxx::Logger const* logger, int level, log4cxx::spi::LocationInfo const& location,
+                   std::string_view msg);
+
+/**
+ *  Record printf-style message, it is formatted directly into the ring slot
+ *  and truncated to the slot size. `args` is not consumed (va_copy is
+ *  used).
+ */
+void recordPrintf(log4cxx::Logger const* logger, int level, log4cxx::spi::LocationInfo const& location,
+                  char const* fmt, va_list args);
+
+/// Record unformatted message, format and arguments are copied.
+void recordFormat(log4cxx::Logger const* logger, int level, log4cxx::spi::LocationInfo const& location,
+                  FormatRecord const& record);
+
+/**
+ *  Write all recorded messages which were not dumped yet, messages from
+ *  all threads are ordered by time. Returns number of messages written.
+ */
+std::size_t dumpFlightRecorder(std::string_view reason);
+
+/**
+ *  Dump recorded messages when signal is received. Process is terminated
+ *  after dump for SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT.
+ */
+void dumpFlightRecorderOnSignal(int signum);
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_FLIGHTRECORDER_H
@@ -0,0 +1,233 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+
+// Local headers
+#include "lsst/log/FormatRecord.h"
+
+namespace {
+
+using lsst::log::detail::FormatRecord;
+
+// Longest printf specification that we accept inside braces
+std::size_t const MAX_SPEC_LEN = 24;
+
+// Append snprintf output to a string
+template <typename T>
+void appendf(std::string& out, char const* pfmt, T value) {
+    char buffer[128];
+    int const n = std::snprintf(buffer, sizeof(buffer), pfmt, value);
+    if (n < 0) {
+        return;
+    }
+    if (static_cast<std::size_t>(n) < sizeof(buffer)) {
+        out.append(buffer, n);
+    } else {
+        std::size_t const pos = out.size();
+        out.resize(pos + n + 1);
+        std::snprintf(&out[pos], n + 1, pfmt, value);
+        out.resize(pos + n);
+    }
+}
+
+// Append value using std::to_chars
+template <typename T>
+void appendChars(std::string& out, T value) {
+    char buffer[32];
+    auto const res = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, res.ptr);
+}
+
+/*
+ *  Build printf format from user specification (text between colon and
+ *  closing brace). Conversion character in the specification is replaced
+ *  with `defConv` if it is not one of the `convs`, `length` modifier is
+ *  inserted before conversion. Returns false if specification is not
+ *  usable.
+ */
+bool makePrintfFormat(char* pfmt, std::string_view spec, char const* length,
+                      char const* convs, char defConv) {
+    if (spec.size() > MAX_SPEC_LEN) {
+        return false;
+    }
+    char conv = defConv;
+    if (not spec.empty() and std::strchr("diouxXeEfFgGaAcspb", spec.back()) != nullptr) {
+        if (std::strchr(convs, spec.back()) != nullptr) {
+            conv = spec.back();
+        }
+        spec.remove_suffix(1);
+    }
+    // only flags, width and precision are allowed in the rest
+    if (spec.find_first_not_of("-+ #0123456789.") != std::string_view::npos) {
+        return false;
+    }
+    char* ptr = pfmt;
+    *ptr++ = '%';
+    ptr = std::copy(spec.begin(), spec.end(), ptr);
+    ptr = std::copy(length, length + std::strlen(length), ptr);
+    *ptr++ = conv;
+    *ptr = '\0';
+    return true;
+}
+
+// Render single argument, return pointer to the next one
+char const* renderArg(std::string& out, char const* arg, std::string_view spec) {
+    auto const type = static_cast<FormatRecord::ArgType>(*arg++);
+    char pfmt[MAX_SPEC_LEN + 8];
+    switch (type) {
+    case FormatRecord::ArgType::Bool: {
+        bool value;
+        std::memcpy(&value, arg, sizeof(value));
+        out += value ? "true" : "false";
+        return arg + sizeof(value);
+    }
+    case FormatRecord::ArgType::Char: {
+        char value;
+        std::memcpy(&value, arg, sizeof(value));
+        if (not spec.empty() and makePrintfFormat(pfmt, spec, "", "cdiouxX", 'c')) {
+            appendf(out, pfmt, static_cast<int>(value));
+        } else {
+            out += value;
+        }
+        return arg + sizeof(value);
+    }
+    case FormatRecord::ArgType::Int: {
+        std::int64_t value;
+        std::memcpy(&value, arg, sizeof(value));
+        if (not spec.empty() and makePrintfFormat(pfmt, spec, "ll", "dioxX", 'd')) {
+            appendf(out, pfmt, static_cast<long long>(value));
+        } else {
+            appendChars(out, value);
+        }
+        return arg + sizeof(value);
+    }
+    case FormatRecord::ArgType::UInt: {
+        std::uint64_t value;
+        std::memcpy(&value, arg, sizeof(value));
+        if (not spec.empty() and makePrintfFormat(pfmt, spec, "ll", "uoxX", 'u')) {
+            appendf(out, pfmt, static_cast<unsigned long long>(value));
+        } else {
+            appendChars(out, value);
+        }
+        return arg + sizeof(value);
+    }
+    case FormatRecord::ArgType::Double: {
+        double value;
+        std::memcpy(&value, arg, sizeof(value));
+        if (not spec.empty() and makePrintfFormat(pfmt, spec, "", "eEfFgGaA", 'g')) {
+            appendf(out, pfmt, value);
+        } else {
+            // shortest representation which round-trips
+            appendChars(out, value);
+        }
+        return arg + sizeof(value);
+    }
+    case FormatRecord::ArgType::Pointer: {
+        void const* value;
+        std::memcpy(&value, arg, sizeof(value));
+        appendf(out, "%p", value);
+        return arg + sizeof(value);
+    }
+    case FormatRecord::ArgType::String: {
+        std::uint32_t size;
+        std::memcpy(&size, arg, sizeof(size));
+        arg += sizeof(size);
+        if (not spec.empty() and makePrintfFormat(pfmt, spec, "", "s", 's')) {
+            // value is not zero-terminated
+            std::string const value(arg, size);
+            appendf(out, pfmt, value.c_str());
+        } else {
+            out.append(arg, size);
+        }
+        return arg + size;
+    }
+    }
+    // corrupted data, stop rendering arguments
+    return nullptr;
+}
+
+} // namespace
+
+namespace lsst {
+namespace log {
+namespace detail {
+
+void FormatRecord::_grow(std::size_t size) {
+    std::size_t const capacity = std::max(size, 2 * _capacity);
+    char* data = new char[capacity];
+    std::memcpy(data, _data, _size);
+    if (_data != _inline) {
+        delete [] _data;
+    }
+    _data = data;
+    _capacity = capacity;
+}
+
+void FormatRecord::render(std::string& out, char const* fmt, char const* data, std::size_t size) {
+    char const* const end = data + size;
+    char const* arg = data;
+    char const* ptr = fmt;
+    while (*ptr != '\0') {
+        // copy everything up to next brace
+        std::size_t const run = std::strcspn(ptr, "{}");
+        out.append(ptr, run);
+        ptr += run;
+        if (*ptr == '\0') {
+            break;
+        }
+        if (ptr[0] == ptr[1]) {
+            // escaped brace
+            out += ptr[0];
+            ptr += 2;
+            continue;
+        }
+        if (ptr[0] == '}') {
+            // unbalanced closing brace, copy as is
+            out += '}';
+            ++ptr;
+            continue;
+        }
+        char const* close = std::strchr(ptr, '}');
+        if (close == nullptr) {
+            out.append(ptr);
+            break;
+        }
+        if (arg != nullptr and arg < end) {
+            std::string_view spec(ptr + 1, close - ptr - 1);
+            if (not spec.empty() and spec.front() == ':') {
+                spec.remove_prefix(1);
+            }
+            arg = renderArg(out, arg, spec);
+        } else {
+            out.append(ptr, close + 1);
+        }
+        ptr = close + 1;
+    }
+}
+
+}}} // namespace lsst::log::detail
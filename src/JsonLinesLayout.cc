@@ -0,0 +1,306 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Third-party headers
+#include "log4cxx/helpers/optionconverter.h"
+#include "log4cxx/helpers/stringhelper.h"
+#include "log4cxx/helpers/transcoder.h"
+#include "log4cxx/level.h"
+#include "log4cxx/spi/loggingevent.h"
+
+// Local headers
+#include "lsst/log/TraceContext.h"
+#include "JsonLinesLayout.h"
+
+// macro below dows not work without this using directive
+// (and it breaks if placed inside namespaces)
+using lsst::log::detail::JsonLinesLayout;
+IMPLEMENT_LOG4CXX_OBJECT(JsonLinesLayout)
+
+using namespace log4cxx::helpers;
+
+namespace {
+
+char const HEX_DIGITS[] = "0123456789abcdef";
+
+// Append escaped form of a single character
+void appendEscaped(std::string& out, char ch) {
+    switch (ch) {
+    case '"': out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\b': out += "\\b"; break;
+    case '\f': out += "\\f"; break;
+    case '\n': out += "\\n"; break;
+    case '\r': out += "\\r"; break;
+    case '\t': out += "\\t"; break;
+    default: {
+        char const escaped[] = {'\\', 'u', '0', '0', HEX_DIGITS[(ch >> 4) & 0xf], HEX_DIGITS[ch & 0xf]};
+        out.append(escaped, sizeof(escaped));
+    }
+    }
+}
+
+inline bool needsEscape(char ch) {
+    return static_cast<unsigned char>(ch) < 0x20 or ch == '"' or ch == '\\';
+}
+
+// Return length of the prefix which does not need escaping
+std::size_t plainPrefix(char const* data, std::size_t size) {
+    std::size_t pos = 0;
+#if defined(__SSE2__)
+    __m128i const quote = _mm_set1_epi8('"');
+    __m128i const backslash = _mm_set1_epi8('\\');
+    __m128i const control = _mm_set1_epi8(0x1f);
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + pos));
+        // unsigned x <= 0x1f is the same as max(x, 0x1f) == 0x1f
+        __m128i const special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        int const mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; pos < size and not needsEscape(data[pos]); ++pos) {
+    }
+    return pos;
+}
+
+// Append JSON field name followed by colon, name does not need escaping;
+// first field also opens the object
+void appendKey(std::string& out, char const* key, bool first = false) {
+    out += first ? '{' : ',';
+    out += '"';
+    out += key;
+    out += "\":";
+}
+
+// Return UTF-8 view of a LogString, `buffer` holds converted string if
+// conversion is needed
+std::string_view utf8(log4cxx::LogString const& str, std::string& buffer) {
+    if constexpr (std::is_same_v<log4cxx::LogString, std::string>) {
+        return str;
+    } else {
+        buffer.clear();
+        Transcoder::encodeUTF8(str, buffer);
+        return buffer;
+    }
+}
+
+// Append timestamp in microseconds since epoch as ISO 8601 string, date
+// and time part is cached per thread as it only changes once a second
+void appendTimestamp(std::string& out, std::int64_t timestamp) {
+    thread_local std::time_t cachedSeconds = -1;
+    thread_local char cached[32];
+    thread_local std::size_t cachedSize = 0;
+
+    std::time_t seconds = timestamp / 1000000;
+    long micros = timestamp % 1000000;
+    if (micros < 0) {
+        micros += 1000000;
+        --seconds;
+    }
+    if (seconds != cachedSeconds) {
+        std::tm tm;
+        gmtime_r(&seconds, &tm);
+        cachedSize = std::strftime(cached, sizeof(cached), "%Y-%m-%dT%H:%M:%S.", &tm);
+        cachedSeconds = seconds;
+    }
+    out += '"';
+    out.append(cached, cachedSize);
+    char digits[6];
+    for (int i = 5; i >= 0; --i) {
+        digits[i] = '0' + micros % 10;
+        micros /= 10;
+    }
+    out.append(digits, sizeof(digits));
+    out += "Z\"";
+}
+
+// Append name of a level, standard names need no allocation
+void appendLevel(std::string& out, log4cxx::LevelPtr const& level) {
+    switch (level->toInt()) {
+    case log4cxx::Level::TRACE_INT: out += "\"TRACE\""; return;
+    case log4cxx::Level::DEBUG_INT: out += "\"DEBUG\""; return;
+    case log4cxx::Level::INFO_INT: out += "\"INFO\""; return;
+    case log4cxx::Level::WARN_INT: out += "\"WARN\""; return;
+    case log4cxx::Level::ERROR_INT: out += "\"ERROR\""; return;
+    case log4cxx::Level::FATAL_INT: out += "\"FATAL\""; return;
+    }
+    std::string buffer;
+    lsst::log::detail::appendJsonString(out, utf8(level->toString(), buffer));
+}
+
+}
+
+namespace lsst::log::detail {
+
+void appendJsonString(std::string& out, std::string_view str) {
+    out += '"';
+    char const* data = str.data();
+    std::size_t size = str.size();
+    while (size > 0) {
+        std::size_t const plain = plainPrefix(data, size);
+        out.append(data, plain);
+        if (plain == size) {
+            break;
+        }
+        appendEscaped(out, data[plain]);
+        data += plain + 1;
+        size -= plain + 1;
+    }
+    out += '"';
+}
+
+JsonLinesLayout::JsonLinesLayout() {
+}
+
+LogString JsonLinesLayout::getContentType() const {
+    return LOG4CXX_STR("application/json");
+}
+
+void JsonLinesLayout::format(LogString& output, const spi::LoggingEventPtr& event, Pool& pool) const {
+    if constexpr (std::is_same_v<LogString, std::string>) {
+        // LogString is UTF-8, write directly into output
+        _format(output, event);
+    } else {
+        thread_local std::string buffer;
+        buffer.clear();
+        _format(buffer, event);
+        LogString decoded;
+        Transcoder::decodeUTF8(buffer, decoded);
+        output += decoded;
+    }
+}
+
+void JsonLinesLayout::_format(std::string& out, const spi::LoggingEventPtr& event) const {
+    std::string buffer;
+
+    appendKey(out, "timestamp", true);
+    appendTimestamp(out, event->getTimeStamp());
+    appendKey(out, "level");
+    appendLevel(out, event->getLevel());
+    appendKey(out, "logger");
+    appendJsonString(out, utf8(event->getLoggerName(), buffer));
+    appendKey(out, "message");
+    if (auto const* deferred = dynamic_cast<FormatLoggingEvent const*>(event.get())) {
+        buffer.clear();
+        deferred->render(buffer);
+        appendJsonString(out, buffer);
+    } else {
+        appendJsonString(out, utf8(event->getRenderedMessage(), buffer));
+    }
+    appendKey(out, "thread");
+    appendJsonString(out, utf8(event->getThreadName(), buffer));
+
+    if (_locationInfo) {
+        auto const& loc = event->getLocationInformation();
+        char const* fileName = loc.getFileName();
+        appendKey(out, "file");
+        appendJsonString(out, fileName != nullptr ? fileName : "");
+        appendKey(out, "line");
+        char digits[16];
+        auto const res = std::to_chars(digits, digits + sizeof(digits), loc.getLineNumber());
+        out.append(digits, res.ptr);
+        appendKey(out, "function");
+        appendJsonString(out, loc.getMethodName());
+    }
+
+    TraceContext const trace = eventTraceContext(*event);
+    if (trace.valid()) {
+        char digits[32];
+        appendKey(out, "trace_id");
+        out += '"';
+        out.append(digits, trace.formatTraceId(digits));
+        out += '"';
+        appendKey(out, "span_id");
+        out += '"';
+        out.append(digits, trace.formatSpanId(digits));
+        out += '"';
+    }
+
+    // MDC goes into nested object unless prefix is given, so that MDC
+    // keys cannot clash with fixed fields
+    bool const nested = _mdcPrefix.empty();
+    if (nested) {
+        appendKey(out, "mdc");
+        out += '{';
+    }
+    bool first = nested;
+    LogString value;
+    for (auto const& key: event->getMDCKeySet()) {
+        if (not first) {
+            out += ',';
+        }
+        first = false;
+        if (nested) {
+            appendJsonString(out, utf8(key, buffer));
+        } else {
+            appendJsonString(out, _mdcPrefix + std::string(utf8(key, buffer)));
+        }
+        out += ':';
+        value.clear();
+        event->getMDC(key, value);
+        appendJsonString(out, utf8(value, buffer));
+    }
+    if (nested) {
+        out += '}';
+    }
+
+    out += "}\n";
+}
+
+bool JsonLinesLayout::supportsDeferredMessages() const {
+    return true;
+}
+
+bool JsonLinesLayout::ignoresThrowable() const {
+    return true;
+}
+
+void JsonLinesLayout::activateOptions(Pool& p) {
+}
+
+void JsonLinesLayout::setOption(const LogString &option, const LogString &value) {
+    if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("LOCATIONINFO"), LOG4CXX_STR("locationinfo"))) {
+        _locationInfo = OptionConverter::toBoolean(value, true);
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("MDCPREFIX"), LOG4CXX_STR("mdcprefix"))) {
+        std::string buffer;
+        _mdcPrefix = utf8(value, buffer);
+    }
+}
+
+} // namespace lsst::log::detail
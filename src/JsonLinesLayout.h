@@ -0,0 +1,125 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_JSONLINESLAYOUT_H
+#define LSST_LOG_JSONLINESLAYOUT_H
+
+// System headers
+#include <string>
+#include <string_view>
+
+// Base class header
+#include "log4cxx/layout.h"
+
+#include "log4cxx/helpers/object.h"
+
+// Local headers
+#include "EventPool.h"
+
+namespace lsst::log::detail {
+
+// This needs to be here for all LOG4CXX macros to work
+using namespace log4cxx;
+
+/**
+ *  Append string to JSON output, adding quotes and escaping characters
+ *  that need it. Bytes outside ASCII range are copied unchanged so input
+ *  should be valid UTF-8.
+ */
+void appendJsonString(std::string& out, std::string_view str);
+
+/**
+ *  Layout which formats each event as a single-line JSON object, intended
+ *  for log shippers. Example configuration:
+ *  \code
+ *  log4j.appender.FA.layout = lsst.log.JsonLinesLayout
+ *  log4j.appender.FA.layout.LocationInfo = false
+ *  \endcode
+ *
+ *  Object contains fields "timestamp" (UTC, ISO 8601 with microseconds),
+ *  "level", "logger", "message", "thread" and, unless \c LocationInfo
+ *  option is false, "file", "line" and "function". If trace context was
+ *  set when the event was logged (see TraceContext) then "trace_id" and
+ *  "span_id" fields with hex IDs are added. MDC entries are added as
+ *  string fields of a nested "mdc" object; if \c MDCPrefix option is set
+ *  then they are top-level fields instead, named by MDC key prefixed with
+ *  the option value.
+ *
+ *  Output is written directly into the buffer provided by appender, with
+ *  string escaping done 16 bytes at a time when SSE2 is available.
+ */
+class JsonLinesLayout : public Layout, public DeferredMessageSupport {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(JsonLinesLayout)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(JsonLinesLayout)
+            LOG4CXX_CAST_ENTRY_CHAIN(Layout)
+    END_LOG4CXX_CAST_MAP()
+
+    JsonLinesLayout();
+
+    /**
+     * Returns content type for this layout, "application/json".
+     */
+    LogString getContentType() const override;
+
+    /**
+     * Format event as JSON and append it to output.
+     */
+    void format(LogString& output, const spi::LoggingEventPtr& event,
+                log4cxx::helpers::Pool& pool) const override;
+
+    /**
+     * Returns true, exception information is not rendered.
+     */
+    bool ignoresThrowable() const override;
+
+    /**
+     * Returns true, deferred messages are rendered by this layout.
+     */
+    bool supportsDeferredMessages() const override;
+
+    /**
+     * Nothing to activate.
+     */
+    void activateOptions(log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Handle configuration options.
+     */
+    void setOption(const LogString &option, const LogString &value) override;
+
+private:
+
+    // Format event as JSON into UTF-8 string
+    void _format(std::string& out, const spi::LoggingEventPtr& event) const;
+
+    bool _locationInfo = true;
+    std::string _mdcPrefix;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_JSONLINESLAYOUT_H
@@ -0,0 +1,102 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Local headers
+#include "LazyAppender.h"
+
+// macro below dows not work without this using directive
+// (and it breaks if placed inside namespaces)
+using lsst::log::detail::LazyAppender;
+IMPLEMENT_LOG4CXX_OBJECT(LazyAppender)
+
+using namespace log4cxx::helpers;
+
+namespace lsst::log::detail {
+
+LazyAppender::LazyAppender() {
+}
+
+LazyAppender::~LazyAppender() {
+    close();
+}
+
+void LazyAppender::setFactory(Factory factory) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _factory = std::move(factory);
+}
+
+void LazyAppender::doAppend(const spi::LoggingEventPtr& event, Pool& pool) {
+    Appender* target = _target.load(std::memory_order_acquire);
+    if (LOG4CXX_UNLIKELY(target == nullptr)) {
+        target = _make();
+        if (target == nullptr) {
+            return;
+        }
+    }
+    target->doAppend(event, pool);
+}
+
+void LazyAppender::append(const spi::LoggingEventPtr& event, Pool& p) {
+    doAppend(event, p);
+}
+
+void LazyAppender::close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_closed) {
+        return;
+    }
+    _closed = true;
+    if (_appender) {
+        _appender->close();
+    }
+}
+
+bool LazyAppender::requiresLayout() const {
+    return false;
+}
+
+void LazyAppender::activateOptions(Pool& p) {
+}
+
+AppenderPtr LazyAppender::getAppender() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _appender;
+}
+
+Appender* LazyAppender::_make() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_appender or _closed or _failed or not _factory) {
+        // made by other thread while we were waiting, or cannot be made
+        return _appender.get();
+    }
+    _appender = _factory();
+    if (not _appender) {
+        _failed = true;
+        return nullptr;
+    }
+    _target.store(_appender.get(), std::memory_order_release);
+    return _appender.get();
+}
+
+} // namespace lsst::log::detail
@@ -0,0 +1,131 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_LAZYAPPENDER_H
+#define LSST_LOG_LAZYAPPENDER_H
+
+// System headers
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+// Base class header
+#include "log4cxx/appenderskeleton.h"
+
+#include "log4cxx/helpers/object.h"
+
+namespace lsst::log::detail {
+
+// This needs to be here for all LOG4CXX macros to work
+using namespace log4cxx;
+
+/**
+ *  Placeholder for an appender which is constructed when it is needed.
+ *
+ *  When lazy appender construction is enabled (see
+ *  Log::setLazyAppendersEnabled()) configuration replaces each appender
+ *  with an instance of this class, the actual appender (and its layout and
+ *  filters) is made by a factory function when the first event reaches
+ *  the placeholder, and all events are passed to it afterwards. Appenders
+ *  for loggers whose messages are all below threshold are never made, so
+ *  they do not open files, connect sockets or start threads.
+ *
+ *  Placeholder has no options, it is not meant to appear in configuration
+ *  files.
+ */
+class LazyAppender : public AppenderSkeleton {
+public:
+
+    /// Type of the function making the actual appender, can return null.
+    using Factory = std::function<AppenderPtr()>;
+
+    DECLARE_LOG4CXX_OBJECT(LazyAppender)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(LazyAppender)
+            LOG4CXX_CAST_ENTRY_CHAIN(AppenderSkeleton)
+    END_LOG4CXX_CAST_MAP()
+
+    // Make an instance
+    LazyAppender();
+
+    // Closes the actual appender
+    ~LazyAppender();
+
+    // we do not support copying
+    LazyAppender(const LazyAppender&) = delete;
+    LazyAppender& operator=(const LazyAppender&) = delete;
+
+    /**
+     * Set function making the actual appender, events which arrive before
+     * this call are discarded.
+     */
+    void setFactory(Factory factory);
+
+    /**
+     * Make actual appender if it was not made yet and pass event to it.
+     */
+    void doAppend(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& pool) override;
+
+    /**
+     * Same as doAppend(), only for completeness.
+     */
+    void append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Close actual appender if it was made, nothing is made after this.
+     */
+    void close() override;
+
+    /**
+     * Returns false, layout belongs to actual appender.
+     */
+    bool requiresLayout() const override;
+
+    /**
+     * Does nothing.
+     */
+    void activateOptions(log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Return actual appender, null if it was not made yet.
+     */
+    AppenderPtr getAppender() const;
+
+private:
+
+    // Make actual appender, returns null if it cannot be made
+    Appender* _make();
+
+    std::atomic<Appender*> _target{nullptr};  // _appender.get() once it is made
+
+    mutable std::mutex _mutex;
+    bool _closed = false;
+    bool _failed = false;  // factory returned null
+    Factory _factory;
+    AppenderPtr _appender;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_LAZYAPPENDER_H
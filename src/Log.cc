@@ -31,27 +31,58 @@
  */
 
 // System headers
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <mutex>
-#include <pthread.h>
+#include <optional>
+#include <set>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <stdio.h>
 #include <stdlib.h>
+#include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 // Third-party headers
 #include <log4cxx/basicconfigurator.h>
 #include <log4cxx/consoleappender.h>
 #include <log4cxx/helpers/bytearrayinputstream.h>
+#include <log4cxx/helpers/fileinputstream.h>
+#include <log4cxx/helpers/loglog.h>
+#include <log4cxx/helpers/optionconverter.h>
+#include <log4cxx/helpers/stringhelper.h>
+#include <log4cxx/helpers/transcoder.h>
+#include <log4cxx/hierarchy.h>
+#include <log4cxx/logmanager.h>
+#include <log4cxx/mdc.h>
 #include <log4cxx/patternlayout.h>
 #include <log4cxx/propertyconfigurator.h>
 #include <log4cxx/xml/domconfigurator.h>
 
 // Local headers
 #include "lsst/log/Log.h"
+#include "ConfigCache.h"
+#include "EventPool.h"
+#include "FlightRecorder.h"
+#include "LazyAppender.h"
 #include "lwpID.h"
+#include "XmlConfig.h"
 
 
-// Max message length for varargs/printf style logging
+// Buffer size for the first formatting attempt of varargs/printf style
+// logging, longer messages are formatted again into a larger buffer
 #define MAX_LOG_MSG_LEN 1024
 
 namespace {
@@ -62,21 +93,269 @@ const char configEnv[] = "LSST_LOG_CONFIG";
 // dafault message layout pattern
 const char layoutPattern[] = "%c %p: %m%n";
 
+// names of the env. variables enabling configuration cache and lazy appenders
+const char configCacheEnv[] = "LSST_LOG_CONFIG_CACHE";
+const char lazyAppendersEnv[] = "LSST_LOG_LAZY_APPENDERS";
+
+// Return true if environment variable is set to non-empty value other than "0"
+bool envFlag(char const* name) {
+    char const* value = getenv(name);
+    return value != nullptr and value[0] != '\0' and std::strcmp(value, "0") != 0;
+}
+
+// Defaults come from environment, can be changed through Log methods
+std::atomic<bool> configCacheEnabled{envFlag(configCacheEnv)};
+std::atomic<bool> lazyAppendersEnabled{envFlag(lazyAppendersEnv)};
+
+using PropertyMap = lsst::log::detail::PropertyMap;
+
+/*
+ * Properties used for current configuration, used by incremental
+ * re-configuration to find what has changed. Empty if logging was
+ * configured by some other means (protected by configMutex).
+ */
+std::optional<PropertyMap> liveProperties;
+
+PropertyMap toPropertyMap(log4cxx::helpers::Properties const& prop) {
+    PropertyMap map;
+    for (auto const& key: prop.propertyNames()) {
+        map.emplace(key, prop.getProperty(key));
+    }
+    return map;
+}
+
+// Kind of the configuration property
+enum class PropertyKind { Logger, Additivity, Appender, Other };
+
+// Classify property key, returns also logger or appender name
+PropertyKind classifyProperty(log4cxx::LogString const& key, log4cxx::LogString& name) {
+    static log4cxx::LogString const rootKeys[] = {LOG4CXX_STR("log4j.rootLogger"),
+                                                  LOG4CXX_STR("log4j.rootCategory")};
+    static log4cxx::LogString const loggerPrefixes[] = {LOG4CXX_STR("log4j.logger."),
+                                                        LOG4CXX_STR("log4j.category.")};
+    static log4cxx::LogString const additivityPrefix(LOG4CXX_STR("log4j.additivity."));
+    static log4cxx::LogString const appenderPrefix(LOG4CXX_STR("log4j.appender."));
+
+    for (auto const& rootKey: rootKeys) {
+        if (key == rootKey) {
+            name.clear();
+            return PropertyKind::Logger;
+        }
+    }
+    for (auto const& prefix: loggerPrefixes) {
+        if (key.compare(0, prefix.size(), prefix) == 0) {
+            name = key.substr(prefix.size());
+            return PropertyKind::Logger;
+        }
+    }
+    if (key.compare(0, additivityPrefix.size(), additivityPrefix) == 0) {
+        name = key.substr(additivityPrefix.size());
+        return PropertyKind::Additivity;
+    }
+    if (key.compare(0, appenderPrefix.size(), appenderPrefix) == 0) {
+        name = key.substr(appenderPrefix.size());
+        name = name.substr(0, name.find(LOG4CXX_STR('.')));
+        return PropertyKind::Appender;
+    }
+    return PropertyKind::Other;
+}
+
+// Return true if key is "log4j.appender.NAME" which defines appender class
+bool isAppenderClass(log4cxx::LogString const& key, log4cxx::LogString const& name) {
+    return key == LOG4CXX_STR("log4j.appender.") + name;
+}
+
+std::map<log4cxx::LogString, log4cxx::AppenderPtr> makeAppenders(PropertyMap const& props,
+                                                                 std::set<log4cxx::LogString> const& names,
+                                                                 bool deferred);
+
+/*
+ * Give factories to the LazyAppender instances, each of them makes its
+ * appender from `props` when it is needed.
+ */
+void bindLazyAppenders(std::vector<log4cxx::AppenderPtr> const& appenders,
+                       std::shared_ptr<PropertyMap const> const& props) {
+    for (auto const& appender: appenders) {
+        if (auto* lazy = dynamic_cast<lsst::log::detail::LazyAppender*>(appender.get())) {
+            log4cxx::LogString const name = lazy->getName();
+            lazy->setFactory([props, name]() {
+                auto const made = ::makeAppenders(*props, {name}, false);
+                auto const iter = made.find(name);
+                return iter == made.end() ? log4cxx::AppenderPtr() : iter->second;
+            });
+        }
+    }
+}
+
+/*
+ * Make instances of the appenders from properties using scratch hierarchy,
+ * its root logger has all appenders attached. If `deferred` is true then
+ * LazyAppender instances are made instead.
+ */
+std::map<log4cxx::LogString, log4cxx::AppenderPtr> makeAppenders(PropertyMap const& props,
+                                                                 std::set<log4cxx::LogString> const& names,
+                                                                 bool deferred) {
+    log4cxx::helpers::Properties prop;
+    log4cxx::LogString rootSpec(LOG4CXX_STR("OFF"));
+    log4cxx::LogString name;
+    for (auto const& item: props) {
+        auto const kind = classifyProperty(item.first, name);
+        if (kind == PropertyKind::Other) {
+            prop.setProperty(item.first, item.second);
+        } else if (kind == PropertyKind::Appender and names.count(name) != 0) {
+            if (not deferred) {
+                prop.setProperty(item.first, item.second);
+            } else if (::isAppenderClass(item.first, name)) {
+                // only the class of "log4j.appender.NAME" is replaced, its
+                // options stay with the real appender
+                prop.setProperty(item.first, LOG4CXX_STR("lsst.log.LazyAppender"));
+            }
+        }
+    }
+    for (auto const& appender: names) {
+        rootSpec += LOG4CXX_STR(", ");
+        rootSpec += appender;
+    }
+    prop.setProperty(LOG4CXX_STR("log4j.rootLogger"), rootSpec);
+    log4cxx::spi::LoggerRepositoryPtr scratch = log4cxx::Hierarchy::create();
+    log4cxx::PropertyConfigurator().doConfigure(prop, scratch);
+    auto scratchRoot = scratch->getRootLogger();
+    std::map<log4cxx::LogString, log4cxx::AppenderPtr> appenders;
+    std::vector<log4cxx::AppenderPtr> made;
+    for (auto const& appender: names) {
+        if (auto instance = scratchRoot->getAppender(appender)) {
+            // detach without closing
+            scratchRoot->removeAppender(instance);
+            appenders[appender] = instance;
+            made.push_back(instance);
+        }
+    }
+    if (deferred) {
+        ::bindLazyAppenders(made, std::make_shared<PropertyMap const>(props));
+    }
+    return appenders;
+}
+
 /*
- * Configure LOG4CXX from file, file must exist. If file extension is .xml
- * then DOMConfigurator is used, otherwise PropertyConfigurator is called.
+ * Configure LOG4CXX from properties and remember them. With lazy appenders
+ * enabled appender definitions are replaced with LazyAppender, which makes
+ * the actual appender on first event.
+ */
+void configFromProperties(log4cxx::helpers::Properties& prop) {
+    if (not lazyAppendersEnabled.load(std::memory_order_relaxed)) {
+        log4cxx::PropertyConfigurator::configure(prop);
+        liveProperties = toPropertyMap(prop);
+        return;
+    }
+
+    auto props = std::make_shared<PropertyMap const>(toPropertyMap(prop));
+    log4cxx::helpers::Properties deferred;
+    log4cxx::LogString name;
+    for (auto const& item: *props) {
+        if (classifyProperty(item.first, name) != PropertyKind::Appender) {
+            deferred.setProperty(item.first, item.second);
+        } else if (::isAppenderClass(item.first, name)) {
+            deferred.setProperty(item.first, LOG4CXX_STR("lsst.log.LazyAppender"));
+        }
+    }
+    log4cxx::PropertyConfigurator::configure(deferred);
+
+    std::vector<log4cxx::AppenderPtr> appenders = log4cxx::Logger::getRootLogger()->getAllAppenders();
+    for (auto const& logger: log4cxx::LogManager::getCurrentLoggers()) {
+        auto const attached = logger->getAllAppenders();
+        appenders.insert(appenders.end(), attached.begin(), attached.end());
+    }
+    ::bindLazyAppenders(appenders, props);
+    liveProperties = *props;
+}
+
+// Check file name extension
+bool isXmlFile(std::string const& filename) {
+    size_t dotpos = filename.find_last_of(".");
+    return dotpos != std::string::npos && filename.compare(dotpos, std::string::npos, ".xml") == 0;
+}
+
+/*
+ * Translate XML configuration file into equivalent properties, returns
+ * false if file cannot be read or it uses features which properties cannot
+ * express (DOMConfigurator has to be used then).
+ */
+bool loadXmlProperties(log4cxx::helpers::Properties& prop, std::string const& filename) {
+    std::ifstream input(filename, std::ios::binary);
+    std::ostringstream text;
+    text << input.rdbuf();
+    std::map<std::string, std::string> props;
+    if (not input or not lsst::log::detail::xmlConfigToProperties(text.str(), props)) {
+        return false;
+    }
+    for (auto const& item: props) {
+        log4cxx::LogString key, value;
+        log4cxx::helpers::Transcoder::decodeUTF8(item.first, key);
+        log4cxx::helpers::Transcoder::decodeUTF8(item.second, value);
+        prop.setProperty(key, value);
+    }
+    return true;
+}
+
+/*
+ * Read properties from a file, XML files are translated into properties.
+ * Returns false and prints error message if properties file cannot be
+ * read, returns false without message for XML files which cannot be
+ * translated.
+ */
+bool loadProperties(log4cxx::helpers::Properties& prop, std::string const& filename) {
+    bool const useCache = configCacheEnabled.load(std::memory_order_relaxed);
+    lsst::log::detail::ConfigSignature signature;
+    if (useCache) {
+        signature = lsst::log::detail::configSignature(filename);
+        PropertyMap props;
+        if (signature.valid and lsst::log::detail::readConfigCache(filename, signature, props)) {
+            for (auto const& item: props) {
+                prop.setProperty(item.first, item.second);
+            }
+            return true;
+        }
+    }
+
+    if (isXmlFile(filename)) {
+        if (not loadXmlProperties(prop, filename)) {
+            return false;
+        }
+    } else {
+        LOG4CXX_DECODE_CHAR(lsname, filename);
+        try {
+            log4cxx::helpers::InputStreamPtr inStream(new log4cxx::helpers::FileInputStream(lsname));
+            prop.load(inStream);
+        } catch (std::exception const&) {
+            log4cxx::helpers::LogLog::error(LOG4CXX_STR("Could not read configuration file [") + lsname +
+                                            LOG4CXX_STR("]."));
+            return false;
+        }
+    }
+    if (useCache and signature.valid) {
+        lsst::log::detail::writeConfigCache(filename, signature, toPropertyMap(prop));
+    }
+    return true;
+}
+
+/*
+ * Configure LOG4CXX from file, file must exist. Properties files and XML
+ * files (extension .xml) which can be expressed as properties are passed
+ * to PropertyConfigurator, other XML files to DOMConfigurator.
  *
  * If file parsing fails then error messages are printed to standard error,
  * but execution continues. LOG4CXX will likely stay un-configured in this
  * case.
  */
 void configFromFile(std::string const& filename) {
-    // find position of extension
-    size_t dotpos = filename.find_last_of(".");
-    if (dotpos != std::string::npos && filename.compare(dotpos, std::string::npos, ".xml") == 0) {
-        log4cxx::xml::DOMConfigurator::configure(filename);
+    log4cxx::helpers::Properties prop;
+    if (loadProperties(prop, filename)) {
+        configFromProperties(prop);
     } else {
-        log4cxx::PropertyConfigurator::configure(filename);
+        if (isXmlFile(filename)) {
+            log4cxx::xml::DOMConfigurator::configure(filename);
+        }
+        liveProperties.reset();
     }
 }
 
@@ -107,43 +386,962 @@ void defaultConfig() {
     auto root = log4cxx::Logger::getRootLogger();
     root->addAppender(appender);
     root->setLevel(log4cxx::Level::getInfo());
+    liveProperties.reset();
+}
+
+// Protects concurrent configuration
+std::mutex configMutex;
+
+// global initialization flag (protected by configMutex)
+bool initialized = false;
+
+// Function called after each configuration, see detail::setConfigureHook()
+std::mutex configureHookMutex;
+std::function<void()> configureHook;
+
+// Call configure hook, must be called without holding configMutex
+void runConfigureHook() {
+    std::function<void()> hook;
+    {
+        std::lock_guard<std::mutex> lock(configureHookMutex);
+        hook = configureHook;
+    }
+    if (hook) {
+        hook();
+    }
+}
+
+/*
+ * This method is called exactly once to initialize LOG4CXX configuration.
+ * If `initialized` is set to true then default configuration is skipped.
+ */
+log4cxx::LoggerPtr log4cxxInit() {
+
+    std::lock_guard<std::mutex> lock(configMutex);
+    if (!initialized) {
+        initialized = true;
+        // do default configuration if no one done any configuration yet
+        ::defaultConfig();
+    }
+
+    // returns root logger to be used as default logger
+    return log4cxx::Logger::getRootLogger();
+}
+
+/*
+ * Incremental re-configuration.
+ *
+ * New properties are compared with the live ones, only loggers whose
+ * properties have changed, or which use appenders whose properties have
+ * changed, are updated. Appenders are created in a scratch hierarchy and
+ * moved to the live loggers; new appenders are attached before replaced ones
+ * are detached so that logging threads always see at least one of them.
+ * Unchanged appenders stay open. Returns false if properties have changes
+ * which cannot be applied incrementally.
+ */
+
+// Parsed value of the logger property, "[LEVEL], APPENDER, ..."
+struct LoggerSpec {
+    bool hasLevel = false;
+    log4cxx::LogString level;
+    std::vector<log4cxx::LogString> appenders;
+};
+
+// Parse logger specification the same way as PropertyConfigurator does
+LoggerSpec parseLoggerSpec(log4cxx::LogString const& value) {
+    LoggerSpec spec;
+    std::vector<log4cxx::LogString> tokens;
+    log4cxx::LogString::size_type pos = 0;
+    while (true) {
+        auto const comma = value.find(LOG4CXX_STR(','), pos);
+        tokens.push_back(log4cxx::helpers::StringHelper::trim(value.substr(pos, comma - pos)));
+        if (comma == log4cxx::LogString::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    if (not (value.empty() or value[0] == LOG4CXX_STR(','))) {
+        spec.hasLevel = true;
+        spec.level = tokens.front();
+    }
+    for (std::size_t i = 1; i < tokens.size(); ++i) {
+        if (not tokens[i].empty()) {
+            spec.appenders.push_back(tokens[i]);
+        }
+    }
+    return spec;
+}
+
+// Logger specifications indexed by logger name (empty for root)
+std::map<log4cxx::LogString, LoggerSpec> loggerSpecs(PropertyMap const& props) {
+    // values can use variable substitution
+    log4cxx::helpers::Properties prop;
+    for (auto const& item: props) {
+        prop.setProperty(item.first, item.second);
+    }
+    std::map<log4cxx::LogString, LoggerSpec> specs;
+    log4cxx::LogString name;
+    for (auto const& item: props) {
+        if (classifyProperty(item.first, name) == PropertyKind::Logger) {
+            specs[name] = parseLoggerSpec(log4cxx::helpers::OptionConverter::substVars(item.second, prop));
+        }
+    }
+    return specs;
+}
+
+log4cxx::LoggerPtr loggerByName(log4cxx::LogString const& name) {
+    if (name.empty()) {
+        return log4cxx::Logger::getRootLogger();
+    }
+    return log4cxx::LogManager::getLoggerLS(name);
+}
+
+bool reconfigureProperties(PropertyMap const& newProps) {
+    if (not liveProperties) {
+        return false;
+    }
+    PropertyMap const& oldProps = *liveProperties;
+
+    // Find what has changed
+    std::set<log4cxx::LogString> changedLoggers;
+    std::set<log4cxx::LogString> changedAdditivity;
+    std::set<log4cxx::LogString> changedAppenders;
+    auto diff = [&](PropertyMap const& props, PropertyMap const& other) {
+        log4cxx::LogString name;
+        for (auto const& item: props) {
+            auto const iter = other.find(item.first);
+            if (iter != other.end() and iter->second == item.second) {
+                continue;
+            }
+            switch (classifyProperty(item.first, name)) {
+            case PropertyKind::Logger:
+                changedLoggers.insert(name);
+                break;
+            case PropertyKind::Additivity:
+                changedAdditivity.insert(name);
+                break;
+            case PropertyKind::Appender:
+                changedAppenders.insert(name);
+                break;
+            case PropertyKind::Other:
+                return false;
+            }
+        }
+        return true;
+    };
+    if (not diff(newProps, oldProps) or not diff(oldProps, newProps)) {
+        return false;
+    }
+
+    auto const oldSpecs = ::loggerSpecs(oldProps);
+    auto const newSpecs = ::loggerSpecs(newProps);
+
+    // Loggers using changed appenders have to be updated too
+    for (auto const* specs: {&oldSpecs, &newSpecs}) {
+        for (auto const& item: *specs) {
+            for (auto const& appender: item.second.appenders) {
+                if (changedAppenders.count(appender) != 0) {
+                    changedLoggers.insert(item.first);
+                }
+            }
+        }
+    }
+
+    // Names of appenders that need new instances, these are changed
+    // appenders and also appenders which are not used by any logger yet
+    std::set<log4cxx::LogString> oldAppenderNames;
+    for (auto const& item: oldSpecs) {
+        oldAppenderNames.insert(item.second.appenders.begin(), item.second.appenders.end());
+    }
+    std::set<log4cxx::LogString> newAppenderNames;
+    std::set<log4cxx::LogString> toCreate;
+    for (auto const& name: changedLoggers) {
+        auto const iter = newSpecs.find(name);
+        if (iter == newSpecs.end()) {
+            continue;
+        }
+        for (auto const& appender: iter->second.appenders) {
+            if (changedAppenders.count(appender) != 0 or oldAppenderNames.count(appender) == 0) {
+                toCreate.insert(appender);
+            }
+        }
+    }
+    for (auto const& item: newSpecs) {
+        newAppenderNames.insert(item.second.appenders.begin(), item.second.appenders.end());
+    }
+
+    // Existing instances of unchanged appenders
+    std::map<log4cxx::LogString, log4cxx::AppenderPtr> appenders;
+    for (auto const& item: oldSpecs) {
+        for (auto const& name: item.second.appenders) {
+            if (changedAppenders.count(name) == 0 and appenders.count(name) == 0) {
+                if (auto appender = ::loggerByName(item.first)->getAppender(name)) {
+                    appenders.emplace(name, appender);
+                }
+            }
+        }
+    }
+
+    // Make new appender instances
+    if (not toCreate.empty()) {
+        auto const made = ::makeAppenders(newProps, toCreate, lazyAppendersEnabled.load(std::memory_order_relaxed));
+        for (auto const& item: made) {
+            appenders[item.first] = item.second;
+        }
+    }
+
+    // Update loggers
+    std::vector<log4cxx::AppenderPtr> detached;
+    for (auto const& name: changedLoggers) {
+        auto logger = ::loggerByName(name);
+        auto const iter = newSpecs.find(name);
+        LoggerSpec const spec = iter == newSpecs.end() ? LoggerSpec() : iter->second;
+        if (spec.hasLevel) {
+            if (not name.empty() and
+                    (log4cxx::helpers::StringHelper::equalsIgnoreCase(spec.level, LOG4CXX_STR("INHERITED"),
+                                                                      LOG4CXX_STR("inherited")) or
+                     log4cxx::helpers::StringHelper::equalsIgnoreCase(spec.level, LOG4CXX_STR("NULL"),
+                                                                      LOG4CXX_STR("null")))) {
+                logger->setLevel(log4cxx::LevelPtr());
+            } else {
+                logger->setLevel(log4cxx::helpers::OptionConverter::toLevel(spec.level,
+                                                                           log4cxx::Level::getDebug()));
+            }
+        } else if (iter == newSpecs.end()) {
+            // logger is not in configuration any more, reset it
+            logger->setLevel(name.empty() ? log4cxx::Level::getDebug() : log4cxx::LevelPtr());
+        }
+
+        std::vector<log4cxx::AppenderPtr> wanted;
+        for (auto const& appender: spec.appenders) {
+            auto const found = appenders.find(appender);
+            if (found != appenders.end()) {
+                wanted.push_back(found->second);
+            }
+        }
+        for (auto const& appender: wanted) {
+            if (not logger->isAttached(appender)) {
+                logger->addAppender(appender);
+            }
+        }
+        for (auto const& appender: logger->getAllAppenders()) {
+            if (std::find(wanted.begin(), wanted.end(), appender) == wanted.end()) {
+                logger->removeAppender(appender);
+                detached.push_back(appender);
+            }
+        }
+    }
+    for (auto const& name: changedAdditivity) {
+        auto const iter = newProps.find(LOG4CXX_STR("log4j.additivity.") + name);
+        bool const additive = iter == newProps.end() or
+            log4cxx::helpers::OptionConverter::toBoolean(iter->second, true);
+        ::loggerByName(name)->setAdditivity(additive);
+    }
+
+    // Close replaced appenders and appenders which are not used any more
+    for (auto const& appender: detached) {
+        auto const found = appenders.find(appender->getName());
+        if (found == appenders.end() or found->second != appender or
+                newAppenderNames.count(appender->getName()) == 0) {
+            appender->close();
+        }
+    }
+
+    liveProperties = newProps;
+    return true;
 }
 
-// Protects concurrent configuration
-std::mutex configMutex;
+/*
+ * Re-configure incrementally if possible, otherwise reset configuration
+ * and configure from scratch. Returns true if configuration was reset.
+ * `lock` holds configMutex, it is released while suppressed message
+ * counts are reported to the appenders which are about to be removed.
+ */
+bool reconfigureFromProperties(log4cxx::helpers::Properties& prop, std::unique_lock<std::mutex>& lock) {
+    if (reconfigureProperties(toPropertyMap(prop))) {
+        return false;
+    }
+    lock.unlock();
+    lsst::log::detail::LogSampler::reportSuppressed();
+    lock.lock();
+    log4cxx::BasicConfigurator::resetConfiguration();
+    configFromProperties(prop);
+    return true;
+}
+
+/*
+ * Background thread which re-configures logging when configuration file
+ * changes. File is checked periodically, change of its modification time
+ * or size triggers re-configuration.
+ */
+class ConfigWatcher {
+public:
+
+    ~ConfigWatcher() { stop(); }
+
+    void start(std::string const& filename, std::chrono::milliseconds interval) {
+        std::lock_guard<std::mutex> control(_controlMutex);
+        _stop();
+        _stopping = false;
+        _thread = std::thread(&ConfigWatcher::_run, this, filename, interval);
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> control(_controlMutex);
+        _stop();
+    }
+
+private:
+
+    // Stop the thread, _controlMutex must be locked
+    void _stop() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _cv.notify_all();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    using Signature = std::tuple<bool, std::filesystem::file_time_type, std::uintmax_t>;
+
+    static Signature _signature(std::string const& filename) {
+        std::error_code ec1, ec2;
+        auto const mtime = std::filesystem::last_write_time(filename, ec1);
+        auto const size = std::filesystem::file_size(filename, ec2);
+        if (ec1 or ec2) {
+            return Signature(false, {}, 0);
+        }
+        return Signature(true, mtime, size);
+    }
+
+    void _run(std::string filename, std::chrono::milliseconds interval) {
+        Signature last = _signature(filename);
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (not _cv.wait_for(lock, interval, [this]() { return _stopping; })) {
+            Signature const current = _signature(filename);
+            // missing file is likely being replaced, wait until it re-appears
+            if (current == last or not std::get<0>(current)) {
+                continue;
+            }
+            last = current;
+            lock.unlock();
+            lsst::log::Log::reconfigure(filename);
+            lock.lock();
+        }
+    }
+
+    std::mutex _controlMutex;  // serializes start() and stop()
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stopping = false;  // protected by _mutex
+    std::thread _thread;  // protected by _controlMutex
+};
+
+ConfigWatcher& configWatcher() {
+    static ConfigWatcher watcher;
+    return watcher;
+}
+
+/*
+ * Match logger name against glob pattern, `*` matches any sequence of
+ * characters and `?` matches any character.
+ */
+bool globMatch(std::string_view pattern, std::string_view name) {
+    std::size_t p = 0, n = 0;
+    // position after last star and name position it was matched at
+    std::size_t starP = std::string_view::npos, starN = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() and (pattern[p] == '?' or pattern[p] == name[n])) {
+            ++p;
+            ++n;
+        } else if (p < pattern.size() and pattern[p] == '*') {
+            starP = ++p;
+            starN = n;
+        } else if (starP != std::string_view::npos) {
+            // let last star match one more character
+            p = starP;
+            n = ++starN;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() and pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+/*
+ * List of the MDC initialization functions. Lists are immutable, new
+ * function is added to a copy which is then published atomically, so that
+ * new threads can run the functions without taking any locks. Old copies
+ * are kept because other threads may still be iterating over them.
+ */
+using MDCInitList = std::vector<std::function<void()>>;
+std::atomic<MDCInitList const*> mdcInitList{nullptr};
+std::vector<std::unique_ptr<MDCInitList const>> mdcInitLists;  // protected by mdcInitMutex
+std::mutex mdcInitMutex;
+
+// per-thread initialization flag
+thread_local bool mdcThreadInitialized = false;
+
+/*
+ * Registry of Log instances referenced by per-call-site caches in LOG*
+ * macros, indexed by LOG4CXX logger. Instances are never destroyed so that
+ * references held by call sites stay valid, registry itself is never
+ * destroyed either to avoid problems with logging from static destructors.
+ */
+struct LogRegistry {
+    std::mutex mutex;
+    std::unordered_map<log4cxx::Logger const*, std::unique_ptr<lsst::log::Log>> logs;
+};
+
+LogRegistry& logRegistry() {
+    static LogRegistry* registry = new LogRegistry();
+    return *registry;
+}
+
+/*
+ * Cache of child loggers used by Log::getChild(), indexed by parent LOG4CXX
+ * logger and suffix. This is an insert-only open-addressing hash table:
+ * readers probe it without locking, writers add entries under a mutex and
+ * publish them with atomic stores, and the table is replaced by a larger
+ * copy when it becomes half full. Whole cache is replaced when logging is
+ * re-configured.
+ *
+ * Readers announce the table they probe in a per-thread hazard slot.
+ * Replaced tables, and entries of previous configurations, are retired and
+ * freed by writers once no hazard slot refers to them (or to a table of
+ * the same configuration, for entries).
+ */
+struct ChildEntry {
+    log4cxx::Logger const* parent;
+    std::string suffix;
+    std::size_t hash;
+    lsst::log::Log child;
+};
+
+struct ChildTable {
+    ChildTable(std::size_t capacity, unsigned generation_)
+        : mask(capacity - 1), generation(generation_),
+          slots(new std::atomic<ChildEntry const*>[capacity]()) {}
+
+    std::size_t capacity() const { return mask + 1; }
+
+    ChildEntry const* find(log4cxx::Logger const* parent, std::string_view suffix,
+                           std::size_t hash) const {
+        for (std::size_t i = hash & mask; ; i = (i + 1) & mask) {
+            ChildEntry const* entry = slots[i].load(std::memory_order_acquire);
+            if (entry == nullptr) {
+                return nullptr;
+            }
+            if (entry->hash == hash and entry->parent == parent and entry->suffix == suffix) {
+                return entry;
+            }
+        }
+    }
+
+    // Only called with registry mutex locked
+    void insert(ChildEntry const* entry) {
+        std::size_t i = entry->hash & mask;
+        while (slots[i].load(std::memory_order_relaxed) != nullptr) {
+            i = (i + 1) & mask;
+        }
+        slots[i].store(entry, std::memory_order_release);
+        ++size;
+    }
+
+    std::size_t const mask;
+    unsigned const generation;  // Log::_configGeneration when table was made
+    std::unique_ptr<std::atomic<ChildEntry const*>[]> slots;
+    std::size_t size = 0;  // protected by registry mutex
+};
+
+// Entries of a replaced configuration
+struct RetiredChildEntries {
+    unsigned generation;
+    std::vector<std::unique_ptr<ChildEntry>> entries;
+};
+
+struct ChildRegistry {
+    std::mutex mutex;
+    std::atomic<ChildTable*> table{nullptr};
+    // all members below are protected by mutex
+    std::unique_ptr<ChildTable> current;
+    std::vector<std::unique_ptr<ChildEntry>> entries;  // entries of current generation
+    std::vector<std::unique_ptr<ChildTable>> retiredTables;
+    std::vector<RetiredChildEntries> retiredEntries;
+    std::vector<std::atomic<ChildTable const*> const*> hazards;  // one per thread
+
+    // Replace current table and retire the old one
+    void replace(std::unique_ptr<ChildTable> table_) {
+        if (current != nullptr) {
+            if (current->generation != table_->generation) {
+                retiredEntries.push_back(RetiredChildEntries{current->generation, std::move(entries)});
+                entries.clear();
+            }
+            retiredTables.push_back(std::move(current));
+        }
+        current = std::move(table_);
+        table.store(current.get(), std::memory_order_seq_cst);
+        reclaim();
+    }
+
+    // Free retired tables and entries which no reader can see
+    void reclaim() {
+        std::set<ChildTable const*> busyTables;
+        for (auto const* hazard: hazards) {
+            if (ChildTable const* table = hazard->load(std::memory_order_seq_cst)) {
+                busyTables.insert(table);
+            }
+        }
+        std::set<unsigned> busyGenerations;
+        auto const last = std::remove_if(
+                retiredTables.begin(), retiredTables.end(), [&](std::unique_ptr<ChildTable> const& table) {
+                    if (busyTables.count(table.get()) == 0) {
+                        return true;
+                    }
+                    busyGenerations.insert(table->generation);
+                    return false;
+                });
+        retiredTables.erase(last, retiredTables.end());
+        retiredEntries.erase(std::remove_if(retiredEntries.begin(), retiredEntries.end(),
+                                            [&](RetiredChildEntries const& retired) {
+                                                return busyGenerations.count(retired.generation) == 0;
+                                            }),
+                             retiredEntries.end());
+    }
+};
+
+ChildRegistry& childRegistry() {
+    static ChildRegistry* registry = new ChildRegistry();
+    return *registry;
+}
+
+// Registers per-thread hazard slot with the child registry
+struct ChildHazardHolder {
+    ChildHazardHolder() : registry(::childRegistry()) {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.hazards.push_back(&hazard);
+    }
+    ~ChildHazardHolder() {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.hazards.erase(std::find(registry.hazards.begin(), registry.hazards.end(), &hazard));
+    }
+    ChildRegistry& registry;
+    std::atomic<ChildTable const*> hazard{nullptr};
+};
+
+// Clears hazard slot when going out of scope
+struct ChildHazardGuard {
+    explicit ChildHazardGuard(std::atomic<ChildTable const*>& hazard_) : hazard(hazard_) {}
+    ~ChildHazardGuard() { hazard.store(nullptr, std::memory_order_release); }
+    std::atomic<ChildTable const*>& hazard;
+};
+
+std::size_t const CHILD_TABLE_INITIAL_CAPACITY = 64;
+
+std::size_t childHash(log4cxx::Logger const* parent, std::string_view suffix) {
+    return std::hash<std::string_view>()(suffix) ^ (std::hash<log4cxx::Logger const*>()(parent) * 31);
+}
+
+/*
+ * Table of interned MDC keys. Tables are immutable, adding a key makes a
+ * new copy which is published atomically so that readers never need a
+ * lock. Old copies are kept because readers may still use them.
+ */
+struct MDCKeyTable {
+    std::unordered_map<std::string, unsigned> index;
+    std::vector<std::string> names;
+};
+
+struct MDCKeyRegistry {
+    std::mutex mutex;
+    std::atomic<MDCKeyTable const*> table{nullptr};
+    std::vector<std::unique_ptr<MDCKeyTable const>> tables;
+};
+
+MDCKeyRegistry& mdcKeyRegistry() {
+    static MDCKeyRegistry* registry = new MDCKeyRegistry();
+    return *registry;
+}
+
+// Return index of interned key or -1 if key is not interned
+int findMDCKey(std::string const& name) {
+    MDCKeyTable const* table = mdcKeyRegistry().table.load(std::memory_order_acquire);
+    if (table != nullptr) {
+        auto iter = table->index.find(name);
+        if (iter != table->index.end()) {
+            return iter->second;
+        }
+    }
+    return -1;
+}
+
+std::string const& mdcKeyName(unsigned index) {
+    return mdcKeyRegistry().table.load(std::memory_order_acquire)->names[index];
+}
+
+/*
+ * Per-thread values of interned MDC keys. Values are copied to LOG4CXX MDC
+ * only when a message is logged, `dirty` lists slots that need to be
+ * copied.
+ */
+struct MDCSlot {
+    lsst::log::detail::MDCValue value;
+    bool initialized = false;
+    bool dirty = false;
+};
+
+struct MDCThreadState {
+    std::vector<MDCSlot> slots;
+    std::vector<unsigned> dirty;
+};
+
+thread_local MDCThreadState mdcThreadState;
+
+// Read value from LOG4CXX MDC, value is left not present if key is not there
+void log4cxxMDCGet(std::string const& key, lsst::log::detail::MDCValue& value) {
+    LOG4CXX_DECODE_CHAR(lsKey, key);
+    log4cxx::LogString lsValue;
+    if (log4cxx::MDC::get(lsKey, lsValue)) {
+        LOG4CXX_ENCODE_CHAR(encoded, lsValue);
+        value.assign(encoded);
+    } else {
+        value.reset();
+    }
+}
+
+// Replace value in LOG4CXX MDC, value which is not present removes the key
+void log4cxxMDCSet(std::string const& key, lsst::log::detail::MDCValue const& value) {
+    log4cxx::MDC::remove(key);
+    if (value.present()) {
+        log4cxx::MDC::put(key, std::string(value.view()));
+    }
+}
+
+// Exchange slot value with a given value
+void mdcExchange(unsigned index, lsst::log::detail::MDCValue& value) {
+    MDCThreadState& state = ::mdcThreadState;
+    if (index >= state.slots.size()) {
+        state.slots.resize(index + 1);
+    }
+    MDCSlot& slot = state.slots[index];
+    if (not slot.initialized) {
+        // key could have been set via LOG4CXX before it was interned
+        ::log4cxxMDCGet(mdcKeyName(index), slot.value);
+        slot.initialized = true;
+    }
+    slot.value.swap(value);
+    if (not slot.dirty) {
+        slot.dirty = true;
+        state.dirty.push_back(index);
+    }
+}
+
+// Copy modified values to LOG4CXX MDC
+void mdcSync() {
+    MDCThreadState& state = ::mdcThreadState;
+    if (state.dirty.empty()) {
+        return;
+    }
+    for (unsigned index: state.dirty) {
+        MDCSlot& slot = state.slots[index];
+        ::log4cxxMDCSet(mdcKeyName(index), slot.value);
+        slot.dirty = false;
+    }
+    state.dirty.clear();
+}
+
+// Time since arbitrary epoch in nanoseconds
+std::int64_t steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Set by Log::setStatisticsEnabled()
+std::atomic<bool> statisticsEnabled{false};
+
+// log2 buckets, last one collects everything above 2^39 ns (~10 minutes)
+std::size_t const LATENCY_BUCKETS = 40;
+
+struct MessageCounter {
+    log4cxx::LoggerPtr logger;
+    std::uint64_t count = 0;
+    std::uint64_t nanoseconds = 0;
+};
+
+using MessageCounterKey = std::pair<log4cxx::Logger const*, int>;
+
+struct MessageCounterKeyHash {
+    std::size_t operator()(MessageCounterKey const& key) const {
+        return std::hash<log4cxx::Logger const*>()(key.first) ^ (std::hash<int>()(key.second) << 1);
+    }
+};
+
+// Aggregated statistics, used for finished threads and for merged results
+struct StatisticsTotals {
+    std::unordered_map<MessageCounterKey, MessageCounter, MessageCounterKeyHash> messages;
+    std::array<std::uint64_t, LATENCY_BUCKETS> latency{};
+
+    void clear() {
+        messages.clear();
+        latency.fill(0);
+    }
+};
+
+/*
+ * Counters for one logger and level. Logger and level are written once
+ * before entry is published, counters are only updated with relaxed
+ * atomic operations so that readers do not need a lock.
+ */
+struct StatisticsEntry {
+    log4cxx::LoggerPtr logger;
+    int level = 0;
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> nanoseconds{0};
+};
+
+// Append-only block of entries, `size` and `next` publish new entries
+struct StatisticsChunk {
+    static constexpr std::size_t SIZE = 64;
+    std::array<StatisticsEntry, SIZE> entries;
+    std::atomic<std::size_t> size{0};
+    std::atomic<StatisticsChunk*> next{nullptr};
+};
+
+/*
+ * Statistics of a single thread. Only owning thread adds entries and
+ * updates counters, readers walk published chunks without locking. Index
+ * is private to the owning thread, it maps logger and level to entry.
+ */
+struct ThreadStatistics {
+
+    ThreadStatistics() = default;
+    ThreadStatistics(ThreadStatistics const&) = delete;
+    ThreadStatistics& operator=(ThreadStatistics const&) = delete;
+
+    ~ThreadStatistics() {
+        StatisticsChunk* chunk = first.next.load(std::memory_order_relaxed);
+        while (chunk != nullptr) {
+            StatisticsChunk* next = chunk->next.load(std::memory_order_relaxed);
+            delete chunk;
+            chunk = next;
+        }
+    }
+
+    // Only called by owning thread
+    StatisticsEntry& find(log4cxx::LoggerPtr const& logger, int level) {
+        std::size_t const hash = MessageCounterKeyHash()(MessageCounterKey(logger.get(), level));
+        if (not index.empty()) {
+            std::size_t const mask = index.size() - 1;
+            for (std::size_t i = hash & mask; index[i] != nullptr; i = (i + 1) & mask) {
+                if (index[i]->logger.get() == logger.get() and index[i]->level == level) {
+                    return *index[i];
+                }
+            }
+        }
+        return add(logger, level, hash);
+    }
+
+    // Add counters to totals, can be called by any thread
+    void addTo(StatisticsTotals& totals) const {
+        for (StatisticsChunk const* chunk = &first; chunk != nullptr;
+             chunk = chunk->next.load(std::memory_order_acquire)) {
+            std::size_t const size = chunk->size.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i != size; ++i) {
+                StatisticsEntry const& entry = chunk->entries[i];
+                std::uint64_t const count = entry.count.load(std::memory_order_relaxed);
+                if (count == 0) {
+                    continue;
+                }
+                auto& counter = totals.messages[MessageCounterKey(entry.logger.get(), entry.level)];
+                counter.logger = entry.logger;
+                counter.count += count;
+                counter.nanoseconds += entry.nanoseconds.load(std::memory_order_relaxed);
+            }
+        }
+        for (std::size_t i = 0; i != LATENCY_BUCKETS; ++i) {
+            totals.latency[i] += latency[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Reset counters to zero, can be called by any thread
+    void clear() {
+        for (StatisticsChunk* chunk = &first; chunk != nullptr;
+             chunk = chunk->next.load(std::memory_order_acquire)) {
+            std::size_t const size = chunk->size.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i != size; ++i) {
+                chunk->entries[i].count.store(0, std::memory_order_relaxed);
+                chunk->entries[i].nanoseconds.store(0, std::memory_order_relaxed);
+            }
+        }
+        for (auto& bucket: latency) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::array<std::atomic<std::uint64_t>, LATENCY_BUCKETS> latency{};
+
+private:
+
+    StatisticsEntry& add(log4cxx::LoggerPtr const& logger, int level, std::size_t hash) {
+        std::size_t size = last->size.load(std::memory_order_relaxed);
+        if (size == StatisticsChunk::SIZE) {
+            auto* chunk = new StatisticsChunk();
+            last->next.store(chunk, std::memory_order_release);
+            last = chunk;
+            size = 0;
+        }
+        StatisticsEntry& entry = last->entries[size];
+        entry.logger = logger;
+        entry.level = level;
+        last->size.store(size + 1, std::memory_order_release);
+
+        // keep index at most half full
+        if (2 * (indexCount + 1) > index.size()) {
+            std::vector<StatisticsEntry*> newIndex(std::max<std::size_t>(16, 2 * index.size()), nullptr);
+            for (StatisticsEntry* item: index) {
+                if (item != nullptr) {
+                    insert(newIndex, item, MessageCounterKeyHash()(MessageCounterKey(item->logger.get(), item->level)));
+                }
+            }
+            index.swap(newIndex);
+        }
+        insert(index, &entry, hash);
+        ++indexCount;
+        return entry;
+    }
+
+    static void insert(std::vector<StatisticsEntry*>& index, StatisticsEntry* entry, std::size_t hash) {
+        std::size_t const mask = index.size() - 1;
+        std::size_t i = hash & mask;
+        while (index[i] != nullptr) {
+            i = (i + 1) & mask;
+        }
+        index[i] = entry;
+    }
+
+    StatisticsChunk first;
+    StatisticsChunk* last = &first;
+    std::vector<StatisticsEntry*> index;
+    std::size_t indexCount = 0;
+};
+
+/*
+ * Registry of per-thread statistics, mutex only protects the list of
+ * threads and retired totals and is not used when messages are counted.
+ */
+struct StatisticsRegistry {
+    std::mutex mutex;
+    std::vector<ThreadStatistics*> threads;
+    StatisticsTotals retired;  // statistics of finished threads
+};
+
+// Never destroyed, threads which exit after static destructors have run
+// still unregister their statistics
+StatisticsRegistry& statisticsRegistry() {
+    static StatisticsRegistry* registry = new StatisticsRegistry();
+    return *registry;
+}
+
+// Registers per-thread statistics, merges them into retired on thread exit
+struct ThreadStatisticsHolder {
+    ThreadStatisticsHolder() : registry(::statisticsRegistry()) {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.threads.push_back(&stats);
+    }
+    ~ThreadStatisticsHolder() {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), &stats));
+        stats.addTo(registry.retired);
+    }
+    StatisticsRegistry& registry;
+    ThreadStatistics stats;
+};
+
+// Add one message to current thread statistics
+void recordStatistics(log4cxx::LoggerPtr const& logger, int level, std::int64_t nanoseconds) {
+    thread_local ThreadStatisticsHolder holder;
+    ThreadStatistics& stats = holder.stats;
+
+    std::uint64_t const ns = nanoseconds > 0 ? nanoseconds : 0;
+    std::size_t bucket = 0;
+    for (std::uint64_t value = ns; value > 1 and bucket + 1 < LATENCY_BUCKETS; value >>= 1) {
+        ++bucket;
+    }
+
+    StatisticsEntry& entry = stats.find(logger, level);
+    entry.count.fetch_add(1, std::memory_order_relaxed);
+    entry.nanoseconds.fetch_add(ns, std::memory_order_relaxed);
+    stats.latency[bucket].fetch_add(1, std::memory_order_relaxed);
+}
 
-// global initialization flag (protected by configMutex)
-bool initialized = false;
 
 /*
- * This method is called exactly once to initialize LOG4CXX configuration.
- * If `initialized` is set to true then default configuration is skipped.
+ * One-time per-thread initialization, calls MDC init functions. This has
+ * to run before message is put into per-thread buffers because those
+ * functions can log messages themselves.
  */
-log4cxx::LoggerPtr log4cxxInit() {
+void mdcThreadInit() {
+    if (LOG4CXX_UNLIKELY(not ::mdcThreadInitialized)) {
+        ::mdcThreadInitialized = true;
 
-    std::lock_guard<std::mutex> lock(configMutex);
-    if (!initialized) {
-        initialized = true;
-        // do default configuration if no one done any configuration yet
-        ::defaultConfig();
+        // call all functions in the current snapshot of MDC init list
+        if (MDCInitList const* list = ::mdcInitList.load(std::memory_order_acquire)) {
+            for (auto& fun: *list) {
+                fun();
+            }
+        }
     }
-
-    // returns root logger to be used as default logger
-    return log4cxx::Logger::getRootLogger();
 }
 
-// List of the MDC initialization functions
-std::vector<std::function<void()>> mdcInitFunctions;
-std::mutex mdcInitMutex;
+/*
+ * Returns true if all appenders which would see events of a logger support
+ * deferred rendering of messages and there is at least one appender.
+ */
+bool supportsDeferredMessages(log4cxx::LoggerPtr logger) {
+    bool any = false;
+    for (; logger; logger = logger->getParent()) {
+        for (auto const& appender: logger->getAllAppenders()) {
+            auto support = std::dynamic_pointer_cast<lsst::log::detail::DeferredMessageSupport>(appender);
+            if (not support or not support->supportsDeferredMessages()) {
+                return false;
+            }
+            any = true;
+        }
+        if (not logger->getAdditivity()) {
+            break;
+        }
+    }
+    return any;
+}
 
-// more efficient alternative to pthread_once
-struct PthreadKey {
-    PthreadKey() {
-        // we don't need destructor for a key
-        pthread_key_create(&key, nullptr);
+/*
+ * Format printf-style message into a string, string is used as a buffer
+ * and its capacity is never reduced. Messages which do not fit into
+ * MAX_LOG_MSG_LEN bytes (or current capacity) are formatted twice.
+ */
+void formatMessage(std::string& out, char const* fmt, va_list args) {
+    out.resize(std::max<std::size_t>(out.capacity(), MAX_LOG_MSG_LEN));
+    va_list copy;
+    va_copy(copy, args);
+    int const size = vsnprintf(&out[0], out.size(), fmt, copy);
+    va_end(copy);
+    if (size < 0) {
+        // invalid format, output it as is
+        out.assign(fmt);
+        return;
+    }
+    if (static_cast<std::size_t>(size) >= out.size()) {
+        out.resize(size + 1);
+        vsnprintf(&out[0], out.size(), fmt, args);
     }
-    pthread_key_t key;
-} pthreadKey;
+    out.resize(size);
+}
 
 } // namespace
 
@@ -154,6 +1352,9 @@ namespace log {
 
 // Log class
 
+std::atomic<unsigned> Log::_configGeneration(1);
+std::atomic<unsigned> Log::_levelGeneration(1);
+
 /**
  *  Returns default LOG4CXX logger.
  */
@@ -175,7 +1376,10 @@ log4cxx::LoggerPtr const& Log::_defaultLogger() {
   * pattern "%c %p: %m%n".
   */
 void Log::configure() {
-    std::lock_guard<std::mutex> lock(::configMutex);
+    // report to appenders which are about to be removed
+    detail::LogSampler::reportSuppressed();
+
+    std::unique_lock<std::mutex> lock(::configMutex);
 
     // Make sure other threads know that default configuration is not needed
     ::initialized = true;
@@ -186,6 +1390,12 @@ void Log::configure() {
 
     // Do default configuration (only if not configured already?)
     ::defaultConfig();
+
+    ++_configGeneration;
+    ++_levelGeneration;
+
+    lock.unlock();
+    ::runConfigureHook();
 }
 
 /** Configures log4cxx from specified file.
@@ -199,7 +1409,10 @@ void Log::configure() {
   * @param filename  Path to configuration file.
   */
 void Log::configure(std::string const& filename) {
-    std::lock_guard<std::mutex> lock(::configMutex);
+    // report to appenders which are about to be removed
+    detail::LogSampler::reportSuppressed();
+
+    std::unique_lock<std::mutex> lock(::configMutex);
 
     // Make sure other threads know that default configuration is not needed
     ::initialized = true;
@@ -209,6 +1422,12 @@ void Log::configure(std::string const& filename) {
     log4cxx::BasicConfigurator::resetConfiguration();
 
     ::configFromFile(filename);
+
+    ++_configGeneration;
+    ++_levelGeneration;
+
+    lock.unlock();
+    ::runConfigureHook();
 }
 
 /** Configures log4cxx using a string containing the list of properties,
@@ -218,7 +1437,10 @@ void Log::configure(std::string const& filename) {
   * @param properties  Configuration properties.
   */
 void Log::configure_prop(std::string const& properties) {
-    std::lock_guard<std::mutex> lock(::configMutex);
+    // report to appenders which are about to be removed
+    detail::LogSampler::reportSuppressed();
+
+    std::unique_lock<std::mutex> lock(::configMutex);
 
     // Make sure other threads know that default configuration is not needed
     ::initialized = true;
@@ -231,7 +1453,109 @@ void Log::configure_prop(std::string const& properties) {
     log4cxx::helpers::InputStreamPtr inStream(new log4cxx::helpers::ByteArrayInputStream(data));
     log4cxx::helpers::Properties prop;
     prop.load(inStream);
-    log4cxx::PropertyConfigurator::configure(prop);
+    ::configFromProperties(prop);
+
+    ++_configGeneration;
+    ++_levelGeneration;
+
+    lock.unlock();
+    ::runConfigureHook();
+}
+
+/** Re-configures logging from a file without resetting configuration.
+  *
+  * New configuration is compared with the current one and only changed
+  * logger levels, additivity flags and appenders are updated: loggers and
+  * appenders which did not change are not touched, and messages are not
+  * lost while configuration is updated. Only properties can be compared,
+  * XML files are translated into properties when they use nothing beyond
+  * appenders with parameters and layouts, loggers and root logger. If
+  * current configuration was not made from properties, XML file cannot be
+  * translated, or properties other than loggers and appenders have changed
+  * then this is equivalent to configure(filename). If file cannot be read
+  * then current configuration is kept.
+  *
+  * @param filename  Path to configuration file.
+  */
+void Log::reconfigure(std::string const& filename) {
+    log4cxx::helpers::Properties prop;
+    if (not ::loadProperties(prop, filename)) {
+        if (::isXmlFile(filename)) {
+            configure(filename);
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(::configMutex);
+
+    // Make sure other threads know that default configuration is not needed
+    ::initialized = true;
+
+    if (::reconfigureFromProperties(prop, lock)) {
+        ++_configGeneration;
+    }
+    ++_levelGeneration;
+
+    lock.unlock();
+    ::runConfigureHook();
+}
+
+/** Re-configures logging from a string containing the list of properties
+  * without resetting configuration, see reconfigure(filename) for details.
+  *
+  * @param properties  Configuration properties.
+  */
+void Log::reconfigure_prop(std::string const& properties) {
+    std::vector<unsigned char> data(properties.begin(), properties.end());
+    log4cxx::helpers::InputStreamPtr inStream(new log4cxx::helpers::ByteArrayInputStream(data));
+    log4cxx::helpers::Properties prop;
+    prop.load(inStream);
+
+    std::unique_lock<std::mutex> lock(::configMutex);
+
+    // Make sure other threads know that default configuration is not needed
+    ::initialized = true;
+
+    if (::reconfigureFromProperties(prop, lock)) {
+        ++_configGeneration;
+    }
+    ++_levelGeneration;
+
+    lock.unlock();
+    ::runConfigureHook();
+}
+
+/** Starts a background thread which watches configuration file and calls
+  * reconfigure(filename) whenever the file changes.
+  *
+  * Only one file can be watched, calling this method again replaces the
+  * previous watch.
+  *
+  * @param filename  Path to configuration file, if empty then the file
+  *                  specified by LSST_LOG_CONFIG environment variable is
+  *                  used.
+  * @param interval  Interval in seconds between checks of the file.
+  */
+void Log::watchConfig(std::string const& filename, double interval) {
+    std::string path = filename;
+    if (path.empty()) {
+        if (const char* env = getenv(::configEnv)) {
+            path = env;
+        }
+    }
+    if (path.empty()) {
+        log4cxx::helpers::LogLog::error(LOG4CXX_STR("watchConfig: file name is not specified and "
+                                                    "LSST_LOG_CONFIG is not set"));
+        return;
+    }
+    auto const period = std::chrono::milliseconds(std::max(static_cast<long>(interval * 1000), 1L));
+    ::configWatcher().start(path, period);
+}
+
+/** Stops watching configuration file started by watchConfig().
+  */
+void Log::unwatchConfig() {
+    ::configWatcher().stop();
 }
 
 /** Get the logger name associated with the Log object.
@@ -272,6 +1596,14 @@ Log Log::getLogger(std::string const& loggername) {
   * @return Previous value for the key in the MDC.
   */
 std::string Log::MDC(std::string const& key, std::string const& value) {
+    int const index = ::findMDCKey(key);
+    if (index >= 0) {
+        detail::MDCValue mdcValue;
+        mdcValue.assign(value);
+        ::mdcExchange(index, mdcValue);
+        return std::string(mdcValue.view());
+    }
+
     // put() does not remove existing mapping, to make it less confusing
     // for clients which expect that MDC() always overwrites existing mapping
     // we explicitly remove it first if it exists.
@@ -286,19 +1618,50 @@ std::string Log::MDC(std::string const& key, std::string const& value) {
   * @param key  Key identifying value to remove.
   */
 void Log::MDCRemove(std::string const& key) {
+    int const index = ::findMDCKey(key);
+    if (index >= 0) {
+        detail::MDCValue mdcValue;
+        ::mdcExchange(index, mdcValue);
+        return;
+    }
     log4cxx::MDC::remove(key);
 }
 
-int Log::MDCRegisterInit(std::function<void()> function) {
+/** Places a KEY/VALUE pair in the MDC for the current thread using
+  * interned key. Empty value is stored in MDC like any other value, use
+  * MDCRemove() to remove the key.
+  *
+  * @param key    Interned key.
+  * @param value  String value.
+  */
+void Log::MDC(MDCKey key, std::string_view value) {
+    detail::MDCValue mdcValue;
+    mdcValue.assign(value);
+    ::mdcExchange(key.index(), mdcValue);
+}
 
-    std::lock_guard<std::mutex> lock(mdcInitMutex);
+/** Remove the value associated with interned KEY within the MDC.
+  *
+  * @param key  Interned key identifying value to remove.
+  */
+void Log::MDCRemove(MDCKey key) {
+    detail::MDCValue mdcValue;
+    ::mdcExchange(key.index(), mdcValue);
+}
+
+int Log::MDCRegisterInit(std::function<void()> function) {
 
     // logMsg may have been called already in this thread, to make sure that
     // this function is executed in this thread call it explicitly
     function();
 
-    // store function for later use
-    ::mdcInitFunctions.push_back(std::move(function));
+    // store function for later use in a new copy of the list
+    std::lock_guard<std::mutex> lock(mdcInitMutex);
+    MDCInitList const* current = ::mdcInitList.load(std::memory_order_relaxed);
+    auto list = current ? std::make_unique<MDCInitList>(*current) : std::make_unique<MDCInitList>();
+    list->push_back(std::move(function));
+    ::mdcInitList.store(list.get(), std::memory_order_release);
+    ::mdcInitLists.push_back(std::move(list));
 
     // return arbitrary number
     return 1;
@@ -310,6 +1673,80 @@ int Log::MDCRegisterInit(std::function<void()> function) {
   */
 void Log::setLevel(int level) {
     _logger->setLevel(log4cxx::Level::toLevel(level));
+    ++_levelGeneration;
+}
+
+/** Set levels of many loggers at once.
+  *
+  * Each rule pattern is either a logger name (empty for root logger), or a
+  * glob pattern where `*` matches any sequence of characters, including
+  * dots, and `?` matches any single character, e.g. "lsst.ip.*" matches all
+  * existing descendants of "lsst.ip" logger and "*" matches all loggers.
+  * When several rules match the same logger, the last one wins. Named
+  * loggers are created if they do not exist, glob patterns only apply to
+  * existing loggers. All patterns are matched in a single pass over the
+  * logger hierarchy and cached thresholds are invalidated once.
+  *
+  * @param rules  Sequence of rules, negative level removes logger level so
+  *               that it is inherited from parent (ignored for root).
+  * @return Previous levels of all changed loggers, passing these to
+  *         setLevels() restores them.
+  */
+std::vector<LogLevelRule> Log::setLevels(std::vector<LogLevelRule> const& rules) {
+    // index of last exact rule for each name, and indices of glob rules
+    std::unordered_map<std::string_view, std::size_t> exact;
+    std::vector<std::size_t> globs;
+    for (std::size_t i = 0; i != rules.size(); ++i) {
+        if (rules[i].pattern.find_first_of("*?") == std::string::npos) {
+            exact[rules[i].pattern] = i;
+        } else {
+            globs.push_back(i);
+        }
+    }
+
+    std::vector<LogLevelRule> saved;
+    auto apply = [&](log4cxx::LoggerPtr const& logger, std::string const& name, LogLevelRule const& rule) {
+        log4cxx::LevelPtr const old = logger->getLevel();
+        saved.push_back(LogLevelRule{name, old ? old->toInt() : -1});
+        if (rule.level >= 0) {
+            logger->setLevel(log4cxx::Level::toLevel(rule.level));
+        } else if (not name.empty()) {
+            logger->setLevel(log4cxx::LevelPtr());
+        }
+    };
+
+    // make sure that all named loggers exist
+    std::vector<std::pair<log4cxx::LoggerPtr, std::size_t>> named;
+    for (auto const& item: exact) {
+        Log const log = getLogger(rules[item.second].pattern);
+        named.emplace_back(log._logger, item.second);
+    }
+
+    if (globs.empty()) {
+        for (auto const& item: named) {
+            apply(item.first, rules[item.second].pattern, rules[item.second]);
+        }
+    } else {
+        auto loggers = log4cxx::LogManager::getCurrentLoggers();
+        loggers.push_back(log4cxx::Logger::getRootLogger());
+        for (auto const& logger: loggers) {
+            std::string const name = Log(logger).getName();
+            auto const iter = exact.find(name);
+            std::size_t const first = iter == exact.end() ? 0 : iter->second + 1;
+            LogLevelRule const* rule = iter == exact.end() ? nullptr : &rules[iter->second];
+            for (auto index = globs.rbegin(); index != globs.rend() and *index >= first; ++index) {
+                if (::globMatch(rules[*index].pattern, name)) {
+                    rule = &rules[*index];
+                    break;
+                }
+            }
+            if (rule != nullptr) {
+                apply(logger, name, *rule);
+            }
+        }
+    }
+    ++_levelGeneration;
+    return saved;
 }
 
 /** Retrieve the logging threshold.
@@ -336,18 +1773,33 @@ int Log::getEffectiveLevel() const {
     return levelno;
 }
 
-/** Return whether the logging threshold of the logger is less than or equal
-  * to LEVEL.
-  * @return Bool indicating whether or not logger is enabled.
+/** Calculate effective threshold of the logger and store it in the cache
+  * together with current level generation number.
+  *
+  * Threshold combines effective level of the logger and the threshold of
+  * the logger repository, same as Logger::isEnabledFor() does.
   *
-  * @param level   Logging threshold to check.
+  * @return Effective threshold.
   */
-bool Log::isEnabledFor(int level) const {
-    if (_logger->isEnabledFor(log4cxx::Level::toLevel(level))) {
-        return true;
-    } else {
-        return false;
+int Log::_updateThreshold() const {
+    // Read generation first, if levels change while we are here
+    // then next call will update it again.
+    unsigned const generation = _levelGeneration.load(std::memory_order_acquire);
+
+    int threshold = log4cxx::Level::OFF_INT;
+    auto repository = _logger->getLoggerRepository();
+    if (repository != nullptr) {
+        threshold = std::max(getEffectiveLevel(), repository->getThreshold()->toInt());
     }
+
+    // flight recorder wants to see messages below threshold too
+    _appendThreshold.store(threshold, std::memory_order_relaxed);
+    threshold = std::min(threshold, detail::flightRecorderLevel.load(std::memory_order_acquire));
+
+    std::uint64_t const cache = (static_cast<std::uint64_t>(generation) << 32) |
+                                static_cast<std::uint32_t>(threshold);
+    _levelCache.store(cache, std::memory_order_relaxed);
+    return threshold;
 }
 
 /**
@@ -359,25 +1811,82 @@ bool Log::isEnabledFor(int level) const {
   * suffix name is used for returned logger name. If suffix is empty
   * then this instance is returned.
   *
+  * Returned loggers are cached, so repeated calls with the same suffix only
+  * do a hash table lookup and do not allocate memory. Cache is cleared when
+  * logging is re-configured.
+  *
   * @param suffix Suffix for tha name of returned logger, can include dot
   *               (but not at leading position) and can be empty.
   * @return Log instance.
  */
-Log Log::getChild(std::string const& suffix) const {
+Log Log::getChild(std::string_view suffix) const {
     // strip leading dots and spaces from suffix
     auto pos = suffix.find_first_not_of(" .");
-    if (pos == std::string::npos) {
+    if (pos == std::string_view::npos) {
         // empty, just return myself
         return *this;
     }
+    suffix.remove_prefix(pos);
+
+    // fast path, child is already in the cache for current configuration
+    log4cxx::Logger const* const parent = _logger.get();
+    std::size_t const hash = ::childHash(parent, suffix);
+    auto& registry = ::childRegistry();
+    {
+        thread_local ChildHazardHolder holder;
+        ChildHazardGuard guard(holder.hazard);
+        // announce the table, then check that it was not replaced meanwhile
+        ChildTable const* table = registry.table.load(std::memory_order_acquire);
+        while (table != nullptr) {
+            holder.hazard.store(table, std::memory_order_seq_cst);
+            ChildTable const* const again = registry.table.load(std::memory_order_seq_cst);
+            if (again == table) {
+                break;
+            }
+            table = again;
+        }
+        if (table != nullptr and table->generation == _configGeneration.load(std::memory_order_acquire)) {
+            if (ChildEntry const* entry = table->find(parent, suffix, hash)) {
+                // update shared threshold cache so that copies do not need to
+                entry->child._threshold();
+                return entry->child;
+            }
+        }
+    }
+
     std::string name = getName();
     if (name.empty()) {
-        name = suffix.substr(pos);
+        name = suffix;
     } else {
         name += '.';
-        name += suffix.substr(pos);
+        name += suffix;
     }
-    return getLogger(name);
+    Log child = getLogger(name);
+
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    unsigned const generation = _configGeneration.load(std::memory_order_acquire);
+    ChildTable* current = registry.current.get();
+    if (current == nullptr or current->generation != generation) {
+        // logging was re-configured, start from scratch
+        registry.replace(std::make_unique<ChildTable>(CHILD_TABLE_INITIAL_CAPACITY, generation));
+        current = registry.current.get();
+    } else if (current->find(parent, suffix, hash) != nullptr) {
+        // somebody else added it in the meantime
+        return child;
+    }
+    if (2 * (current->size + 1) > current->capacity()) {
+        auto bigger = std::make_unique<ChildTable>(2 * current->capacity(), generation);
+        for (std::size_t i = 0; i != current->capacity(); ++i) {
+            if (ChildEntry const* entry = current->slots[i].load(std::memory_order_relaxed)) {
+                bigger->insert(entry);
+            }
+        }
+        registry.replace(std::move(bigger));
+        current = registry.current.get();
+    }
+    registry.entries.push_back(std::make_unique<ChildEntry>(ChildEntry{parent, std::string(suffix), hash, child}));
+    current->insert(registry.entries.back().get());
+    return child;
 }
 
 /** Method used by LOG_INFO and similar macros to process a log message
@@ -387,43 +1896,439 @@ void Log::log(log4cxx::LevelPtr level,     ///< message level
               log4cxx::spi::LocationInfo const& location,  ///< message origin location
               char const* fmt,             ///< message format string
               ...                          ///< message arguments
-             ) {
+             ) const {
     va_list args;
     va_start(args, fmt);
-    char msg[MAX_LOG_MSG_LEN];
-    vsnprintf(msg, MAX_LOG_MSG_LEN, fmt, args);
-    logMsg(level, location, msg);
+    vlog(level, location, fmt, args);
+    va_end(args);
+}
+
+/** Same as log() but with arguments given as va_list, message length is
+  * not limited.
+  */
+void Log::vlog(log4cxx::LevelPtr level,     ///< message level
+               log4cxx::spi::LocationInfo const& location,  ///< message origin location
+               char const* fmt,             ///< message format string
+               va_list args                 ///< message arguments
+              ) const {
+    ::mdcThreadInit();
+    if (_toFlightRecorder(level)) {
+        // bounded formatting straight into recorder slot
+        detail::recordPrintf(_logger.get(), level->toInt(), location, fmt, args);
+        return;
+    }
+    if constexpr (std::is_same_v<log4cxx::LogString, std::string>) {
+        // format directly into the string that is passed to logging event,
+        // nested logging calls from appenders happen after the event has
+        // copied it
+        thread_local log4cxx::LogString buffer;
+        ::formatMessage(buffer, fmt, args);
+        _append(level, location, buffer);
+    } else {
+        std::string msg;
+        ::formatMessage(msg, fmt, args);
+        log4cxx::LogString buffer;
+        log4cxx::helpers::Transcoder::decode(msg, buffer);
+        _append(level, location, buffer);
+    }
 }
 
 /** Method used by LOGS_INFO and similar macros to process a log message.
   */
 void Log::logMsg(log4cxx::LevelPtr level,     ///< message level
                  log4cxx::spi::LocationInfo const& location,  ///< message origin location
-                 std::string const& msg       ///< message string
-                 ) {
+                 std::string_view msg         ///< message string
+                 ) const {
+    ::mdcThreadInit();
+    if (_toFlightRecorder(level)) {
+        detail::recordMessage(_logger.get(), level->toInt(), location, msg);
+        return;
+    }
+
+    // message is copied into logging event so per-thread buffer can be
+    // re-used by nested logging calls
+    if constexpr (std::is_same_v<log4cxx::LogString, std::string>) {
+        thread_local log4cxx::LogString buffer;
+        buffer.assign(msg.data(), msg.size());
+        _append(level, location, buffer);
+    } else {
+        log4cxx::LogString buffer;
+        log4cxx::helpers::Transcoder::decode(std::string(msg), buffer);
+        _append(level, location, buffer);
+    }
+}
+
+bool Log::_toFlightRecorder(log4cxx::LevelPtr const& level) const {
+    if (LOG4CXX_UNLIKELY(detail::flightRecorderLevel.load(std::memory_order_relaxed) != log4cxx::Level::OFF_INT)) {
+        int const levelInt = level->toInt();
+        _threshold();
+        if (levelInt < _appendThreshold.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        if (levelInt >= detail::flightRecorderDumpLevel.load(std::memory_order_relaxed)) {
+            detail::dumpFlightRecorder(level->toString());
+        }
+    }
+    return false;
+}
+
+bool Log::_deferRendering() const {
+    unsigned const generation = _levelGeneration.load(std::memory_order_acquire);
+    std::uint64_t const cache = _deferCache.load(std::memory_order_relaxed);
+    if (static_cast<unsigned>(cache >> 32) == generation and (cache & 3) != 0) {
+        return (cache & 3) == 2;
+    }
+
+    bool const defer = ::supportsDeferredMessages(_logger);
+
+    _deferCache.store((static_cast<std::uint64_t>(generation) << 32) | (defer ? 2 : 1),
+                      std::memory_order_relaxed);
+    return defer;
+}
+
+void Log::_append(log4cxx::LevelPtr const& level, log4cxx::spi::LocationInfo const& location,
+                  log4cxx::LogString const& msg, detail::FormatRecord const* record) const {
+
+    // make values of interned MDC keys visible to LOG4CXX
+    ::mdcSync();
+
+    bool const withStatistics = ::statisticsEnabled.load(std::memory_order_relaxed);
+    std::int64_t const start = LOG4CXX_UNLIKELY(withStatistics) ? ::steadyNanoseconds() : 0;
+
+    // Same as forcedLog but event memory comes from per-thread free list and
+    // the pool is re-used
+    {
+        detail::EventPoolScope scope;
+        if (record != nullptr) {
+            _logger->callAppenders(detail::makeLoggingEvent(_logger->getName(), level, *record, location),
+                                   scope.pool());
+        } else {
+            _logger->callAppenders(detail::makeLoggingEvent(_logger->getName(), level, msg, location),
+                                   scope.pool());
+        }
+    }
+
+    if (LOG4CXX_UNLIKELY(withStatistics)) {
+        ::recordStatistics(_logger, level->toInt(), ::steadyNanoseconds() - start);
+    }
+}
 
-    // do one-time per-thread initialization, this was implemented
-    // with thread_local initially but clang on OS X did not support it
-    void *ptr = pthread_getspecific(::pthreadKey.key);
-    if (ptr == nullptr) {
+void Log::setStatisticsEnabled(bool enabled) {
+    ::statisticsEnabled.store(enabled, std::memory_order_relaxed);
+}
 
-        // use pointer value as a flag, don't care where it points to
-        ptr = static_cast<void*>(&::pthreadKey);
-        pthread_setspecific(::pthreadKey.key, ptr);
+bool Log::isStatisticsEnabled() {
+    return ::statisticsEnabled.load(std::memory_order_relaxed);
+}
 
-        std::lock_guard<std::mutex> lock(mdcInitMutex);
-		// call all functions in the MDC init list
-        for (auto& fun: mdcInitFunctions) {
-            fun();
+LogStatistics Log::getStatistics() {
+    ::StatisticsTotals total;
+    {
+        // registry lock only keeps threads from exiting, counters are read
+        // while owning threads keep updating them
+        auto& registry = ::statisticsRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        total = registry.retired;
+        for (auto* stats: registry.threads) {
+            stats->addTo(total);
         }
     }
 
-    // forward everything to logger
-    _logger->forcedLog(level, msg, location);
+    LogStatistics result;
+    for (auto const& item: total.messages) {
+        result.messages.push_back(LogMessageStatistics{Log(item.second.logger).getName(), item.first.second, item.second.count,
+                                                       item.second.nanoseconds});
+    }
+    std::sort(result.messages.begin(), result.messages.end(), [](auto const& lhs, auto const& rhs) {
+        return std::tie(lhs.logger, lhs.level) < std::tie(rhs.logger, rhs.level);
+    });
+    result.latencyHistogram.assign(total.latency.begin(), total.latency.end());
+    while (not result.latencyHistogram.empty() and result.latencyHistogram.back() == 0) {
+        result.latencyHistogram.pop_back();
+    }
+    return result;
+}
+
+void Log::resetStatistics() {
+    auto& registry = ::statisticsRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.retired.clear();
+    for (auto* stats: registry.threads) {
+        stats->clear();
+    }
+}
+
+void Log::enableFlightRecorder(std::string const& filename, int level, int dumpLevel, std::size_t capacity) {
+    detail::enableFlightRecorder(filename, level, dumpLevel, capacity);
+    // cached thresholds change
+    ++_levelGeneration;
+}
+
+void Log::disableFlightRecorder() {
+    detail::disableFlightRecorder();
+    ++_levelGeneration;
+}
+
+bool Log::isFlightRecorderEnabled() {
+    return detail::flightRecorderLevel.load(std::memory_order_relaxed) != log4cxx::Level::OFF_INT;
+}
+
+std::size_t Log::dumpFlightRecorder() {
+    return detail::dumpFlightRecorder("explicit dump");
+}
+
+void Log::dumpFlightRecorderOnSignal(int signum) {
+    detail::dumpFlightRecorderOnSignal(signum);
+}
+
+void Log::setConfigCacheEnabled(bool enabled) {
+    ::configCacheEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Log::isConfigCacheEnabled() {
+    return ::configCacheEnabled.load(std::memory_order_relaxed);
+}
+
+void Log::setLazyAppendersEnabled(bool enabled) {
+    ::lazyAppendersEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Log::isLazyAppendersEnabled() {
+    return ::lazyAppendersEnabled.load(std::memory_order_relaxed);
+}
+
+/** Method used by LOGF_INFO and similar macros to process a log message
+  * with captured arguments.
+  *
+  * If all appenders of the logger support deferred rendering (e.g.
+  * AsyncRingAppender with ExtendedPatternLayout or BinaryFileAppender)
+  * the record is passed to them unrendered, otherwise it is rendered here.
+  */
+void Log::logRecord(log4cxx::LevelPtr level,     ///< message level
+                    log4cxx::spi::LocationInfo const& location,  ///< message origin location
+                    detail::FormatRecord const& record  ///< message format and arguments
+                    ) const {
+    ::mdcThreadInit();
+    if (_toFlightRecorder(level)) {
+        // record without rendering
+        detail::recordFormat(_logger.get(), level->toInt(), location, record);
+        return;
+    }
+    if (_deferRendering()) {
+        _append(level, location, log4cxx::LogString(), &record);
+        return;
+    }
+
+    // re-use per-thread buffer, message is copied into logging event
+    // before any appender runs so nested logging does not clash
+    if constexpr (std::is_same_v<log4cxx::LogString, std::string>) {
+        thread_local log4cxx::LogString buffer;
+        buffer.clear();
+        record.render(buffer);
+        _append(level, location, buffer);
+    } else {
+        std::string msg;
+        record.render(msg);
+        log4cxx::LogString buffer;
+        log4cxx::helpers::Transcoder::decode(msg, buffer);
+        _append(level, location, buffer);
+    }
 }
 
 unsigned lwpID() {
     return detail::lwpID();
 }
 
+
+// MDCKey class
+
+MDCKey::MDCKey(std::string const& name) {
+    int const index = ::findMDCKey(name);
+    if (index >= 0) {
+        _index = index;
+        return;
+    }
+
+    auto& registry = ::mdcKeyRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    MDCKeyTable const* table = registry.table.load(std::memory_order_relaxed);
+    auto newTable = table ? std::make_unique<MDCKeyTable>(*table) : std::make_unique<MDCKeyTable>();
+    auto result = newTable->index.emplace(name, newTable->names.size());
+    if (result.second) {
+        newTable->names.push_back(name);
+        registry.table.store(newTable.get(), std::memory_order_release);
+        registry.tables.push_back(std::move(newTable));
+    }
+    // if somebody else added it in the meantime we use their index
+    _index = result.first->second;
+}
+
+std::string const& MDCKey::name() const {
+    return ::mdcKeyName(_index);
+}
+
+void detail::setConfigureHook(std::function<void()> hook) {
+    std::lock_guard<std::mutex> lock(::configureHookMutex);
+    ::configureHook = std::move(hook);
+}
+
+void detail::mdcSwap(MDCKey key, MDCValue& value) {
+    ::mdcExchange(key.index(), value);
+}
+
+void detail::mdcSwap(std::string const& key, MDCValue& value) {
+    int const index = ::findMDCKey(key);
+    if (index >= 0) {
+        ::mdcExchange(index, value);
+        return;
+    }
+    MDCValue oldValue;
+    ::log4cxxMDCGet(key, oldValue);
+    ::log4cxxMDCSet(key, value);
+    value.swap(oldValue);
+}
+
+
+// LogCallSite class
+
+void detail::LogCallSite::_resolve(char const* loggername) {
+
+    // Read generation first, if configuration changes while we are here
+    // then next call will resolve it again.
+    unsigned const generation = Log::_configGeneration.load(std::memory_order_acquire);
+
+    Log log = loggername == nullptr ? Log::getDefaultLogger() : Log::getLogger(loggername);
+
+    Log const* cached = nullptr;
+    {
+        auto& registry = ::logRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        auto& entry = registry.logs[log._logger.get()];
+        if (entry == nullptr) {
+            entry.reset(new Log(log));
+        }
+        cached = entry.get();
+    }
+
+    _log.store(cached, std::memory_order_relaxed);
+    _generation.store(generation, std::memory_order_release);
+}
+
+// LogSampler class
+
+namespace {
+
+// Call site which suppressed some messages
+struct SuppressedSite {
+    std::string logger;
+    int level;
+    log4cxx::spi::LocationInfo location;
+    std::atomic<std::uint64_t>* counter;
+};
+
+struct SuppressedRegistry {
+    std::mutex mutex;
+    std::vector<SuppressedSite> sites;
+};
+
+SuppressedRegistry& suppressedRegistry() {
+    static SuppressedRegistry registry;
+    return registry;
+}
+
+// Interval between reports and time of the next report, in nanoseconds
+std::atomic<std::int64_t> reportInterval{10'000'000'000};
+std::atomic<std::int64_t> nextReport{0};
+
+} // namespace
+
+bool detail::LogSampler::rateLimit(double perSecond) {
+    if (not (perSecond > 0)) {
+        return false;
+    }
+    // This is GCRA form of a token bucket: instead of a token count we
+    // keep the time when the bucket becomes full, each message moves that
+    // time forward by one token interval.
+    double const capacity = std::max(perSecond, 1.);
+    auto const interval = static_cast<std::int64_t>(1e9 / perSecond);
+    auto const tolerance = static_cast<std::int64_t>(1e9 * (capacity - 1) / perSecond);
+    std::int64_t const now = steadyNanoseconds();
+    std::int64_t bucketTime = _bucketTime.load(std::memory_order_relaxed);
+    while (true) {
+        std::int64_t const start = std::max(bucketTime, now);
+        if (start - now > tolerance) {
+            // bucket is empty
+            return false;
+        }
+        if (_bucketTime.compare_exchange_weak(bucketTime, start + interval, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+void detail::LogSampler::suppress(Log const& log, int level, log4cxx::spi::LocationInfo const& location) {
+    _suppressed.fetch_add(1, std::memory_order_relaxed);
+    if (LOG4CXX_UNLIKELY(not _registered.load(std::memory_order_acquire))) {
+        if (not _registered.exchange(true, std::memory_order_acq_rel)) {
+            auto& registry = suppressedRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            if (registry.sites.empty()) {
+                // final counts are reported at exit, before log4cxx is
+                // destroyed as it was initialized before this
+                std::atexit(&LogSampler::reportSuppressed);
+            }
+            registry.sites.push_back(SuppressedSite{log.getName(), level, location, &_suppressed});
+        }
+    }
+    _reportIfDue();
+}
+
+void detail::LogSampler::_reportIfDue() {
+    std::int64_t const interval = reportInterval.load(std::memory_order_relaxed);
+    if (interval <= 0) {
+        return;
+    }
+    std::int64_t const now = steadyNanoseconds();
+    std::int64_t next = nextReport.load(std::memory_order_relaxed);
+    if (next == 0) {
+        // first suppressed message starts the reporting period
+        nextReport.compare_exchange_strong(next, now + interval, std::memory_order_relaxed);
+    } else if (now >= next and
+               nextReport.compare_exchange_strong(next, now + interval, std::memory_order_relaxed)) {
+        reportSuppressed();
+    }
+}
+
+void detail::LogSampler::reportSuppressed() {
+    std::vector<std::pair<SuppressedSite const*, std::uint64_t>> reports;
+    auto& registry = suppressedRegistry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    for (auto const& site: registry.sites) {
+        std::uint64_t const count = site.counter->exchange(0, std::memory_order_relaxed);
+        if (count > 0) {
+            reports.emplace_back(&site, count);
+        }
+    }
+    // Sites are only appended, copy what we need to log without holding
+    // the lock, logging can re-enter suppress().
+    std::vector<SuppressedSite> sites;
+    for (auto const& report: reports) {
+        sites.push_back(*report.first);
+    }
+    lock.unlock();
+
+    for (std::size_t i = 0; i != sites.size(); ++i) {
+        auto const& site = sites[i];
+        Log::getLogger(site.logger).logMsg(
+            log4cxx::Level::toLevel(site.level), site.location,
+            "suppressed " + std::to_string(reports[i].second) + " messages from this location");
+    }
+}
+
+void detail::LogSampler::setReportInterval(double seconds) {
+    reportInterval.store(seconds > 0 ? static_cast<std::int64_t>(seconds * 1e9) : 0,
+                           std::memory_order_relaxed);
+    nextReport.store(0, std::memory_order_relaxed);
+}
+
 }} // namespace lsst::log
@@ -0,0 +1,143 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_RINGBUFFER_H
+#define LSST_LOG_RINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace lsst::log::detail {
+
+/**
+ *  Bounded lock-free queue with fixed capacity.
+ *
+ *  Any number of threads can push and pop concurrently, each slot carries
+ *  a sequence number which tells whether slot is ready for writing or
+ *  reading in a current lap (algorithm by D. Vyukov). Capacity is rounded
+ *  up to a power of two.
+ */
+template <typename T>
+class RingBuffer {
+public:
+
+    explicit RingBuffer(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        _mask = size - 1;
+        _cells.reset(new Cell[size]);
+        for (std::size_t i = 0; i != size; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // no copy allowed
+    RingBuffer(RingBuffer const&) = delete;
+    RingBuffer& operator=(RingBuffer const&) = delete;
+
+    /// Return buffer capacity.
+    std::size_t capacity() const { return _mask + 1; }
+
+    /**
+     *  Add new element to the queue.
+     *
+     *  @return False if queue is full, value is not moved in that case.
+     */
+    bool tryPush(T& value) {
+        std::size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &_cells[pos & _mask];
+            std::size_t const seq = cell->sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     *  Remove oldest element from the queue.
+     *
+     *  @return False if queue is empty.
+     */
+    bool tryPop(T& value) {
+        std::size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &_cells[pos & _mask];
+            std::size_t const seq = cell->sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        cell->data = T();
+        cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Return true if queue looks empty, result is approximate.
+    bool empty() const {
+        return _enqueuePos.load(std::memory_order_seq_cst) == _dequeuePos.load(std::memory_order_seq_cst);
+    }
+
+private:
+
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    std::size_t _mask = 0;
+    // separate producer and consumer positions to avoid false sharing
+    alignas(64) std::atomic<std::size_t> _enqueuePos{0};
+    alignas(64) std::atomic<std::size_t> _dequeuePos{0};
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_RINGBUFFER_H
@@ -0,0 +1,280 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <pthread.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+
+// Third-party headers
+#include "log4cxx/helpers/loglog.h"
+#include "log4cxx/helpers/optionconverter.h"
+#include "log4cxx/helpers/stringhelper.h"
+#include "log4cxx/helpers/transcoder.h"
+#include "log4cxx/layout.h"
+#include "log4cxx/level.h"
+#include "log4cxx/spi/loggingevent.h"
+
+// Local headers
+#include "ShardedFileAppender.h"
+
+// macro below dows not work without this using directive
+// (and it breaks if placed inside namespaces)
+using lsst::log::detail::ShardedFileAppender;
+IMPLEMENT_LOG4CXX_OBJECT(ShardedFileAppender)
+
+using namespace log4cxx::helpers;
+
+namespace {
+
+// ASCII record separator which starts each record
+char const RECORD_SEPARATOR = '\x1e';
+
+// Environment variables which define MPI rank, in the order of preference
+char const* const RANK_VARIABLES[] = {"OMPI_COMM_WORLD_RANK", "PMIX_RANK", "PMI_RANK",
+                                      "MV2_COMM_WORLD_RANK", "SLURM_PROCID"};
+
+// Incremented in child process after each fork
+std::atomic<std::uint64_t> forkGeneration{0};
+
+void onFork() {
+    forkGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+[[maybe_unused]] int const atforkRegistered = pthread_atfork(nullptr, nullptr, onFork);
+
+std::string rankFromEnvironment() {
+    for (char const* name: RANK_VARIABLES) {
+        if (char const* value = std::getenv(name)) {
+            if (*value != '\0') {
+                return value;
+            }
+        }
+    }
+    return "0";
+}
+
+std::string shortHostName() {
+    char buffer[256];
+    if (::gethostname(buffer, sizeof(buffer)) != 0) {
+        return "localhost";
+    }
+    buffer[sizeof(buffer) - 1] = '\0';
+    std::string name(buffer);
+    return name.substr(0, name.find('.'));
+}
+
+// Replace all occurrences of `key` in `str`
+void replaceAll(std::string& str, std::string const& key, std::string const& value) {
+    for (auto pos = str.find(key); pos != std::string::npos; pos = str.find(key, pos + value.size())) {
+        str.replace(pos, key.size(), value);
+    }
+}
+
+}
+
+namespace lsst::log::detail {
+
+ShardedFileAppender::ShardedFileAppender() : _flushLevel(Level::WARN_INT) {
+    char const* tmpdir = std::getenv("TMPDIR");
+    _directory = tmpdir != nullptr and *tmpdir != '\0' ? tmpdir : "/tmp";
+}
+
+ShardedFileAppender::~ShardedFileAppender() {
+    close();
+}
+
+void ShardedFileAppender::append(const spi::LoggingEventPtr& event, Pool& p) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_closed) {
+        return;
+    }
+    if (LOG4CXX_UNLIKELY(_forkGeneration != ::forkGeneration.load(std::memory_order_relaxed))) {
+        // this is a child process, file and buffer belong to parent
+        _close(false);
+        _open(true);
+    }
+    if (_fd < 0) {
+        return;
+    }
+
+    _formatted.clear();
+    getLayout()->format(_formatted, event, p);
+
+    if (_timestamps) {
+        char prefix[32];
+        prefix[0] = ::RECORD_SEPARATOR;
+        auto const res = std::to_chars(prefix + 1, prefix + sizeof(prefix) - 1,
+                                       static_cast<std::int64_t>(event->getTimeStamp()));
+        *res.ptr = ' ';
+        _buffer.append(prefix, res.ptr + 1);
+    }
+    if constexpr (std::is_same_v<LogString, std::string>) {
+        _buffer += _formatted;
+    } else {
+        std::string encoded;
+        Transcoder::encode(_formatted, encoded);
+        _buffer += encoded;
+    }
+
+    if (_buffer.size() >= _bufferSize or event->getLevel()->toInt() >= _flushLevel) {
+        _flush();
+    }
+}
+
+void ShardedFileAppender::_flush() {
+    char const* ptr = _buffer.data();
+    std::size_t size = _buffer.size();
+    while (size > 0 and _fd >= 0) {
+        ssize_t const n = ::write(_fd, ptr, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (not _writeError) {
+                _writeError = true;
+                LOG4CXX_DECODE_CHAR(msg, "ShardedFileAppender: write failed " + _fileName + ": " +
+                                         std::strerror(errno));
+                LogLog::error(msg);
+            }
+            break;
+        }
+        ptr += n;
+        size -= n;
+    }
+    _buffer.clear();
+}
+
+bool ShardedFileAppender::_open(bool forked) {
+    _forkGeneration = ::forkGeneration.load(std::memory_order_relaxed);
+    _writeError = false;
+
+    std::string const pid = std::to_string(::getpid());
+    std::string name = _fileNameTemplate;
+    ::replaceAll(name, "{rank}", _rank.empty() ? ::rankFromEnvironment() : _rank);
+    ::replaceAll(name, "{pid}", pid);
+    ::replaceAll(name, "{host}", ::shortHostName());
+
+    std::filesystem::path path = std::filesystem::path(_directory) / name;
+    if (forked and _fileNameTemplate.find("{pid}") == std::string::npos) {
+        // without process ID child would re-open the file of its parent
+        path.replace_filename(path.stem().string() + "-" + pid + path.extension().string());
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(_directory, ec);
+    _fileName = path.string();
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+    if (not _fileAppend) {
+        flags |= O_TRUNC;
+    }
+    _fd = ::open(_fileName.c_str(), flags, 0666);
+    if (_fd < 0) {
+        LOG4CXX_DECODE_CHAR(msg, "ShardedFileAppender: failed to open file " + _fileName + ": " +
+                                 std::strerror(errno));
+        LogLog::error(msg);
+        _fileName.clear();
+        return false;
+    }
+    return true;
+}
+
+void ShardedFileAppender::_close(bool flush) {
+    if (flush) {
+        _flush();
+    }
+    _buffer.clear();
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _fileName.clear();
+}
+
+void ShardedFileAppender::close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_closed) {
+        return;
+    }
+    _closed = true;
+    // never flush buffer inherited from parent process
+    _close(_forkGeneration == ::forkGeneration.load(std::memory_order_relaxed));
+}
+
+std::string ShardedFileAppender::getFileName() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _fileName;
+}
+
+bool ShardedFileAppender::requiresLayout() const {
+    return true;
+}
+
+void ShardedFileAppender::activateOptions(Pool& p) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_fd >= 0) {
+        return;
+    }
+    if (not getLayout()) {
+        LogLog::error(LOG4CXX_STR("ShardedFileAppender: layout is not set"));
+        return;
+    }
+    _open();
+}
+
+void ShardedFileAppender::setOption(const LogString &option, const LogString &value) {
+
+    if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("DIRECTORY"), LOG4CXX_STR("directory"))) {
+        LOG4CXX_ENCODE_CHAR(directory, value);
+        _directory = directory;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("FILENAME"), LOG4CXX_STR("filename"))) {
+        LOG4CXX_ENCODE_CHAR(fileName, value);
+        _fileNameTemplate = fileName;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("RANK"), LOG4CXX_STR("rank"))) {
+        LOG4CXX_ENCODE_CHAR(rank, value);
+        _rank = rank;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("APPEND"), LOG4CXX_STR("append"))) {
+        _fileAppend = OptionConverter::toBoolean(value, true);
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("BUFFERSIZE"), LOG4CXX_STR("buffersize"))) {
+        int const size = OptionConverter::toInt(value, 0);
+        _bufferSize = size > 0 ? size : 0;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("FLUSHLEVEL"), LOG4CXX_STR("flushlevel"))) {
+        _flushLevel = OptionConverter::toLevel(value, Level::getWarn())->toInt();
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("TIMESTAMPS"), LOG4CXX_STR("timestamps"))) {
+        _timestamps = OptionConverter::toBoolean(value, true);
+    } else {
+        AppenderSkeleton::setOption(option, value);
+    }
+}
+
+} // namespace lsst::log::detail
@@ -0,0 +1,166 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_SHARDEDFILEAPPENDER_H
+#define LSST_LOG_SHARDEDFILEAPPENDER_H
+
+// System headers
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Base class header
+#include "log4cxx/appenderskeleton.h"
+
+#include "log4cxx/helpers/object.h"
+
+namespace lsst::log::detail {
+
+// This needs to be here for all LOG4CXX macros to work
+using namespace log4cxx;
+
+/**
+ *  File appender which writes a separate file for each process.
+ *
+ *  Intended for MPI ranks and worker processes, each process writes its
+ *  own file (normally in a node-local directory) so that processes do not
+ *  interleave their output or contend on a shared file. File name is made
+ *  from a template in which \c {rank}, \c {pid} and \c {host} are
+ *  replaced with MPI rank (from \c OMPI_COMM_WORLD_RANK, \c PMIX_RANK,
+ *  \c PMI_RANK, \c MV2_COMM_WORLD_RANK or \c SLURM_PROCID environment
+ *  variables, 0 if none is set), process ID and short host name. Child
+ *  process created with \c fork() opens its own file before its first
+ *  message, data buffered by parent is not written by the child. If file
+ *  name template has no \c {pid} then \c -PID is added to the name of
+ *  child's file (before extension). Example configuration:
+ *  \code
+ *  log4j.rootLogger = INFO, SHARD
+ *  log4j.appender.SHARD = lsst.log.ShardedFileAppender
+ *  log4j.appender.SHARD.Directory = /local/scratch/logs
+ *  log4j.appender.SHARD.FileName = job-{rank}-{pid}.log
+ *  log4j.appender.SHARD.layout = PatternLayout
+ *  log4j.appender.SHARD.layout.ConversionPattern = %d %-5p %c - %m%n
+ *  \endcode
+ *
+ *  Supported options:
+ *  - \c Directory - output directory, created if it does not exist,
+ *    default is \c $TMPDIR or \c /tmp
+ *  - \c FileName - file name template, default is
+ *    \c {host}-{rank}-{pid}.log
+ *  - \c Rank - rank to use instead of the one from environment
+ *  - \c Append - if false then truncate output file, default is true
+ *  - \c BufferSize - size in bytes of the output buffer, default is 0
+ *    which writes each event immediately; buffered events are written
+ *    when buffer is full, for events at \c FlushLevel or above and when
+ *    appender is closed
+ *  - \c FlushLevel - level which flushes the buffer, default is WARN
+ *  - \c Timestamps - if true (default) each record starts with an ASCII
+ *    record separator (0x1E) followed by event timestamp in microseconds
+ *    and a space; this is used by \c python -m lsst.log.shardmerge to
+ *    merge files in time order, false writes plain layout output
+ */
+class ShardedFileAppender : public AppenderSkeleton {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(ShardedFileAppender)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(ShardedFileAppender)
+            LOG4CXX_CAST_ENTRY_CHAIN(AppenderSkeleton)
+    END_LOG4CXX_CAST_MAP()
+
+    // Make an instance
+    ShardedFileAppender();
+
+    // Flushes buffer and closes the file
+    ~ShardedFileAppender();
+
+    // we do not support copying
+    ShardedFileAppender(const ShardedFileAppender&) = delete;
+    ShardedFileAppender& operator=(const ShardedFileAppender&) = delete;
+
+    /**
+     * Format the event and write or buffer it.
+     */
+    void append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Flush the buffer and close the file.
+     */
+    void close() override;
+
+    /**
+     * Returns true, layout is used to format events.
+     */
+    bool requiresLayout() const override;
+
+    /**
+     * Open output file.
+     */
+    void activateOptions(log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Handle configuration options.
+     */
+    void setOption(const LogString &option, const LogString &value) override;
+
+    /**
+     * Return name of the file for current process, empty if file is not
+     * open.
+     */
+    std::string getFileName() const;
+
+private:
+
+    // Build file name and open it, re-uses file name template; `forked` is
+    // true in a child process, its file name always includes process ID
+    bool _open(bool forked = false);
+
+    // Write out the buffer
+    void _flush();
+
+    // Release the file, buffered data is written only if `flush` is true
+    void _close(bool flush);
+
+    std::string _directory;
+    std::string _fileNameTemplate = "{host}-{rank}-{pid}.log";
+    std::string _rank;
+    bool _fileAppend = true;
+    bool _timestamps = true;
+    std::size_t _bufferSize = 0;
+    int _flushLevel;
+
+    mutable std::mutex _mutex;
+    bool _closed = false;
+    std::string _fileName;  // actual file name
+    int _fd = -1;
+    std::uint64_t _forkGeneration = 0;  // value when file was opened
+    bool _writeError = false;
+    std::string _buffer;
+    LogString _formatted;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_SHARDEDFILEAPPENDER_H
@@ -0,0 +1,419 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <queue>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+
+// Third-party headers
+#include "log4cxx/helpers/loglog.h"
+#include "log4cxx/helpers/optionconverter.h"
+#include "log4cxx/helpers/stringhelper.h"
+#include "log4cxx/helpers/transcoder.h"
+#include "log4cxx/layout.h"
+#include "log4cxx/level.h"
+#include "log4cxx/patternlayout.h"
+
+// Local headers
+#include "JsonLinesLayout.h"
+#include "ThreadBufferAppender.h"
+
+// macro below dows not work without this using directive
+// (and it breaks if placed inside namespaces)
+using lsst::log::detail::ThreadBufferAppender;
+IMPLEMENT_LOG4CXX_OBJECT(ThreadBufferAppender)
+
+using namespace log4cxx::helpers;
+
+namespace {
+
+// Maximum number of iovec entries passed to a single writev call
+std::size_t const MAX_IOV = 1024;
+
+// Instance IDs, never reused so that stale per-thread entries of
+// destroyed appenders do not match new instances
+std::atomic<std::uint64_t> nextId{1};
+
+// Counts append() calls in progress for the duration of its scope
+class ActiveAppend {
+public:
+    explicit ActiveAppend(std::atomic<int>& count) : _count(count) {
+        _count.fetch_add(1, std::memory_order_seq_cst);
+    }
+    ~ActiveAppend() { _count.fetch_sub(1, std::memory_order_release); }
+
+    ActiveAppend(ActiveAppend const&) = delete;
+    ActiveAppend& operator=(ActiveAppend const&) = delete;
+
+private:
+    std::atomic<int>& _count;
+};
+
+}
+
+namespace lsst::log::detail {
+
+ThreadBufferAppender::ThreadBufferAppender()
+    : _id(nextId.fetch_add(1, std::memory_order_relaxed)),
+      _flushLevel(Level::WARN_INT) {
+}
+
+ThreadBufferAppender::~ThreadBufferAppender() {
+    close();
+}
+
+void ThreadBufferAppender::doAppend(const spi::LoggingEventPtr& event, Pool& pool) {
+    // AppenderSkeleton::doAppend serializes all callers on a mutex which
+    // is exactly what this appender tries to avoid. Threshold and filters
+    // only change during configuration so it is safe to check them here.
+    doAppendImpl(event, pool);
+}
+
+ThreadBufferAppender::ThreadBuffer& ThreadBufferAppender::_threadBuffer(Pool& p) {
+    // Buffers of this thread for all live instances, usually just one.
+    // Appender keeps its own reference to each buffer so that data of
+    // exited threads can still be flushed.
+    thread_local std::vector<std::pair<std::uint64_t, ThreadBufferPtr>> threadBuffers;
+
+    for (auto const& entry: threadBuffers) {
+        if (entry.first == _id) {
+            return *entry.second;
+        }
+    }
+
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->layout = _copyLayout(p);
+    {
+        std::lock_guard<std::mutex> lock(_buffersMutex);
+        _buffers.push_back(buffer);
+    }
+    // drop buffers of closed appenders
+    threadBuffers.erase(std::remove_if(threadBuffers.begin(), threadBuffers.end(),
+                                       [](auto const& entry) { return entry.second.use_count() == 1; }),
+                        threadBuffers.end());
+    threadBuffers.emplace_back(_id, buffer);
+    return *buffer;
+}
+
+LayoutPtr ThreadBufferAppender::_copyLayout(Pool& p) const {
+    auto const pattern = std::dynamic_pointer_cast<PatternLayout>(getLayout());
+    if (not pattern) {
+        return LayoutPtr();
+    }
+    // new instance of the same class, so that subclasses keep their
+    // conversions
+    Object* const object = pattern->getClass().newInstance();
+    auto* const copy = dynamic_cast<PatternLayout*>(object);
+    if (copy == nullptr) {
+        delete object;
+        return LayoutPtr();
+    }
+    LayoutPtr result(copy);
+    copy->setConversionPattern(pattern->getConversionPattern());
+    copy->activateOptions(p);
+    return result;
+}
+
+void ThreadBufferAppender::append(const spi::LoggingEventPtr& event, Pool& p) {
+    // close() sets the flag before it waits for the counter, so either it
+    // waits for this call or this call sees the flag
+    ::ActiveAppend active(_activeAppends);
+    if (_closed.load(std::memory_order_seq_cst) or not _running.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    ThreadBuffer& buffer = _threadBuffer(p);
+
+    // Format outside of the buffer lock so that flusher is never blocked
+    // by a slow layout
+    thread_local LogString formatted;
+    formatted.clear();
+    LayoutPtr const& layout = getLayout();
+    if (buffer.layout) {
+        buffer.layout->format(formatted, event, p);
+    } else if (layout) {
+        if (_concurrentFormat) {
+            layout->format(formatted, event, p);
+        } else {
+            std::lock_guard<std::mutex> lock(_layoutMutex);
+            layout->format(formatted, event, p);
+        }
+    } else {
+        formatted = event->getRenderedMessage();
+        formatted += LOG4CXX_STR("\n");
+    }
+    std::string_view text;
+    if constexpr (std::is_same_v<LogString, std::string>) {
+        text = formatted;
+    } else {
+        thread_local std::string encoded;
+        encoded.clear();
+        Transcoder::encode(formatted, encoded);
+        text = encoded;
+    }
+
+    std::size_t size;
+    {
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.records.push_back(Record{event->getTimeStamp(), buffer.data.size(), text.size()});
+        buffer.data += text;
+        size = buffer.data.size();
+    }
+
+    if (event->getLevel()->toInt() >= _flushLevel or size >= 4 * _bufferSize) {
+        // Important messages are written immediately, also write now if
+        // flusher thread cannot keep up.
+        flush();
+    } else if (size >= _bufferSize and not _flushRequested.exchange(true, std::memory_order_acq_rel)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _flushCond.notify_one();
+    }
+}
+
+void ThreadBufferAppender::flush() {
+    std::lock_guard<std::mutex> lock(_flushMutex);
+    _flush();
+}
+
+void ThreadBufferAppender::_run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _flushCond.wait_for(lock, _flushInterval, [this]() {
+                return _flushRequested.load(std::memory_order_acquire) or
+                       _closed.load(std::memory_order_acquire);
+            });
+        }
+        _flushRequested.store(false, std::memory_order_release);
+        flush();
+        if (_closed.load(std::memory_order_acquire)) {
+            break;
+        }
+    }
+}
+
+void ThreadBufferAppender::_flush() {
+    if (_fd < 0) {
+        return;
+    }
+
+    // Take filled buffers from all threads, each thread's buffer is only
+    // locked for the duration of a swap.
+    std::vector<ThreadBufferPtr> buffers;
+    {
+        std::lock_guard<std::mutex> lock(_buffersMutex);
+        // forget buffers of exited threads once they are drained
+        _buffers.erase(std::remove_if(_buffers.begin(), _buffers.end(), [](auto const& buffer) {
+                           if (buffer.use_count() > 1) {
+                               return false;
+                           }
+                           std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+                           return buffer->records.empty();
+                       }), _buffers.end());
+        buffers = _buffers;
+    }
+    std::vector<ThreadBuffer*> filled;
+    for (auto const& buffer: buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        if (not buffer->records.empty()) {
+            std::swap(buffer->data, buffer->flushData);
+            std::swap(buffer->records, buffer->flushRecords);
+            filled.push_back(buffer.get());
+        }
+    }
+    if (filled.empty()) {
+        return;
+    }
+
+    // Merge records from all buffers in timestamp order, records of each
+    // thread keep their original order. Adjacent records from the same
+    // buffer are written with a single iovec.
+    using Cursor = std::pair<std::int64_t, std::size_t>;  // timestamp, index in filled
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heap;
+    std::vector<std::size_t> next(filled.size(), 0);
+    for (std::size_t i = 0; i != filled.size(); ++i) {
+        heap.emplace(filled[i]->flushRecords.front().timestamp, i);
+    }
+    std::vector<iovec> iov;
+    std::size_t lastBuffer = filled.size();
+    while (not heap.empty()) {
+        std::size_t const i = heap.top().second;
+        heap.pop();
+        ThreadBuffer& buffer = *filled[i];
+        Record const& record = buffer.flushRecords[next[i]];
+        if (i == lastBuffer) {
+            iov.back().iov_len += record.size;
+        } else {
+            if (iov.size() == MAX_IOV) {
+                _writev(iov.data(), iov.size());
+                iov.clear();
+            }
+            iov.push_back(iovec{&buffer.flushData[record.offset], record.size});
+        }
+        lastBuffer = i;
+        if (++next[i] < buffer.flushRecords.size()) {
+            heap.emplace(buffer.flushRecords[next[i]].timestamp, i);
+        }
+    }
+    _writev(iov.data(), iov.size());
+
+    // keep allocated memory for the next round
+    for (ThreadBuffer* buffer: filled) {
+        buffer->flushData.clear();
+        buffer->flushRecords.clear();
+    }
+}
+
+void ThreadBufferAppender::_writev(iovec* iov, std::size_t count) {
+    while (count > 0) {
+        ssize_t n = ::writev(_fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (not _writeError) {
+                _writeError = true;
+                LOG4CXX_DECODE_CHAR(msg, std::string("ThreadBufferAppender: write failed: ") +
+                                         std::strerror(errno));
+                LogLog::error(msg);
+            }
+            return;
+        }
+        // skip what was written, partial writes are possible
+        while (count > 0 and static_cast<std::size_t>(n) >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+void ThreadBufferAppender::close() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_closed.exchange(true, std::memory_order_seq_cst)) {
+            return;
+        }
+        _flushCond.notify_all();
+    }
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+
+    // Wait for threads which passed the check before the flag was set,
+    // appends are short and never wait for close().
+    while (_activeAppends.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+
+    // Write whatever was appended after the last flush; holding the lock
+    // while closing output prevents concurrent flush() calls from using
+    // closed descriptor.
+    std::lock_guard<std::mutex> lock(_flushMutex);
+    _flush();
+    {
+        // this also makes per-thread references unique so that threads
+        // can drop them
+        std::lock_guard<std::mutex> buffersLock(_buffersMutex);
+        _buffers.clear();
+    }
+    if (_fd > 2) {
+        ::close(_fd);
+    }
+    _fd = -1;
+}
+
+bool ThreadBufferAppender::requiresLayout() const {
+    return true;
+}
+
+void ThreadBufferAppender::activateOptions(Pool& p) {
+    if (_running.load(std::memory_order_relaxed) or _closed.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (std::dynamic_pointer_cast<JsonLinesLayout>(getLayout())) {
+        // thread-safe layout
+        _concurrentFormat = true;
+    }
+    if (not _fileName.empty()) {
+        int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+        flags |= _fileAppend ? O_APPEND : O_TRUNC;
+        int const fd = ::open(_fileName.c_str(), flags, 0666);
+        if (fd < 0) {
+            LOG4CXX_DECODE_CHAR(msg, "ThreadBufferAppender: failed to open file " + _fileName +
+                                     ": " + std::strerror(errno));
+            LogLog::error(msg);
+            return;
+        }
+        _fd = fd;
+    }
+    _thread = std::thread(&ThreadBufferAppender::_run, this);
+    _running.store(true, std::memory_order_release);
+}
+
+void ThreadBufferAppender::setOption(const LogString &option, const LogString &value) {
+
+    if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("FILE"), LOG4CXX_STR("file"))) {
+        LOG4CXX_ENCODE_CHAR(fileName, value);
+        _fileName = fileName;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("APPEND"), LOG4CXX_STR("append"))) {
+        _fileAppend = OptionConverter::toBoolean(value, true);
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("TARGET"), LOG4CXX_STR("target"))) {
+        if (StringHelper::equalsIgnoreCase(value, LOG4CXX_STR("SYSTEM.ERR"), LOG4CXX_STR("system.err"))) {
+            _fd = 2;
+        } else {
+            _fd = 1;
+        }
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("BUFFERSIZE"),
+                                              LOG4CXX_STR("buffersize"))) {
+        int const size = OptionConverter::toInt(value, 64 * 1024);
+        _bufferSize = size > 0 ? size : 1;
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("FLUSHINTERVAL"),
+                                              LOG4CXX_STR("flushinterval"))) {
+        int const interval = OptionConverter::toInt(value, 1000);
+        _flushInterval = std::chrono::milliseconds(interval > 0 ? interval : 1);
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("FLUSHLEVEL"),
+                                              LOG4CXX_STR("flushlevel"))) {
+        _flushLevel = Level::toLevel(value, Level::getWarn())->toInt();
+    } else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("CONCURRENTFORMAT"),
+                                              LOG4CXX_STR("concurrentformat"))) {
+        _concurrentFormat = OptionConverter::toBoolean(value, false);
+    } else {
+        AppenderSkeleton::setOption(option, value);
+    }
+}
+
+} // namespace lsst::log::detail
@@ -0,0 +1,210 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LSST_LOG_THREADBUFFERAPPENDER_H
+#define LSST_LOG_THREADBUFFERAPPENDER_H
+
+// System headers
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/uio.h>
+
+// Base class header
+#include "log4cxx/appenderskeleton.h"
+
+#include "log4cxx/helpers/object.h"
+
+namespace lsst::log::detail {
+
+// This needs to be here for all LOG4CXX macros to work
+using namespace log4cxx;
+
+/**
+ *  File appender which buffers formatted events per thread.
+ *
+ *  Each logging thread formats events with the configured layout into its
+ *  own buffer, so threads do not serialize on a shared lock or on I/O.
+ *  Buffers are periodically collected by a flusher thread which merges
+ *  their contents in timestamp order and writes them with a single
+ *  \c writev() call. Example configuration:
+ *  \code
+ *  log4j.rootLogger = INFO, TB
+ *  log4j.appender.TB = lsst.log.ThreadBufferAppender
+ *  log4j.appender.TB.File = /tmp/app.log
+ *  log4j.appender.TB.layout = org.apache.log4j.PatternLayout
+ *  log4j.appender.TB.layout.ConversionPattern = %d %-5p %c - %m%n
+ *  \endcode
+ *
+ *  Supported options:
+ *  - \c File - output file name; if not set output goes to \c Target
+ *  - \c Append - if false then truncate output file, default is true
+ *  - \c Target - \c System.out (default) or \c System.err
+ *  - \c BufferSize - size in bytes of a per-thread buffer which triggers
+ *    flush, default is 64 KiB
+ *  - \c FlushInterval - maximum time in milliseconds that events stay in
+ *    buffers, default is 1000
+ *  - \c FlushLevel - events at this or higher level are written out
+ *    immediately together with all buffered events, default is WARN
+ *  - \c ConcurrentFormat - if true then layout is called concurrently from
+ *    all logging threads, default is false which serializes formatting.
+ *    Only needed for thread-safe layouts of other types than listed
+ *    below, which are always formatted concurrently.
+ *
+ *  Layouts derived from \c PatternLayout (e.g. lsst.log.ExtendedPatternLayout)
+ *  are not thread-safe, each thread formats with its own copy of the
+ *  layout made from the conversion pattern. \c lsst.log.JsonLinesLayout
+ *  is thread-safe and is shared by all threads without locking.
+ *
+ *  Events are ordered by timestamp within each flush; buffered events
+ *  are written out when appender is closed, e.g. when logging is
+ *  re-configured.
+ */
+class ThreadBufferAppender : public AppenderSkeleton {
+public:
+
+    DECLARE_LOG4CXX_OBJECT(ThreadBufferAppender)
+    BEGIN_LOG4CXX_CAST_MAP()
+            LOG4CXX_CAST_ENTRY(ThreadBufferAppender)
+            LOG4CXX_CAST_ENTRY_CHAIN(AppenderSkeleton)
+    END_LOG4CXX_CAST_MAP()
+
+    // Make an instance
+    ThreadBufferAppender();
+
+    // Flushes buffered events and stops flusher thread
+    ~ThreadBufferAppender();
+
+    // we do not support copying
+    ThreadBufferAppender(const ThreadBufferAppender&) = delete;
+    ThreadBufferAppender& operator=(const ThreadBufferAppender&) = delete;
+
+    /**
+     * Filter and append the event without taking appender-wide mutex.
+     */
+    void doAppend(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& pool) override;
+
+    /**
+     * Format the event into the buffer of the calling thread.
+     */
+    void append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Write out all buffered events and stop flusher thread.
+     */
+    void close() override;
+
+    /**
+     * Returns true, this appender needs a layout to format events.
+     */
+    bool requiresLayout() const override;
+
+    /**
+     * Open output and start flusher thread.
+     */
+    void activateOptions(log4cxx::helpers::Pool& p) override;
+
+    /**
+     * Handle configuration options.
+     */
+    void setOption(const LogString &option, const LogString &value) override;
+
+    /**
+     * Write out all buffered events now.
+     */
+    void flush();
+
+private:
+
+    // Location of one formatted event in a thread buffer
+    struct Record {
+        std::int64_t timestamp;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    // Buffer of a single thread; mutex is only shared with flusher which
+    // swaps filled buffer with the empty one
+    struct ThreadBuffer {
+        std::mutex mutex;
+        std::string data;
+        std::vector<Record> records;
+        // per-thread copy of pattern layout, only used by owning thread
+        LayoutPtr layout;
+        // only used by flusher, protected by _flushMutex
+        std::string flushData;
+        std::vector<Record> flushRecords;
+    };
+    using ThreadBufferPtr = std::shared_ptr<ThreadBuffer>;
+
+    // Return buffer of the calling thread, making new one if needed
+    ThreadBuffer& _threadBuffer(log4cxx::helpers::Pool& p);
+
+    // Return new copy of the layout if it is a pattern layout, null otherwise
+    LayoutPtr _copyLayout(log4cxx::helpers::Pool& p) const;
+
+    // Flusher thread body
+    void _run();
+
+    // Collect thread buffers and write them out, _flushMutex must be held
+    void _flush();
+
+    // Write all data described by iovec array
+    void _writev(iovec* iov, std::size_t count);
+
+    // Unique ID of this instance, used to find per-thread buffers
+    std::uint64_t const _id;
+
+    std::string _fileName;
+    bool _fileAppend = true;
+    int _fd = 1;
+    std::size_t _bufferSize = 64 * 1024;
+    std::chrono::milliseconds _flushInterval{1000};
+    int _flushLevel;
+    bool _concurrentFormat = false;
+
+    std::mutex _layoutMutex;  // serializes formatting with shared layout unless _concurrentFormat
+    std::mutex _buffersMutex;  // protects _buffers
+    std::vector<ThreadBufferPtr> _buffers;
+    std::mutex _flushMutex;  // serializes flushes
+    std::mutex _mutex;  // only used for waiting on condition variable
+    std::condition_variable _flushCond;
+    std::thread _thread;  // only touched by activateOptions() and close()
+    std::atomic<bool> _running{false};  // set when flusher thread is started
+    std::atomic<bool> _flushRequested{false};
+    std::atomic<bool> _closed{false};
+    std::atomic<int> _activeAppends{0};  // append() calls in progress
+    bool _writeError = false;
+};
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_THREADBUFFERAPPENDER_H
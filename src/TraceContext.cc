@@ -0,0 +1,110 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Local headers
+#include "lsst/log/TraceContext.h"
+#include "EventPool.h"
+
+namespace {
+
+char const HEX_DIGITS[] = "0123456789abcdef";
+
+// Write 16 hex digits of a number
+char* formatHex(char* out, std::uint64_t value) {
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        *out++ = HEX_DIGITS[(value >> shift) & 0xf];
+    }
+    return out;
+}
+
+// Parse hex digits into a number, returns false if there are non-hex characters
+bool parseHex(std::string_view str, std::uint64_t& value) {
+    value = 0;
+    for (char ch: str) {
+        int digit;
+        if (ch >= '0' and ch <= '9') {
+            digit = ch - '0';
+        } else if (ch >= 'a' and ch <= 'f') {
+            digit = ch - 'a' + 10;
+        } else if (ch >= 'A' and ch <= 'F') {
+            digit = ch - 'A' + 10;
+        } else {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+} // namespace
+
+namespace lsst {
+namespace log {
+
+TraceContext TraceContext::fromTraceparent(std::string_view header) {
+    // version-traceid-parentid-flags, later versions can append more fields
+    std::uint64_t version, flags;
+    TraceContext context;
+    if (header.size() < 55 or header[2] != '-' or header[35] != '-' or header[52] != '-' or
+            not ::parseHex(header.substr(0, 2), version) or version == 0xff or
+            (header.size() > 55 and (version == 0 or header[55] != '-')) or
+            not ::parseHex(header.substr(3, 16), context.traceIdHigh) or
+            not ::parseHex(header.substr(19, 16), context.traceIdLow) or
+            not ::parseHex(header.substr(36, 16), context.spanId) or
+            not ::parseHex(header.substr(53, 2), flags) or not context.valid()) {
+        return TraceContext();
+    }
+    return context;
+}
+
+std::string TraceContext::traceIdHex() const {
+    char buffer[32];
+    return std::string(buffer, formatTraceId(buffer));
+}
+
+std::string TraceContext::spanIdHex() const {
+    char buffer[16];
+    return std::string(buffer, formatSpanId(buffer));
+}
+
+char* TraceContext::formatTraceId(char* out) const {
+    return ::formatHex(::formatHex(out, traceIdHigh), traceIdLow);
+}
+
+char* TraceContext::formatSpanId(char* out) const {
+    return ::formatHex(out, spanId);
+}
+
+namespace detail {
+
+TraceContext eventTraceContext(log4cxx::spi::LoggingEvent const& event) {
+    if (auto const* lsstEvent = dynamic_cast<LsstLoggingEvent const*>(&event)) {
+        return lsstEvent->trace;
+    }
+    return TraceContext();
+}
+
+} // namespace detail
+
+}} // namespace lsst::log
@@ -0,0 +1,481 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+// System headers
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+// Local headers
+#include "XmlConfig.h"
+
+namespace {
+
+// Element of XML document, text content is not kept
+struct Node {
+    std::string name;
+    std::map<std::string, std::string> attributes;
+    std::vector<Node> children;
+};
+
+// Deepest nesting accepted, log4j configurations have three levels
+int const MAX_DEPTH = 16;
+
+bool isSpace(char c) {
+    return c == ' ' or c == '\t' or c == '\r' or c == '\n';
+}
+
+// Append UTF-8 encoding of a code point
+bool appendUtf8(std::string& out, std::uint32_t cp) {
+    if (cp == 0 or cp > 0x10FFFF or (cp >= 0xD800 and cp <= 0xDFFF)) {
+        return false;
+    }
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    return true;
+}
+
+// Replace predefined entities and character references, returns false for
+// anything else
+bool decodeEntities(std::string_view in, std::string& out) {
+    out.clear();
+    while (not in.empty()) {
+        std::size_t const amp = in.find('&');
+        out.append(in.substr(0, amp));
+        if (amp == std::string_view::npos) {
+            break;
+        }
+        in.remove_prefix(amp + 1);
+        std::size_t const semi = in.find(';');
+        if (semi == std::string_view::npos) {
+            return false;
+        }
+        std::string_view const entity = in.substr(0, semi);
+        in.remove_prefix(semi + 1);
+        if (entity == "lt") {
+            out += '<';
+        } else if (entity == "gt") {
+            out += '>';
+        } else if (entity == "amp") {
+            out += '&';
+        } else if (entity == "quot") {
+            out += '"';
+        } else if (entity == "apos") {
+            out += '\'';
+        } else if (entity.size() > 1 and entity[0] == '#') {
+            bool const hex = entity[1] == 'x';
+            std::string_view digits = entity.substr(hex ? 2 : 1);
+            if (digits.empty() or digits.size() > 8) {
+                return false;
+            }
+            std::uint32_t cp = 0;
+            for (char c: digits) {
+                int digit;
+                if (c >= '0' and c <= '9') {
+                    digit = c - '0';
+                } else if (hex and c >= 'a' and c <= 'f') {
+                    digit = c - 'a' + 10;
+                } else if (hex and c >= 'A' and c <= 'F') {
+                    digit = c - 'A' + 10;
+                } else {
+                    return false;
+                }
+                cp = cp * (hex ? 16 : 10) + digit;
+            }
+            if (not appendUtf8(out, cp)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ *  Minimal non-validating XML parser for configuration files: elements,
+ *  attributes, comments, processing instructions and DOCTYPE without
+ *  internal subset. Text other than whitespace is rejected, as no log4j
+ *  configuration element has it.
+ */
+class Parser {
+public:
+
+    explicit Parser(std::string_view text) : _text(text) {}
+
+    bool parseDocument(Node& root) {
+        // UTF-8 byte order mark
+        if (_startsWith("\xEF\xBB\xBF")) {
+            _pos += 3;
+        }
+        if (_startsWith("<?xml") and not _checkDeclaration()) {
+            return false;
+        }
+        if (not _skipMisc(true) or not _parseElement(root, 0) or not _skipMisc(false)) {
+            return false;
+        }
+        return _pos == _text.size();
+    }
+
+private:
+
+    bool _startsWith(std::string_view prefix) const {
+        return _text.substr(_pos, prefix.size()) == prefix;
+    }
+
+    void _skipSpace() {
+        while (_pos < _text.size() and isSpace(_text[_pos])) {
+            ++_pos;
+        }
+    }
+
+    // Skip past the next occurrence of `end`
+    bool _skipPast(std::string_view end) {
+        std::size_t const found = _text.find(end, _pos);
+        if (found == std::string_view::npos) {
+            return false;
+        }
+        _pos = found + end.size();
+        return true;
+    }
+
+    // Skip XML declaration, values are decoded as UTF-8 so other encodings
+    // are not accepted
+    bool _checkDeclaration() {
+        std::size_t const end = _text.find("?>", _pos);
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        std::string_view const decl = _text.substr(_pos, end - _pos);
+        _pos = end + 2;
+        std::size_t const attr = decl.find("encoding");
+        if (attr == std::string_view::npos) {
+            return true;
+        }
+        std::size_t const start = decl.find_first_of("\"'", attr);
+        if (start == std::string_view::npos) {
+            return false;
+        }
+        std::size_t const stop = decl.find(decl[start], start + 1);
+        if (stop == std::string_view::npos) {
+            return false;
+        }
+        std::string encoding(decl.substr(start + 1, stop - start - 1));
+        for (char& c: encoding) {
+            if (c >= 'A' and c <= 'Z') {
+                c = c - 'A' + 'a';
+            }
+        }
+        return encoding == "utf-8" or encoding == "utf8" or encoding == "us-ascii" or encoding == "ascii";
+    }
+
+    // Skip whitespace, comments and processing instructions, DOCTYPE is
+    // only allowed before root element
+    bool _skipMisc(bool prolog) {
+        while (true) {
+            _skipSpace();
+            if (_startsWith("<!--")) {
+                if (not _skipPast("-->")) {
+                    return false;
+                }
+            } else if (_startsWith("<?")) {
+                if (not _skipPast("?>")) {
+                    return false;
+                }
+            } else if (prolog and _startsWith("<!DOCTYPE")) {
+                std::size_t const end = _text.find('>', _pos);
+                if (end == std::string_view::npos or
+                        _text.substr(_pos, end - _pos).find('[') != std::string_view::npos) {
+                    // internal subset can define entities
+                    return false;
+                }
+                _pos = end + 1;
+            } else {
+                return true;
+            }
+        }
+    }
+
+    std::string_view _name() {
+        std::size_t const start = _pos;
+        while (_pos < _text.size() and not isSpace(_text[_pos]) and _text[_pos] != '/' and
+               _text[_pos] != '>' and _text[_pos] != '=') {
+            ++_pos;
+        }
+        return _text.substr(start, _pos - start);
+    }
+
+    bool _parseElement(Node& node, int depth) {
+        if (depth > MAX_DEPTH or not _startsWith("<")) {
+            return false;
+        }
+        ++_pos;
+        node.name = _name();
+        if (node.name.empty()) {
+            return false;
+        }
+
+        // attributes
+        while (true) {
+            _skipSpace();
+            if (_startsWith("/>")) {
+                _pos += 2;
+                return true;
+            }
+            if (_startsWith(">")) {
+                ++_pos;
+                break;
+            }
+            std::string const name(_name());
+            _skipSpace();
+            if (name.empty() or not _startsWith("=")) {
+                return false;
+            }
+            ++_pos;
+            _skipSpace();
+            if (_pos >= _text.size() or (_text[_pos] != '"' and _text[_pos] != '\'')) {
+                return false;
+            }
+            char const quote = _text[_pos++];
+            std::size_t const end = _text.find(quote, _pos);
+            if (end == std::string_view::npos) {
+                return false;
+            }
+            std::string_view const raw = _text.substr(_pos, end - _pos);
+            _pos = end + 1;
+            std::string value;
+            if (raw.find('<') != std::string_view::npos or not decodeEntities(raw, value) or
+                    not node.attributes.emplace(name, value).second) {
+                return false;
+            }
+        }
+
+        // content
+        while (true) {
+            _skipSpace();
+            if (_startsWith("<!--")) {
+                if (not _skipPast("-->")) {
+                    return false;
+                }
+            } else if (_startsWith("<?")) {
+                if (not _skipPast("?>")) {
+                    return false;
+                }
+            } else if (_startsWith("</")) {
+                _pos += 2;
+                if (_name() != node.name) {
+                    return false;
+                }
+                _skipSpace();
+                if (not _startsWith(">")) {
+                    return false;
+                }
+                ++_pos;
+                return true;
+            } else if (_startsWith("<!")) {
+                // CDATA or declarations
+                return false;
+            } else if (_startsWith("<")) {
+                node.children.emplace_back();
+                if (not _parseElement(node.children.back(), depth + 1)) {
+                    return false;
+                }
+            } else {
+                // text or end of input
+                return false;
+            }
+        }
+    }
+
+    std::string_view _text;
+    std::size_t _pos = 0;
+};
+
+// Return attribute value or nullptr
+std::string const* attribute(Node const& node, char const* name) {
+    auto const iter = node.attributes.find(name);
+    return iter == node.attributes.end() ? nullptr : &iter->second;
+}
+
+// Check that node has no attributes other than listed
+bool onlyAttributes(Node const& node, std::initializer_list<char const*> names) {
+    for (auto const& item: node.attributes) {
+        bool known = false;
+        for (char const* name: names) {
+            known = known or item.first == name;
+        }
+        if (not known) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Translate <param> elements of `node` into `prefix`.NAME properties
+bool translateParam(Node const& param, std::string const& prefix,
+                    std::map<std::string, std::string>& props) {
+    std::string const* name = attribute(param, "name");
+    std::string const* value = attribute(param, "value");
+    if (name == nullptr or value == nullptr or name->empty() or not param.children.empty() or
+            not onlyAttributes(param, {"name", "value"})) {
+        return false;
+    }
+    props[prefix + "." + *name] = *value;
+    return true;
+}
+
+bool translateAppender(Node const& node, std::map<std::string, std::string>& props) {
+    std::string const* name = attribute(node, "name");
+    std::string const* cls = attribute(node, "class");
+    if (name == nullptr or cls == nullptr or name->empty() or not onlyAttributes(node, {"name", "class"})) {
+        return false;
+    }
+    std::string const prefix = "log4j.appender." + *name;
+    props[prefix] = *cls;
+    for (auto const& child: node.children) {
+        if (child.name == "param") {
+            if (not translateParam(child, prefix, props)) {
+                return false;
+            }
+        } else if (child.name == "layout") {
+            std::string const* layoutClass = attribute(child, "class");
+            if (layoutClass == nullptr or not onlyAttributes(child, {"class"})) {
+                return false;
+            }
+            props[prefix + ".layout"] = *layoutClass;
+            for (auto const& param: child.children) {
+                if (param.name != "param" or not translateParam(param, prefix + ".layout", props)) {
+                    return false;
+                }
+            }
+        } else {
+            // filters, error handlers, policies, nested appenders
+            return false;
+        }
+    }
+    return true;
+}
+
+bool translateLogger(Node const& node, bool root, std::map<std::string, std::string>& props) {
+    std::string name;
+    if (root) {
+        if (not node.attributes.empty()) {
+            return false;
+        }
+    } else {
+        std::string const* attr = attribute(node, "name");
+        if (attr == nullptr or attr->empty() or not onlyAttributes(node, {"name", "additivity"})) {
+            return false;
+        }
+        name = *attr;
+        if (std::string const* additivity = attribute(node, "additivity")) {
+            props["log4j.additivity." + name] = *additivity;
+        }
+    }
+
+    std::string level;
+    std::string appenders;
+    bool any = false;
+    for (auto const& child: node.children) {
+        if (child.name == "level" or child.name == "priority") {
+            std::string const* value = attribute(child, "value");
+            if (value == nullptr or not child.children.empty() or not onlyAttributes(child, {"value"})) {
+                return false;
+            }
+            level = *value;
+        } else if (child.name == "appender-ref") {
+            std::string const* ref = attribute(child, "ref");
+            if (ref == nullptr or ref->empty() or not child.children.empty() or
+                    not onlyAttributes(child, {"ref"})) {
+                return false;
+            }
+            appenders += ", " + *ref;
+        } else {
+            return false;
+        }
+        any = true;
+    }
+    if (any) {
+        // property with empty level is allowed, level is not changed then
+        props[root ? std::string("log4j.rootLogger") : "log4j.logger." + name] = level + appenders;
+    }
+    return true;
+}
+
+} // namespace
+
+namespace lsst::log::detail {
+
+bool xmlConfigToProperties(std::string_view xml, std::map<std::string, std::string>& props) {
+    Node root;
+    if (not Parser(xml).parseDocument(root)) {
+        return false;
+    }
+    if (root.name != "log4j:configuration" and root.name != "configuration") {
+        return false;
+    }
+
+    std::map<std::string, std::string> result;
+    for (auto const& item: root.attributes) {
+        if (item.first == "threshold" or item.first == "debug") {
+            result["log4j." + item.first] = item.second;
+        } else if (item.first != "reset" and item.first.compare(0, 5, "xmlns") != 0) {
+            return false;
+        }
+    }
+    for (auto const& child: root.children) {
+        bool ok;
+        if (child.name == "appender") {
+            ok = translateAppender(child, result);
+        } else if (child.name == "logger" or child.name == "category") {
+            ok = translateLogger(child, false, result);
+        } else if (child.name == "root") {
+            ok = translateLogger(child, true, result);
+        } else {
+            // renderers, factories and unknown elements
+            ok = false;
+        }
+        if (not ok) {
+            return false;
+        }
+    }
+    props.swap(result);
+    return true;
+}
+
+} // namespace lsst::log::detail
@@ -0,0 +1,53 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LSST_LOG_XMLCONFIG_H
+#define LSST_LOG_XMLCONFIG_H
+
+// System headers
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace lsst::log::detail {
+
+/**
+ *  Translate log4j XML configuration into equivalent configuration
+ *  properties (UTF-8 keys and values).
+ *
+ *  Only the subset of DOMConfigurator syntax which has a properties
+ *  equivalent is accepted: configuration attributes `threshold` and
+ *  `debug`, appenders with parameters and a layout, loggers and root
+ *  logger with level, additivity and appender references. Returns false
+ *  if the document is not well-formed or uses anything else (filters,
+ *  error handlers, rolling policies, nested appender references, custom
+ *  level or logger classes, renderers, entities and CDATA sections), such
+ *  configurations have to be passed to DOMConfigurator.
+ */
+bool xmlConfigToProperties(std::string_view xml, std::map<std::string, std::string>& props);
+
+} // namespace lsst::log::detail
+
+#endif // LSST_LOG_XMLCONFIG_H
@@ -25,6 +25,7 @@
 #include <iostream>
 #include <string>
 #if defined(__linux__)
+#include <pthread.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 #elif defined(__APPLE__)
@@ -33,6 +34,24 @@
 #include <atomic>
 #endif
 
+namespace {
+
+#if defined(__linux__) || defined(__APPLE__)
+
+// LWP of the current thread, zero until first lwpID() call
+thread_local unsigned cachedLwp = 0;
+
+// Forking thread has different LWP in child process
+void resetCachedLwp() {
+    cachedLwp = 0;
+}
+
+[[maybe_unused]] int const atforkRegistered = pthread_atfork(nullptr, nullptr, resetCachedLwp);
+
+#endif
+
+} // namespace
+
 namespace lsst {
 namespace log {
 namespace detail {
@@ -41,23 +60,28 @@ unsigned lwpID() {
 
 #if defined(__linux__)
 
-    // On Linux have to do syscall
-    auto lwp = syscall(SYS_gettid);
+    // On Linux have to do syscall, do it once per thread
+    if (cachedLwp == 0) {
+        cachedLwp = static_cast<unsigned>(syscall(SYS_gettid));
+    }
+    return cachedLwp;
 
 #elif defined(__APPLE__)
 
     // OSX has a special Pthreads function to find out PID
-    auto lwp = pthread_mach_thread_np(pthread_self());
+    if (cachedLwp == 0) {
+        cachedLwp = static_cast<unsigned>(pthread_mach_thread_np(pthread_self()));
+    }
+    return cachedLwp;
 
 #else
 
     // On all other system just generate incremental number and call it LWP
     static std::atomic<unsigned> threadNum(0);
     thread_local static auto lwp = ++threadNum;
+    return static_cast<unsigned>(lwp);
 
 #endif
-
-    return static_cast<unsigned>(lwp);
 }
 
 }}} // namespace lsst::log::detail
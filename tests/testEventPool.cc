@@ -0,0 +1,190 @@
+// -*- LSST-C++ -*-
+/*
+ * This file is part of log.
+ *
+ * Developed for the LSST Data Management System.
+ * This product includes software developed by the LSST Project
+ * (https://www.lsst.org).
+ * See the COPYRIGHT file at the top-level directory of this distribution
+ * for details of code ownership.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// System headers
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Local headers
+#include "lsst/log/Log.h"
+#include "EventPool.h"
+
+#define BOOST_TEST_MODULE EventPool
+#define BOOST_TEST_DYN_LINK
+#include "boost/test/unit_test.hpp"
+
+using lsst::log::detail::allocateEventBlock;
+using lsst::log::detail::deallocateEventBlock;
+using lsst::log::detail::EVENT_BLOCK_SIZE;
+
+namespace {
+
+/*
+ * Arena of a new thread can be re-used from a finished thread and hold
+ * free blocks of its own, tests which look for particular blocks allocate
+ * this many extra blocks to get past them.
+ */
+std::size_t const EXTRA_BLOCKS = 4096;
+
+std::vector<void*> allocateBlocks(std::size_t count, std::size_t size = 64) {
+    std::vector<void*> blocks;
+    for (std::size_t i = 0; i != count; ++i) {
+        blocks.push_back(allocateEventBlock(size));
+        // whole block must be writable
+        std::memset(blocks.back(), 0x5a, size);
+    }
+    return blocks;
+}
+
+void deallocateBlocks(std::vector<void*> const& blocks) {
+    for (void* block: blocks) {
+        deallocateEventBlock(block);
+    }
+}
+
+bool isAligned(void* ptr) {
+    return reinterpret_cast<std::uintptr_t>(ptr) % alignof(std::max_align_t) == 0;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(heap_fallback) {
+    std::thread([]() {
+        void* small = allocateEventBlock(64);
+        BOOST_TEST(isAligned(small));
+        deallocateEventBlock(small);
+
+        // large blocks come from heap, are usable to their full size and
+        // are not added to the free list
+        std::size_t const size = 4 * EVENT_BLOCK_SIZE + 1;
+        void* large = allocateEventBlock(size);
+        BOOST_TEST(isAligned(large));
+        std::memset(large, 0x5a, size);
+        deallocateEventBlock(large);
+
+        // blocks in the free list hold EVENT_BLOCK_SIZE bytes
+        void* full = allocateEventBlock(EVENT_BLOCK_SIZE);
+        BOOST_TEST(full == small);
+        std::memset(full, 0x5a, EVENT_BLOCK_SIZE);
+        deallocateEventBlock(full);
+    }).join();
+}
+
+BOOST_AUTO_TEST_CASE(cross_thread_free) {
+    std::thread([]() {
+        auto const blocks = allocateBlocks(100);
+        std::thread([&blocks]() { deallocateBlocks(blocks); }).join();
+
+        // blocks released by other thread return to the allocating thread
+        auto const again = allocateBlocks(blocks.size() + EXTRA_BLOCKS);
+        std::set<void*> const reused(again.begin(), again.end());
+        for (void* block: blocks) {
+            BOOST_TEST(reused.count(block) == 1u);
+        }
+        deallocateBlocks(again);
+    }).join();
+}
+
+BOOST_AUTO_TEST_CASE(thread_exit_arena_reuse) {
+    // blocks outlive the thread which allocated them, as events still
+    // queued in asynchronous appender do
+    std::vector<void*> blocks;
+    std::thread([&blocks]() { blocks = allocateBlocks(10); }).join();
+    std::vector<void*> freed(blocks.begin(), blocks.begin() + 5);
+    deallocateBlocks(freed);
+
+    // next new thread re-uses the arena of finished thread and gets back
+    // the blocks which were released after that thread exited
+    std::vector<void*> again;
+    std::thread([&again]() {
+        again = allocateBlocks(EXTRA_BLOCKS + 5);
+        deallocateBlocks(again);
+    }).join();
+    for (void* block: freed) {
+        BOOST_TEST(std::count(again.begin(), again.end(), block) == 1);
+    }
+
+    // remaining blocks can still be released
+    deallocateBlocks(std::vector<void*>(blocks.begin() + 5, blocks.end()));
+}
+
+BOOST_AUTO_TEST_CASE(async_ring_appender_threads) {
+    char name[] = P_tmpdir "/testEventPool-XXXXXX";
+    int const fd = mkstemp(name);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to create temporary file.");
+    }
+    ::close(fd);
+
+    // buffer holds all messages so that producer threads exit while their
+    // events are queued, writer thread releases them
+    LOG_CONFIG_PROP(std::string("log4j.rootLogger=INFO, AR\n"
+                                "log4j.appender.AR=lsst.log.AsyncRingAppender\n"
+                                "log4j.appender.AR.File=") + name + "\n"
+                    "log4j.appender.AR.BufferSize=4096\n"
+                    "log4j.appender.AR.layout=PatternLayout\n"
+                    "log4j.appender.AR.layout.ConversionPattern=%m%n\n");
+
+    int const nRounds = 4;
+    int const nThreads = 4;
+    int const nMessages = 200;
+    for (int round = 0; round != nRounds; ++round) {
+        // threads of later rounds re-use arenas of finished threads
+        std::vector<std::thread> threads;
+        for (int i = 0; i != nThreads; ++i) {
+            threads.emplace_back([round, i]() {
+                for (int j = 0; j != nMessages; ++j) {
+                    LOGL_INFO("pool", "round %d thread %d message %d", round, i, j);
+                    LOGLF_INFO("pool", "round {} thread {} format {}", round, i, j);
+                }
+            });
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+    }
+
+    // closing the appender writes everything
+    LOG_CONFIG_PROP("log4j.rootLogger=INFO\n");
+
+    std::ifstream input(name);
+    int lines = 0;
+    for (std::string line; std::getline(input, line); ) {
+        BOOST_TEST(line.compare(0, 6, "round ") == 0);
+        ++lines;
+    }
+    BOOST_TEST(lines == 2 * nRounds * nThreads * nMessages);
+    std::remove(name);
+}
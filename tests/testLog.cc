@@ -21,9 +21,13 @@
  */
 
 // System headers
+#include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <string>
 #include <stdexcept>
 #include <sys/types.h>
@@ -419,3 +423,899 @@ BOOST_FIXTURE_TEST_CASE(logger, LogFixture) {
           "FATAL - This is FATAL 43 logging\n"
           "INFO - Format 3 2.71828 foo c++\n");
 }
+
+BOOST_FIXTURE_TEST_CASE(logger_call_site, LogFixture) {
+    configure(LAYOUT_COMPONENT);
+
+    // names which are not literals are not cached at call site
+    for (std::string const name: {"site.a", "site.b"}) {
+        LOGL_INFO(name, "This is INFO");
+        LOGLS_INFO(name, "This is INFO");
+    }
+
+    // cached loggers must survive re-configuration
+    for (int i = 0; i != 2; ++i) {
+        LOGL_INFO("site.c", "This is INFO %d", i);
+        LOGLS_DEBUG("site.c", "This is DEBUG " << i);
+        configure(LAYOUT_COMPONENT);
+        LOG_SET_LVL("site.c", LOG_LVL_INFO);
+    }
+
+    check("INFO  site.a - This is INFO\n"
+          "INFO  site.a - This is INFO\n"
+          "INFO  site.b - This is INFO\n"
+          "INFO  site.b - This is INFO\n"
+          "INFO  site.c - This is INFO 0\n"
+          "DEBUG site.c - This is DEBUG 0\n"
+          "INFO  site.c - This is INFO 1\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(level_cache, LogFixture) {
+    configure(LAYOUT_COMPONENT);
+
+    lsst::log::Log parent = LOG_GET("cache.parent");
+    lsst::log::Log child = LOG_GET("cache.parent.child.grandchild");
+    BOOST_TEST(child.isDebugEnabled());
+
+    // change of parent level has to invalidate cached child threshold
+    parent.setLevel(LOG_LVL_WARN);
+    BOOST_TEST(not child.isInfoEnabled());
+    BOOST_TEST(child.isWarnEnabled());
+    BOOST_TEST(child.isEnabledFor(LOG_LVL_ERROR));
+
+    lsst::log::Log copy = child;
+    BOOST_TEST(not copy.isInfoEnabled());
+    BOOST_TEST(copy.isWarnEnabled());
+
+    // re-configuration resets levels
+    configure(LAYOUT_COMPONENT);
+    BOOST_TEST(copy.isDebugEnabled());
+    BOOST_TEST(child.isDebugEnabled());
+
+    // repository-wide threshold is also taken into account
+    LOG_CONFIG_PROP("log4j.threshold=ERROR\n"
+                    "log4j.rootLogger=DEBUG, FA\n"
+                    "log4j.appender.FA=FileAppender\n"
+                    "log4j.appender.FA.file=" + ofName + "\n"
+                    "log4j.appender.FA.layout=PatternLayout\n"
+                    "log4j.appender.FA.layout.ConversionPattern=%-5p %c - %m%n\n");
+    BOOST_TEST(not child.isWarnEnabled());
+    BOOST_TEST(child.isErrorEnabled());
+    LOGL_WARN(child, "This is WARN");
+    LOGL_ERROR(child, "This is ERROR");
+
+    check("ERROR cache.parent.child.grandchild - This is ERROR\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(async_ring_appender, LogFixture) {
+    // small buffer forces producers to block and wait for writer thread
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, AR\n"
+                    "log4j.appender.AR=lsst.log.AsyncRingAppender\n"
+                    "log4j.appender.AR.File=" + ofName + "\n"
+                    "log4j.appender.AR.BufferSize=4\n"
+                    "log4j.appender.AR.layout=PatternLayout\n"
+                    "log4j.appender.AR.layout.ConversionPattern=%-5p %c - %m%n\n");
+
+    LOGL_INFO("async", "This is INFO");
+    LOGL_DEBUG("async", "This is DEBUG");
+    LOGL_TRACE("async", "This is TRACE");
+
+    int const nThreads = 4;
+    int const nMessages = 250;
+    std::vector<std::thread> threads;
+    for (int i = 0; i != nThreads; ++i) {
+        threads.emplace_back([i]() {
+            for (int j = 0; j != nMessages; ++j) {
+                LOGL_INFO("async.thread", "thread %d message %d", i, j);
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    // re-configuration closes the appender which flushes everything
+    configure(LAYOUT_COMPONENT);
+
+    std::ifstream input(ofName.c_str());
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(input, line); ) {
+        lines.push_back(line);
+    }
+    BOOST_REQUIRE_EQUAL(lines.size(), 2u + nThreads*nMessages);
+    BOOST_CHECK_EQUAL(lines[0], "INFO  async - This is INFO");
+    BOOST_CHECK_EQUAL(lines[1], "DEBUG async - This is DEBUG");
+
+    // messages from each thread are written in order
+    std::vector<int> next(nThreads, 0);
+    for (auto it = lines.begin() + 2; it != lines.end(); ++it) {
+        int thread, message;
+        BOOST_REQUIRE_EQUAL(sscanf(it->c_str(), "INFO  async.thread - thread %d message %d",
+                                   &thread, &message), 2);
+        BOOST_CHECK_EQUAL(message, next[thread]);
+        next[thread] = message + 1;
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(thread_buffer_appender, LogFixture) {
+    // small buffer forces frequent flushes while threads are logging
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, TB\n"
+                    "log4j.appender.TB=lsst.log.ThreadBufferAppender\n"
+                    "log4j.appender.TB.File=" + ofName + "\n"
+                    "log4j.appender.TB.BufferSize=256\n"
+                    "log4j.appender.TB.layout=PatternLayout\n"
+                    "log4j.appender.TB.layout.ConversionPattern=%-5p %c - %m%n\n");
+
+    LOGL_INFO("buffered", "This is INFO");
+    LOGL_TRACE("buffered", "This is TRACE");
+
+    // WARN is written out immediately together with buffered messages
+    LOGL_WARN("buffered", "This is WARN");
+    {
+        std::ifstream input(ofName.c_str());
+        std::string line;
+        BOOST_REQUIRE(std::getline(input, line));
+        BOOST_CHECK_EQUAL(line, "INFO  buffered - This is INFO");
+        BOOST_REQUIRE(std::getline(input, line));
+        BOOST_CHECK_EQUAL(line, "WARN  buffered - This is WARN");
+    }
+
+    int const nThreads = 4;
+    int const nMessages = 250;
+    std::vector<std::thread> threads;
+    for (int i = 0; i != nThreads; ++i) {
+        threads.emplace_back([i]() {
+            for (int j = 0; j != nMessages; ++j) {
+                LOGL_INFO("buffered.thread", "thread %d message %d", i, j);
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    // re-configuration closes the appender which flushes everything
+    configure(LAYOUT_COMPONENT);
+
+    std::ifstream input(ofName.c_str());
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(input, line); ) {
+        lines.push_back(line);
+    }
+    BOOST_REQUIRE_EQUAL(lines.size(), 2u + nThreads*nMessages);
+
+    // messages from each thread are written in order
+    std::vector<int> next(nThreads, 0);
+    for (auto it = lines.begin() + 2; it != lines.end(); ++it) {
+        int thread, message;
+        BOOST_REQUIRE_EQUAL(sscanf(it->c_str(), "INFO  buffered.thread - thread %d message %d",
+                                   &thread, &message), 2);
+        BOOST_CHECK_EQUAL(message, next[thread]);
+        next[thread] = message + 1;
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(thread_buffer_close, LogFixture) {
+    // appender is closed by re-configuration while threads are logging
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, TB\n"
+                    "log4j.appender.TB=lsst.log.ThreadBufferAppender\n"
+                    "log4j.appender.TB.File=" + ofName + "\n"
+                    "log4j.appender.TB.BufferSize=256\n"
+                    "log4j.appender.TB.layout=PatternLayout\n"
+                    "log4j.appender.TB.layout.ConversionPattern=%-5p %c - %m%n\n");
+
+    int const nThreads = 4;
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i != nThreads; ++i) {
+        threads.emplace_back([i, &stop]() {
+            for (int j = 0; not stop.load(); ++j) {
+                LOGL_INFO("buffered.close", "thread %d message %d", i, j);
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    configure(LAYOUT_COMPONENT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    stop = true;
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    configure(LAYOUT_COMPONENT);
+
+    // messages accepted by closed appender are written before the file
+    // is re-opened by the new one, so each thread's messages are in order
+    std::ifstream input(ofName.c_str());
+    std::vector<int> last(nThreads, -1);
+    for (std::string line; std::getline(input, line); ) {
+        int thread, message;
+        BOOST_REQUIRE_EQUAL(sscanf(line.c_str(), "INFO  buffered.close - thread %d message %d",
+                                   &thread, &message), 2);
+        BOOST_CHECK_GT(message, last[thread]);
+        last[thread] = message;
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(thread_buffer_layout_copy, LogFixture) {
+    // each thread formats with its own copy of the layout, copies have
+    // the same class and pattern as configured layout
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, TB\n"
+                    "log4j.appender.TB=lsst.log.ThreadBufferAppender\n"
+                    "log4j.appender.TB.File=" + ofName + "\n"
+                    "log4j.appender.TB.layout=lsst.log.ExtendedPatternLayout\n"
+                    "log4j.appender.TB.layout.ConversionPattern=%-5p [%lwp] %m%n\n");
+
+    int const nThreads = 4;
+    std::vector<unsigned> lwps(nThreads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i != nThreads; ++i) {
+        threads.emplace_back([i, &lwps]() {
+            lwps[i] = lsst::log::lwpID();
+            for (int j = 0; j != 10; ++j) {
+                LOGL_INFO("buffered.thread", "thread %d", i);
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    // re-configuration closes the appender which flushes everything
+    configure(LAYOUT_COMPONENT);
+
+    std::ifstream input(ofName.c_str());
+    int count = 0;
+    for (std::string line; std::getline(input, line); ++count) {
+        unsigned lwp;
+        int thread;
+        BOOST_REQUIRE_EQUAL(sscanf(line.c_str(), "INFO  [%u] thread %d", &lwp, &thread), 2);
+        BOOST_REQUIRE(thread >= 0 and thread < nThreads);
+        BOOST_CHECK_EQUAL(lwp, lwps[thread]);
+    }
+    BOOST_CHECK_EQUAL(count, nThreads*10);
+}
+
+BOOST_FIXTURE_TEST_CASE(format_record, LogFixture) {
+    configure(LAYOUT_COMPONENT);
+
+    std::string const name = "component";
+    LOGF_INFO("This is {}", "INFO");
+    LOGF_TRACE("This is {}", "TRACE");
+    LOGLF_DEBUG("fmt", "x={} y={:.3f} z={:04d} {{{}}}", 1, 2.5, 42, name);
+    LOGLF_WARN("fmt", "bool={} char={} ptr={}", true, 'c', static_cast<char const*>(nullptr));
+    LOGF("fmt", LOG_LVL_ERROR, "no arguments");
+
+    // messages are not truncated
+    std::string const longString(2000, 'x');
+    LOGLF_ERROR("fmt", "{}", longString);
+
+    check("INFO  root - This is INFO\n"
+          "DEBUG fmt - x=1 y=2.500 z=0042 {component}\n"
+          "WARN  fmt - bool=true char=c ptr=(null)\n"
+          "ERROR fmt - no arguments\n"
+          "ERROR fmt - " + longString + "\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(json_lines_layout, LogFixture) {
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, FA\n"
+                    "log4j.appender.FA=FileAppender\n"
+                    "log4j.appender.FA.file=" + ofName + "\n"
+                    "log4j.appender.FA.layout=lsst.log.JsonLinesLayout\n"
+                    "log4j.appender.FA.layout.MDCPrefix=mdc.\n");
+
+    LOG_MDC("JSONKEY", "mdc \"value\"");
+    LOGL_INFO("json", "This is INFO");
+    LOGL_WARN("json", "quote \" backslash \\ newline \n tab \t bell \a end");
+    LOG_MDC_REMOVE("JSONKEY");
+
+    std::ifstream input(ofName.c_str());
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(input, line); ) {
+        lines.push_back(line);
+    }
+    BOOST_REQUIRE_EQUAL(lines.size(), 2u);
+    for (auto const& line: lines) {
+        BOOST_TEST(line.front() == '{');
+        BOOST_TEST(line.back() == '}');
+        BOOST_TEST(line.find("\"timestamp\":\"") != std::string::npos);
+        BOOST_TEST(line.find("\"logger\":\"json\"") != std::string::npos);
+        BOOST_TEST(line.find("\"file\":\"" __FILE__ "\"") != std::string::npos);
+        BOOST_TEST(line.find("\"mdc.JSONKEY\":\"mdc \\\"value\\\"\"") != std::string::npos);
+    }
+    BOOST_TEST(lines[0].find("\"level\":\"INFO\",") != std::string::npos);
+    BOOST_TEST(lines[0].find("\"message\":\"This is INFO\",") != std::string::npos);
+    BOOST_TEST(lines[1].find("\"level\":\"WARN\",") != std::string::npos);
+    BOOST_TEST(lines[1].find("\"message\":\"quote \\\" backslash \\\\ newline \\n tab \\t "
+                             "bell \\u0007 end\",") != std::string::npos);
+}
+
+BOOST_FIXTURE_TEST_CASE(json_lines_layout_mdc, LogFixture) {
+    // without prefix MDC is nested and cannot clash with fixed fields
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, FA\n"
+                    "log4j.appender.FA=FileAppender\n"
+                    "log4j.appender.FA.file=" + ofName + "\n"
+                    "log4j.appender.FA.layout=lsst.log.JsonLinesLayout\n"
+                    "log4j.appender.FA.layout.LocationInfo=false\n");
+
+    LOGL_INFO("json", "no MDC");
+    LOG_MDC("level", "mdc level");
+    LOG_MDC("message", "mdc message");
+    LOGL_INFO("json", "with MDC");
+    LOG_MDC_REMOVE("level");
+    LOG_MDC_REMOVE("message");
+
+    std::ifstream input(ofName.c_str());
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(input, line); ) {
+        lines.push_back(line);
+    }
+    BOOST_REQUIRE_EQUAL(lines.size(), 2u);
+    BOOST_TEST(lines[0].find("\"thread\":") != std::string::npos);
+    BOOST_TEST(lines[0].size() >= 10u);
+    BOOST_TEST(lines[0].compare(lines[0].size() - 10, 10, ",\"mdc\":{}}") == 0);
+    BOOST_TEST(lines[1].find("\"level\":\"INFO\",") != std::string::npos);
+    BOOST_TEST(lines[1].find("\"message\":\"with MDC\",") != std::string::npos);
+    BOOST_TEST(lines[1].find(",\"mdc\":{\"level\":\"mdc level\",\"message\":\"mdc message\"}}") !=
+               std::string::npos);
+}
+
+BOOST_FIXTURE_TEST_CASE(lwp_pattern, LogFixture) {
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, FA\n"
+                    "log4j.appender.FA=FileAppender\n"
+                    "log4j.appender.FA.file=" + ofName + "\n"
+                    "log4j.appender.FA.layout=lsst.log.ExtendedPatternLayout\n"
+                    "log4j.appender.FA.layout.ConversionPattern=%-5p [%lwp] %m%n\n");
+
+    LOGL_INFO("lwp", "main thread");
+    unsigned lwpThread = 0;
+    std::thread thread([&lwpThread]() {
+        lwpThread = lsst::log::lwpID();
+        LOGL_INFO("lwp", "other thread");
+    });
+    thread.join();
+
+    check("INFO  [" + std::to_string(lsst::log::lwpID()) + "] main thread\n"
+          "INFO  [" + std::to_string(lwpThread) + "] other thread\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(lwp_pattern_async, LogFixture) {
+    // events are formatted by writer thread, LWP is that of logging thread
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, AR\n"
+                    "log4j.appender.AR=lsst.log.AsyncRingAppender\n"
+                    "log4j.appender.AR.File=" + ofName + "\n"
+                    "log4j.appender.AR.layout=lsst.log.ExtendedPatternLayout\n"
+                    "log4j.appender.AR.layout.ConversionPattern=%-5p [%lwp] %m%n\n");
+
+    LOGL_INFO("lwp", "main thread");
+    unsigned lwpThread = 0;
+    std::thread thread([&lwpThread]() {
+        lwpThread = lsst::log::lwpID();
+        LOGL_INFO("lwp", "other thread");
+    });
+    thread.join();
+
+    // re-configuration closes the appender which flushes everything
+    configure(LAYOUT_COMPONENT);
+
+    std::ifstream input(ofName.c_str());
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(input, line); ) {
+        lines.push_back(line);
+    }
+    BOOST_REQUIRE_EQUAL(lines.size(), 2u);
+    BOOST_CHECK_EQUAL(lines[0], "INFO  [" + std::to_string(lsst::log::lwpID()) + "] main thread");
+    BOOST_CHECK_EQUAL(lines[1], "INFO  [" + std::to_string(lwpThread) + "] other thread");
+}
+
+BOOST_FIXTURE_TEST_CASE(format_record_deferred, LogFixture) {
+    // records are rendered by writer thread of async appender, binary
+    // appender stores them unrendered, file appender needs eager rendering
+    std::string const binName = ofName + ".blog";
+    std::string const textName = ofName + ".txt";
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, AR\n"
+                    "log4j.appender.AR=lsst.log.AsyncRingAppender\n"
+                    "log4j.appender.AR.File=" + ofName + "\n"
+                    "log4j.appender.AR.layout=lsst.log.ExtendedPatternLayout\n"
+                    "log4j.appender.AR.layout.ConversionPattern=%-5p %c - %m%n\n"
+                    "log4j.logger.bin=DEBUG, BIN\n"
+                    "log4j.additivity.bin=false\n"
+                    "log4j.appender.BIN=lsst.log.BinaryFileAppender\n"
+                    "log4j.appender.BIN.File=" + binName + "\n"
+                    "log4j.logger.text=DEBUG, FA\n"
+                    "log4j.appender.FA=FileAppender\n"
+                    "log4j.appender.FA.file=" + textName + "\n"
+                    "log4j.appender.FA.layout=PatternLayout\n"
+                    "log4j.appender.FA.layout.ConversionPattern=%-5p %c - %m%n\n");
+
+    LOGLF_INFO("async", "x={} y={:.2f} name={}", 1, 2.5, std::string("abc"));
+    LOGLF_DEBUG("bin", "deferred format {:04d}", 42);
+    LOGLF_WARN("text", "x={} {{}}", -1);
+
+    // re-configuration closes the appenders which flushes everything
+    configure(LAYOUT_COMPONENT);
+
+    auto readFile = [](std::string const& name) {
+        std::ifstream input(name.c_str(), std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    };
+    BOOST_CHECK_EQUAL(readFile(ofName), "INFO  async - x=1 y=2.50 name=abc\n"
+                                        "WARN  text - x=-1 {}\n");
+    BOOST_CHECK_EQUAL(readFile(textName), "WARN  text - x=-1 {}\n");
+    std::string const binary = readFile(binName);
+    BOOST_CHECK_NE(binary.find("deferred format {:04d}"), std::string::npos);
+    BOOST_CHECK_EQUAL(binary.find("deferred format 0042"), std::string::npos);
+
+    std::remove(binName.c_str());
+    std::remove(textName.c_str());
+}
+
+BOOST_FIXTURE_TEST_CASE(trace_context, LogFixture) {
+    LOG_CONFIG_PROP("log4j.rootLogger=DEBUG, FA\n"
+                    "log4j.appender.FA=FileAppender\n"
+                    "log4j.appender.FA.file=" + ofName + "\n"
+                    "log4j.appender.FA.layout=lsst.log.ExtendedPatternLayout\n"
+                    "log4j.appender.FA.layout.ConversionPattern=%-5p [%traceid/%spanid] %m%n\n");
+
+    using lsst::log::TraceContext;
+    TraceContext const trace =
+        TraceContext::fromTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+    BOOST_CHECK(trace.valid());
+    BOOST_CHECK_EQUAL(trace.traceIdHigh, 0x4bf92f3577b34da6ULL);
+    BOOST_CHECK_EQUAL(trace.traceIdLow, 0xa3ce929d0e0e4736ULL);
+    BOOST_CHECK_EQUAL(trace.spanId, 0x00f067aa0ba902b7ULL);
+    BOOST_CHECK_EQUAL(trace.traceIdHex(), "4bf92f3577b34da6a3ce929d0e0e4736");
+    BOOST_CHECK_EQUAL(trace.spanIdHex(), "00f067aa0ba902b7");
+    BOOST_CHECK(not TraceContext::fromTraceparent("00-00000000000000000000000000000000-00f067aa0ba902b7-01").valid());
+    BOOST_CHECK(not TraceContext::fromTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7").valid());
+    BOOST_CHECK(not TraceContext::fromTraceparent("ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01").valid());
+
+    LOGL_INFO("trace", "no context");
+    std::function<void()> task;
+    {
+        lsst::log::LogTraceScope scope(trace);
+        BOOST_CHECK(TraceContext::current() == trace);
+        LOGL_INFO("trace", "in scope");
+        task = lsst::log::withTraceContext([]() { LOGL_INFO("trace", "in task"); });
+    }
+    BOOST_CHECK(not TraceContext::current().valid());
+    std::thread thread(task);
+    thread.join();
+    LOGL_INFO("trace", "after scope");
+
+    check("INFO  [/] no context\n"
+          "INFO  [4bf92f3577b34da6a3ce929d0e0e4736/00f067aa0ba902b7] in scope\n"
+          "INFO  [4bf92f3577b34da6a3ce929d0e0e4736/00f067aa0ba902b7] in task\n"
+          "INFO  [/] after scope\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(sampling, LogFixture) {
+    configure(LAYOUT_COMPONENT);
+
+    // only explicit reports to make output predictable
+    lsst::log::detail::LogSampler::setReportInterval(0);
+
+    for (int i = 0; i != 7; ++i) {
+        LOGL_INFO_EVERY_N("sample", 3, "every %d", i);
+    }
+    for (int i = 0; i != 5; ++i) {
+        LOGLS_WARN_FIRST_N("sample", 2, "first " << i);
+    }
+    for (int i = 0; i != 7; ++i) {
+        LOGL_ERROR_ONCE("sample", "once %d", i);
+    }
+    for (int i = 0; i != 10; ++i) {
+        // bucket holds two tokens, refill is too slow to matter here
+        LOGL_INFO_RATE_LIMIT("sample", 2, "rate %d", i);
+    }
+    for (int i = 0; i != 5; ++i) {
+        // disabled messages are neither counted nor reported
+        LOGL_TRACE_EVERY_N("sample", 2, "trace %d", i);
+    }
+    lsst::log::detail::LogSampler::reportSuppressed();
+    // counters are reset by report
+    lsst::log::detail::LogSampler::reportSuppressed();
+
+    lsst::log::detail::LogSampler::setReportInterval(10);
+
+    check("INFO  sample - every 0\n"
+          "INFO  sample - every 3\n"
+          "INFO  sample - every 6\n"
+          "WARN  sample - first 0\n"
+          "WARN  sample - first 1\n"
+          "ERROR sample - once 0\n"
+          "INFO  sample - rate 0\n"
+          "INFO  sample - rate 1\n"
+          "INFO  sample - suppressed 4 messages from this location\n"
+          "WARN  sample - suppressed 3 messages from this location\n"
+          "ERROR sample - suppressed 6 messages from this location\n"
+          "INFO  sample - suppressed 8 messages from this location\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(sampling_reports, LogFixture) {
+    configure(LAYOUT_COMPONENT);
+
+    // report is due as soon as anything is suppressed
+    lsst::log::detail::LogSampler::setReportInterval(1e-9);
+
+    // logged message at a site with suppressed messages makes a report
+    for (int i = 0; i != 3; ++i) {
+        LOGL_INFO_EVERY_N("sample.pass", 2, "every %d", i);
+    }
+
+    // remaining counts are reported before configuration is reset
+    lsst::log::detail::LogSampler::setReportInterval(0);
+    for (int i = 0; i != 3; ++i) {
+        LOGL_WARN_ONCE("sample.pass", "once %d", i);
+    }
+    configure(LAYOUT_COMPONENT);
+
+    // and before reconfigure() which cannot be done incrementally
+    for (int i = 0; i != 2; ++i) {
+        LOGL_WARN_ONCE("sample.pass", "again %d", i);
+    }
+    lsst::log::Log::reconfigure_prop("log4j.rootLogger=DEBUG, FA\n"
+                                     "log4j.threshold=ALL\n"
+                                     "log4j.appender.FA=FileAppender\n"
+                                     "log4j.appender.FA.file=" + ofName + "\n"
+                                     "log4j.appender.FA.layout=PatternLayout\n"
+                                     "log4j.appender.FA.layout.ConversionPattern=%-5p %c - %m%n\n");
+
+    lsst::log::detail::LogSampler::setReportInterval(10);
+
+    check("INFO  sample.pass - every 0\n"
+          "INFO  sample.pass - suppressed 1 messages from this location\n"
+          "INFO  sample.pass - every 2\n"
+          "WARN  sample.pass - once 0\n"
+          "WARN  sample.pass - suppressed 2 messages from this location\n"
+          "WARN  sample.pass - again 0\n"
+          "WARN  sample.pass - suppressed 1 messages from this location\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(statistics, LogFixture) {
+    configure(LAYOUT_COMPONENT);
+
+    lsst::log::Log::resetStatistics();
+    LOGL_INFO("stats", "not counted");
+    lsst::log::Log::setStatisticsEnabled(true);
+    std::thread([]() {
+        // statistics of finished threads are kept
+        LOGL_INFO("stats", "thread");
+    }).join();
+    LOGL_INFO("stats", "This is INFO");
+    LOGLS_WARN("stats", "This is WARN");
+    LOGL_TRACE("stats", "below threshold, not counted");
+    LOGS_ERROR("root error");
+    lsst::log::Log::setStatisticsEnabled(false);
+    LOGL_INFO("stats", "not counted");
+
+    auto const stats = lsst::log::Log::getStatistics();
+    BOOST_REQUIRE_EQUAL(stats.messages.size(), 3u);
+    BOOST_CHECK_EQUAL(stats.messages[0].logger, "");
+    BOOST_CHECK_EQUAL(stats.messages[0].level, LOG_LVL_ERROR);
+    BOOST_CHECK_EQUAL(stats.messages[0].count, 1u);
+    BOOST_CHECK_EQUAL(stats.messages[1].logger, "stats");
+    BOOST_CHECK_EQUAL(stats.messages[1].level, LOG_LVL_INFO);
+    BOOST_CHECK_EQUAL(stats.messages[1].count, 2u);
+    BOOST_CHECK_EQUAL(stats.messages[2].logger, "stats");
+    BOOST_CHECK_EQUAL(stats.messages[2].level, LOG_LVL_WARN);
+    BOOST_CHECK_EQUAL(stats.messages[2].count, 1u);
+    std::uint64_t total = 0;
+    for (auto count: stats.latencyHistogram) {
+        total += count;
+    }
+    BOOST_CHECK_EQUAL(total, 4u);
+
+    lsst::log::Log::resetStatistics();
+    BOOST_CHECK(lsst::log::Log::getStatistics().messages.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(flight_recorder, LogFixture) {
+    configure(LAYOUT_COMPONENT);
+    LOG_SET_LVL("recorder", LOG_LVL_INFO);
+    std::string const dumpName = ofName + ".dump";
+    lsst::log::Log::enableFlightRecorder(dumpName, LOG_LVL_DEBUG);
+    BOOST_CHECK(lsst::log::Log::isFlightRecorderEnabled());
+
+    LOGL_TRACE("recorder", "not recorded");
+    LOGL_DEBUG("recorder", "printf %d", 1);
+    LOGLF_DEBUG("recorder", "format {} {:.1f}", "x", 2.5);
+    // formatted into the slot and truncated
+    std::string const longString(1000, 'y');
+    LOGL_DEBUG("recorder", "long %s", longString.c_str());
+    LOGL_INFO("recorder", "This is INFO");
+    // dumps three recorded messages
+    LOGL_WARN("recorder", "This is WARN");
+    std::thread([]() { LOGLS_DEBUG("recorder", "thread"); }).join();
+    BOOST_CHECK_EQUAL(lsst::log::Log::dumpFlightRecorder(), 1u);
+    BOOST_CHECK_EQUAL(lsst::log::Log::dumpFlightRecorder(), 0u);
+
+    lsst::log::Log::disableFlightRecorder();
+    BOOST_CHECK(not lsst::log::Log::isFlightRecorderEnabled());
+    BOOST_CHECK(not lsst::log::Log::getLogger("recorder").isDebugEnabled());
+    LOGL_DEBUG("recorder", "discarded");
+    BOOST_CHECK_EQUAL(lsst::log::Log::dumpFlightRecorder(), 0u);
+
+    check("INFO  recorder - This is INFO\n"
+          "WARN  recorder - This is WARN\n");
+
+    std::ifstream input(dumpName.c_str());
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(input, line); ) {
+        lines.push_back(line);
+    }
+    std::remove(dumpName.c_str());
+    BOOST_REQUIRE_EQUAL(lines.size(), 6u);
+    BOOST_CHECK_EQUAL(lines[0], "=== flight recorder dump: WARN ===");
+    BOOST_TEST(lines[1].find(" DEBUG [") != std::string::npos);
+    BOOST_TEST(lines[1].find("] recorder (testLog.cc:") != std::string::npos);
+    BOOST_TEST(lines[1].find(") - printf 1") != std::string::npos);
+    BOOST_TEST(lines[2].find(") - format x 2.5") != std::string::npos);
+    BOOST_TEST(lines[3].find(") - long yyy") != std::string::npos);
+    BOOST_TEST(lines[3].size() < longString.size());
+    BOOST_TEST(lines[3].substr(lines[3].size() - 3) == "...");
+    BOOST_CHECK_EQUAL(lines[4], "=== flight recorder dump: explicit dump ===");
+    BOOST_TEST(lines[5].find(") - thread") != std::string::npos);
+}
+
+// LSST_LOG_MIN_LEVEL is used when logging macros are expanded, so it can
+// be changed for one test
+#undef LSST_LOG_MIN_LEVEL
+#define LSST_LOG_MIN_LEVEL LOG_LVL_INFO
+
+BOOST_FIXTURE_TEST_CASE(min_level, LogFixture) {
+    configure(LAYOUT_COMPONENT);
+
+    // arguments of elided macros must not be evaluated
+    int count = 0;
+    auto arg = [&count]() { return ++count; };
+    LOGL_DEBUG("min", "This is DEBUG %d", arg());
+    LOGS_TRACE("This is TRACE " << arg());
+    LOGLF_DEBUG("min", "This is DEBUG {}", arg());
+    LOG("min", LOG_LVL_DEBUG, "This is DEBUG %d", arg());
+    LOGL_INFO("min", "This is INFO %d", arg());
+    LOG("min", LOG_LVL_WARN, "This is WARN %d", arg());
+
+    BOOST_TEST(not LOG_CHECK_DEBUG());
+    BOOST_TEST(not LOG_CHECK_LVL("min", LOG_LVL_TRACE));
+    BOOST_TEST(LOG_CHECK_INFO());
+    BOOST_TEST(count == 2);
+
+    check("INFO  min - This is INFO 1\n"
+          "WARN  min - This is WARN 2\n");
+}
+
+#undef LSST_LOG_MIN_LEVEL
+#define LSST_LOG_MIN_LEVEL INT_MIN
+
+BOOST_FIXTURE_TEST_CASE(mdc_interned, LogFixture) {
+    configure(LAYOUT_MDC);
+
+    lsst::log::MDCKey const key("INTERNED");
+    BOOST_TEST(key.name() == "INTERNED");
+    BOOST_TEST(lsst::log::MDCKey("INTERNED").index() == key.index());
+
+    LOG_MDC(key, "1");
+    LOGS_INFO("message 1");
+    {
+        LOG_MDC_SCOPE("INTERNED", "2");
+        LOGS_INFO("message 2");
+        // string-based API works with interned keys too
+        BOOST_TEST(LOG_MDC("INTERNED", "3") == "2");
+        LOGS_INFO("message 3");
+    }
+    LOGS_INFO("message 4");
+    {
+        std::string const longValue(100, 'x');
+        LOG_MDC_SCOPE(key, longValue);
+        LOGS_INFO("message 5");
+    }
+    LOG_MDC_REMOVE("INTERNED");
+    LOGS_INFO("message 6");
+
+    check("INFO  - message 1 {{INTERNED,1}}\n"
+          "INFO  - message 2 {{INTERNED,2}}\n"
+          "INFO  - message 3 {{INTERNED,3}}\n"
+          "INFO  - message 4 {{INTERNED,1}}\n"
+          "INFO  - message 5 {{INTERNED," + std::string(100, 'x') + "}}\n"
+          "INFO  - message 6 {}\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(mdc_empty_value, LogFixture) {
+    configure(LAYOUT_MDC);
+
+    lsst::log::MDCKey const key("EMPTY");
+
+    // empty value is kept in MDC, only MDCRemove removes the key
+    LOG_MDC(key, "");
+    LOGS_INFO("message 1");
+    {
+        LOG_MDC_SCOPE(key, "1");
+        LOGS_INFO("message 2");
+    }
+    LOGS_INFO("message 3");
+    LOG_MDC_REMOVE(key);
+    LOGS_INFO("message 4");
+
+    // keys made at run time are not interned
+    std::string const dynamicKey = "DYNAMIC";
+    {
+        LOG_MDC_SCOPE(dynamicKey, "");
+        LOGS_INFO("message 5");
+    }
+    LOGS_INFO("message 6");
+
+    check("INFO  - message 1 {{EMPTY,}}\n"
+          "INFO  - message 2 {{EMPTY,1}}\n"
+          "INFO  - message 3 {{EMPTY,}}\n"
+          "INFO  - message 4 {}\n"
+          "INFO  - message 5 {{DYNAMIC,}}\n"
+          "INFO  - message 6 {}\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(mdc_init_threads, LogFixture) {
+
+    configure(LAYOUT_MDC);
+
+    // MDC_INIT function from mdc_init test is still registered
+    LOG_MDC_INIT([](){ LOG_MDC("MDC_INIT2", "OK"); });
+
+    // many threads starting at the same time
+    int const nThreads = 8;
+    std::vector<std::thread> threads;
+    for (int i = 0; i != nThreads; ++i) {
+        threads.emplace_back([]() { LOGS_INFO("thread"); });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    std::string expected_msg;
+    for (int i = 0; i != nThreads; ++i) {
+        expected_msg += "INFO  - thread {{MDC_INIT,OK}{MDC_INIT2,OK}}\n";
+    }
+    check(expected_msg);
+
+    LOG_MDC_REMOVE("MDC_INIT");
+    LOG_MDC_REMOVE("MDC_INIT2");
+}
+
+BOOST_FIXTURE_TEST_CASE(child_cache, LogFixture) {
+
+    configure(LAYOUT_SIMPLE);
+
+    // enough children to make cache grow a few times
+    auto parent = LOG_GET("cache");
+    for (int pass = 0; pass != 2; ++pass) {
+        for (int i = 0; i != 500; ++i) {
+            auto const suffix = "child" + std::to_string(i);
+            BOOST_TEST(parent.getChild(suffix).getName() == "cache." + suffix);
+        }
+    }
+    BOOST_TEST(parent.getChild("..child1").getName() == "cache.child1");
+    BOOST_TEST(LOG_GET_CHILD("", "cache").getName() == "cache");
+
+    // cached loggers see level changes and survive re-configuration
+    auto child = parent.getChild("sub");
+    parent.setLevel(LOG_LVL_WARN);
+    BOOST_TEST(parent.getChild("sub").getEffectiveLevel() == LOG_LVL_WARN);
+    configure(LAYOUT_SIMPLE);
+    child = parent.getChild("sub");
+    BOOST_TEST(child.getName() == "cache.sub");
+    LOGLS_INFO(child, "This is INFO");
+    check("INFO - This is INFO\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(child_cache_reconfigure, LogFixture) {
+
+    // readers use the cache while it is replaced and old tables are freed
+    configure(LAYOUT_SIMPLE);
+    auto parent = LOG_GET("cache");
+    std::atomic<bool> ok{true};
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 4; ++t) {
+        threads.emplace_back([parent, &ok]() {
+            bool threadOk = true;
+            for (int i = 0; i != 20000; ++i) {
+                auto const suffix = "child" + std::to_string(i % 200);
+                threadOk = threadOk and parent.getChild(suffix).getName() == "cache." + suffix;
+            }
+            if (not threadOk) {
+                ok = false;
+            }
+        });
+    }
+    for (int i = 0; i != 20; ++i) {
+        configure(LAYOUT_SIMPLE);
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    BOOST_TEST(ok);
+}
+
+BOOST_FIXTURE_TEST_CASE(reconfigure, LogFixture) {
+
+    std::string const config = "log4j.rootLogger=INFO, FA\n"
+            "log4j.appender.FA=FileAppender\n"
+            "log4j.appender.FA.file=" + ofName + "\n";
+    LOG_CONFIG_PROP(config + "log4j.appender.FA.layout=SimpleLayout\n");
+
+    auto log = LOG_GET("reconfig.sub");
+    LOGLS_DEBUG(log, "This is DEBUG 1");
+
+    // only level changes, appender stays the same
+    lsst::log::Log::reconfigure_prop(config + "log4j.appender.FA.layout=SimpleLayout\n"
+                                     "log4j.logger.reconfig=DEBUG\n");
+    BOOST_TEST(log.isEnabledFor(LOG_LVL_DEBUG));
+    LOGLS_DEBUG(log, "This is DEBUG 2");
+
+    // appender is replaced when its properties change
+    lsst::log::Log::reconfigure_prop(config + "log4j.appender.FA.layout=PatternLayout\n"
+                                     "log4j.appender.FA.layout.ConversionPattern=%p %c - %m%n\n"
+                                     "log4j.logger.reconfig=DEBUG\n");
+    LOGLS_DEBUG(log, "This is DEBUG 3");
+
+    // removed logger goes back to inherited level
+    lsst::log::Log::reconfigure_prop(config + "log4j.appender.FA.layout=PatternLayout\n"
+                                     "log4j.appender.FA.layout.ConversionPattern=%p %c - %m%n\n");
+    BOOST_TEST(not log.isEnabledFor(LOG_LVL_DEBUG));
+    LOGLS_DEBUG(log, "This is DEBUG 4");
+    LOGLS_INFO(log, "This is INFO");
+
+    check("DEBUG - This is DEBUG 2\n"
+          "DEBUG reconfig.sub - This is DEBUG 3\n"
+          "INFO reconfig.sub - This is INFO\n");
+}
+
+BOOST_FIXTURE_TEST_CASE(set_levels, LogFixture) {
+
+    configure(LAYOUT_SIMPLE);
+
+    auto a = LOG_GET("levels.a");
+    auto ab = LOG_GET("levels.a.b");
+    auto c = LOG_GET("levels.c");
+    a.setLevel(LOG_LVL_INFO);
+    BOOST_TEST(c.getLevel() == -1);
+
+    {
+        lsst::log::LogLevelScope scope({{"levels.*", LOG_LVL_WARN},
+                                        {"levels.a.*", LOG_LVL_DEBUG},
+                                        {"levels.new", LOG_LVL_TRACE}});
+        BOOST_TEST(a.getLevel() == LOG_LVL_WARN);
+        BOOST_TEST(ab.getLevel() == LOG_LVL_DEBUG);
+        BOOST_TEST(c.getLevel() == LOG_LVL_WARN);
+        BOOST_TEST(LOG_GET("levels.new").getLevel() == LOG_LVL_TRACE);
+        BOOST_TEST(not c.isEnabledFor(LOG_LVL_INFO));
+        BOOST_TEST(ab.isEnabledFor(LOG_LVL_DEBUG));
+    }
+
+    // previous levels are restored, including missing ones
+    BOOST_TEST(a.getLevel() == LOG_LVL_INFO);
+    BOOST_TEST(ab.getLevel() == -1);
+    BOOST_TEST(c.getLevel() == -1);
+    BOOST_TEST(LOG_GET("levels.new").getLevel() == -1);
+    BOOST_TEST(c.isEnabledFor(LOG_LVL_DEBUG));
+
+    // later rules win, root logger is matched by empty name
+    auto saved = lsst::log::Log::setLevels({{"levels.c", LOG_LVL_ERROR}, {"*", LOG_LVL_INFO},
+                                            {"", LOG_LVL_WARN}});
+    BOOST_TEST(c.getLevel() == LOG_LVL_INFO);
+    BOOST_TEST(lsst::log::Log::getDefaultLogger().getLevel() == LOG_LVL_WARN);
+    lsst::log::Log::setLevels(saved);
+    BOOST_TEST(lsst::log::Log::getDefaultLogger().getLevel() == LOG_LVL_DEBUG);
+    BOOST_TEST(a.getLevel() == LOG_LVL_INFO);
+}
+
+BOOST_FIXTURE_TEST_CASE(printf_long_message, LogFixture) {
+    configure(LAYOUT_COMPONENT);
+
+    // messages longer than initial buffer are not truncated
+    std::string const longString(3000, 'x');
+    LOGL_INFO("printf", "long %s end", longString.c_str());
+    LOGL_INFO("printf", "short %d", 42);
+    LOGL_WARN("printf", "%s|%s", longString.c_str(), longString.c_str());
+
+    check("INFO  printf - long " + longString + " end\n"
+          "INFO  printf - short 42\n"
+          "WARN  printf - " + longString + "|" + longString + "\n");
+}
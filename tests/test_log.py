@@ -229,6 +229,76 @@ INFO - This is INFO
 DEBUG - This is DEBUG
 """)
 
+    def testBinaryFileAppender(self):
+        """Test binary log output and its decoder."""
+        import json
+        from lsst.log.binlog import readBinaryLog, formatRecord, recordToJson
+
+        filename = os.path.join(self.tempDir, "log.blog")
+        self.configure(f"""
+log4j.rootLogger=DEBUG, BIN
+log4j.appender.BIN=lsst.log.BinaryFileAppender
+log4j.appender.BIN.File={filename}
+""")
+        log.MDC("x", 3)
+        log.trace("This is TRACE")
+        log.info("This is INFO")
+        log.MDCRemove("x")
+        log.getLogger("a.b").debug("This is %s", "DEBUG")
+        # closes the file
+        log.configure()
+
+        records = list(readBinaryLog(filename))
+        self.assertEqual(len(records), 2)
+        self.assertEqual([formatRecord(record, "%c %p %X: %m (%F)%n") for record in records], [
+            "root INFO {{x,3}}: This is INFO (test_log.py)\n",
+            "a.b DEBUG {}: This is DEBUG (test_log.py)\n",
+        ])
+        self.assertEqual(records[0].funcName, "testBinaryFileAppender")
+        self.assertEqual(records[0].lwp, log.getDefaultLogger().lwpID())
+        self.assertEqual(formatRecord(records[0], "%-6p|%.3c|%X{x}"), "INFO  |oot|3")
+        self.assertLessEqual(records[0].timestamp, records[1].timestamp)
+        data = json.loads(recordToJson(records[1]))
+        self.assertEqual(data["logger"], "a.b")
+        self.assertEqual(data["level"], "DEBUG")
+        self.assertEqual(data["mdc"], {})
+
+    def testBinaryLogFormat(self):
+        """Test decoding of unrendered LOGF messages in binary log files."""
+        import struct
+        from lsst.log.binlog import readBinaryLog, renderFormat
+
+        def record(rtype, payload):
+            return struct.pack("<IB", 5 + len(payload), rtype) + payload
+
+        def string(string_id, value):
+            value = value.encode()
+            return record(1, struct.pack("<II", string_id, len(value)) + value)
+
+        fmt = "x={} y={:.2f} {}: {:>3} {{}} {:#x} {} {}"
+        args = (b"\x02" + struct.pack("<q", -7) + b"\x04" + struct.pack("<d", 2.5)
+                + b"\x06" + struct.pack("<I", 3) + b"abc" + b"\x00\x01"
+                + b"\x03" + struct.pack("<Q", 255) + b"\x04" + struct.pack("<d", 1e20))
+        data = (b"LSSTBLOG" + struct.pack("<II", 1, 0x01020304)
+                + string(0, "root") + string(1, "file.cc") + string(2, "func") + string(3, fmt)
+                + record(4, struct.pack("<I", 3) + args)
+                + record(2, struct.pack("<qiIIIiIHI", 1000, 20000, 0, 1, 2, 10, 123, 0, 0))
+                + record(2, struct.pack("<qiIIIiIHI", 2000, 20000, 0, 1, 2, 11, 123, 0, 5) + b"plain"))
+        filename = os.path.join(self.tempDir, "format.blog")
+        with open(filename, "wb") as file:
+            file.write(data)
+
+        records = list(readBinaryLog(filename))
+        self.assertEqual([record.message for record in records],
+                         ["x=-7 y=2.50 abc: true {} 0xff 1e+20 {}", "plain"])
+        self.assertEqual(renderFormat("{} {} {:08.3f}", b"\x04" + struct.pack("<d", 0.1)
+                                      + b"\x04" + struct.pack("<d", 123456.0)
+                                      + b"\x04" + struct.pack("<d", 3.14159), "<"),
+                         "0.1 123456 0003.142")
+        # unknown argument type stops rendering of the arguments
+        self.assertEqual(renderFormat("{} {} {}", b"\x05" + struct.pack("<Q", 0) + b"\x63", "<"),
+                         "(nil)  {}")
+
     def testPythonLogging(self):
         """Test logging through the Python logging interface."""
         with TestLog.StdoutCapture(self.outputFilename):
@@ -257,6 +327,46 @@ root INFO: ((1, 2), (3, 4))
 root INFO: {1: 2}
 """)
 
+    def testPythonLoggingLevelChange(self):
+        """Test that LogHandler follows lsst.log level changes."""
+        with TestLog.StdoutCapture(self.outputFilename):
+            lgr = logging.getLogger("handler.level")
+            lgr.setLevel(logging.DEBUG)
+            lgr.propagate = False
+            handler = log.LogHandler()
+            lgr.addHandler(handler)
+            log.configure()
+            lsstlgr = log.getLogger("handler.level")
+            lsstlgr.setLevel(log.WARN)
+            lgr.info("This is INFO 1")
+            lgr.warning("This is WARNING 1")
+            lsstlgr.setLevel(log.INFO)
+            lgr.info("This is INFO 2")
+            lgr.debug("This is DEBUG")
+            log.configure_prop("""
+log4j.rootLogger=DEBUG, CA
+log4j.appender.CA=ConsoleAppender
+log4j.appender.CA.layout=PatternLayout
+log4j.appender.CA.layout.ConversionPattern=%c %p: %m%n
+""")
+            lgr.debug("This is DEBUG 2")
+            try:
+                raise RuntimeError("message")
+            except RuntimeError:
+                lgr.exception("This is EXCEPTION")
+            lgr.removeHandler(handler)
+
+        with open(self.outputFilename) as f:
+            lines = [line.rstrip("\n") for line in f.readlines()]
+        self.assertEqual(lines[:5], [
+            "handler.level WARN: This is WARNING 1",
+            "handler.level INFO: This is INFO 2",
+            "handler.level DEBUG: This is DEBUG 2",
+            "handler.level ERROR: This is EXCEPTION",
+            "Traceback (most recent call last):",
+        ])
+        self.assertEqual(lines[-1], "RuntimeError: message")
+
     def testMdcInit(self):
 
         expected_msg = \
@@ -330,6 +440,428 @@ log4j.appender.CA.layout.ConversionPattern=%-5p - %m %X%n
 
         self.assertEqual(lwp1, lwp2)
 
+    def testStatistics(self):
+        """Test collection of message statistics."""
+        with TestLog.StdoutCapture(self.outputFilename):
+            self.configure("""
+log4j.rootLogger=INFO, CA
+log4j.appender.CA=ConsoleAppender
+log4j.appender.CA.layout=PatternLayout
+log4j.appender.CA.layout.ConversionPattern=%m%n
+""")
+            log.resetStatistics()
+            log.info("not counted")
+            log.setStatisticsEnabled(True)
+            try:
+                logger = log.getLogger("stats")
+                for i in range(3):
+                    logger.info("info %d", i)
+                logger.warn("warn")
+                logger.debug("below threshold, not counted")
+                log.info("root")
+            finally:
+                log.setStatisticsEnabled(False)
+            stats = log.getStatistics()
+
+        counts = {(item["logger"], item["level"]): item["count"] for item in stats["messages"]}
+        self.assertEqual(counts, {("", log.INFO): 1, ("stats", log.INFO): 3, ("stats", log.WARN): 1})
+        self.assertEqual(sum(stats["latencyHistogram"]), 5)
+        log.resetStatistics()
+        self.assertEqual(log.getStatistics(), {"messages": [], "latencyHistogram": []})
+
+    def testWatchConfig(self):
+        """Test incremental re-configuration from a watched file."""
+        import time
+
+        configFile = os.path.join(self.tempDir, "log.properties")
+        config = """
+log4j.rootLogger=INFO, FA
+log4j.appender.FA=FileAppender
+log4j.appender.FA.file={}
+log4j.appender.FA.layout=SimpleLayout
+""".format(self.outputFilename)
+        with open(configFile, "w") as f:
+            f.write(config)
+        log.configure(configFile)
+        logger = log.getLogger("watched")
+        logger.debug("This is DEBUG 1")
+
+        log.watchConfig(configFile, 0.01)
+        try:
+            with open(configFile, "w") as f:
+                f.write(config + "log4j.logger.watched=DEBUG\n")
+            for _ in range(500):
+                if logger.isEnabledFor(log.DEBUG):
+                    break
+                time.sleep(0.01)
+        finally:
+            log.unwatchConfig()
+        logger.debug("This is DEBUG 2")
+
+        log.reconfigure_prop(config)
+        logger.debug("This is DEBUG 3")
+        logger.info("This is INFO")
+
+        self.check("""
+DEBUG - This is DEBUG 2
+INFO - This is INFO
+""")
+
+    def testSetLevels(self):
+        """Test setting levels of many loggers at once."""
+        import lsst.log.utils
+
+        log.setLevels({"levels.a": log.INFO, "levels.a.b": log.INFO})
+        log.getLogger("levels.c")
+        with lsst.log.utils.temporaryLogLevels([("levels.*", log.WARN), ("levels.a.*", log.DEBUG)]):
+            self.assertEqual(log.getLevel("levels.a"), log.WARN)
+            self.assertEqual(log.getLevel("levels.a.b"), log.DEBUG)
+            self.assertEqual(log.getLevel("levels.c"), log.WARN)
+        self.assertEqual(log.getLevel("levels.a"), log.INFO)
+        self.assertEqual(log.getLevel("levels.a.b"), log.INFO)
+        self.assertEqual(log.getLevel("levels.c"), -1)
+
+        lsst.log.utils.traceSetAt("levels", 2)
+        self.assertEqual(log.getLevel("TRACE2.levels"), log.DEBUG)
+        self.assertEqual(log.getLevel("TRACE3.levels"), log.INFO)
+
+    def testShardedFileAppender(self):
+        """Test per-process log files and their merging."""
+        from lsst.log.shardmerge import mergeShards
+
+        shardDir = os.path.join(self.tempDir, "shards")
+        self.configure(f"""
+log4j.rootLogger=INFO, SHARD
+log4j.appender.SHARD=lsst.log.ShardedFileAppender
+log4j.appender.SHARD.Directory={shardDir}
+log4j.appender.SHARD.FileName=shard-{{rank}}-{{pid}}.log
+log4j.appender.SHARD.Rank=7
+log4j.appender.SHARD.BufferSize=65536
+log4j.appender.SHARD.layout=PatternLayout
+log4j.appender.SHARD.layout.ConversionPattern=%p %m%n
+""")
+        log.info("parent 1")
+        pid = os.fork()
+        if pid == 0:
+            # child must not write what parent has buffered
+            log.info("child")
+            log.configure()
+            os._exit(0)
+        os.waitpid(pid, 0)
+        log.info("parent 2")
+        # closes the file
+        log.configure()
+
+        self.assertEqual(sorted(os.listdir(shardDir)),
+                         sorted([f"shard-7-{os.getpid()}.log", f"shard-7-{pid}.log"]))
+        records = list(mergeShards([shardDir]))
+        self.assertEqual([record.text for record in records],
+                         ["INFO parent 1\n", "INFO child\n", "INFO parent 2\n"])
+        self.assertEqual(records[1].shard, f"shard-7-{pid}")
+
+    def testShardedFileAppenderForkName(self):
+        """Test that child process gets its own file when file name has no
+        process ID, and that records longer than read block are merged."""
+        from lsst.log import shardmerge
+
+        shardDir = os.path.join(self.tempDir, "shards")
+        self.configure(f"""
+log4j.rootLogger=INFO, SHARD
+log4j.appender.SHARD=lsst.log.ShardedFileAppender
+log4j.appender.SHARD.Directory={shardDir}
+log4j.appender.SHARD.FileName=shard-{{rank}}.log
+log4j.appender.SHARD.Rank=7
+log4j.appender.SHARD.layout=PatternLayout
+log4j.appender.SHARD.layout.ConversionPattern=%p %m%n
+""")
+        log.info("parent 1")
+        pid = os.fork()
+        if pid == 0:
+            log.info("child")
+            log.configure()
+            os._exit(0)
+        os.waitpid(pid, 0)
+        log.info("parent 2")
+        log.configure()
+
+        self.assertEqual(sorted(os.listdir(shardDir)), sorted(["shard-7.log", f"shard-7-{pid}.log"]))
+        readSize = shardmerge._READ_SIZE
+        shardmerge._READ_SIZE = 5
+        try:
+            records = list(shardmerge.mergeShards([shardDir]))
+        finally:
+            shardmerge._READ_SIZE = readSize
+        self.assertEqual([record.text for record in records],
+                         ["INFO parent 1\n", "INFO child\n", "INFO parent 2\n"])
+
+    def testFlightRecorder(self):
+        """Test recording of messages below threshold."""
+        dumpName = os.path.join(self.tempDir, "recorder.log")
+        with TestLog.StdoutCapture(self.outputFilename):
+            log.configure()
+            log.setLevel("", log.INFO)
+            log.enableFlightRecorder(dumpName, level=log.DEBUG)
+            try:
+                self.assertTrue(log.isEnabledFor("", log.DEBUG))
+                log.trace("not recorded")
+                log.debug("This is %s", "DEBUG")
+                log.info("This is INFO")
+                log.error("This is ERROR")
+                log.debug("not dumped yet")
+            finally:
+                log.disableFlightRecorder()
+            self.assertFalse(log.isEnabledFor("", log.DEBUG))
+            self.assertEqual(log.dumpFlightRecorder(), 1)
+
+        self.check("""
+root INFO: This is INFO
+root ERROR: This is ERROR
+""")
+        with open(dumpName) as dump:
+            lines = dump.read().splitlines()
+        self.assertEqual(len(lines), 4)
+        self.assertEqual(lines[0], "=== flight recorder dump: ERROR ===")
+        self.assertIn(" DEBUG [", lines[1])
+        self.assertTrue(lines[1].endswith(" - This is DEBUG"))
+        self.assertEqual(lines[2], "=== flight recorder dump: explicit dump ===")
+        self.assertTrue(lines[3].endswith(" - not dumped yet"))
+
+    def testCompressedRollingFileAppender(self):
+        """Test compressed output and rollover."""
+        import glob
+        import gzip
+
+        filename = os.path.join(self.tempDir, "app.log.gz")
+        self.configure(f"""
+log4j.rootLogger=INFO, GZ
+log4j.appender.GZ=lsst.log.CompressedRollingFileAppender
+log4j.appender.GZ.File={filename}
+log4j.appender.GZ.BufferSize=1
+log4j.appender.GZ.MaxFileSize=1
+log4j.appender.GZ.MaxBackupIndex=100
+log4j.appender.GZ.layout=PatternLayout
+log4j.appender.GZ.layout.ConversionPattern=%p %m%n
+""")
+        messages = [f"This is INFO {i}" for i in range(20)]
+        for message in messages:
+            log.info(message)
+        log.debug("This is DEBUG")
+        # compresses everything and closes the file
+        log.configure()
+
+        backups = glob.glob(os.path.join(self.tempDir, "app.log.*.gz"))
+        self.assertGreater(len(backups), 0)
+        # oldest messages are in the files with highest index
+        backups.sort(key=lambda name: -int(name.split(".")[-2]))
+        lines = []
+        for name in backups + [filename]:
+            with gzip.open(name, "rt") as file:
+                lines += file.read().splitlines()
+        self.assertEqual(lines, [f"INFO {message}" for message in messages])
+
+    def testLazyAppenders(self):
+        """Test that appenders are constructed by the first message."""
+        quietFilename = os.path.join(self.tempDir, "quiet.log")
+        log.setLazyAppendersEnabled(True)
+        try:
+            self.configure(f"""
+log4j.rootLogger=INFO, FA
+log4j.appender.FA=FileAppender
+log4j.appender.FA.file={{0}}
+log4j.appender.FA.layout=PatternLayout
+log4j.appender.FA.layout.ConversionPattern=%p %c %m%n
+log4j.logger.quiet=ERROR, QA
+log4j.additivity.quiet=false
+log4j.appender.QA=FileAppender
+log4j.appender.QA.file={quietFilename}
+log4j.appender.QA.layout=PatternLayout
+log4j.appender.QA.layout.ConversionPattern=%p %c %m%n
+""")
+            self.assertFalse(os.path.exists(self.outputFilename))
+            log.info("This is INFO")
+            quiet = log.Log.getLogger("quiet")
+            quiet.warn("This is WARN")
+            self.assertFalse(os.path.exists(quietFilename))
+            quiet.error("This is ERROR")
+            self.assertTrue(os.path.exists(quietFilename))
+            log.configure()
+        finally:
+            log.setLazyAppendersEnabled(False)
+
+        self.check("""
+INFO root This is INFO
+""")
+        with open(quietFilename) as file:
+            self.assertEqual(file.read(), "ERROR quiet This is ERROR\n")
+
+    def testConfigCache(self):
+        """Test that parsed configuration files are cached in the cache
+        directory and the cache is invalidated when file changes."""
+        configDir = os.path.join(self.tempDir, "config")
+        cacheDir = os.path.join(self.tempDir, "cache")
+        os.mkdir(configDir)
+        config = os.path.join(configDir, "log.properties")
+        properties = f"""
+log4j.rootLogger=INFO, FA
+log4j.appender.FA=FileAppender
+log4j.appender.FA.file={self.outputFilename}
+log4j.appender.FA.layout=PatternLayout
+log4j.appender.FA.layout.ConversionPattern=%p %m%n
+"""
+        with open(config, "w") as file:
+            file.write(properties)
+        xdgCacheHome = os.environ.get("XDG_CACHE_HOME")
+        os.environ["XDG_CACHE_HOME"] = cacheDir
+        # configuration directory is read-only, as in install trees
+        os.chmod(configDir, 0o555)
+        log.setConfigCacheEnabled(True)
+        try:
+            log.configure(config)
+            caches = os.listdir(os.path.join(cacheDir, "lsst_log"))
+            self.assertEqual(len(caches), 1)
+            cache = os.path.join(cacheDir, "lsst_log", caches[0])
+            log.info("This is INFO 1")
+            mtime = os.stat(cache).st_mtime_ns
+
+            # second configuration re-uses the cache
+            log.configure(config)
+            self.assertEqual(os.stat(cache).st_mtime_ns, mtime)
+            log.info("This is INFO 2")
+            log.debug("This is DEBUG 2")
+
+            # changed file is parsed again
+            os.chmod(configDir, 0o755)
+            with open(config, "w") as file:
+                file.write(properties.replace("INFO", "DEBUG"))
+            log.configure(config)
+            log.debug("This is DEBUG 3")
+            log.configure()
+        finally:
+            log.setConfigCacheEnabled(False)
+            os.chmod(configDir, 0o755)
+            if xdgCacheHome is None:
+                del os.environ["XDG_CACHE_HOME"]
+            else:
+                os.environ["XDG_CACHE_HOME"] = xdgCacheHome
+
+        self.check("""
+INFO This is INFO 1
+INFO This is INFO 2
+DEBUG This is DEBUG 3
+""")
+
+    def testXmlConfig(self):
+        """Test that simple XML configurations are translated into properties
+        and others are passed to DOMConfigurator."""
+        quietFilename = os.path.join(self.tempDir, "quiet.log")
+        config = os.path.join(self.tempDir, "log.xml")
+        xml = f"""<?xml version="1.0" encoding="UTF-8" ?>
+<log4j:configuration xmlns:log4j="http://jakarta.apache.org/log4j/">
+  <appender name="FA" class="org.apache.log4j.FileAppender">
+    <param name="file" value="{self.outputFilename}"/>
+    <layout class="org.apache.log4j.PatternLayout">
+      <param name="ConversionPattern" value="%p %c %m%n"/>
+    </layout>
+  </appender>
+  <appender name="QA" class="org.apache.log4j.FileAppender">
+    <param name="file" value="{quietFilename}"/>
+    <layout class="org.apache.log4j.PatternLayout">
+      <param name="ConversionPattern" value="%p %c %m%n"/>
+    </layout>
+  </appender>
+  <root>
+    <priority value="info"/>
+    <appender-ref ref="FA"/>
+  </root>
+  <logger name="quiet" additivity="false">
+    <level value="error"/>
+    <appender-ref ref="QA"/>
+  </logger>
+</log4j:configuration>
+"""
+        with open(config, "w") as file:
+            file.write(xml)
+
+        # translated configuration makes lazy appenders
+        log.setLazyAppendersEnabled(True)
+        try:
+            log.configure(config)
+            log.info("This is INFO 1")
+            self.assertFalse(os.path.exists(quietFilename))
+
+            # and it can be updated incrementally
+            with open(config, "w") as file:
+                file.write(xml.replace('"error"', '"warn"'))
+            log.reconfigure(config)
+            quiet = log.Log.getLogger("quiet")
+            quiet.info("This is INFO 2")
+            quiet.warn("This is WARN 2")
+        finally:
+            log.setLazyAppendersEnabled(False)
+
+        # filter is only supported by DOMConfigurator
+        filtered = xml.replace("""
+  </appender>
+  <appender name="QA\"""", """
+    <filter class="org.apache.log4j.varia.LevelRangeFilter">
+      <param name="LevelMin" value="WARN"/>
+    </filter>
+  </appender>
+  <appender name="QA\"""")
+        self.assertNotEqual(filtered, xml)
+        with open(config, "w") as file:
+            file.write(filtered)
+        log.configure(config)
+        log.info("This is INFO 3")
+        log.warn("This is WARN 3")
+        log.configure()
+
+        self.check("""
+INFO root This is INFO 1
+WARN root This is WARN 3
+""")
+        with open(quietFilename) as file:
+            self.assertEqual(file.read(), "WARN quiet This is WARN 2\n")
+
+    def testTraceContext(self):
+        """Test trace context in forwarded records and JSON output."""
+        import json
+
+        traceId = 0x4bf92f3577b34da6a3ce929d0e0e4736
+        spanId = 0x00f067aa0ba902b7
+        self.assertEqual(log.getTraceContext(), (0, 0))
+        with log.TraceContextScope(traceId, spanId):
+            self.assertEqual(log.getTraceContext(), (traceId, spanId))
+        self.assertEqual(log.getTraceContext(), (0, 0))
+
+        self.configure("""
+log4j.rootLogger=DEBUG, PyLog
+log4j.appender.PyLog = PyLogAppender
+""")
+        with self.assertLogs(level="INFO") as cm:
+            log.info("no context")
+            with log.TraceContextScope(traceId, spanId):
+                log.info("with context")
+        self.assertEqual(len(cm.records), 2)
+        self.assertFalse(hasattr(cm.records[0], "trace_id"))
+        self.assertEqual(cm.records[1].trace_id, traceId)
+        self.assertEqual(cm.records[1].span_id, spanId)
+
+        self.configure("""
+log4j.rootLogger=INFO, FA
+log4j.appender.FA=FileAppender
+log4j.appender.FA.file={0}
+log4j.appender.FA.layout=lsst.log.JsonLinesLayout
+log4j.appender.FA.layout.LocationInfo=false
+""")
+        with log.TraceContextScope(traceId, spanId):
+            log.info("with context")
+        log.configure()
+        with open(self.outputFilename) as file:
+            record = json.loads(file.readline())
+        self.assertEqual(record["trace_id"], "4bf92f3577b34da6a3ce929d0e0e4736")
+        self.assertEqual(record["span_id"], "00f067aa0ba902b7")
+
     def testLogger(self):
         """
         Test log object.
@@ -352,6 +884,34 @@ b WARN: This is WARN
 b ERROR: This is ERROR
 b FATAL: This is FATAL
 b WARN: Format 3 2.71828 foo
+""")
+
+    def testLoggerLocation(self):
+        """Test that native logging methods report location of the caller
+        """
+        def helper(logger):
+            logger.warn("From helper %s", "function")
+
+        with TestLog.StdoutCapture(self.outputFilename):
+            self.configure("""
+log4j.rootLogger=INFO, CA
+log4j.appender.CA=ConsoleAppender
+log4j.appender.CA.layout=PatternLayout
+log4j.appender.CA.layout.ConversionPattern=%c %M (%F:%L) - %m%n
+""")
+            logger = log.Log.getLogger("b")
+            logger.info("Method")
+            log.info("Function")
+            log.log("b", log.ERROR, "Function %d", 2)
+            helper(logger)
+            logger.debug("Not logged %s", "at all")
+        # line numbers relative to helper definition
+        line = helper.__code__.co_firstlineno
+        self.check(f"""
+b testLoggerLocation (test_log.py:{line + 11}) - Method
+root testLoggerLocation (test_log.py:{line + 12}) - Function
+b testLoggerLocation (test_log.py:{line + 13}) - Function 2
+b helper (test_log.py:{line + 1}) - From helper function
 """)
 
     def testLoggerLevel(self):
@@ -586,6 +1146,67 @@ log4j.appender.PyLog.MessagePattern = %m (LABEL=%X{{LABEL}})
         self.assertEqual(cm.records[0].MDC, {"LABEL": "some.task"})
         self.assertEqual(cm.records[0].msg, "lsst.log: forwarded (LABEL=some.task)")
 
+    def testForwardToPythonAppenderBatched(self):
+        """Test that `log4cxx` appender can forward messages in batches"""
+        self.configure("""
+log4j.rootLogger=DEBUG, PyLog
+log4j.appender.PyLog = PyLogAppender
+log4j.appender.PyLog.BatchSize = 4
+log4j.appender.PyLog.MaxLatency = 60000
+""")
+
+        def worker():
+            for i in range(10):
+                log.warn("lsst.log: batched %d", i)
+
+        with self.assertLogs(level="WARNING") as cm:
+            thread = threading.Thread(target=worker)
+            thread.start()
+            thread.join()
+            # re-configuration forwards everything that is still queued
+            log.configure_prop("log4j.rootLogger=INFO")
+        self.assertEqual([record.msg for record in cm.records],
+                         [f"lsst.log: batched {i}" for i in range(10)])
+        # records are attributed to the thread which made them
+        for record in cm.records:
+            self.assertEqual(record.thread, thread.ident)
+
+    def testForwardToPythonAppenderCache(self):
+        """Test that appender works with more loggers than it can cache"""
+        self.configure("""
+log4j.rootLogger=DEBUG, PyLog
+log4j.appender.PyLog = PyLogAppender
+log4j.appender.PyLog.CacheSize = 2
+""")
+        names = [f"cached.logger{i}" for i in range(5)]
+        with self.assertLogs(level="WARNING") as cm:
+            for repeat in range(3):
+                for name in names + names[:2]:
+                    log.getLogger(name).warn(f"to {name}")
+        self.assertEqual([record.name for record in cm.records], (names + names[:2]) * 3)
+        self.assertEqual([record.msg for record in cm.records],
+                         [f"to {name}" for name in (names + names[:2]) * 3])
+
+    def testForwardToPythonAppenderLevelChange(self):
+        """Test that cached levels of Python loggers follow level changes"""
+        self.configure("""
+log4j.rootLogger=DEBUG, PyLog
+log4j.appender.PyLog = PyLogAppender
+""")
+
+        with self.assertLogs(level="WARNING") as cm:
+            log.info("lsst.log: rejected 1")
+            log.warn("lsst.log: forwarded 1")
+            log.info("lsst.log: rejected 2")
+            logging.getLogger().setLevel(logging.INFO)
+            log.info("lsst.log: forwarded 2")
+            logging.disable(logging.WARNING)
+            log.warn("lsst.log: rejected 3")
+            logging.disable(logging.NOTSET)
+            log.warn("lsst.log: forwarded 3")
+        self.assertEqual([record.msg for record in cm.records],
+                         [f"lsst.log: forwarded {i}" for i in range(1, 4)])
+
     def testForwardToPythonAppenderFormatMDC(self):
         """Test that we can format `log4cxx` MDC on Python side"""
 
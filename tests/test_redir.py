@@ -26,6 +26,7 @@ This tests logging redirection to Python streams.
 import io
 import os
 import shutil
+import sys
 import tempfile
 import unittest
 
@@ -108,6 +109,74 @@ root WARN: Format 3 2.71828 foo
 """
         )
 
+    def testRedirReconfigure(self):
+        """
+        Test that redirection survives re-configuration.
+        """
+        with TestRedir.StdoutCapture(self.outputFilename):
+            log.configure()
+            dest = io.StringIO()
+            log_utils.enable_notebook_logging(dest)
+            log.info("before configure")
+            log.configure_prop("""
+log4j.rootLogger=INFO, CA
+log4j.appender.CA=ConsoleAppender
+log4j.appender.CA.layout=PatternLayout
+log4j.appender.CA.layout.ConversionPattern=%p %m%n
+""")
+            log.info("after configure")
+            log.reconfigure_prop("""
+log4j.rootLogger=INFO, CA
+log4j.appender.CA=ConsoleAppender
+log4j.appender.CA.layout=PatternLayout
+log4j.appender.CA.layout.ConversionPattern=[%p] %m%n
+""")
+            log.info("after reconfigure")
+            log_utils.disable_notebook_logging()
+            log.info("after disable")
+            # capture can be enabled again
+            log_utils.enable_notebook_logging(dest)
+            log.info("enabled again")
+            log_utils.disable_notebook_logging()
+        self.assertEqual(
+            dest.getvalue(),
+            """root INFO: before configure
+INFO after configure
+[INFO] after reconfigure
+[INFO] enabled again
+""",
+        )
+        self.check(
+            """
+ after disable
+"""
+        )
+
+    def testStreamAppender(self):
+        """
+        Test PyStreamAppender configured from properties.
+        """
+        dest = io.StringIO()
+        stdout = sys.stdout
+        sys.stdout = dest
+        try:
+            log.configure_prop("""
+log4j.rootLogger=INFO, PS
+log4j.appender.PS=PyStreamAppender
+log4j.appender.PS.Target=stdout
+log4j.appender.PS.BufferSize=256
+log4j.appender.PS.layout=PatternLayout
+log4j.appender.PS.layout.ConversionPattern=%p %m%n
+""")
+            for i in range(1000):
+                log.info("message %d", i)
+            log.debug("This is DEBUG")
+            # resetting configuration closes appender and writes everything
+            log.configure()
+        finally:
+            sys.stdout = stdout
+        self.assertEqual(dest.getvalue(), "".join(f"INFO message {i}\n" for i in range(1000)))
+
 
 if __name__ == "__main__":
     unittest.main()